@@ -0,0 +1,620 @@
+// gpufw_bench.c - in-process benchmark over the gpufw_suite workloads: warmup,
+// repetitions and per-phase percentiles, written as text, CSV (run_bench.pl
+// compatible) and JSON; -C characterizes the device for the roofline column,
+// -T measures throughput with several host threads sharing one context
+#define _POSIX_C_SOURCE 200809L
+#include "src/libgpufw.h"
+#include "gpufw_suite.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+enum { PH_UPLOAD, PH_KERNEL, PH_DOWNLOAD, PH_TOTAL, PH_COUNT };
+static const char *phase_names[PH_COUNT] = { "upload", "kernel", "download", "total" };
+
+typedef struct {
+    int count;
+    double min, median, p95, p99, mean, stddev;
+} bench_stats;
+
+typedef struct {
+    size_t n;
+    int valid;
+    size_t lws;
+    char variant[32];           // kernel variant, empty for workloads without variants
+    bench_stats ph[PH_COUNT];
+    double gbps[PH_COUNT];      // bytes moved by the phase / median time
+    double gflops[PH_COUNT];    // workload operations / median time (kernel and total only)
+    double *samples[PH_COUNT];  // sorted per-iteration times, kept for the JSON output
+    double roof[PH_COUNT];      // roofline bound / median time, 0 without a device profile
+    int compute_bound;          // the kernel's roofline bound is FP32 peak, not memory bandwidth
+} size_result;
+
+typedef struct {
+    const suite_workload *w;
+    const char *kernel_file;
+    size_t sizes[32];
+    int nsizes;
+    int warmup, reps, init_reps;
+    size_t local_size;
+    const char *variant;
+    int device_index;
+    int native;
+    const char *csv_path, *json_path;
+    const gpufw_device_profile *prof;   // stored profile of the device, or NULL
+    gpufw_xfer_mode xfer;               // device's transfer mode (small staged transfers copy)
+} bench_opts;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Linear interpolation between closest ranks of a sorted sample.
+static double percentile(const double *sorted, int n, double p) {
+    double r = p * (n - 1);
+    int lo = (int)r;
+    if (lo + 1 >= n) return sorted[n - 1];
+    return sorted[lo] + (sorted[lo + 1] - sorted[lo]) * (r - lo);
+}
+
+// Sorts samples in place.
+static void summarize(double *samples, int n, bench_stats *st) {
+    memset(st, 0, sizeof(*st));
+    if (n <= 0) return;
+    qsort(samples, n, sizeof(double), cmp_double);
+    double sum = 0.0, sq = 0.0;
+    for (int i = 0; i < n; i++) sum += samples[i];
+    st->mean = sum / n;
+    for (int i = 0; i < n; i++) sq += (samples[i] - st->mean) * (samples[i] - st->mean);
+    st->count = n;
+    st->stddev = n > 1 ? sqrt(sq / (n - 1)) : 0.0;
+    st->min = samples[0];
+    st->median = percentile(samples, n, 0.50);
+    st->p95 = percentile(samples, n, 0.95);
+    st->p99 = percentile(samples, n, 0.99);
+}
+
+static int parse_sizes(const char *arg, bench_opts *o) {
+    char *copy = strdup(arg), *save = NULL;
+    o->nsizes = 0;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        size_t n = strtoull(tok, NULL, 10);
+        if (n == 0 || o->nsizes == (int)(sizeof(o->sizes) / sizeof(o->sizes[0]))) {
+            free(copy);
+            return -1;
+        }
+        o->sizes[o->nsizes++] = n;
+    }
+    free(copy);
+    return o->nsizes > 0 ? 0 : -1;
+}
+
+// One iteration; each phase ends with the queue drained so its time stands alone.
+static int run_once(suite_run *r, const suite_workload *w, double t[PH_COUNT]) {
+    int err;
+    if (r->ctx->backend == GPUFW_BACKEND_NATIVE_CPU) {
+        double t0 = now_ms();
+        err = w->native(r);
+        t[PH_KERNEL] = t[PH_TOTAL] = now_ms() - t0;
+        t[PH_UPLOAD] = t[PH_DOWNLOAD] = 0.0;
+        return err;
+    }
+    double t0 = now_ms();
+    err = suite_upload(r);
+    if (!err) err = gpufw_finish(r->ctx);
+    double t1 = now_ms();
+    if (!err) err = w->launch(r);
+    double t2 = now_ms();
+    if (!err) err = suite_download(r);
+    if (!err) err = gpufw_finish(r->ctx);
+    double t3 = now_ms();
+    t[PH_UPLOAD] = t1 - t0;
+    t[PH_KERNEL] = t2 - t1;
+    t[PH_DOWNLOAD] = t3 - t2;
+    t[PH_TOTAL] = t3 - t0;
+    return err;
+}
+
+static int bench_size(gpufw_ctx *ctx, const bench_opts *o, size_t n, size_result *res) {
+    const suite_workload *w = o->w;
+    double **samples = res->samples;
+    suite_run run = { .ctx = ctx, .n = n, .local_size = o->local_size, .variant = o->variant };
+    int err = -1;
+
+    res->n = n;
+    int have_samples = 1;
+    for (int p = 0; p < PH_COUNT; p++)
+        if (!(samples[p] = calloc(o->reps, sizeof(double)))) have_samples = 0;
+    if (!have_samples) goto out;
+    if ((err = w->setup(&run)) != 0) goto out;
+    res->lws = run.lws;
+    snprintf(res->variant, sizeof(res->variant), "%s", run.variant_name);
+
+    double t[PH_COUNT];
+    for (int i = 0; i < o->warmup; i++) {
+        if ((err = run_once(&run, w, t)) != 0) goto out;
+    }
+    for (int i = 0; i < o->reps; i++) {
+        if ((err = run_once(&run, w, t)) != 0) goto out;
+        for (int p = 0; p < PH_COUNT; p++) samples[p][i] = t[p];
+    }
+    res->valid = w->check(&run) == 0;
+    if (!res->valid) fprintf(stderr, "gpufw_bench: %s n=%zu does not match the host reference\n", w->name, n);
+
+    // transfers count the harness-moved buffers, kernel and total the workload's own traffic
+    double moved[PH_COUNT] = { 0.0 }, flops = 0.0;
+    for (int i = 0; i < run.nbufs; i++) {
+        if (run.buf[i].src) moved[PH_UPLOAD] += run.buf[i].bytes;
+        if (run.buf[i].dst) moved[PH_DOWNLOAD] += run.buf[i].bytes;
+    }
+    w->work(n, &moved[PH_KERNEL], &flops);
+    moved[PH_TOTAL] = moved[PH_KERNEL];
+    // fastest the device could do each phase: each transfer at the measured host
+    // rate of the path gpufw_write/read_buffer take for its size, the kernel at
+    // its roofline, total their sum
+    double bound[PH_COUNT] = { 0.0 };
+    if (o->prof) {
+        for (int i = 0; i < run.nbufs; i++) {
+            gpufw_xfer_mode path = gpufw_buffer_xfer_path(ctx, run.buf[i].bytes);
+            double up = gpufw_xfer_gbps(o->prof, path, 1), down = gpufw_xfer_gbps(o->prof, path, 0);
+            if (run.buf[i].src && up > 0.0) bound[PH_UPLOAD] += run.buf[i].bytes / (up * 1e9) * 1e3;
+            if (run.buf[i].dst && down > 0.0) bound[PH_DOWNLOAD] += run.buf[i].bytes / (down * 1e9) * 1e3;
+        }
+        bound[PH_KERNEL] = gpufw_roofline_ms(o->prof, moved[PH_KERNEL], flops, &res->compute_bound);
+        bound[PH_TOTAL] = bound[PH_UPLOAD] + bound[PH_KERNEL] + bound[PH_DOWNLOAD];
+    }
+    for (int p = 0; p < PH_COUNT; p++) {
+        summarize(samples[p], o->reps, &res->ph[p]);
+        double sec = res->ph[p].median / 1e3;
+        if (sec <= 0.0) continue;
+        res->gbps[p] = moved[p] / sec / 1e9;
+        if (p == PH_KERNEL || p == PH_TOTAL) res->gflops[p] = flops / sec / 1e9;
+        res->roof[p] = bound[p] / res->ph[p].median;
+    }
+    err = 0;
+out:
+    suite_teardown(&run);
+    return err;
+}
+
+typedef struct {
+    gpufw_ctx *ctx;
+    const bench_opts *o;
+    size_t n;
+    pthread_barrier_t *start;
+    double *lat;                // per-job total time, o->reps of them
+    double t_begin, t_end;
+    int err, valid;
+} thread_job;
+
+// Setup and warmup happen on the thread itself, so its kernels and queue are
+// its own; the timed jobs of all threads start together.
+static void *thread_main(void *p) {
+    thread_job *j = p;
+    const suite_workload *w = j->o->w;
+    suite_run run = { .ctx = j->ctx, .n = j->n, .local_size = j->o->local_size, .variant = j->o->variant };
+    double t[PH_COUNT];
+    j->err = w->setup(&run);
+    for (int i = 0; i < j->o->warmup && !j->err; i++) j->err = run_once(&run, w, t);
+    pthread_barrier_wait(j->start);
+    j->t_begin = now_ms();
+    for (int i = 0; i < j->o->reps && !j->err; i++) {
+        j->err = run_once(&run, w, t);
+        j->lat[i] = t[PH_TOTAL];
+    }
+    j->t_end = now_ms();
+    j->valid = !j->err && w->check(&run) == 0;
+    suite_teardown(&run);
+    return NULL;
+}
+
+// -T: the first size from 1..N host threads at once, each running reps
+// upload/launch/download jobs on its own queue of the shared context.
+static int bench_threads(gpufw_ctx *ctx, const bench_opts *o, const char *list) {
+    int counts[16], ncounts = 0;
+    char *copy = strdup(list), *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        int t = atoi(tok);
+        if (t < 1 || t > 256 || ncounts == (int)(sizeof(counts) / sizeof(counts[0]))) {
+            fprintf(stderr, "gpufw_bench: bad thread list '%s'\n", list);
+            free(copy);
+            return 1;
+        }
+        counts[ncounts++] = t;
+    }
+    free(copy);
+    if (ncounts == 0) return 1;
+
+    size_t n = o->sizes[0];
+    printf("threads: %s n=%zu, %d jobs per thread after %d warmup\n", o->w->name, n, o->reps, o->warmup);
+    printf("%7s %7s %12s %8s %10s %10s %10s  %s\n", "threads", "queues", "jobs/s", "speedup", "p50_ms", "p95_ms",
+           "p99_ms", "check");
+    int rc = 0;
+    double base = 0.0;
+    for (int c = 0; c < ncounts; c++) {
+        int nt = counts[c];
+        thread_job *jobs = calloc(nt, sizeof(*jobs));
+        pthread_t *th = calloc(nt, sizeof(*th));
+        double *lat = calloc((size_t)nt * o->reps, sizeof(double));
+        if (!jobs || !th || !lat) {
+            free(jobs); free(th); free(lat);
+            return 1;
+        }
+        pthread_barrier_t start;
+        pthread_barrier_init(&start, NULL, nt);
+        int started = 0;
+        for (int i = 0; i < nt; i++) {
+            jobs[i] = (thread_job){ ctx, o, n, &start, lat + (size_t)i * o->reps, 0.0, 0.0, 0, 0 };
+            if (pthread_create(&th[i], NULL, thread_main, &jobs[i]) != 0) break;
+            started++;
+        }
+        if (started < nt) {
+            // the barrier would never open; nothing sensible to measure
+            fprintf(stderr, "gpufw_bench: could only start %d of %d threads\n", started, nt);
+            exit(1);
+        }
+        int err = 0, valid = 1;
+        double t0 = 0.0, t1 = 0.0;
+        for (int i = 0; i < nt; i++) {
+            pthread_join(th[i], NULL);
+            if (jobs[i].err) err = jobs[i].err;
+            if (!jobs[i].valid) valid = 0;
+            if (i == 0 || jobs[i].t_begin < t0) t0 = jobs[i].t_begin;
+            if (i == 0 || jobs[i].t_end > t1) t1 = jobs[i].t_end;
+        }
+        pthread_barrier_destroy(&start);
+        if (err) {
+            fprintf(stderr, "gpufw_bench: %s n=%zu with %d threads failed (%d)\n", o->w->name, n, nt, err);
+            rc = 1;
+        } else {
+            bench_stats st;
+            summarize(lat, nt * o->reps, &st);
+            double rate = t1 > t0 ? (double)nt * o->reps / ((t1 - t0) / 1e3) : 0.0;
+            if (c == 0) base = rate / nt;
+            printf("%7d %7u %12.1f %7.2fx %10.4f %10.4f %10.4f  %s\n", nt, gpufw_thread_queues(ctx), rate,
+                   base > 0.0 ? rate / base : 0.0, st.median, st.p95, st.p99, valid ? "ok" : "MISMATCH");
+            if (!valid) rc = 1;
+        }
+        free(jobs);
+        free(th);
+        free(lat);
+    }
+    return rc;
+}
+
+static int phase_applies(const gpufw_ctx *ctx, int p) {
+    return ctx->backend == GPUFW_BACKEND_OPENCL || p == PH_KERNEL || p == PH_TOTAL;
+}
+
+static void print_text(const gpufw_ctx *ctx, const bench_opts *o, const bench_stats *init, const size_result *res,
+                       int nres) {
+    printf("init: median %.3f ms, min %.3f ms (%d runs)\n", init->median, init->min, init->count);
+    if (ctx->backend == GPUFW_BACKEND_OPENCL) gpufw_init_print_stats(ctx, stdout);     // phases of the last run
+    for (int r = 0; r < nres; r++) {
+        printf("%s n=%zu (%s), local size %zu%s%s%s\n", o->w->name, res[r].n, o->w->size_unit, res[r].lws,
+               res[r].variant[0] ? ", variant " : "", res[r].variant, res[r].valid ? "" : "  ** RESULT MISMATCH **");
+        printf("  %-9s %10s %10s %10s %10s %10s %10s  %s\n", "phase", "min_ms", "median_ms", "p95_ms",
+               "p99_ms", "mean_ms", "stddev_ms", "rate");
+        for (int p = 0; p < PH_COUNT; p++) {
+            const bench_stats *s = &res[r].ph[p];
+            if (!phase_applies(ctx, p)) continue;
+            printf("  %-9s %10.4f %10.4f %10.4f %10.4f %10.4f %10.4f  %.2f GB/s", phase_names[p], s->min,
+                   s->median, s->p95, s->p99, s->mean, s->stddev, res[r].gbps[p]);
+            if (res[r].gflops[p] > 0.0) printf(", %.3f GFLOP/s", res[r].gflops[p]);
+            if (res[r].roof[p] > 0.0) {
+                printf(", %.1f%% of %s", res[r].roof[p] * 100.0,
+                       p == PH_KERNEL ? (res[r].compute_bound ? "FP32 peak" : "memory bandwidth") : "bound");
+            }
+            printf("\n");
+        }
+        // same line the client prints, for scripts that scrape it
+        printf("Kernel time: %.3f ms (median, n=%zu)\n", res[r].ph[PH_KERNEL].median, res[r].n);
+    }
+}
+
+// Quote a CSV field only when needed, doubling embedded quotes.
+static void csv_field(FILE *f, const char *s) {
+    if (!strpbrk(s, ",\"\n")) {
+        fputs(s, f);
+        return;
+    }
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"') fputc('"', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void csv_row(FILE *f, const char *stamp, size_t n, const char *notes, const char *phase,
+                    const bench_opts *o, const bench_stats *s, double gbps, double gflops, const char *device,
+                    double roof) {
+    csv_field(f, stamp);
+    fprintf(f, ",%zu,%.4f,", n, s->median);
+    csv_field(f, notes);
+    fprintf(f, ",%s,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,", phase, o->warmup, s->count, s->min,
+            s->median, s->p95, s->p99, s->mean, s->stddev, gbps, gflops);
+    csv_field(f, device);
+    fprintf(f, ",%s,%.4f\n", o->w->name, roof);
+}
+
+// Leading columns match run_bench.pl (timestamp,n,elapsed_ms,notes), with
+// elapsed_ms the phase median, but the rows only go into a file that is empty
+// or starts with this header: under run_bench.pl's four columns they would be
+// read as client runs.
+#define CSV_HEADER "timestamp,n,elapsed_ms,notes,phase,warmup,reps,min_ms,median_ms,p95_ms,p99_ms," \
+                   "mean_ms,stddev_ms,gbps,gflops,device,workload,roofline\n"
+
+static int write_csv(const char *path, const gpufw_ctx *ctx, const bench_opts *o, const char *stamp,
+                     const char *device, const bench_stats *init, const size_result *res, int nres) {
+    FILE *f = fopen(path, "r");
+    if (f) {
+        char line[256];
+        int ok = !fgets(line, sizeof(line), f) || strcmp(line, CSV_HEADER) == 0;
+        fclose(f);
+        if (!ok) {
+            fprintf(stderr, "%s: not a gpufw_bench results file (different header), not appending\n", path);
+            return -1;
+        }
+    }
+    f = fopen(path, "a");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    if (ftell(f) == 0) fputs(CSV_HEADER, f);
+    csv_row(f, stamp, 0, "", "init", o, init, 0.0, 0.0, device, 0.0);
+    for (int r = 0; r < nres; r++) {
+        char notes[96];
+        snprintf(notes, sizeof(notes), "kernel_ms=%.3f%s%s%s", res[r].ph[PH_KERNEL].median,
+                 res[r].variant[0] ? " variant=" : "", res[r].variant, res[r].valid ? "" : " invalid");
+        for (int p = 0; p < PH_COUNT; p++) {
+            if (!phase_applies(ctx, p)) continue;
+            csv_row(f, stamp, res[r].n, notes, phase_names[p], o, &res[r].ph[p], res[r].gbps[p],
+                    res[r].gflops[p], device, res[r].roof[p]);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) fprintf(f, "\\u%04x", *s);
+        else fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+// Summary plus the raw samples, which parse_results.pl --baseline tests on.
+static void json_stats(FILE *f, const bench_stats *s, const double *samples) {
+    fprintf(f, "\"count\": %d, \"min_ms\": %.6f, \"median_ms\": %.6f, \"p95_ms\": %.6f, \"p99_ms\": %.6f, "
+               "\"mean_ms\": %.6f, \"stddev_ms\": %.6f, \"samples_ms\": [",
+            s->count, s->min, s->median, s->p95, s->p99, s->mean, s->stddev);
+    for (int i = 0; i < s->count; i++) fprintf(f, "%s%.6f", i ? ", " : "", samples[i]);
+    fputc(']', f);
+}
+
+static int write_json(const char *path, const gpufw_ctx *ctx, const bench_opts *o, const char *stamp,
+                      const char *device, const bench_stats *init, const double *init_samples,
+                      const size_result *res, int nres) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "{\n  \"tool\": \"gpufw_bench\",\n  \"workload\": \"%s\",\n  \"size_unit\": \"%s\",\n"
+               "  \"timestamp\": ", o->w->name, o->w->size_unit);
+    json_string(f, stamp);
+    fprintf(f, ",\n  \"device\": ");
+    json_string(f, device);
+    fprintf(f, ",\n  \"backend\": \"%s\",\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"local_size\": %zu,\n",
+            ctx->backend == GPUFW_BACKEND_OPENCL ? "opencl" : "native_cpu", o->warmup, o->reps, o->local_size);
+    fprintf(f, "  \"init\": { ");
+    json_stats(f, init, init_samples);
+    fprintf(f, " },\n  \"sizes\": [\n");
+    for (int r = 0; r < nres; r++) {
+        fprintf(f, "    { \"n\": %zu, \"local_size\": %zu, ", res[r].n, res[r].lws);
+        if (o->prof) fprintf(f, "\"bound\": \"%s\", ", res[r].compute_bound ? "compute" : "memory");
+        if (res[r].variant[0]) fprintf(f, "\"variant\": \"%s\", ", res[r].variant);
+        fprintf(f, "\"valid\": %s, \"phases\": {\n", res[r].valid ? "true" : "false");
+        int first = 1;
+        for (int p = 0; p < PH_COUNT; p++) {
+            if (!phase_applies(ctx, p)) continue;
+            fprintf(f, "%s      \"%s\": { ", first ? "" : ",\n", phase_names[p]);
+            json_stats(f, &res[r].ph[p], res[r].samples[p]);
+            fprintf(f, ", \"gbps\": %.6f", res[r].gbps[p]);
+            if (res[r].gflops[p] > 0.0) fprintf(f, ", \"gflops\": %.6f", res[r].gflops[p]);
+            if (res[r].roof[p] > 0.0) fprintf(f, ", \"roofline\": %.6f", res[r].roof[p]);
+            fprintf(f, " }");
+            first = 0;
+        }
+        fprintf(f, "\n    } }%s\n", r + 1 < nres ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [-W workload] [-k kernel.cl] [-n n1,n2,...] [-w warmup] [-r reps] [-I init_reps]\n", prog);
+    printf("          [-l local_size] [-V variant] [-d device] [-c] [-o results.csv] [-j results.json]\n");
+    printf("       %s -C [-d device] [-b bytes]\n", prog);
+    printf("       %s -T t1,t2,... [-W workload] [-n n] [-w warmup] [-r reps] ...\n", prog);
+    printf("  -W  workload (default vecadd; -W list shows all), -k overrides its kernel file\n");
+    printf("  -n  problem sizes: elements, or the matrix/grid side for 2-D workloads\n");
+    printf("  -w  untimed iterations per size (default 3)    -r  timed iterations (default 20)\n");
+    printf("  -I  times to repeat context init (default 1)   -l  local size or tile side, 0 = workload default\n");
+    printf("  -V  vecadd kernel variant: auto (default, as gpufw_vecadd picks), generic, or\n");
+    printf("      <width>x<per-item> such as 4x2 for float4 loads, two per work-item\n");
+    printf("  -c  native CPU backend instead of OpenCL (vecadd only)\n");
+    printf("  -o  append one CSV row per size and phase; -j write JSON\n");
+    printf("  -C  measure transfer bandwidths, device copy bandwidth, FP32 peak and launch overhead,\n");
+    printf("      and store them as the device profile that the roofline column is computed from\n");
+    printf("  -b  transfer size for -C (default 64 MiB)\n");
+    printf("  -T  run the first size from each number of host threads at once, sharing one context\n");
+    printf("      (GPUFW_INIT_THREADS), and report jobs/s and speedup over one thread's rate\n");
+}
+
+// -C: measure the device's limits and store them for later runs.
+static int characterize(const bench_opts *o, size_t bytes) {
+    gpufw_ctx ctx;
+    if (gpufw_init_ex(&ctx, o->kernel_file, o->device_index, NULL) != 0) {
+        fprintf(stderr, "gpufw_bench: init failed\n");
+        return 1;
+    }
+    gpufw_device_profile prof;
+    int rc = gpufw_characterize(&ctx, bytes, &prof) == 0 ? 0 : 1;
+    if (!rc) {
+        gpufw_device_profile_print(&prof, stdout);
+        if (gpufw_device_profile_save(&ctx, &prof) != 0) {
+            fprintf(stderr, "gpufw_bench: could not store the device profile\n");
+            rc = 1;
+        }
+    }
+    gpufw_cleanup(&ctx);
+    return rc;
+}
+
+static void list_workloads(void) {
+    printf("%-10s %-22s %-9s %-26s %s\n", "workload", "kernel", "n is", "default sizes", "stresses");
+    for (const suite_workload *w = suite_workloads; w->name; w++)
+        printf("%-10s %-22s %-9s %-26s %s\n", w->name, w->kernel_file, w->size_unit, w->sizes, w->bound);
+}
+
+int main(int argc, char **argv) {
+    bench_opts o = { suite_find("vecadd"), NULL, { 0 }, 0, 3, 20, 1, 0, NULL, 0, 0, NULL, NULL, NULL, GPUFW_XFER_AUTO };
+    const char *sizes = NULL;
+    int opt, char_mode = 0;
+    size_t char_bytes = 0;
+    const char *thread_list = NULL;
+    while ((opt = getopt(argc, argv, "W:k:n:w:r:I:l:V:d:co:j:Cb:T:h")) != -1) {
+        switch (opt) {
+        case 'W':
+            if (!strcmp(optarg, "list")) {
+                list_workloads();
+                return 0;
+            }
+            if (!(o.w = suite_find(optarg))) {
+                fprintf(stderr, "gpufw_bench: unknown workload '%s' (try -W list)\n", optarg);
+                return 1;
+            }
+            break;
+        case 'k': o.kernel_file = optarg; break;
+        case 'n': sizes = optarg; break;
+        case 'w': o.warmup = atoi(optarg); break;
+        case 'r': o.reps = atoi(optarg); break;
+        case 'I': o.init_reps = atoi(optarg); break;
+        case 'l': o.local_size = strtoull(optarg, NULL, 10); break;
+        case 'V': o.variant = optarg; break;
+        case 'd': o.device_index = atoi(optarg); break;
+        case 'c': o.native = 1; break;
+        case 'o': o.csv_path = optarg; break;
+        case 'j': o.json_path = optarg; break;
+        case 'C': char_mode = 1; break;
+        case 'b': char_bytes = strtoull(optarg, NULL, 10); break;
+        case 'T': thread_list = optarg; break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (o.warmup < 0 || o.reps < 1 || o.init_reps < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (parse_sizes(sizes ? sizes : o.w->sizes, &o) != 0) {
+        fprintf(stderr, "gpufw_bench: bad size list '%s'\n", sizes ? sizes : o.w->sizes);
+        return 1;
+    }
+    if (o.native && !o.w->native) {
+        fprintf(stderr, "gpufw_bench: %s has no native CPU version\n", o.w->name);
+        return 1;
+    }
+    if (!o.kernel_file) o.kernel_file = o.w->kernel_file;
+    if (char_mode) return characterize(&o, char_bytes);
+
+    // Init is timed on its own: a cold run includes the program build or cache load
+    gpufw_ctx ctx;
+    gpufw_init_opts init_opts = { (o.native ? GPUFW_INIT_NATIVE_CPU : 0) | (thread_list ? GPUFW_INIT_THREADS : 0) };
+    double *init_ms = calloc(o.init_reps, sizeof(double));
+    if (!init_ms) return 1;
+    for (int i = 0; i < o.init_reps; i++) {
+        double t0 = now_ms();
+        if (gpufw_init_ex(&ctx, o.kernel_file, o.device_index, &init_opts) != 0) {
+            fprintf(stderr, "gpufw_bench: init failed\n");
+            return 1;
+        }
+        init_ms[i] = now_ms() - t0;
+        if (i + 1 < o.init_reps) gpufw_cleanup(&ctx);
+    }
+    bench_stats init;
+    summarize(init_ms, o.init_reps, &init);
+
+    char device[256];
+    if (ctx.backend == GPUFW_BACKEND_OPENCL) {
+        if (clGetDeviceInfo(ctx.device, CL_DEVICE_NAME, sizeof(device), device, NULL) != CL_SUCCESS)
+            strcpy(device, "unknown");
+    } else {
+        snprintf(device, sizeof(device), "native cpu %s x%u", gpufw_cpu_isa_name(gpufw_cpu_detect_isa()),
+                 gpufw_cpu_threads());
+    }
+    char stamp[64];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%a %b %e %H:%M:%S %Y", localtime(&now));     // Perl's scalar(localtime)
+    printf("device: %s, workload %s, warmup %d, reps %d\n", device, o.w->name, o.warmup, o.reps);
+    gpufw_device_profile prof;
+    if (ctx.backend == GPUFW_BACKEND_OPENCL && gpufw_device_profile_load(&ctx, &prof) == 0) {
+        o.prof = &prof;
+        o.xfer = gpufw_get_xfer_mode(&ctx);
+        printf("roofline: %.2f GB/s device memory, %.2f GFLOP/s FP32, transfers via %s\n", prof.d2d_gbps,
+               prof.fp32_gflops, gpufw_xfer_mode_name(o.xfer));
+    } else if (ctx.backend == GPUFW_BACKEND_OPENCL) {
+        printf("roofline: no device profile, run %s -C first\n", argv[0]);
+    }
+
+    if (thread_list) {
+        int rc = bench_threads(&ctx, &o, thread_list);
+        free(init_ms);
+        gpufw_cleanup(&ctx);
+        gpufw_cpu_shutdown();
+        return rc;
+    }
+
+    size_result *res = calloc(o.nsizes, sizeof(*res));
+    int nres = 0, rc = 0;
+    for (int s = 0; s < o.nsizes; s++) {
+        if (bench_size(&ctx, &o, o.sizes[s], &res[nres]) != 0) {
+            fprintf(stderr, "gpufw_bench: %s n=%zu failed\n", o.w->name, o.sizes[s]);
+            for (int p = 0; p < PH_COUNT; p++) free(res[nres].samples[p]);
+            memset(&res[nres], 0, sizeof(res[nres]));
+            rc = 1;
+            continue;
+        }
+        if (!res[nres].valid) rc = 1;
+        nres++;
+    }
+
+    print_text(&ctx, &o, &init, res, nres);
+    if (o.csv_path && write_csv(o.csv_path, &ctx, &o, stamp, device, &init, res, nres) != 0) rc = 1;
+    if (o.json_path && write_json(o.json_path, &ctx, &o, stamp, device, &init, init_ms, res, nres) != 0) rc = 1;
+
+    for (int s = 0; s < o.nsizes; s++)
+        for (int p = 0; p < PH_COUNT; p++) free(res[s].samples[p]);
+    free(res);
+    free(init_ms);
+    gpufw_cleanup(&ctx);
+    gpufw_cpu_shutdown();
+    return rc;
+}
@@ -0,0 +1,514 @@
+// gpufw_suite.c - vecadd, saxpy, reduction, scan, SGEMM, histogram and stencil
+// workloads with host reference checks, for gpufw_bench
+#include "gpufw_suite.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static size_t round_up(size_t x, size_t m) {
+    return (x + m - 1) / m * m;
+}
+
+// Deterministic inputs so runs on different machines check the same data.
+static unsigned lcg_next(unsigned *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+static float *random_floats(size_t n, unsigned seed) {
+    float *v = malloc(n * sizeof(float));
+    if (!v) return NULL;
+    for (size_t i = 0; i < n; i++) v[i] = (float)(lcg_next(&seed) & 0xffff) / 65536.0f;
+    return v;
+}
+
+// Registers a harness-moved buffer (even on failure, so teardown frees the
+// host arrays); the device side exists only on OpenCL.
+static int add_buf(suite_run *r, void *src, void *dst, size_t bytes, unsigned dir, cl_mem_flags flags) {
+    suite_buf *b = &r->buf[r->nbufs++];
+    b->src = src;
+    b->dst = dst;
+    b->bytes = bytes;
+    if (((dir & SUITE_IN) && !src) || ((dir & SUITE_OUT) && !dst)) return -1;
+    if (r->ctx->backend != GPUFW_BACKEND_OPENCL) return 0;
+    b->mem = gpufw_alloc_buffer(r->ctx, bytes, flags);
+    return b->mem ? 0 : -1;
+}
+
+static cl_mem add_scratch(suite_run *r, size_t floats) {
+    if (r->nscratch == SUITE_MAX_SCRATCH) {
+        fprintf(stderr, "suite: too many scratch buffers\n");
+        return NULL;
+    }
+    cl_mem m = gpufw_alloc_buffer(r->ctx, floats * sizeof(float), CL_MEM_READ_WRITE);
+    if (!m) return NULL;
+    r->scratch_len[r->nscratch] = floats;
+    r->scratch[r->nscratch++] = m;
+    return m;
+}
+
+static int set_mem(suite_run *r, cl_kernel k, cl_uint idx, cl_mem m) {
+    return gpufw_set_kernel_arg(r->ctx, k, idx, sizeof(cl_mem), &m);
+}
+
+static int set_int(suite_run *r, cl_kernel k, cl_uint idx, size_t v) {
+    int iv = (int)v;
+    return gpufw_set_kernel_arg(r->ctx, k, idx, sizeof(int), &iv);
+}
+
+// Largest power of two <= want that the kernel can run as one work-group.
+static size_t pow2_group(suite_run *r, cl_kernel k, size_t want) {
+    size_t max = want;
+    if (clGetKernelWorkGroupInfo(k, r->ctx->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max), &max, NULL) != CL_SUCCESS)
+        max = want;
+    if (want > max) want = max;
+    size_t p = 1;
+    while (p * 2 <= want) p *= 2;
+    return p;
+}
+
+static int close_enough(double got, double want, double tol) {
+    return fabs(got - want) <= tol * fmax(1.0, fabs(want));
+}
+
+static int report_mismatch(const char *name, size_t i, double got, double want) {
+    fprintf(stderr, "suite %s: mismatch at %zu: got %g, want %g\n", name, i, got, want);
+    return -1;
+}
+
+// Compare a whole output array against a host reference (and free the
+// reference); tol has close_enough's meaning. Prints the validator's report,
+// with the first mismatching indices, when anything is off.
+static int validate_floats(const char *name, const float *got, float *want, size_t n, double tol) {
+    if (!want) return -1;
+    gpufw_validate_opts o = { 0, tol, tol, GPUFW_NAN_MATCH, GPUFW_INF_EXACT, 8 };
+    gpufw_validate_report rep;
+    int rc = gpufw_validate_f32(got, want, n, &o, &rep);
+    free(want);
+    if (rc == 0) return 0;
+    gpufw_validate_print(&rep, name, stderr);
+    return -1;
+}
+
+/* vecadd: c = a + b, pure streaming bandwidth */
+
+static int vecadd_setup(suite_run *r) {
+    size_t n = r->n, bytes = n * sizeof(float);
+    float *a = malloc(bytes), *b = malloc(bytes), *c = malloc(bytes);
+    int err = add_buf(r, a, NULL, bytes, SUITE_IN, CL_MEM_READ_ONLY);
+    if (!err) err = add_buf(r, b, NULL, bytes, SUITE_IN, CL_MEM_READ_ONLY);
+    if (!err) err = add_buf(r, NULL, c, bytes, SUITE_OUT, CL_MEM_WRITE_ONLY);
+    if (err) return err;
+    for (size_t i = 0; i < n; i++) {
+        a[i] = (float)(i & 1023);
+        b[i] = 2.0f;
+    }
+    if (r->ctx->backend != GPUFW_BACKEND_OPENCL) return 0;
+    if ((err = gpufw_create_kernel(r->ctx, "vecadd", &r->k[0])) != 0) return err;
+    for (int i = 0; i < 3 && !err; i++) err = set_mem(r, r->k[0], i, r->buf[i].mem);
+    if (!err) err = set_int(r, r->k[0], 3, n);
+    r->lws = r->local_size;
+    snprintf(r->variant_name, sizeof(r->variant_name), "generic");
+    if (err || (r->variant && strcmp(r->variant, "generic") == 0)) return err;
+
+    /* Same choice gpufw_vecadd makes, unless -V fixed the shape */
+    gpufw_variant v;
+    unsigned width, per_item;
+    char extra;
+    if (r->variant && strcmp(r->variant, "auto") != 0) {
+        if (sscanf(r->variant, "%ux%u%c", &width, &per_item, &extra) != 2 ||
+            gpufw_variant_fixed(n, width, per_item, &v) != 0) {
+            fprintf(stderr, "vecadd: bad variant '%s'\n", r->variant);
+            return -1;
+        }
+    } else if (gpufw_variant_pick(r->ctx, n, &v) != 0) {
+        return 0;
+    }
+    if (gpufw_variant_kernel(r->ctx, "vecadd_vec", &v, &r->kv) != 0) {
+        r->kv = NULL;
+        return r->variant && strcmp(r->variant, "auto") != 0 ? -1 : 0;
+    }
+    for (int i = 0; i < 3 && !err; i++) err = set_mem(r, r->kv, i, r->buf[i].mem);
+    if (!err) err = set_int(r, r->kv, 3, n);
+    r->gws = gpufw_variant_global_size(&v, n);
+    gpufw_variant_str(&v, r->variant_name, sizeof(r->variant_name));
+    return err;
+}
+
+static int vecadd_launch(suite_run *r) {
+    if (r->kv) return gpufw_launch_kernel(r->ctx, r->kv, r->gws, r->lws);
+    return gpufw_launch_kernel(r->ctx, r->k[0], r->n, r->lws);
+}
+
+static int vecadd_native(suite_run *r) {
+    return gpufw_cpu_vecadd(r->buf[0].src, r->buf[1].src, r->buf[2].dst, r->n);
+}
+
+static int vecadd_check(const suite_run *r) {
+    float *want = malloc(r->n * sizeof(float));
+    for (size_t i = 0; want && i < r->n; i++) want[i] = (float)(i & 1023) + 2.0f;
+    return validate_floats("vecadd", r->buf[2].dst, want, r->n, 0.0);
+}
+
+static void vecadd_work(size_t n, double *bytes, double *flops) {
+    *bytes = 12.0 * n;
+    *flops = (double)n;
+}
+
+/* saxpy: y = alpha * x + y, streaming with a read-modify-write */
+
+#define SAXPY_ALPHA 2.5f
+
+static int saxpy_setup(suite_run *r) {
+    size_t n = r->n, bytes = n * sizeof(float);
+    float *x = random_floats(n, 1), *y = random_floats(n, 2), *out = malloc(bytes);
+    float alpha = SAXPY_ALPHA;
+    int err = add_buf(r, x, NULL, bytes, SUITE_IN, CL_MEM_READ_ONLY);
+    if (!err) err = add_buf(r, y, out, bytes, SUITE_IN | SUITE_OUT, CL_MEM_READ_WRITE);
+    if (err) return err;
+    if ((err = gpufw_create_kernel(r->ctx, "saxpy", &r->k[0])) != 0) return err;
+    err = gpufw_set_kernel_arg(r->ctx, r->k[0], 0, sizeof(float), &alpha);
+    if (!err) err = set_mem(r, r->k[0], 1, r->buf[0].mem);
+    if (!err) err = set_mem(r, r->k[0], 2, r->buf[1].mem);
+    if (!err) err = set_int(r, r->k[0], 3, n);
+    r->lws = r->local_size;
+    return err;
+}
+
+static int saxpy_launch(suite_run *r) {
+    return gpufw_launch_kernel(r->ctx, r->k[0], r->n, r->lws);
+}
+
+static int saxpy_check(const suite_run *r) {
+    const float *x = r->buf[0].src, *y = r->buf[1].src;
+    float *want = malloc(r->n * sizeof(float));
+    for (size_t i = 0; want && i < r->n; i++) want[i] = (float)((double)SAXPY_ALPHA * x[i] + y[i]);
+    return validate_floats("saxpy", r->buf[1].dst, want, r->n, 1e-6);
+}
+
+static void saxpy_work(size_t n, double *bytes, double *flops) {
+    *bytes = 12.0 * n;
+    *flops = 2.0 * n;
+}
+
+/* reduce: sum of n floats, local-memory tree with a second single-group pass */
+
+#define REDUCE_MAX_GROUPS 1024
+
+static int reduce_setup(suite_run *r) {
+    size_t n = r->n;
+    float *in = random_floats(n, 3), *sum = malloc(sizeof(float));
+    int err = add_buf(r, in, NULL, n * sizeof(float), SUITE_IN, CL_MEM_READ_ONLY);
+    if (!err) err = add_buf(r, NULL, sum, sizeof(float), SUITE_OUT, CL_MEM_WRITE_ONLY);
+    if (err) return err;
+    if ((err = gpufw_create_kernel(r->ctx, "reduce_sum", &r->k[0])) != 0) return err;
+    r->lws = pow2_group(r, r->k[0], r->local_size ? r->local_size : 256);
+    size_t groups = (n + r->lws - 1) / r->lws;
+    if (groups > REDUCE_MAX_GROUPS) groups = REDUCE_MAX_GROUPS;
+    return add_scratch(r, groups) ? 0 : -1;
+}
+
+static int reduce_launch(suite_run *r) {
+    cl_kernel k = r->k[0];
+    cl_mem partial = r->scratch[0];
+    size_t groups = r->scratch_len[0];
+    size_t local_bytes = r->lws * sizeof(float);
+    int err = set_mem(r, k, 0, r->buf[0].mem);
+    if (!err) err = set_mem(r, k, 1, partial);
+    if (!err) err = gpufw_set_kernel_arg(r->ctx, k, 2, local_bytes, NULL);
+    if (!err) err = set_int(r, k, 3, r->n);
+    if (!err) err = gpufw_launch_kernel_async(r->ctx, k, groups * r->lws, r->lws, 0, NULL, NULL);
+    // the in-order queue runs the second pass after the first
+    if (!err) err = set_mem(r, k, 0, partial);
+    if (!err) err = set_mem(r, k, 1, r->buf[1].mem);
+    if (!err) err = set_int(r, k, 3, groups);
+    if (!err) err = gpufw_launch_kernel_async(r->ctx, k, r->lws, r->lws, 0, NULL, NULL);
+    if (!err) err = gpufw_finish(r->ctx);
+    return err;
+}
+
+static int reduce_check(const suite_run *r) {
+    const float *in = r->buf[0].src;
+    double want = 0.0;
+    for (size_t i = 0; i < r->n; i++) want += in[i];
+    float got = *(const float *)r->buf[1].dst;
+    // float partial sums drift by about log2(n) ulps of the total
+    return close_enough(got, want, 1e-5) ? 0 : report_mismatch("reduce", 0, got, want);
+}
+
+static void reduce_work(size_t n, double *bytes, double *flops) {
+    *bytes = 4.0 * n;
+    *flops = (double)n;
+}
+
+/* scan: exclusive prefix sum, Blelloch block scans over as many levels as needed */
+
+static int scan_setup(suite_run *r) {
+    size_t n = r->n, bytes = n * sizeof(float);
+    float *in = malloc(bytes), *out = malloc(bytes);
+    if (in) {
+        // small integers keep every prefix exact in float up to 2^24
+        unsigned seed = 4;
+        for (size_t i = 0; i < n; i++) in[i] = (float)(lcg_next(&seed) & 3);
+    }
+    int err = add_buf(r, in, NULL, bytes, SUITE_IN, CL_MEM_READ_ONLY);
+    if (!err) err = add_buf(r, NULL, out, bytes, SUITE_OUT, CL_MEM_READ_WRITE);
+    if (err) return err;
+    if ((err = gpufw_create_kernel(r->ctx, "scan_block", &r->k[0])) != 0) return err;
+    if ((err = gpufw_create_kernel(r->ctx, "scan_add", &r->k[1])) != 0) return err;
+    r->lws = pow2_group(r, r->k[0], r->local_size ? r->local_size : 256);
+    size_t per_block = 2 * r->lws, len = n;
+    for (;;) {
+        size_t blocks = (len + per_block - 1) / per_block;
+        if (!add_scratch(r, blocks)) return -1;
+        if (blocks == 1) break;
+        len = blocks;
+    }
+    return 0;
+}
+
+static int scan_launch(suite_run *r) {
+    cl_kernel blk = r->k[0], add = r->k[1];
+    size_t len = r->n;
+    int err = 0;
+    // level l scans the previous level's block sums in place
+    for (int l = 0; l < r->nscratch && !err; l++) {
+        cl_mem in = l ? r->scratch[l - 1] : r->buf[0].mem;
+        cl_mem out = l ? r->scratch[l - 1] : r->buf[1].mem;
+        err = set_mem(r, blk, 0, in);
+        if (!err) err = set_mem(r, blk, 1, out);
+        if (!err) err = set_mem(r, blk, 2, r->scratch[l]);
+        if (!err) err = gpufw_set_kernel_arg(r->ctx, blk, 3, 2 * r->lws * sizeof(float), NULL);
+        if (!err) err = set_int(r, blk, 4, len);
+        if (!err) err = gpufw_launch_kernel_async(r->ctx, blk, r->scratch_len[l] * r->lws, r->lws, 0, NULL, NULL);
+        len = r->scratch_len[l];
+    }
+    // then fold each level's scanned block sums back into the level below
+    for (int l = r->nscratch - 2; l >= 0 && !err; l--) {
+        cl_mem data = l ? r->scratch[l - 1] : r->buf[1].mem;
+        size_t data_len = l ? r->scratch_len[l - 1] : r->n;
+        err = set_mem(r, add, 0, data);
+        if (!err) err = set_mem(r, add, 1, r->scratch[l]);
+        if (!err) err = set_int(r, add, 2, data_len);
+        if (!err) err = gpufw_launch_kernel_async(r->ctx, add, round_up(data_len, r->lws), r->lws, 0, NULL, NULL);
+    }
+    if (!err) err = gpufw_finish(r->ctx);
+    return err;
+}
+
+static int scan_check(const suite_run *r) {
+    const float *in = r->buf[0].src;
+    float *want = malloc(r->n * sizeof(float));
+    double acc = 0.0;
+    for (size_t i = 0; want && i < r->n; i++) {
+        want[i] = (float)acc;
+        acc += in[i];
+    }
+    return validate_floats("scan", r->buf[1].dst, want, r->n, 1e-6);
+}
+
+static void scan_work(size_t n, double *bytes, double *flops) {
+    *bytes = 8.0 * n;
+    *flops = (double)n;
+}
+
+/* sgemm: C = A * B on n x n matrices, local-memory tiles */
+
+static int sgemm_setup(suite_run *r) {
+    size_t n = r->n, bytes = n * n * sizeof(float);
+    float *a = random_floats(n * n, 5), *b = random_floats(n * n, 6), *c = malloc(bytes);
+    int err = add_buf(r, a, NULL, bytes, SUITE_IN, CL_MEM_READ_ONLY);
+    if (!err) err = add_buf(r, b, NULL, bytes, SUITE_IN, CL_MEM_READ_ONLY);
+    if (!err) err = add_buf(r, NULL, c, bytes, SUITE_OUT, CL_MEM_WRITE_ONLY);
+    if (err) return err;
+    if ((err = gpufw_create_kernel(r->ctx, "sgemm_tiled", &r->k[0])) != 0) return err;
+    // -l gives the tile side; the work-group is tile x tile
+    size_t max = 256, ts = r->local_size ? r->local_size : 16;
+    clGetKernelWorkGroupInfo(r->k[0], r->ctx->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max), &max, NULL);
+    while (ts > 1 && ts * ts > max) ts /= 2;
+    r->lws = ts;
+    size_t tile_bytes = ts * ts * sizeof(float);
+    for (int i = 0; i < 3 && !err; i++) err = set_mem(r, r->k[0], i, r->buf[i].mem);
+    if (!err) err = gpufw_set_kernel_arg(r->ctx, r->k[0], 3, tile_bytes, NULL);
+    if (!err) err = gpufw_set_kernel_arg(r->ctx, r->k[0], 4, tile_bytes, NULL);
+    if (!err) err = set_int(r, r->k[0], 5, n);
+    return err;
+}
+
+static int sgemm_launch(suite_run *r) {
+    size_t side = round_up(r->n, r->lws);
+    size_t gws[2] = { side, side }, lws[2] = { r->lws, r->lws };
+    return gpufw_launch_kernel_nd(r->ctx, r->k[0], 2, gws, lws);
+}
+
+static int sgemm_check(const suite_run *r) {
+    const float *a = r->buf[0].src, *b = r->buf[1].src, *c = r->buf[2].dst;
+    size_t n = r->n;
+    double *row = malloc(n * sizeof(double));
+    if (!row) return -1;
+    int err = 0;
+    for (size_t i = 0; i < n && !err; i++) {
+        memset(row, 0, n * sizeof(double));
+        for (size_t k = 0; k < n; k++) {
+            double aik = a[i * n + k];
+            for (size_t j = 0; j < n; j++) row[j] += aik * b[k * n + j];
+        }
+        // inputs are in [0, 1), so each entry's rounding error grows with n
+        for (size_t j = 0; j < n && !err; j++)
+            if (!close_enough(c[i * n + j], row[j], 1e-5 * sqrt((double)n)))
+                err = report_mismatch("sgemm", i * n + j, c[i * n + j], row[j]);
+    }
+    free(row);
+    return err;
+}
+
+static void sgemm_work(size_t n, double *bytes, double *flops) {
+    *bytes = 12.0 * n * n;
+    *flops = 2.0 * n * n * n;
+}
+
+/* histogram: 256 bins over n bytes, local and global atomics */
+
+#define HIST_BINS 256
+
+static int histogram_setup(suite_run *r) {
+    size_t n = r->n;
+    unsigned char *data = malloc(n);
+    unsigned *zero = calloc(HIST_BINS, sizeof(unsigned)), *bins = malloc(HIST_BINS * sizeof(unsigned));
+    if (data) {
+        // half the bytes land in 8 hot bins so atomics contend, as with real images
+        unsigned seed = 7;
+        for (size_t i = 0; i < n; i++) {
+            unsigned v = lcg_next(&seed);
+            data[i] = (unsigned char)(v & 0x100 ? (v & 7) : (v & 0xff));
+        }
+    }
+    int err = add_buf(r, data, NULL, n, SUITE_IN, CL_MEM_READ_ONLY);
+    if (!err) err = add_buf(r, zero, bins, HIST_BINS * sizeof(unsigned), SUITE_IN | SUITE_OUT, CL_MEM_READ_WRITE);
+    if (err) return err;
+    if ((err = gpufw_create_kernel(r->ctx, "histogram256", &r->k[0])) != 0) return err;
+    r->lws = pow2_group(r, r->k[0], r->local_size ? r->local_size : 256);
+    err = set_mem(r, r->k[0], 0, r->buf[0].mem);
+    if (!err) err = set_mem(r, r->k[0], 1, r->buf[1].mem);
+    if (!err) err = gpufw_set_kernel_arg(r->ctx, r->k[0], 2, HIST_BINS * sizeof(unsigned), NULL);
+    if (!err) err = set_int(r, r->k[0], 3, n);
+    return err;
+}
+
+static int histogram_launch(suite_run *r) {
+    // each work-item strides over about 16 bytes, enough to amortize the bin flush
+    size_t groups = (r->n / 16 + r->lws - 1) / r->lws;
+    if (groups == 0) groups = 1;
+    return gpufw_launch_kernel(r->ctx, r->k[0], groups * r->lws, r->lws);
+}
+
+static int histogram_check(const suite_run *r) {
+    const unsigned char *data = r->buf[0].src;
+    const unsigned *bins = r->buf[1].dst;
+    unsigned want[HIST_BINS] = { 0 };
+    for (size_t i = 0; i < r->n; i++) want[data[i]]++;
+    for (int b = 0; b < HIST_BINS; b++)
+        if (bins[b] != want[b]) return report_mismatch("histogram", b, bins[b], want[b]);
+    return 0;
+}
+
+static void histogram_work(size_t n, double *bytes, double *flops) {
+    *bytes = (double)n + HIST_BINS * 4.0;
+    *flops = (double)n;
+}
+
+/* stencil: one 5-point Jacobi sweep over an n x n grid */
+
+static int stencil_setup(suite_run *r) {
+    size_t n = r->n, bytes = n * n * sizeof(float);
+    float *in = random_floats(n * n, 8), *out = malloc(bytes);
+    int err = add_buf(r, in, NULL, bytes, SUITE_IN, CL_MEM_READ_ONLY);
+    if (!err) err = add_buf(r, NULL, out, bytes, SUITE_OUT, CL_MEM_WRITE_ONLY);
+    if (err) return err;
+    if ((err = gpufw_create_kernel(r->ctx, "stencil5", &r->k[0])) != 0) return err;
+    r->lws = r->local_size;     // tile side; 0 lets the runtime choose
+    err = set_mem(r, r->k[0], 0, r->buf[0].mem);
+    if (!err) err = set_mem(r, r->k[0], 1, r->buf[1].mem);
+    if (!err) err = set_int(r, r->k[0], 2, n);
+    if (!err) err = set_int(r, r->k[0], 3, n);
+    return err;
+}
+
+static int stencil_launch(suite_run *r) {
+    size_t side = r->lws ? round_up(r->n, r->lws) : r->n;
+    size_t gws[2] = { side, side }, lws[2] = { r->lws, r->lws };
+    return gpufw_launch_kernel_nd(r->ctx, r->k[0], 2, gws, r->lws ? lws : NULL);
+}
+
+static int stencil_check(const suite_run *r) {
+    const float *in = r->buf[0].src;
+    size_t n = r->n;
+    float *want = malloc(n * n * sizeof(float));
+    for (size_t y = 0; want && y < n; y++) {
+        for (size_t x = 0; x < n; x++) {
+            size_t i = y * n + x;
+            want[i] = in[i];
+            if (x > 0 && y > 0 && x + 1 < n && y + 1 < n)
+                want[i] = (float)(0.2 * ((double)in[i] + in[i - 1] + in[i + 1] + in[i - n] + in[i + n]));
+        }
+    }
+    return validate_floats("stencil", r->buf[1].dst, want, n * n, 1e-6);
+}
+
+static void stencil_work(size_t n, double *bytes, double *flops) {
+    *bytes = 8.0 * n * n;
+    *flops = 5.0 * n * n;
+}
+
+const suite_workload suite_workloads[] = {
+    { "vecadd", "kernels/vecadd.cl", "1024,65536,262144,1048576", "elements", "bandwidth",
+      vecadd_setup, vecadd_launch, vecadd_native, vecadd_check, vecadd_work },
+    { "saxpy", "kernels/saxpy.cl", "1024,65536,262144,1048576", "elements", "bandwidth",
+      saxpy_setup, saxpy_launch, NULL, saxpy_check, saxpy_work },
+    { "reduce", "kernels/reduce.cl", "1024,65536,262144,1048576", "elements", "bandwidth, local memory",
+      reduce_setup, reduce_launch, NULL, reduce_check, reduce_work },
+    { "scan", "kernels/scan.cl", "1024,65536,262144,1048576", "elements", "local memory, barriers",
+      scan_setup, scan_launch, NULL, scan_check, scan_work },
+    { "sgemm", "kernels/sgemm.cl", "128,256,512,1024", "side", "compute, local memory",
+      sgemm_setup, sgemm_launch, NULL, sgemm_check, sgemm_work },
+    { "histogram", "kernels/histogram.cl", "65536,1048576,4194304", "elements", "atomics",
+      histogram_setup, histogram_launch, NULL, histogram_check, histogram_work },
+    { "stencil", "kernels/stencil.cl", "256,512,1024,2048", "side", "bandwidth, cache reuse",
+      stencil_setup, stencil_launch, NULL, stencil_check, stencil_work },
+    { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+};
+
+const suite_workload *suite_find(const char *name) {
+    for (const suite_workload *w = suite_workloads; w->name; w++)
+        if (!strcmp(w->name, name)) return w;
+    return NULL;
+}
+
+int suite_upload(suite_run *r) {
+    int err = 0;
+    for (int i = 0; i < r->nbufs && !err; i++)
+        if (r->buf[i].src) err = gpufw_write_buffer(r->ctx, r->buf[i].mem, r->buf[i].src, r->buf[i].bytes);
+    return err;
+}
+
+int suite_download(suite_run *r) {
+    int err = 0;
+    for (int i = 0; i < r->nbufs && !err; i++)
+        if (r->buf[i].dst) err = gpufw_read_buffer(r->ctx, r->buf[i].mem, r->buf[i].dst, r->buf[i].bytes);
+    return err;
+}
+
+void suite_teardown(suite_run *r) {
+    for (int i = 0; i < SUITE_MAX_KERNELS; i++)
+        if (r->k[i]) clReleaseKernel(r->k[i]);
+    for (int i = 0; i < r->nscratch; i++) gpufw_release_buffer(r->ctx, r->scratch[i]);
+    for (int i = 0; i < r->nbufs; i++) {
+        if (r->buf[i].mem) gpufw_release_buffer(r->ctx, r->buf[i].mem);
+        free(r->buf[i].src);
+        free(r->buf[i].dst);
+    }
+    gpufw_ctx *ctx = r->ctx;
+    memset(r, 0, sizeof(*r));
+    r->ctx = ctx;
+}
@@ -0,0 +1,62 @@
+// gpufw_suite.h - benchmark workloads driven by gpufw_bench
+#ifndef GPUFW_SUITE_H
+#define GPUFW_SUITE_H
+
+#include "src/libgpufw.h"
+
+#define SUITE_MAX_BUFS     4
+#define SUITE_MAX_SCRATCH  8
+#define SUITE_MAX_KERNELS  2
+
+// Buffers the harness moves: the upload phase writes src, the download
+// phase reads into dst. In-place data gets both, as separate host arrays, so
+// every iteration starts from the same input.
+enum { SUITE_IN = 1, SUITE_OUT = 2 };
+
+typedef struct {
+    void *src;
+    void *dst;
+    size_t bytes;
+    cl_mem mem;
+} suite_buf;
+
+typedef struct {
+    gpufw_ctx *ctx;
+    size_t n;                   // problem size, see suite_workload.size_unit
+    size_t local_size;          // from -l; 0 = workload default
+    size_t lws;                 // local size actually used
+    suite_buf buf[SUITE_MAX_BUFS];
+    int nbufs;
+    cl_mem scratch[SUITE_MAX_SCRATCH];      // device-only intermediates
+    size_t scratch_len[SUITE_MAX_SCRATCH];
+    int nscratch;
+    cl_kernel k[SUITE_MAX_KERNELS];
+    const char *variant;        // from -V: NULL or "auto", "generic", or <width>x<per-item>
+    char variant_name[32];      // variant the workload runs, empty when it has none
+    cl_kernel kv;               // variant kernel, owned by ctx (teardown leaves it alone)
+    size_t gws;                 // global size for kv
+} suite_run;
+
+typedef struct {
+    const char *name;
+    const char *kernel_file;        // relative to A_libgpufw
+    const char *sizes;              // default size list
+    const char *size_unit;          // "elements", or "side" for n x n problems
+    const char *bound;              // what the workload stresses
+    int (*setup)(suite_run *r);     // host data, device buffers, kernels and fixed args
+    int (*launch)(suite_run *r);    // enqueue the kernel(s) and wait for them
+    int (*native)(suite_run *r);    // native CPU backend version, or NULL
+    int (*check)(const suite_run *r);       // 0 when outputs match the host reference
+    // Algorithmic work for one launch: bytes a perfect cache would move and
+    // arithmetic operations (FLOPs; bin updates for the histogram).
+    void (*work)(size_t n, double *bytes, double *flops);
+} suite_workload;
+
+extern const suite_workload suite_workloads[];     // ends with a NULL name
+
+const suite_workload *suite_find(const char *name);
+int suite_upload(suite_run *r);
+int suite_download(suite_run *r);
+void suite_teardown(suite_run *r);     // releases everything setup created
+
+#endif // GPUFW_SUITE_H
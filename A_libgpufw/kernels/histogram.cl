@@ -0,0 +1,21 @@
+// 256-bin byte histogram. Work-items bump a per-group copy of the bins in
+// local memory with atomics, then each group adds its non-zero bins to the
+// global result with one atomic per bin. bins must be zeroed before launch.
+#define HIST_BINS 256
+
+__kernel void histogram256(__global const uchar *data,
+                           __global uint *bins,
+                           __local uint *local_bins,
+                           int n) {
+    int lid = get_local_id(0);
+    int lsz = get_local_size(0);
+    for (int b = lid; b < HIST_BINS; b += lsz)
+        local_bins[b] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int i = get_global_id(0); i < n; i += get_global_size(0))
+        atomic_inc(&local_bins[data[i]]);
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int b = lid; b < HIST_BINS; b += lsz)
+        if (local_bins[b])
+            atomic_add(&bins[b], local_bins[b]);
+}
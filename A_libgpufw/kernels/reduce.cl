@@ -0,0 +1,22 @@
+// Tree reduction. Each work-group sums a grid-strided slice of the input,
+// halves the partial sums in local memory and writes one value per group;
+// the host runs a second single-group pass over those partials.
+// The local size must be a power of two.
+__kernel void reduce_sum(__global const float *in,
+                         __global float *out,
+                         __local float *scratch,
+                         int n) {
+    int lid = get_local_id(0);
+    float acc = 0.0f;
+    for (int i = get_global_id(0); i < n; i += get_global_size(0))
+        acc += in[i];
+    scratch[lid] = acc;
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (int s = get_local_size(0) / 2; s > 0; s >>= 1) {
+        if (lid < s)
+            scratch[lid] += scratch[lid + s];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0)
+        out[get_group_id(0)] = scratch[0];
+}
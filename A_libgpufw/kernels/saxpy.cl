@@ -0,0 +1,8 @@
+__kernel void saxpy(float alpha,
+                    __global const float *x,
+                    __global float *y,
+                    int n) {
+    int gid = get_global_id(0);
+    if (gid < n)
+        y[gid] = alpha * x[gid] + y[gid];
+}
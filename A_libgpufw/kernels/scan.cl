@@ -0,0 +1,59 @@
+// Work-efficient (Blelloch) exclusive prefix sum. scan_block scans
+// 2 * local_size elements per group in local memory (up-sweep, then
+// down-sweep) and stores each block's total in sums; the host scans sums the
+// same way and scan_add folds the block offsets back in. in may equal out.
+// The local size must be a power of two.
+__kernel void scan_block(__global const float *in,
+                         __global float *out,
+                         __global float *sums,
+                         __local float *tmp,
+                         int n) {
+    int lid = get_local_id(0);
+    int lsz = get_local_size(0);
+    int m = 2 * lsz;
+    int base = get_group_id(0) * m;
+    int ai = lid, bi = lid + lsz;
+    tmp[ai] = base + ai < n ? in[base + ai] : 0.0f;
+    tmp[bi] = base + bi < n ? in[base + bi] : 0.0f;
+
+    int offset = 1;
+    for (int d = lsz; d > 0; d >>= 1) {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid < d) {
+            int x = offset * (2 * lid + 1) - 1;
+            int y = offset * (2 * lid + 2) - 1;
+            tmp[y] += tmp[x];
+        }
+        offset <<= 1;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid == 0) {
+        sums[get_group_id(0)] = tmp[m - 1];
+        tmp[m - 1] = 0.0f;
+    }
+    for (int d = 1; d < m; d <<= 1) {
+        offset >>= 1;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid < d) {
+            int x = offset * (2 * lid + 1) - 1;
+            int y = offset * (2 * lid + 2) - 1;
+            float t = tmp[x];
+            tmp[x] = tmp[y];
+            tmp[y] += t;
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (base + ai < n)
+        out[base + ai] = tmp[ai];
+    if (base + bi < n)
+        out[base + bi] = tmp[bi];
+}
+
+// Launch with the same local size as scan_block so blocks line up.
+__kernel void scan_add(__global float *out,
+                       __global const float *offsets,
+                       int n) {
+    int i = get_global_id(0);
+    if (i < n)
+        out[i] += offsets[i / (2 * get_local_size(0))];
+}
@@ -0,0 +1,25 @@
+// C = A * B for row-major n x n matrices. Each work-group computes one
+// ts x ts tile of C (ts = local size in both dimensions), staging matching
+// tiles of A and B through local memory; edges are zero-padded so n need not
+// be a multiple of ts. The global size is n rounded up to ts.
+__kernel void sgemm_tiled(__global const float *A,
+                          __global const float *B,
+                          __global float *C,
+                          __local float *As,
+                          __local float *Bs,
+                          int n) {
+    int ts = get_local_size(0);
+    int tx = get_local_id(0), ty = get_local_id(1);
+    int col = get_global_id(0), row = get_global_id(1);
+    float acc = 0.0f;
+    for (int t = 0; t < n; t += ts) {
+        As[ty * ts + tx] = row < n && t + tx < n ? A[row * n + t + tx] : 0.0f;
+        Bs[ty * ts + tx] = t + ty < n && col < n ? B[(t + ty) * n + col] : 0.0f;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        for (int k = 0; k < ts; k++)
+            acc += As[ty * ts + k] * Bs[k * ts + tx];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (row < n && col < n)
+        C[row * n + col] = acc;
+}
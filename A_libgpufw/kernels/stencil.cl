@@ -0,0 +1,16 @@
+// One Jacobi sweep of a 5-point stencil over a w x h row-major grid; the
+// boundary is copied through unchanged.
+__kernel void stencil5(__global const float *in,
+                       __global float *out,
+                       int w,
+                       int h) {
+    int x = get_global_id(0), y = get_global_id(1);
+    if (x >= w || y >= h)
+        return;
+    int i = y * w + x;
+    if (x == 0 || y == 0 || x == w - 1 || y == h - 1) {
+        out[i] = in[i];
+        return;
+    }
+    out[i] = 0.2f * (in[i] + in[i - 1] + in[i + 1] + in[i - w] + in[i + w]);
+}
@@ -5,4 +5,52 @@ __kernel void vecadd(__global const float *a,
     int gid = get_global_id(0);
     if (gid < n)
         c[gid] = a[gid] + b[gid];
-}
\ No newline at end of file
+}
+
+// Specialized variant, configured with build options (see gpufw_variant.c):
+//   GPUFW_VW     floats per vector load: 1, 2, 4, 8 or 16
+//   GPUFW_EPT    vectors per work-item, strided by the global size so
+//                neighbouring work-items still touch neighbouring memory
+//   GPUFW_EXACT  1 when n is a multiple of GPUFW_VW * GPUFW_EPT and the
+//                global size is exactly n / (GPUFW_VW * GPUFW_EPT): no bounds checks
+// The defaults build a scalar, bounds-checked kernel.
+#ifndef GPUFW_VW
+#define GPUFW_VW 1
+#endif
+#ifndef GPUFW_EPT
+#define GPUFW_EPT 1
+#endif
+#ifndef GPUFW_EXACT
+#define GPUFW_EXACT 0
+#endif
+
+#define GPUFW_CAT_(a, b) a##b
+#define GPUFW_CAT(a, b) GPUFW_CAT_(a, b)
+#if GPUFW_VW == 1
+#define VLOAD(i, p) ((p)[i])
+#define VSTORE(v, i, p) ((p)[i] = (v))
+#else
+#define VLOAD(i, p) GPUFW_CAT(vload, GPUFW_VW)(i, p)
+#define VSTORE(v, i, p) GPUFW_CAT(vstore, GPUFW_VW)(v, i, p)
+#endif
+
+__kernel void vecadd_vec(__global const float *a,
+                         __global const float *b,
+                         __global float *c,
+                         int n) {
+    size_t gsz = get_global_size(0);
+    for (int k = 0; k < GPUFW_EPT; k++) {
+        size_t v = get_global_id(0) + k * gsz;
+#if GPUFW_EXACT
+        VSTORE(VLOAD(v, a) + VLOAD(v, b), v, c);
+#else
+        size_t base = v * GPUFW_VW;
+        if (base + GPUFW_VW <= (size_t)n) {
+            VSTORE(VLOAD(v, a) + VLOAD(v, b), v, c);
+        } else {
+            for (size_t i = base; i < (size_t)n; i++)
+                c[i] = a[i] + b[i];
+        }
+#endif
+    }
+}
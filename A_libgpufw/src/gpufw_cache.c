@@ -0,0 +1,297 @@
+// gpufw_cache.c - on-disk cache of compiled program binaries
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#define CACHE_MAGIC "GPUFWBC1"
+
+/* On-disk entry: header, then the full key string (guards against hash
+   collisions), then the raw CL_PROGRAM_BINARIES blob. */
+struct cache_header {
+    char magic[8];
+    uint64_t key_hash;
+    uint32_t key_len;
+    uint32_t reserved;
+    uint64_t bin_size;
+    double build_ms;        /* source build time when the entry was stored */
+};
+
+double gpufw_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+uint64_t gpufw_hash64(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = data;
+    uint64_t h = seed;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+void gpufw_print_build_log(cl_program program, cl_device_id device, cl_int err, const char *who) {
+    size_t log_size = 0;
+    clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+    if (log_size > 0) {
+        char *log = malloc(log_size + 1);
+        if (log) {
+            clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
+            log[log_size] = '\0';
+            fprintf(stderr, "%s: clBuildProgram failed (%d). Build log:\n%s\n", who, err, log);
+            free(log);
+        }
+    } else {
+        fprintf(stderr, "%s: clBuildProgram failed (%d), no build log available\n", who, err);
+    }
+}
+
+static int cache_enabled(void) {
+    const char *e = getenv("GPUFW_CACHE");
+    return !(e && strcmp(e, "0") == 0);
+}
+
+/* Resolve and create the cache directory. Returns 0 on success. */
+int gpufw_cache_dir(char *out, size_t out_len) {
+    const char *dir = getenv("GPUFW_CACHE_DIR");
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int n;
+    if (dir && *dir)       n = snprintf(out, out_len, "%s", dir);
+    else if (xdg && *xdg)  n = snprintf(out, out_len, "%s/gpufw", xdg);
+    else if (home && *home) n = snprintf(out, out_len, "%s/.cache/gpufw", home);
+    else                   n = snprintf(out, out_len, "/tmp/gpufw-cache");
+    if (n < 0 || (size_t)n >= out_len) return -1;
+
+    /* mkdir -p */
+    for (char *p = out + 1; *p; ++p) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(out, 0755) != 0 && errno != EEXIST) { *p = '/'; return -1; }
+        *p = '/';
+    }
+    if (mkdir(out, 0755) != 0 && errno != EEXIST) return -1;
+    return 0;
+}
+
+static void append_info(char *key, size_t key_len, const char *label, const char *val) {
+    size_t used = strlen(key);
+    if (used < key_len)
+        snprintf(key + used, key_len - used, "%s=%s;", label, val ? val : "");
+}
+
+static void device_string(cl_device_id dev, cl_device_info what, char *buf, size_t len) {
+    buf[0] = '\0';
+    if (clGetDeviceInfo(dev, what, len, buf, NULL) != CL_SUCCESS) buf[0] = '\0';
+    buf[len - 1] = '\0';
+}
+
+static void platform_string(cl_platform_id plat, cl_platform_info what, char *buf, size_t len) {
+    buf[0] = '\0';
+    if (clGetPlatformInfo(plat, what, len, buf, NULL) != CL_SUCCESS) buf[0] = '\0';
+    buf[len - 1] = '\0';
+}
+
+/* Path of a per-device state file <cache dir>/<prefix>-<hash>.db, where the
+   hash covers device name, driver version and extra. $env overrides the whole
+   path; $env=0 disables persistence (returns -1). */
+int gpufw_state_path(const gpufw_ctx *ctx, const char *env, const char *prefix, const char *extra,
+                     char *out, size_t out_len) {
+    out[0] = '\0';
+    const char *e = env ? getenv(env) : NULL;
+    if (e && strcmp(e, "0") == 0) return -1;
+    if (e && *e) return snprintf(out, out_len, "%s", e) < (int)out_len ? 0 : -1;
+
+    char dir[4096], buf[256];
+    if (gpufw_cache_dir(dir, sizeof(dir)) != 0) return -1;
+    uint64_t h = GPUFW_HASH_SEED;
+    if (ctx->device) {
+        device_string(ctx->device, CL_DEVICE_NAME, buf, sizeof(buf));
+        h = gpufw_hash64(buf, strlen(buf), h);
+        device_string(ctx->device, CL_DRIVER_VERSION, buf, sizeof(buf));
+        h = gpufw_hash64(buf, strlen(buf), h);
+    }
+    if (extra) h = gpufw_hash64(extra, strlen(extra), h);
+    int n = snprintf(out, out_len, "%s/%s-%016llx.db", dir, prefix, (unsigned long long)h);
+    return (n > 0 && (size_t)n < out_len) ? 0 : -1;
+}
+
+/* Build the full cache key text for this source/options/device combination. */
+static void make_key(const gpufw_ctx *ctx, const char *src, size_t src_len, const char *options,
+                     char *key, size_t key_len) {
+    char buf[256], hex[32];
+    key[0] = '\0';
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)gpufw_hash64(src, src_len, GPUFW_HASH_SEED));
+    append_info(key, key_len, "src", hex);
+    append_info(key, key_len, "opts", options);
+    device_string(ctx->device, CL_DEVICE_NAME, buf, sizeof(buf));
+    append_info(key, key_len, "dev", buf);
+    device_string(ctx->device, CL_DRIVER_VERSION, buf, sizeof(buf));
+    append_info(key, key_len, "drv", buf);
+    platform_string(ctx->platform, CL_PLATFORM_NAME, buf, sizeof(buf));
+    append_info(key, key_len, "plat", buf);
+    platform_string(ctx->platform, CL_PLATFORM_VERSION, buf, sizeof(buf));
+    append_info(key, key_len, "platver", buf);
+}
+
+/* Try to load a cached binary. Returns the built program or NULL. */
+static cl_program cache_load(gpufw_ctx *ctx, const char *path, const char *key, uint64_t key_hash,
+                             const char *options) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    double t0 = gpufw_now_ms();
+    struct cache_header hdr;
+    size_t key_len = strlen(key);
+    char *stored_key = NULL;
+    unsigned char *bin = NULL;
+    cl_program prog = NULL;
+
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, CACHE_MAGIC, 8) != 0 ||
+        hdr.key_hash != key_hash || hdr.key_len != key_len || hdr.bin_size == 0)
+        goto out;
+
+    stored_key = malloc(key_len);
+    bin = malloc(hdr.bin_size);
+    if (!stored_key || !bin) goto out;
+    if (fread(stored_key, 1, key_len, f) != key_len || memcmp(stored_key, key, key_len) != 0) goto out;
+    if (fread(bin, 1, hdr.bin_size, f) != hdr.bin_size) goto out;
+
+    cl_int err, bin_status = CL_SUCCESS;
+    size_t bin_size = hdr.bin_size;
+    const unsigned char *bins[1] = { bin };
+    prog = clCreateProgramWithBinary(ctx->context, 1, &ctx->device, &bin_size, bins, &bin_status, &err);
+    if (err != CL_SUCCESS || bin_status != CL_SUCCESS || !prog) {
+        if (prog) clReleaseProgram(prog);
+        prog = NULL;
+        ctx->cache_stats.rejected++;
+        unlink(path);
+        goto out;
+    }
+    err = clBuildProgram(prog, 1, &ctx->device, options, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        clReleaseProgram(prog);
+        prog = NULL;
+        ctx->cache_stats.rejected++;
+        unlink(path);
+        goto out;
+    }
+
+    double load_ms = gpufw_now_ms() - t0;
+    ctx->cache_stats.hits++;
+    ctx->cache_stats.load_ms += load_ms;
+    if (hdr.build_ms > load_ms) ctx->cache_stats.saved_ms += hdr.build_ms - load_ms;
+
+out:
+    free(stored_key);
+    free(bin);
+    fclose(f);
+    return prog;
+}
+
+/* Store the binary of a freshly built program. Written to a temp file and
+   renamed so concurrent processes never see a partial entry. */
+static void cache_store(gpufw_ctx *ctx, cl_program prog, const char *path, const char *key,
+                        uint64_t key_hash, double build_ms) {
+    size_t bin_size = 0;
+    if (clGetProgramInfo(prog, CL_PROGRAM_BINARY_SIZES, sizeof(bin_size), &bin_size, NULL) != CL_SUCCESS ||
+        bin_size == 0)
+        return;
+    unsigned char *bin = malloc(bin_size);
+    if (!bin) return;
+    unsigned char *bins[1] = { bin };
+    if (clGetProgramInfo(prog, CL_PROGRAM_BINARIES, sizeof(bins), bins, NULL) != CL_SUCCESS) {
+        free(bin);
+        return;
+    }
+
+    char tmp[4200];
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (!f) { free(bin); return; }
+
+    struct cache_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CACHE_MAGIC, 8);
+    hdr.key_hash = key_hash;
+    hdr.key_len = (uint32_t)strlen(key);
+    hdr.bin_size = bin_size;
+    hdr.build_ms = build_ms;
+
+    int ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+             fwrite(key, 1, hdr.key_len, f) == hdr.key_len &&
+             fwrite(bin, 1, bin_size, f) == bin_size;
+    ok = (fclose(f) == 0) && ok;
+    free(bin);
+    if (ok && rename(tmp, path) == 0) {
+        ctx->cache_stats.stores++;
+    } else {
+        unlink(tmp);
+    }
+}
+
+static int build_program(gpufw_ctx *ctx, const char *src, size_t src_len, const char *options, cl_program *out_program) {
+    cl_int err;
+    char key[2048], dir[3072], path[4096];
+    uint64_t key_hash = 0;
+    int use_cache = cache_enabled() && gpufw_cache_dir(dir, sizeof(dir)) == 0;
+
+    if (use_cache) {
+        make_key(ctx, src, src_len, options, key, sizeof(key));
+        key_hash = gpufw_hash64(key, strlen(key), GPUFW_HASH_SEED);
+        snprintf(path, sizeof(path), "%s/%016llx.bin", dir, (unsigned long long)key_hash);
+        cl_program prog = cache_load(ctx, path, key, key_hash, options);
+        if (prog) {
+            *out_program = prog;
+            return 0;
+        }
+    }
+    ctx->cache_stats.misses++;
+
+    double t0 = gpufw_now_ms();
+    cl_program prog = clCreateProgramWithSource(ctx->context, 1, &src, &src_len, &err);
+    if (err != CL_SUCCESS || prog == NULL) {
+        fprintf(stderr, "gpufw_build_program: clCreateProgramWithSource failed (%d)\n", err);
+        return err ? err : -1;
+    }
+    err = clBuildProgram(prog, 1, &ctx->device, options, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        gpufw_print_build_log(prog, ctx->device, err, "gpufw_build_program");
+        clReleaseProgram(prog);
+        return err;
+    }
+    double build_ms = gpufw_now_ms() - t0;
+    ctx->cache_stats.build_ms += build_ms;
+
+    if (use_cache) cache_store(ctx, prog, path, key, key_hash, build_ms);
+    *out_program = prog;
+    return 0;
+}
+
+/* Build program from source, going through the binary cache when enabled.
+   Builds are serialized per context: they update cache_stats and are rare. */
+int gpufw_build_program(gpufw_ctx *ctx, const char *src, size_t src_len, const char *options, cl_program *out_program) {
+    GPUFW_TRACE_CALL();
+    if (!ctx || !ctx->context || !src || !out_program) return -1;
+    gpufw_lock(ctx);
+    int err = build_program(ctx, src, src_len, options, out_program);
+    gpufw_unlock(ctx);
+    return err;
+}
+
+void gpufw_cache_print_stats(const gpufw_ctx *ctx, FILE *out) {
+    if (!ctx || !out) return;
+    const gpufw_cache_stats *s = &ctx->cache_stats;
+    fprintf(out, "Program cache: hits=%u misses=%u rejected=%u stores=%u build_ms=%.3f load_ms=%.3f saved_ms=%.3f\n",
+            s->hits, s->misses, s->rejected, s->stores, s->build_ms, s->load_ms, s->saved_ms);
+}
@@ -0,0 +1,262 @@
+// gpufw_cpu.c - native CPU backend: SIMD kernels picked at runtime + worker pool
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GPUFW_X86 1
+#endif
+
+#define CPU_MIN_PARALLEL  (64u << 10)   /* elements; below this threads cost more than they save */
+#define CPU_GRAIN         64            /* split points stay cache-line aligned */
+
+/* ---- ISA detection ---- */
+
+static const char *isa_names[] = { "scalar", "sse2", "avx2", "avx512" };
+
+const char *gpufw_cpu_isa_name(gpufw_cpu_isa isa) {
+    if ((unsigned)isa >= sizeof(isa_names) / sizeof(isa_names[0])) return "?";
+    return isa_names[isa];
+}
+
+static gpufw_cpu_isa detect_hw(void) {
+#ifdef GPUFW_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return GPUFW_ISA_AVX512;
+    if (__builtin_cpu_supports("avx2")) return GPUFW_ISA_AVX2;
+    if (__builtin_cpu_supports("sse2")) return GPUFW_ISA_SSE2;
+#endif
+    return GPUFW_ISA_SCALAR;
+}
+
+/* Best ISA the CPU supports, optionally capped by GPUFW_CPU_ISA. */
+gpufw_cpu_isa gpufw_cpu_detect_isa(void) {
+    static int cached = -1;
+    if (cached >= 0) return (gpufw_cpu_isa)cached;
+    gpufw_cpu_isa isa = detect_hw();
+    const char *e = getenv("GPUFW_CPU_ISA");
+    if (e) {
+        for (unsigned i = 0; i < sizeof(isa_names) / sizeof(isa_names[0]); ++i)
+            if (strcmp(e, isa_names[i]) == 0 && (gpufw_cpu_isa)i < isa) isa = (gpufw_cpu_isa)i;
+    }
+    cached = (int)isa;
+    return isa;
+}
+
+/* ---- vecadd kernels ---- */
+
+typedef void (*vecadd_fn)(const float *a, const float *b, float *c, size_t n);
+
+static void vecadd_scalar(const float *a, const float *b, float *c, size_t n) {
+    for (size_t i = 0; i < n; ++i) c[i] = a[i] + b[i];
+}
+
+#ifdef GPUFW_X86
+__attribute__((target("sse2")))
+static void vecadd_sse2(const float *a, const float *b, float *c, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128 x0 = _mm_add_ps(_mm_loadu_ps(a + i),      _mm_loadu_ps(b + i));
+        __m128 x1 = _mm_add_ps(_mm_loadu_ps(a + i + 4),  _mm_loadu_ps(b + i + 4));
+        __m128 x2 = _mm_add_ps(_mm_loadu_ps(a + i + 8),  _mm_loadu_ps(b + i + 8));
+        __m128 x3 = _mm_add_ps(_mm_loadu_ps(a + i + 12), _mm_loadu_ps(b + i + 12));
+        _mm_storeu_ps(c + i, x0);
+        _mm_storeu_ps(c + i + 4, x1);
+        _mm_storeu_ps(c + i + 8, x2);
+        _mm_storeu_ps(c + i + 12, x3);
+    }
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(c + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    for (; i < n; ++i) c[i] = a[i] + b[i];
+}
+
+__attribute__((target("avx2")))
+static void vecadd_avx2(const float *a, const float *b, float *c, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256 x0 = _mm256_add_ps(_mm256_loadu_ps(a + i),      _mm256_loadu_ps(b + i));
+        __m256 x1 = _mm256_add_ps(_mm256_loadu_ps(a + i + 8),  _mm256_loadu_ps(b + i + 8));
+        __m256 x2 = _mm256_add_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+        __m256 x3 = _mm256_add_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+        _mm256_storeu_ps(c + i, x0);
+        _mm256_storeu_ps(c + i + 8, x1);
+        _mm256_storeu_ps(c + i + 16, x2);
+        _mm256_storeu_ps(c + i + 24, x3);
+    }
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(c + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    for (; i < n; ++i) c[i] = a[i] + b[i];
+}
+
+__attribute__((target("avx512f")))
+static void vecadd_avx512(const float *a, const float *b, float *c, size_t n) {
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        __m512 x0 = _mm512_add_ps(_mm512_loadu_ps(a + i),      _mm512_loadu_ps(b + i));
+        __m512 x1 = _mm512_add_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        __m512 x2 = _mm512_add_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32));
+        __m512 x3 = _mm512_add_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48));
+        _mm512_storeu_ps(c + i, x0);
+        _mm512_storeu_ps(c + i + 16, x1);
+        _mm512_storeu_ps(c + i + 32, x2);
+        _mm512_storeu_ps(c + i + 48, x3);
+    }
+    for (; i + 16 <= n; i += 16)
+        _mm512_storeu_ps(c + i, _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+    if (i < n) {
+        __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+        _mm512_mask_storeu_ps(c + i, m, _mm512_add_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i)));
+    }
+}
+#endif
+
+static vecadd_fn pick_vecadd(void) {
+    switch (gpufw_cpu_detect_isa()) {
+#ifdef GPUFW_X86
+    case GPUFW_ISA_AVX512: return vecadd_avx512;
+    case GPUFW_ISA_AVX2:   return vecadd_avx2;
+    case GPUFW_ISA_SSE2:   return vecadd_sse2;
+#endif
+    default:               return vecadd_scalar;
+    }
+}
+
+/* ---- worker pool ---- */
+
+/* Persistent workers; gpufw_cpu_parallel_for hands each one a contiguous
+   range and runs the first range on the calling thread. */
+struct cpu_pool {
+    pthread_t *threads;
+    unsigned nworkers;              /* not counting the caller */
+    pthread_mutex_t submit;         /* one parallel_for at a time */
+    pthread_mutex_t mu;
+    pthread_cond_t wake, done;
+    unsigned long gen;
+    unsigned remaining;
+    gpufw_cpu_range_fn fn;
+    void *arg;
+    size_t n, per;
+    int stop;
+};
+
+static struct cpu_pool pool = {
+    .submit = PTHREAD_MUTEX_INITIALIZER,
+    .mu = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static void *worker_main(void *p) {
+    unsigned id = (unsigned)(size_t)p;      /* 1..nworkers */
+    unsigned long seen = 0;
+    pthread_mutex_lock(&pool.mu);
+    for (;;) {
+        while (pool.gen == seen && !pool.stop) pthread_cond_wait(&pool.wake, &pool.mu);
+        if (pool.stop) break;
+        seen = pool.gen;
+        size_t begin = id * pool.per, end = begin + pool.per;
+        if (end > pool.n) end = pool.n;
+        gpufw_cpu_range_fn fn = pool.fn;
+        void *arg = pool.arg;
+        pthread_mutex_unlock(&pool.mu);
+        if (begin < end) fn(arg, begin, end);
+        pthread_mutex_lock(&pool.mu);
+        if (--pool.remaining == 0) pthread_cond_signal(&pool.done);
+    }
+    pthread_mutex_unlock(&pool.mu);
+    return NULL;
+}
+
+static void pool_start(void) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *e = getenv("GPUFW_CPU_THREADS");
+    if (e && atoi(e) > 0) ncpu = atoi(e);
+    if (ncpu < 1) ncpu = 1;
+    pool.nworkers = (unsigned)ncpu - 1;
+    if (pool.nworkers == 0) return;
+    pool.threads = calloc(pool.nworkers, sizeof(pthread_t));
+    if (!pool.threads) { pool.nworkers = 0; return; }
+    for (unsigned i = 0; i < pool.nworkers; ++i) {
+        if (pthread_create(&pool.threads[i], NULL, worker_main, (void *)(size_t)(i + 1)) != 0) {
+            pool.nworkers = i;
+            break;
+        }
+    }
+}
+
+unsigned gpufw_cpu_threads(void) {
+    pthread_once(&pool_once, pool_start);
+    return pool.nworkers + 1;
+}
+
+void gpufw_cpu_parallel_for(size_t n, size_t min_parallel, gpufw_cpu_range_fn fn, void *arg) {
+    if (n == 0) return;
+    unsigned nthreads = gpufw_cpu_threads();
+    if (nthreads == 1 || n < min_parallel) {
+        fn(arg, 0, n);
+        return;
+    }
+    pthread_mutex_lock(&pool.submit);
+    pthread_mutex_lock(&pool.mu);
+    size_t per = (n + nthreads - 1) / nthreads;
+    pool.per = (per + CPU_GRAIN - 1) / CPU_GRAIN * CPU_GRAIN;
+    pool.n = n;
+    pool.fn = fn;
+    pool.arg = arg;
+    pool.remaining = pool.nworkers;
+    pool.gen++;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.mu);
+
+    fn(arg, 0, pool.per < n ? pool.per : n);
+
+    pthread_mutex_lock(&pool.mu);
+    while (pool.remaining > 0) pthread_cond_wait(&pool.done, &pool.mu);
+    pthread_mutex_unlock(&pool.mu);
+    pthread_mutex_unlock(&pool.submit);
+}
+
+void gpufw_cpu_shutdown(void) {
+    pthread_once(&pool_once, pool_start);
+    pthread_mutex_lock(&pool.submit);
+    pthread_mutex_lock(&pool.mu);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.mu);
+    for (unsigned i = 0; i < pool.nworkers; ++i) pthread_join(pool.threads[i], NULL);
+    free(pool.threads);
+    pool.threads = NULL;
+    pool.nworkers = 0;
+    pthread_mutex_unlock(&pool.submit);
+}
+
+/* ---- workloads ---- */
+
+struct vecadd_job {
+    vecadd_fn fn;
+    const float *a, *b;
+    float *c;
+};
+
+static void vecadd_range(void *p, size_t begin, size_t end) {
+    struct vecadd_job *j = p;
+    j->fn(j->a + begin, j->b + begin, j->c + begin, end - begin);
+}
+
+int gpufw_cpu_vecadd(const float *a, const float *b, float *c, size_t n) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("n", n);
+    if (!a || !b || !c) return -1;
+    static vecadd_fn fn;
+    if (!fn) fn = pick_vecadd();
+    struct vecadd_job job = { fn, a, b, c };
+    gpufw_cpu_parallel_for(n, CPU_MIN_PARALLEL, vecadd_range, &job);
+    return 0;
+}
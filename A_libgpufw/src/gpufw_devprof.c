@@ -0,0 +1,314 @@
+// gpufw_devprof.c - device characterization (bandwidths, FP32 peak, launch overhead) and roofline bounds
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#define DEVPROF_DEFAULT_BYTES (64u << 20)
+#define DEVPROF_MIN_BYTES     (1u << 20)
+#define DEVPROF_XFER_REPS     5         /* per path, after one untimed run; the best counts */
+#define DEVPROF_FMA_REPS      5
+#define DEVPROF_FMA_ITERS     512
+#define DEVPROF_FMA_ITEMS_PER_CU 4096
+#define DEVPROF_LAUNCH_REPS   200
+#define DEVPROF_DB_MAGIC      "# gpufw device v1"
+
+/* Built through the program cache like any other source. Each work-item runs
+   four independent float4 FMA chains (16 lanes, 32 FLOPs per iteration) so
+   the loop is throughput- rather than latency-bound. */
+static const char devprof_src[] =
+    "__kernel void devprof_noop(__global float *out) { }\n"
+    "__kernel void devprof_fma(__global float *out, int iters) {\n"
+    "    float s = get_global_id(0) * 1e-9f;\n"
+    "    float4 x0 = (float4)(s, s + 1.0f, s + 2.0f, s + 3.0f);\n"
+    "    float4 x1 = x0 + 4.0f, x2 = x0 + 8.0f, x3 = x0 + 12.0f;\n"
+    "    const float4 m = (float4)(0.999f), a = (float4)(0.001f);\n"
+    "    for (int i = 0; i < iters; i++) {\n"
+    "        x0 = fma(x0, m, a); x1 = fma(x1, m, a);\n"
+    "        x2 = fma(x2, m, a); x3 = fma(x3, m, a);\n"
+    "    }\n"
+    "    float4 t = x0 + x1 + x2 + x3;\n"
+    "    out[get_global_id(0)] = t.x + t.y + t.z + t.w;\n"
+    "}\n";
+
+typedef enum { DIR_H2D, DIR_D2H } xfer_dir;
+
+/* One blocking transfer of bytes between host and dev. */
+static int xfer_copy(gpufw_ctx *ctx, cl_mem dev, void *host, size_t bytes, xfer_dir dir) {
+    if (dir == DIR_H2D) return clEnqueueWriteBuffer(gpufw_queue(ctx), dev, CL_TRUE, 0, bytes, host, 0, NULL, NULL);
+    return clEnqueueReadBuffer(gpufw_queue(ctx), dev, CL_TRUE, 0, bytes, host, 0, NULL, NULL);
+}
+
+/* Map an ALLOC_HOST_PTR buffer, copy through the mapping, unmap and wait:
+   what a zero-copy producer or consumer pays. */
+static int xfer_mapped(gpufw_ctx *ctx, cl_mem mapped, void *host, size_t bytes, xfer_dir dir) {
+    cl_int err;
+    cl_map_flags flags = dir == DIR_H2D ? CL_MAP_WRITE_INVALIDATE_REGION : CL_MAP_READ;
+    void *p = clEnqueueMapBuffer(gpufw_queue(ctx), mapped, CL_TRUE, flags, 0, bytes, 0, NULL, NULL, &err);
+    if (err != CL_SUCCESS || !p) return err != CL_SUCCESS ? err : -1;
+    if (dir == DIR_H2D) memcpy(p, host, bytes);
+    else memcpy(host, p, bytes);
+    err = clEnqueueUnmapMemObject(gpufw_queue(ctx), mapped, p, 0, NULL, NULL);
+    if (err == CL_SUCCESS) err = clFinish(gpufw_queue(ctx));
+    return err;
+}
+
+/* Best rate in GB/s over the timed reps: through the mapping when mapped is
+   set, else a copy between host (pageable or pinned) and dev. */
+static double measure_xfer(gpufw_ctx *ctx, cl_mem dev, cl_mem mapped, void *host, size_t bytes, xfer_dir dir,
+                           int *err_out) {
+    double best = 0.0;
+    for (int i = 0; i <= DEVPROF_XFER_REPS; i++) {
+        double t0 = gpufw_now_ms();
+        int err = mapped ? xfer_mapped(ctx, mapped, host, bytes, dir) : xfer_copy(ctx, dev, host, bytes, dir);
+        double ms = gpufw_now_ms() - t0;
+        if (err != CL_SUCCESS) {
+            *err_out = err;
+            return 0.0;
+        }
+        if (i > 0 && (best == 0.0 || ms < best)) best = ms;
+    }
+    return best > 0.0 ? (double)bytes / (best / 1e3) / 1e9 : 0.0;
+}
+
+static double measure_d2d(gpufw_ctx *ctx, cl_mem src, cl_mem dst, size_t bytes, int *err_out) {
+    double best = 0.0;
+    for (int i = 0; i <= DEVPROF_XFER_REPS; i++) {
+        double t0 = gpufw_now_ms();
+        cl_int err = clEnqueueCopyBuffer(gpufw_queue(ctx), src, dst, 0, 0, bytes, 0, NULL, NULL);
+        if (err == CL_SUCCESS) err = clFinish(gpufw_queue(ctx));
+        double ms = gpufw_now_ms() - t0;
+        if (err != CL_SUCCESS) {
+            *err_out = err;
+            return 0.0;
+        }
+        if (i > 0 && (best == 0.0 || ms < best)) best = ms;
+    }
+    /* a copy reads and writes every byte */
+    return best > 0.0 ? 2.0 * (double)bytes / (best / 1e3) / 1e9 : 0.0;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int measure_kernels(gpufw_ctx *ctx, gpufw_device_profile *p) {
+    cl_program prog = NULL;
+    cl_kernel noop = NULL, fma = NULL;
+    cl_mem out = NULL;
+    cl_int err = gpufw_build_program(ctx, devprof_src, sizeof(devprof_src) - 1, NULL, &prog);
+    if (err != CL_SUCCESS) return err;
+
+    cl_uint cus = 1;
+    clGetDeviceInfo(ctx->device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cus), &cus, NULL);
+    size_t items = (size_t)(cus ? cus : 1) * DEVPROF_FMA_ITEMS_PER_CU;
+    int iters = DEVPROF_FMA_ITERS;
+    noop = clCreateKernel(prog, "devprof_noop", &err);
+    if (err == CL_SUCCESS) fma = clCreateKernel(prog, "devprof_fma", &err);
+    if (err == CL_SUCCESS) out = clCreateBuffer(ctx->context, CL_MEM_WRITE_ONLY, items * sizeof(float), NULL, &err);
+    if (err == CL_SUCCESS) err = clSetKernelArg(noop, 0, sizeof(cl_mem), &out);
+    if (err == CL_SUCCESS) err = clSetKernelArg(fma, 0, sizeof(cl_mem), &out);
+    if (err == CL_SUCCESS) err = clSetKernelArg(fma, 1, sizeof(int), &iters);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_characterize: kernel setup failed (%d)\n", err);
+        goto out;
+    }
+
+    /* launch overhead: enqueue to completion of a one-item kernel, median */
+    double lat[DEVPROF_LAUNCH_REPS];
+    size_t one = 1;
+    for (int i = 0; i < DEVPROF_LAUNCH_REPS && err == CL_SUCCESS; i++) {
+        double t0 = gpufw_now_ms();
+        err = clEnqueueNDRangeKernel(gpufw_queue(ctx), noop, 1, NULL, &one, NULL, 0, NULL, NULL);
+        if (err == CL_SUCCESS) err = clFinish(gpufw_queue(ctx));
+        lat[i] = gpufw_now_ms() - t0;
+    }
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_characterize: empty kernel launch failed (%d)\n", err);
+        goto out;
+    }
+    qsort(lat, DEVPROF_LAUNCH_REPS, sizeof(double), cmp_double);
+    p->launch_us = lat[DEVPROF_LAUNCH_REPS / 2] * 1e3;
+
+    double best = 0.0;
+    for (int i = 0; i <= DEVPROF_FMA_REPS && err == CL_SUCCESS; i++) {
+        double t0 = gpufw_now_ms();
+        err = clEnqueueNDRangeKernel(gpufw_queue(ctx), fma, 1, NULL, &items, NULL, 0, NULL, NULL);
+        if (err == CL_SUCCESS) err = clFinish(gpufw_queue(ctx));
+        double ms = gpufw_now_ms() - t0;
+        if (i > 0 && (best == 0.0 || ms < best)) best = ms;
+    }
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_characterize: FMA kernel failed (%d)\n", err);
+        goto out;
+    }
+    if (best > 0.0) p->fp32_gflops = (double)items * iters * 32.0 / (best / 1e3) / 1e9;
+
+out:
+    if (out) clReleaseMemObject(out);
+    if (fma) clReleaseKernel(fma);
+    if (noop) clReleaseKernel(noop);
+    clReleaseProgram(prog);
+    return err;
+}
+
+int gpufw_characterize(gpufw_ctx *ctx, size_t bytes, gpufw_device_profile *out) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("bytes", bytes);
+    if (!ctx || !out || !ctx->context || !ctx->queue) return -1;
+    memset(out, 0, sizeof(*out));
+    if (clGetDeviceInfo(ctx->device, CL_DEVICE_NAME, sizeof(out->device), out->device, NULL) != CL_SUCCESS)
+        strcpy(out->device, "unknown");
+    out->device[sizeof(out->device) - 1] = '\0';
+
+    cl_ulong max_alloc = 0;
+    clGetDeviceInfo(ctx->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL);
+    if (!bytes) bytes = DEVPROF_DEFAULT_BYTES;
+    if (max_alloc && bytes > max_alloc) bytes = (size_t)max_alloc;
+    if (bytes < DEVPROF_MIN_BYTES) bytes = DEVPROF_MIN_BYTES;
+    out->bytes = bytes;
+
+    /* Plain buffers straight from the driver: the pool would keep them around */
+    cl_int err = CL_SUCCESS;
+    cl_mem dev = NULL, dev2 = NULL, pinned = NULL, mapped = NULL;
+    void *pinned_host = NULL;
+    char *host = malloc(bytes);
+    if (!host) return -1;
+    memset(host, 1, bytes);
+    dev = clCreateBuffer(ctx->context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+    if (err == CL_SUCCESS) dev2 = clCreateBuffer(ctx->context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+    if (err == CL_SUCCESS) pinned = clCreateBuffer(ctx->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, NULL, &err);
+    if (err == CL_SUCCESS) mapped = clCreateBuffer(ctx->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, NULL, &err);
+    if (err == CL_SUCCESS)
+        pinned_host = clEnqueueMapBuffer(gpufw_queue(ctx), pinned, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, bytes,
+                                         0, NULL, NULL, &err);
+    if (err != CL_SUCCESS || !pinned_host) {
+        fprintf(stderr, "gpufw_characterize: cannot allocate %zu-byte buffers (%d)\n", bytes, err);
+        if (err == CL_SUCCESS) err = -1;
+        goto out;
+    }
+    memset(pinned_host, 1, bytes);
+
+    out->h2d_pageable_gbps = measure_xfer(ctx, dev, NULL, host, bytes, DIR_H2D, &err);
+    out->d2h_pageable_gbps = measure_xfer(ctx, dev, NULL, host, bytes, DIR_D2H, &err);
+    out->h2d_pinned_gbps = measure_xfer(ctx, dev, NULL, pinned_host, bytes, DIR_H2D, &err);
+    out->d2h_pinned_gbps = measure_xfer(ctx, dev, NULL, pinned_host, bytes, DIR_D2H, &err);
+    out->h2d_mapped_gbps = measure_xfer(ctx, NULL, mapped, host, bytes, DIR_H2D, &err);
+    out->d2h_mapped_gbps = measure_xfer(ctx, NULL, mapped, host, bytes, DIR_D2H, &err);
+    out->d2d_gbps = measure_d2d(ctx, dev, dev2, bytes, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_characterize: transfer measurement failed (%d)\n", err);
+        goto out;
+    }
+    err = measure_kernels(ctx, out);
+
+out:
+    if (pinned_host) clEnqueueUnmapMemObject(gpufw_queue(ctx), pinned, pinned_host, 0, NULL, NULL);
+    clFinish(gpufw_queue(ctx));
+    if (mapped) clReleaseMemObject(mapped);
+    if (pinned) clReleaseMemObject(pinned);
+    if (dev2) clReleaseMemObject(dev2);
+    if (dev) clReleaseMemObject(dev);
+    free(host);
+    return err;
+}
+
+static int profile_path(const gpufw_ctx *ctx, char *out, size_t out_len) {
+    return gpufw_state_path(ctx, "GPUFW_DEVICE_PROFILE", "device", NULL, out, out_len);
+}
+
+/* Fields in file order; the first token of each line is the key. */
+#define DEVPROF_FIELDS(X) \
+    X(h2d_pageable_gbps) X(h2d_pinned_gbps) X(h2d_mapped_gbps) \
+    X(d2h_pageable_gbps) X(d2h_pinned_gbps) X(d2h_mapped_gbps) \
+    X(d2d_gbps) X(fp32_gflops) X(launch_us)
+
+int gpufw_device_profile_save(gpufw_ctx *ctx, const gpufw_device_profile *p) {
+    char path[4200], tmp[4300];
+    if (!ctx || !p || profile_path(ctx, path, sizeof(path)) != 0) return -1;
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        fprintf(stderr, "gpufw_device_profile_save: cannot write '%s'\n", tmp);
+        return -1;
+    }
+    fprintf(f, "%s\ndevice %s\nbytes %zu\n", DEVPROF_DB_MAGIC, p->device, p->bytes);
+#define X(name) fprintf(f, #name " %.6g\n", p->name);
+    DEVPROF_FIELDS(X)
+#undef X
+    int err = ferror(f);
+    if (fclose(f) != 0 || err || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int gpufw_device_profile_load(gpufw_ctx *ctx, gpufw_device_profile *p) {
+    char path[4200], line[256], key[32];
+    if (!ctx || !p || profile_path(ctx, path, sizeof(path)) != 0) return -1;
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    memset(p, 0, sizeof(*p));
+    if (!fgets(line, sizeof(line), f) || strncmp(line, DEVPROF_DB_MAGIC, strlen(DEVPROF_DB_MAGIC)) != 0) {
+        fprintf(stderr, "gpufw_device_profile_load: ignoring '%s' (unknown format)\n", path);
+        fclose(f);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        double v;
+        if (strncmp(line, "device ", 7) == 0) {
+            size_t len = strcspn(line + 7, "\n");
+            if (len >= sizeof(p->device)) len = sizeof(p->device) - 1;
+            memcpy(p->device, line + 7, len);
+            p->device[len] = '\0';
+            continue;
+        }
+        if (sscanf(line, "%31s %lf", key, &v) != 2) continue;
+        if (strcmp(key, "bytes") == 0) p->bytes = (size_t)v;
+#define X(name) else if (strcmp(key, #name) == 0) p->name = v;
+        DEVPROF_FIELDS(X)
+#undef X
+    }
+    fclose(f);
+    return p->d2d_gbps > 0.0 || p->fp32_gflops > 0.0 ? 0 : -1;
+}
+
+void gpufw_device_profile_print(const gpufw_device_profile *p, FILE *out) {
+    if (!p || !out) return;
+    fprintf(out, "device: %s (transfers of %zu bytes)\n", p->device, p->bytes);
+    fprintf(out, "  %-16s %10s %10s\n", "host memory", "h2d GB/s", "d2h GB/s");
+    fprintf(out, "  %-16s %10.2f %10.2f\n", "pageable", p->h2d_pageable_gbps, p->d2h_pageable_gbps);
+    fprintf(out, "  %-16s %10.2f %10.2f\n", "pinned", p->h2d_pinned_gbps, p->d2h_pinned_gbps);
+    fprintf(out, "  %-16s %10.2f %10.2f\n", "mapped", p->h2d_mapped_gbps, p->d2h_mapped_gbps);
+    fprintf(out, "  device memory copy  %.2f GB/s (read + write)\n", p->d2d_gbps);
+    fprintf(out, "  FP32 FMA peak       %.2f GFLOP/s\n", p->fp32_gflops);
+    fprintf(out, "  launch overhead     %.1f us (empty kernel, enqueue to completion)\n", p->launch_us);
+    if (p->d2d_gbps > 0.0 && p->fp32_gflops > 0.0)
+        fprintf(out, "  ridge point         %.2f FLOP/byte\n", p->fp32_gflops / p->d2d_gbps);
+}
+
+double gpufw_roofline_ms(const gpufw_device_profile *p, double bytes, double flops, int *compute_bound) {
+    double mem_ms = p && p->d2d_gbps > 0.0 ? bytes / (p->d2d_gbps * 1e9) * 1e3 : 0.0;
+    double fp_ms = p && p->fp32_gflops > 0.0 ? flops / (p->fp32_gflops * 1e9) * 1e3 : 0.0;
+    if (compute_bound) *compute_bound = fp_ms > mem_ms;
+    return fp_ms > mem_ms ? fp_ms : mem_ms;
+}
+
+double gpufw_xfer_gbps(const gpufw_device_profile *p, gpufw_xfer_mode mode, int to_device) {
+    if (!p) return 0.0;
+    switch (mode) {
+    case GPUFW_XFER_STAGED:
+        return to_device ? p->h2d_pinned_gbps : p->d2h_pinned_gbps;
+    case GPUFW_XFER_MAP:
+    case GPUFW_XFER_USE_HOST:
+        return to_device ? p->h2d_mapped_gbps : p->d2h_mapped_gbps;
+    default:
+        return to_device ? p->h2d_pageable_gbps : p->d2h_pageable_gbps;
+    }
+}
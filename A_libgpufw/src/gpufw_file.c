@@ -0,0 +1,155 @@
+// gpufw_file.c - out-of-core streaming between memory-mapped files
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#define FILE_DEFAULT_WINDOW (64u << 20)     /* bytes per file per window */
+
+/* Resident set size now: /proc/self/statm where there is one, else the
+   peak reported by getrusage. */
+static size_t resident_bytes(void) {
+    long pg = sysconf(_SC_PAGESIZE);
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        unsigned long size, res;
+        int ok = fscanf(f, "%lu %lu", &size, &res) == 2;
+        fclose(f);
+        if (ok && pg > 0) return (size_t)res * (size_t)pg;
+    }
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0) return (size_t)ru.ru_maxrss * 1024;
+    return 0;
+}
+
+struct window_map {
+    void *base;
+    size_t len;
+};
+
+/* Map [off, off + len) of fd; the mapping starts on the page holding off. */
+static void *map_window(int fd, size_t off, size_t len, int prot, struct window_map *m) {
+    size_t pg = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = off / pg * pg;
+    m->len = len + (off - start);
+    m->base = mmap(NULL, m->len, prot, MAP_SHARED, fd, (off_t)start);
+    if (m->base == MAP_FAILED) {
+        m->base = NULL;
+        return NULL;
+    }
+    posix_madvise(m->base, m->len, POSIX_MADV_SEQUENTIAL);
+    return (char *)m->base + (off - start);
+}
+
+static void unmap_window(struct window_map *m) {
+    if (m->base) munmap(m->base, m->len);
+    m->base = NULL;
+}
+
+static int open_inputs(unsigned num_inputs, const char *const *paths, size_t elem_size, int *fds, size_t *n) {
+    for (unsigned k = 0; k < num_inputs; ++k) {
+        struct stat st;
+        fds[k] = open(paths[k], O_RDONLY);
+        if (fds[k] < 0 || fstat(fds[k], &st) != 0) {
+            fprintf(stderr, "gpufw_stream_files: cannot open '%s': %s\n", paths[k], strerror(errno));
+            return -1;
+        }
+        size_t elems = (size_t)st.st_size / elem_size;
+        if (k > 0 && elems != *n) {
+            fprintf(stderr, "gpufw_stream_files: '%s' holds %zu elements, '%s' %zu\n", paths[k], elems, paths[0], *n);
+            return -1;
+        }
+        *n = elems;
+        posix_fadvise(fds[k], 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    return 0;
+}
+
+int gpufw_stream_files(gpufw_ctx *ctx, cl_kernel kernel, size_t elem_size, unsigned num_inputs,
+                       const char *const *input_paths, const char *output_path,
+                       const gpufw_file_stream_opts *opts, gpufw_file_stream_stats *stats) {
+    GPUFW_TRACE_CALL();
+    if (stats) memset(stats, 0, sizeof(*stats));
+    if (!ctx || !ctx->queue || !kernel || !elem_size || !input_paths || !output_path ||
+        num_inputs == 0 || num_inputs > GPUFW_STREAM_MAX_INPUTS)
+        return -1;
+
+    double t0 = gpufw_now_ms();
+    size_t base_rss = resident_bytes(), peak_rss = base_rss;
+    int fds[GPUFW_STREAM_MAX_INPUTS], out = -1;
+    for (unsigned k = 0; k < num_inputs; ++k) fds[k] = -1;
+    size_t n = 0, windows = 0;
+    int err = open_inputs(num_inputs, input_paths, elem_size, fds, &n);
+    if (!err) {
+        out = open(output_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (out < 0 || ftruncate(out, (off_t)(n * elem_size)) != 0) {
+            fprintf(stderr, "gpufw_stream_files: cannot create '%s': %s\n", output_path, strerror(errno));
+            err = -1;
+        }
+    }
+
+    size_t window = opts && opts->window_elems ? opts->window_elems : FILE_DEFAULT_WINDOW / elem_size;
+    if (window == 0) window = 1;
+
+    /* Only one window of each file is mapped at a time, and it is unmapped
+       before the next, so resident memory stays near (inputs + 1) windows
+       however large the files are. The kernel reads ahead on the next window
+       while the device works through this one. */
+    for (size_t off = 0; off < n && !err; off += window) {
+        size_t len = n - off < window ? n - off : window;
+        size_t pos = off * elem_size, bytes = len * elem_size;
+        if (off + len < n) {
+            size_t next = (n - off - len < window ? n - off - len : window) * elem_size;
+            for (unsigned k = 0; k < num_inputs; ++k)
+                posix_fadvise(fds[k], (off_t)(pos + bytes), (off_t)next, POSIX_FADV_WILLNEED);
+        }
+
+        struct window_map in_map[GPUFW_STREAM_MAX_INPUTS], out_map = { NULL, 0 };
+        const void *in[GPUFW_STREAM_MAX_INPUTS];
+        memset(in_map, 0, sizeof(in_map));
+        for (unsigned k = 0; k < num_inputs && !err; ++k)
+            if (!(in[k] = map_window(fds[k], pos, bytes, PROT_READ, &in_map[k]))) err = -1;
+        void *dst = err ? NULL : map_window(out, pos, bytes, PROT_READ | PROT_WRITE, &out_map);
+        if (!err && !dst) err = -1;
+        if (err) fprintf(stderr, "gpufw_stream_files: mmap of window at element %zu failed: %s\n", off, strerror(errno));
+
+        if (!err) err = gpufw_stream_run(ctx, kernel, len, elem_size, num_inputs, in, dst, opts ? &opts->stream : NULL);
+        size_t rss = resident_bytes();
+        if (rss > peak_rss) peak_rss = rss;
+
+        /* written pages stay in the page cache for writeback; consumed input
+           pages are not needed again */
+        unmap_window(&out_map);
+        for (unsigned k = 0; k < num_inputs; ++k) {
+            unmap_window(&in_map[k]);
+            posix_fadvise(fds[k], (off_t)pos, (off_t)bytes, POSIX_FADV_DONTNEED);
+        }
+        windows++;
+    }
+
+    for (unsigned k = 0; k < num_inputs; ++k)
+        if (fds[k] >= 0) close(fds[k]);
+    if (out >= 0 && close(out) != 0 && !err) {
+        fprintf(stderr, "gpufw_stream_files: closing '%s' failed: %s\n", output_path, strerror(errno));
+        err = -1;
+    }
+    if (stats) {
+        stats->elems = n;
+        stats->windows = windows;
+        stats->ms = gpufw_now_ms() - t0;
+        stats->gbps = stats->ms > 0 ? (double)(num_inputs + 1) * n * elem_size / (stats->ms * 1e6) : 0;
+        stats->base_rss = base_rss;
+        stats->peak_rss = peak_rss;
+    }
+    return err;
+}
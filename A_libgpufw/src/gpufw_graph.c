@@ -0,0 +1,526 @@
+// gpufw_graph.c - recorded transfer/launch pipelines replayed with per-job bindings
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#define GRAPH_ARG_MAX       64  /* bytes of a recorded constant argument */
+#define GRAPH_CMDBUF_CACHE  4   /* command buffers kept per run of launches */
+
+/* cl_khr_command_buffer entry points. Declared here rather than taken from
+   CL/cl_ext.h so the library builds against headers that predate the
+   extension; the command buffer handle is only ever passed back to the driver. */
+#define GRAPH_EXT_NAME "cl_khr_command_buffer"
+typedef void *graph_cmdbuf;
+typedef graph_cmdbuf (CL_API_CALL *create_cmdbuf_fn)(cl_uint num_queues, const cl_command_queue *queues,
+                                                     const void *properties, cl_int *errcode_ret);
+typedef cl_int (CL_API_CALL *finalize_cmdbuf_fn)(graph_cmdbuf cb);
+typedef cl_int (CL_API_CALL *release_cmdbuf_fn)(graph_cmdbuf cb);
+typedef cl_int (CL_API_CALL *enqueue_cmdbuf_fn)(cl_uint num_queues, cl_command_queue *queues, graph_cmdbuf cb,
+                                                cl_uint num_wait, const cl_event *wait_list, cl_event *event);
+typedef cl_int (CL_API_CALL *command_ndrange_fn)(graph_cmdbuf cb, cl_command_queue queue, const void *properties,
+                                                 cl_kernel kernel, cl_uint work_dim, const size_t *offset,
+                                                 const size_t *global, const size_t *local, cl_uint num_sync,
+                                                 const cl_uint *sync_wait, cl_uint *sync_point, void *mutable_handle);
+
+enum graph_op { GRAPH_WRITE, GRAPH_READ, GRAPH_LAUNCH };
+enum graph_arg_kind { GRAPH_ARG_CONST, GRAPH_ARG_MEM, GRAPH_ARG_SIZE };
+
+struct graph_arg {
+    cl_kernel kernel;
+    cl_uint index;
+    enum graph_arg_kind kind;
+    unsigned param;             /* GRAPH_ARG_MEM */
+    gpufw_graph_size value;     /* GRAPH_ARG_SIZE */
+    size_t size;
+    int has_value;              /* GRAPH_ARG_CONST without a value is __local memory */
+    unsigned char blob[GRAPH_ARG_MAX];
+};
+
+struct graph_step {
+    enum graph_op op;
+    unsigned mem, host;                 /* transfers: parameter slots */
+    gpufw_graph_size offset, bytes;
+    cl_kernel kernel;                   /* launches */
+    gpufw_graph_size global;
+    size_t local;
+    struct graph_arg *args;             /* set right before the launch */
+    unsigned nargs;
+    size_t tuned_gws, tuned_lws;        /* local 0: the last tuning lookup */
+    int run;                            /* index into runs, -1 if none */
+};
+
+/* One finalized command buffer for a run and the bindings it was recorded with. */
+struct cmdbuf_entry {
+    graph_cmdbuf cb;
+    cl_command_queue queue;
+    cl_mem mem[GPUFW_GRAPH_MAX_PARAMS];
+    size_t n;
+    cl_event last;              /* previous enqueue; a buffer may not be pending twice */
+    unsigned long used;
+};
+
+/* Consecutive launches, replayed as one command buffer when the device has one. */
+struct graph_run {
+    size_t first, count;
+    struct cmdbuf_entry cache[GRAPH_CMDBUF_CACHE];
+};
+
+struct gpufw_graph {
+    gpufw_ctx *ctx;
+    struct graph_step *steps;
+    size_t nsteps, cap;
+    struct graph_arg *pending;  /* recorded arguments waiting for their kernel's launch */
+    unsigned npending, pending_cap;
+    int ended, failed;
+    unsigned nparams;           /* highest parameter slot used + 1 */
+    struct graph_run *runs;
+    size_t nruns;
+    unsigned long tick;
+    int use_cmdbuf;
+    create_cmdbuf_fn create_cmdbuf;
+    finalize_cmdbuf_fn finalize_cmdbuf;
+    release_cmdbuf_fn release_cmdbuf;
+    enqueue_cmdbuf_fn enqueue_cmdbuf;
+    command_ndrange_fn command_ndrange;
+};
+
+static size_t size_eval(gpufw_graph_size s, size_t n) {
+    return (n * s.mul + s.div - 1) / s.div + s.add;
+}
+
+gpufw_graph *gpufw_graph_begin(gpufw_ctx *ctx) {
+    if (!ctx || !ctx->queue) return NULL;
+    gpufw_graph *g = calloc(1, sizeof(*g));
+    if (!g) return NULL;
+    g->ctx = ctx;
+    return g;
+}
+
+/* Record-time errors stick, so a pipeline is checked once at gpufw_graph_end. */
+static int record_fail(gpufw_graph *g, const char *who, const char *what) {
+    fprintf(stderr, "%s: %s\n", who, what);
+    if (g) g->failed = 1;
+    return -1;
+}
+
+static int check_param(gpufw_graph *g, unsigned param, const char *who) {
+    if (param >= GPUFW_GRAPH_MAX_PARAMS) return record_fail(g, who, "parameter slot out of range");
+    if (param + 1 > g->nparams) g->nparams = param + 1;
+    return 0;
+}
+
+static int check_size(gpufw_graph *g, gpufw_graph_size s, const char *who) {
+    if (!s.div) return record_fail(g, who, "size divisor is 0");
+    return 0;
+}
+
+static struct graph_step *push_step(gpufw_graph *g, enum graph_op op, const char *who) {
+    if (g->nsteps == g->cap) {
+        size_t cap = g->cap ? g->cap * 2 : 8;
+        struct graph_step *ns = realloc(g->steps, cap * sizeof(*ns));
+        if (!ns) {
+            record_fail(g, who, "out of memory");
+            return NULL;
+        }
+        g->steps = ns;
+        g->cap = cap;
+    }
+    struct graph_step *s = &g->steps[g->nsteps++];
+    memset(s, 0, sizeof(*s));
+    s->op = op;
+    s->run = -1;
+    return s;
+}
+
+static int record_xfer(gpufw_graph *g, enum graph_op op, unsigned mem, gpufw_graph_size offset,
+                       unsigned host, gpufw_graph_size bytes, const char *who) {
+    if (!g || g->ended) return record_fail(g, who, "graph is not recording");
+    if (check_param(g, mem, who) || check_param(g, host, who) ||
+        check_size(g, offset, who) || check_size(g, bytes, who))
+        return -1;
+    struct graph_step *s = push_step(g, op, who);
+    if (!s) return -1;
+    s->mem = mem;
+    s->host = host;
+    s->offset = offset;
+    s->bytes = bytes;
+    return 0;
+}
+
+int gpufw_graph_write(gpufw_graph *g, unsigned mem, gpufw_graph_size offset, unsigned src, gpufw_graph_size bytes) {
+    return record_xfer(g, GRAPH_WRITE, mem, offset, src, bytes, "gpufw_graph_write");
+}
+
+int gpufw_graph_read(gpufw_graph *g, unsigned mem, gpufw_graph_size offset, unsigned dst, gpufw_graph_size bytes) {
+    return record_xfer(g, GRAPH_READ, mem, offset, dst, bytes, "gpufw_graph_read");
+}
+
+static struct graph_arg *push_arg(gpufw_graph *g, cl_kernel kernel, cl_uint index, const char *who) {
+    if (!g || g->ended) {
+        record_fail(g, who, "graph is not recording");
+        return NULL;
+    }
+    if (!kernel) {
+        record_fail(g, who, "no kernel");
+        return NULL;
+    }
+    if (g->npending == g->pending_cap) {
+        unsigned cap = g->pending_cap ? g->pending_cap * 2 : 8;
+        struct graph_arg *na = realloc(g->pending, cap * sizeof(*na));
+        if (!na) {
+            record_fail(g, who, "out of memory");
+            return NULL;
+        }
+        g->pending = na;
+        g->pending_cap = cap;
+    }
+    struct graph_arg *a = &g->pending[g->npending++];
+    memset(a, 0, sizeof(*a));
+    a->kernel = kernel;
+    a->index = index;
+    return a;
+}
+
+int gpufw_graph_arg(gpufw_graph *g, cl_kernel kernel, cl_uint index, size_t size, const void *value) {
+    if (size > GRAPH_ARG_MAX && value) return record_fail(g, "gpufw_graph_arg", "argument too large to record");
+    struct graph_arg *a = push_arg(g, kernel, index, "gpufw_graph_arg");
+    if (!a) return -1;
+    a->kind = GRAPH_ARG_CONST;
+    a->size = size;
+    a->has_value = value != NULL;
+    if (value) memcpy(a->blob, value, size);
+    return 0;
+}
+
+int gpufw_graph_arg_mem(gpufw_graph *g, cl_kernel kernel, cl_uint index, unsigned mem) {
+    if (g && check_param(g, mem, "gpufw_graph_arg_mem")) return -1;
+    struct graph_arg *a = push_arg(g, kernel, index, "gpufw_graph_arg_mem");
+    if (!a) return -1;
+    a->kind = GRAPH_ARG_MEM;
+    a->param = mem;
+    a->size = sizeof(cl_mem);
+    return 0;
+}
+
+int gpufw_graph_arg_size(gpufw_graph *g, cl_kernel kernel, cl_uint index, size_t size, gpufw_graph_size value) {
+    if (size != sizeof(cl_int) && size != sizeof(cl_long))
+        return record_fail(g, "gpufw_graph_arg_size", "size arguments must be 4 or 8 bytes");
+    if (g && check_size(g, value, "gpufw_graph_arg_size")) return -1;
+    struct graph_arg *a = push_arg(g, kernel, index, "gpufw_graph_arg_size");
+    if (!a) return -1;
+    a->kind = GRAPH_ARG_SIZE;
+    a->value = value;
+    a->size = size;
+    return 0;
+}
+
+int gpufw_graph_launch(gpufw_graph *g, cl_kernel kernel, gpufw_graph_size global, size_t local) {
+    const char *who = "gpufw_graph_launch";
+    if (!g || g->ended) return record_fail(g, who, "graph is not recording");
+    if (!kernel) return record_fail(g, who, "no kernel");
+    if (check_size(g, global, who)) return -1;
+    struct graph_step *s = push_step(g, GRAPH_LAUNCH, who);
+    if (!s) return -1;
+    s->kernel = kernel;
+    s->global = global;
+    s->local = local;
+
+    /* Move this kernel's pending arguments onto the launch, in recording order. */
+    unsigned nargs = 0;
+    for (unsigned i = 0; i < g->npending; ++i)
+        if (g->pending[i].kernel == kernel) nargs++;
+    if (!nargs) return 0;
+    s->args = malloc(nargs * sizeof(*s->args));
+    if (!s->args) return record_fail(g, who, "out of memory");
+    unsigned keep = 0;
+    for (unsigned i = 0; i < g->npending; ++i) {
+        if (g->pending[i].kernel == kernel) s->args[s->nargs++] = g->pending[i];
+        else g->pending[keep++] = g->pending[i];
+    }
+    g->npending = keep;
+    return 0;
+}
+
+static int has_extension(cl_device_id device, const char *name) {
+    size_t len = 0;
+    if (clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, NULL, &len) != CL_SUCCESS || !len) return 0;
+    char *ext = malloc(len + 1);
+    if (!ext) return 0;
+    int found = 0;
+    if (clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, len, ext, NULL) == CL_SUCCESS) {
+        ext[len] = '\0';
+        size_t nlen = strlen(name);
+        for (const char *p = strstr(ext, name); p && !found; p = strstr(p + 1, name))
+            found = (p == ext || p[-1] == ' ') && (p[nlen] == ' ' || p[nlen] == '\0');
+    }
+    free(ext);
+    return found;
+}
+
+static void cmdbuf_detect(gpufw_graph *g) {
+    gpufw_ctx *ctx = g->ctx;
+    const char *e = getenv("GPUFW_GRAPH_CMDBUF");
+    if (e && strcmp(e, "0") == 0) return;
+    if (!ctx->platform || !has_extension(ctx->device, GRAPH_EXT_NAME)) return;
+    g->create_cmdbuf = (create_cmdbuf_fn)clGetExtensionFunctionAddressForPlatform(ctx->platform, "clCreateCommandBufferKHR");
+    g->finalize_cmdbuf = (finalize_cmdbuf_fn)clGetExtensionFunctionAddressForPlatform(ctx->platform, "clFinalizeCommandBufferKHR");
+    g->release_cmdbuf = (release_cmdbuf_fn)clGetExtensionFunctionAddressForPlatform(ctx->platform, "clReleaseCommandBufferKHR");
+    g->enqueue_cmdbuf = (enqueue_cmdbuf_fn)clGetExtensionFunctionAddressForPlatform(ctx->platform, "clEnqueueCommandBufferKHR");
+    g->command_ndrange = (command_ndrange_fn)clGetExtensionFunctionAddressForPlatform(ctx->platform, "clCommandNDRangeKernelKHR");
+    g->use_cmdbuf = g->create_cmdbuf && g->finalize_cmdbuf && g->release_cmdbuf &&
+                    g->enqueue_cmdbuf && g->command_ndrange;
+}
+
+int gpufw_graph_end(gpufw_graph *g) {
+    GPUFW_TRACE_CALL();
+    if (!g || g->ended) return -1;
+    if (g->failed) {
+        fprintf(stderr, "gpufw_graph_end: a recording call failed\n");
+        return -1;
+    }
+    if (!g->nsteps) {
+        fprintf(stderr, "gpufw_graph_end: empty graph\n");
+        return -1;
+    }
+    if (g->npending) {
+        fprintf(stderr, "gpufw_graph_end: %u argument(s) recorded for a kernel that is never launched\n", g->npending);
+        return -1;
+    }
+    free(g->pending);
+    g->pending = NULL;
+    g->pending_cap = 0;
+
+    cmdbuf_detect(g);
+    if (g->use_cmdbuf) {
+        size_t nruns = 0;
+        for (size_t i = 0; i < g->nsteps; ++i)
+            if (g->steps[i].op == GRAPH_LAUNCH && (i == 0 || g->steps[i - 1].op != GRAPH_LAUNCH)) nruns++;
+        g->runs = calloc(nruns, sizeof(*g->runs));
+        if (!g->runs) {
+            g->use_cmdbuf = 0;
+        } else {
+            for (size_t i = 0; i < g->nsteps; ++i) {
+                if (g->steps[i].op != GRAPH_LAUNCH) continue;
+                if (i == 0 || g->steps[i - 1].op != GRAPH_LAUNCH) g->runs[g->nruns++].first = i;
+                g->runs[g->nruns - 1].count++;
+                g->steps[i].run = (int)(g->nruns - 1);
+            }
+        }
+    }
+    g->ended = 1;
+    return 0;
+}
+
+int gpufw_graph_uses_cmdbuf(const gpufw_graph *g) {
+    return g && g->ended && g->use_cmdbuf;
+}
+
+/* Bind one launch's recorded arguments for this replay. */
+static cl_int set_args(const struct graph_step *s, const gpufw_graph_args *args) {
+    for (unsigned i = 0; i < s->nargs; ++i) {
+        const struct graph_arg *a = &s->args[i];
+        cl_int err;
+        if (a->kind == GRAPH_ARG_MEM) {
+            err = clSetKernelArg(s->kernel, a->index, sizeof(cl_mem), &args->mem[a->param]);
+        } else if (a->kind == GRAPH_ARG_SIZE) {
+            size_t v = size_eval(a->value, args->n);
+            cl_int v32 = (cl_int)v;
+            cl_long v64 = (cl_long)v;
+            err = clSetKernelArg(s->kernel, a->index, a->size, a->size == sizeof(cl_int) ? (void *)&v32 : (void *)&v64);
+        } else {
+            err = clSetKernelArg(s->kernel, a->index, a->size, a->has_value ? a->blob : NULL);
+        }
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "gpufw_graph_replay: clSetKernelArg(%u) failed (%d)\n", a->index, err);
+            return err;
+        }
+    }
+    return CL_SUCCESS;
+}
+
+/* Local size for a launch recorded with 0; the tuning table is only consulted
+   when the global size changes between replays. */
+static size_t launch_local(gpufw_ctx *ctx, struct graph_step *s, size_t gws) {
+    if (s->local) return s->local;
+    if (gws != s->tuned_gws) {
+        s->tuned_lws = gpufw_tune_pick(ctx, s->kernel, gws, 0, NULL);
+        s->tuned_gws = gws;
+    }
+    return s->tuned_lws;
+}
+
+static void cmdbuf_entry_free(gpufw_graph *g, struct cmdbuf_entry *e) {
+    if (e->last) {
+        clWaitForEvents(1, &e->last);
+        clReleaseEvent(e->last);
+    }
+    if (e->cb) g->release_cmdbuf(e->cb);
+    memset(e, 0, sizeof(*e));
+}
+
+/* Record run r for the current bindings: arguments are captured per command,
+   and each launch waits for the one before it. */
+static cl_int cmdbuf_record(gpufw_graph *g, struct graph_run *r, cl_command_queue q,
+                            const gpufw_graph_args *args, graph_cmdbuf *out) {
+    cl_int err;
+    graph_cmdbuf cb = g->create_cmdbuf(1, &q, NULL, &err);
+    if (err != CL_SUCCESS || !cb) {
+        fprintf(stderr, "gpufw_graph_replay: clCreateCommandBufferKHR failed (%d)\n", err);
+        return err != CL_SUCCESS ? err : -1;
+    }
+    cl_uint sync = 0;
+    for (size_t i = r->first; i < r->first + r->count && err == CL_SUCCESS; ++i) {
+        struct graph_step *s = &g->steps[i];
+        size_t gws = size_eval(s->global, args->n);
+        size_t lws = launch_local(g->ctx, s, gws);
+        err = set_args(s, args);
+        if (err == CL_SUCCESS) {
+            cl_uint prev = sync;
+            err = g->command_ndrange(cb, NULL, NULL, s->kernel, 1, NULL, &gws, lws ? &lws : NULL,
+                                     i > r->first ? 1 : 0, i > r->first ? &prev : NULL, &sync, NULL);
+            if (err != CL_SUCCESS) fprintf(stderr, "gpufw_graph_replay: clCommandNDRangeKernelKHR failed (%d)\n", err);
+        }
+    }
+    if (err == CL_SUCCESS) {
+        err = g->finalize_cmdbuf(cb);
+        if (err != CL_SUCCESS) fprintf(stderr, "gpufw_graph_replay: clFinalizeCommandBufferKHR failed (%d)\n", err);
+    }
+    if (err != CL_SUCCESS) {
+        g->release_cmdbuf(cb);
+        return err;
+    }
+    *out = cb;
+    return CL_SUCCESS;
+}
+
+/* Enqueue run r through the command buffer recorded for these bindings,
+   recording one (and evicting the least recently used) on a miss. */
+static cl_int cmdbuf_replay(gpufw_graph *g, struct graph_run *r, cl_command_queue q,
+                            const gpufw_graph_args *args, cl_event *evp) {
+    struct cmdbuf_entry *e = NULL, *victim = &r->cache[0];
+    for (unsigned i = 0; i < GRAPH_CMDBUF_CACHE; ++i) {
+        struct cmdbuf_entry *c = &r->cache[i];
+        if (c->cb && c->queue == q && c->n == args->n &&
+            memcmp(c->mem, args->mem, g->nparams * sizeof(cl_mem)) == 0) {
+            e = c;
+            break;
+        }
+        if (!c->cb ? victim->cb != NULL : (victim->cb && c->used < victim->used)) victim = c;
+    }
+    if (!e) {
+        graph_cmdbuf cb = NULL;
+        cl_int err = cmdbuf_record(g, r, q, args, &cb);
+        if (err != CL_SUCCESS) return err;
+        cmdbuf_entry_free(g, victim);
+        e = victim;
+        e->cb = cb;
+        e->queue = q;
+        e->n = args->n;
+        memcpy(e->mem, args->mem, g->nparams * sizeof(cl_mem));
+    }
+    e->used = ++g->tick;
+
+    /* Without simultaneous use a command buffer must finish before it is
+       enqueued again; a job that waited for its results has already done so. */
+    if (e->last) {
+        cl_int status = CL_COMPLETE;
+        clGetEventInfo(e->last, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+        if (status != CL_COMPLETE) clWaitForEvents(1, &e->last);
+        clReleaseEvent(e->last);
+        e->last = NULL;
+    }
+    cl_event ev;
+    cl_int err = g->enqueue_cmdbuf(1, &q, e->cb, 0, NULL, &ev);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_graph_replay: clEnqueueCommandBufferKHR failed (%d)\n", err);
+        return err;
+    }
+    e->last = ev;
+    if (evp) {
+        clRetainEvent(ev);
+        *evp = ev;
+    }
+    return CL_SUCCESS;
+}
+
+static cl_int replay_step(gpufw_ctx *ctx, struct graph_step *s, cl_command_queue q,
+                          const gpufw_graph_args *args, cl_event *evp) {
+    cl_int err;
+    if (s->op == GRAPH_LAUNCH) {
+        size_t gws = size_eval(s->global, args->n);
+        size_t lws = launch_local(ctx, s, gws);
+        err = set_args(s, args);
+        if (err != CL_SUCCESS) return err;
+        err = clEnqueueNDRangeKernel(q, s->kernel, 1, NULL, &gws, lws ? &lws : NULL, 0, NULL, evp);
+        if (err != CL_SUCCESS) fprintf(stderr, "gpufw_graph_replay: clEnqueueNDRangeKernel failed (%d)\n", err);
+        else if (evp) gpufw_prof_track_kernel(ctx, s->kernel, gws, *evp);
+        return err;
+    }
+    size_t off = size_eval(s->offset, args->n);
+    size_t bytes = size_eval(s->bytes, args->n);
+    if (!bytes) return evp ? clEnqueueMarkerWithWaitList(q, 0, NULL, evp) : CL_SUCCESS;
+    if (s->op == GRAPH_WRITE) {
+        err = clEnqueueWriteBuffer(q, args->mem[s->mem], CL_FALSE, off, bytes, args->src[s->host], 0, NULL, evp);
+        if (err != CL_SUCCESS) fprintf(stderr, "gpufw_graph_replay: clEnqueueWriteBuffer failed (%d)\n", err);
+        else if (evp) gpufw_prof_track(ctx, GPUFW_OP_WRITE, "write(graph)", bytes, *evp);
+    } else {
+        err = clEnqueueReadBuffer(q, args->mem[s->mem], CL_FALSE, off, bytes, args->dst[s->host], 0, NULL, evp);
+        if (err != CL_SUCCESS) fprintf(stderr, "gpufw_graph_replay: clEnqueueReadBuffer failed (%d)\n", err);
+        else if (evp) gpufw_prof_track(ctx, GPUFW_OP_READ, "read(graph)", bytes, *evp);
+    }
+    return err;
+}
+
+int gpufw_graph_replay(gpufw_ctx *ctx, gpufw_graph *g, const gpufw_graph_args *args, gpufw_event *done) {
+    GPUFW_TRACE_CALL();
+    if (done) *done = NULL;
+    if (!ctx || !ctx->queue || !g || !g->ended || g->ctx != ctx || !args) return -1;
+    cl_command_queue q = gpufw_queue(ctx);
+    if (!q) return -1;
+
+    /* Only the final command needs an event, unless profiling tracks them all. */
+    cl_int err = CL_SUCCESS;
+    for (size_t i = 0; i < g->nsteps && err == CL_SUCCESS; ++i) {
+        struct graph_step *s = &g->steps[i];
+        struct graph_run *r = g->use_cmdbuf && s->run >= 0 ? &g->runs[s->run] : NULL;
+        size_t end = r ? r->first + r->count - 1 : i;
+        cl_event ev = NULL;
+        cl_event *evp = (end == g->nsteps - 1 && done) || ctx->prof ? &ev : NULL;
+        if (r) {
+            err = cmdbuf_replay(g, r, q, args, evp);
+            if (err == CL_SUCCESS) {
+                if (evp) gpufw_prof_track(ctx, GPUFW_OP_KERNEL, "cmdbuf(graph)", size_eval(s->global, args->n), ev);
+                i = end;
+            } else {
+                /* fall back to host replay for the life of the graph */
+                fprintf(stderr, "gpufw_graph_replay: command buffer failed, replaying from the host\n");
+                g->use_cmdbuf = 0;
+                err = replay_step(ctx, s, q, args, evp);
+            }
+        } else {
+            err = replay_step(ctx, s, q, args, evp);
+        }
+        if (ev) {
+            if (i == g->nsteps - 1 && done && err == CL_SUCCESS) *done = ev;
+            else clReleaseEvent(ev);
+        }
+    }
+    if (err == CL_SUCCESS) clFlush(q);
+    return err;
+}
+
+void gpufw_graph_release(gpufw_graph *g) {
+    if (!g) return;
+    for (size_t r = 0; r < g->nruns; ++r)
+        for (unsigned i = 0; i < GRAPH_CMDBUF_CACHE; ++i)
+            if (g->runs[r].cache[i].cb || g->runs[r].cache[i].last) cmdbuf_entry_free(g, &g->runs[r].cache[i]);
+    for (size_t i = 0; i < g->nsteps; ++i) free(g->steps[i].args);
+    free(g->steps);
+    free(g->pending);
+    free(g->runs);
+    free(g);
+}
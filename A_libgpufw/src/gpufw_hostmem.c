@@ -0,0 +1,421 @@
+// gpufw_hostmem.c - host-visible buffers, zero-copy mapping and pinned staging
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#define STAGING_SLOTS       3
+#define STAGING_SLOT_SIZE   (4u << 20)
+#define STAGING_MIN_XFER    (256u << 10)   /* below this a plain copy is cheaper */
+#define USE_HOST_ALIGN      4096           /* page alignment keeps CL_MEM_USE_HOST_PTR zero-copy */
+#define USE_HOST_SIZE_ALIGN 64
+
+struct staging_slot {
+    cl_mem mem;             /* CL_MEM_ALLOC_HOST_PTR buffer, i.e. pinned host memory */
+    void *ptr;              /* persistent mapping of mem */
+    cl_event busy;          /* last transfer using ptr */
+};
+
+struct gpufw_staging {
+    size_t slot_size;
+    unsigned next;
+    struct staging_slot slot[STAGING_SLOTS];
+};
+
+static const char *mode_names[] = { "auto", "copy", "map", "usehost", "staged" };
+
+const char *gpufw_xfer_mode_name(gpufw_xfer_mode mode) {
+    if ((unsigned)mode >= sizeof(mode_names) / sizeof(mode_names[0])) return "?";
+    return mode_names[mode];
+}
+
+/* CPU and integrated devices share memory with the host, so mapping is free
+   there; discrete devices want DMA from pinned memory instead. */
+static gpufw_xfer_mode detect_mode(gpufw_ctx *ctx) {
+    const char *e = getenv("GPUFW_XFER");
+    if (e) {
+        for (unsigned m = GPUFW_XFER_COPY; m <= GPUFW_XFER_STAGED; ++m)
+            if (strcmp(e, mode_names[m]) == 0) return (gpufw_xfer_mode)m;
+    }
+    cl_device_type type = 0;
+    cl_bool unified = CL_FALSE;
+    clGetDeviceInfo(ctx->device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+    clGetDeviceInfo(ctx->device, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified), &unified, NULL);
+    if ((type & CL_DEVICE_TYPE_CPU) || unified) return GPUFW_XFER_MAP;
+    return GPUFW_XFER_STAGED;
+}
+
+gpufw_xfer_mode gpufw_get_xfer_mode(gpufw_ctx *ctx) {
+    if (!ctx || !ctx->device) return GPUFW_XFER_COPY;
+    if (ctx->xfer_mode == GPUFW_XFER_AUTO) ctx->xfer_mode = detect_mode(ctx);
+    return ctx->xfer_mode;
+}
+
+void gpufw_set_xfer_mode(gpufw_ctx *ctx, gpufw_xfer_mode mode) {
+    if (ctx) ctx->xfer_mode = mode;
+}
+
+/* ---- staging ring ---- */
+
+static struct gpufw_staging *staging_get(gpufw_ctx *ctx) {
+    if (ctx->staging) return ctx->staging;
+    struct gpufw_staging *st = calloc(1, sizeof(*st));
+    if (!st) return NULL;
+    st->slot_size = STAGING_SLOT_SIZE;
+    for (unsigned i = 0; i < STAGING_SLOTS; ++i) {
+        cl_int err;
+        struct staging_slot *s = &st->slot[i];
+        s->mem = clCreateBuffer(ctx->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, st->slot_size, NULL, &err);
+        if (err == CL_SUCCESS && s->mem)
+            s->ptr = clEnqueueMapBuffer(gpufw_queue(ctx), s->mem, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0,
+                                        st->slot_size, 0, NULL, NULL, &err);
+        if (err != CL_SUCCESS || !s->ptr) {
+            fprintf(stderr, "gpufw_staging: pinned slot setup failed (%d)\n", err);
+            ctx->staging = st;
+            gpufw_staging_destroy(ctx);
+            return NULL;
+        }
+    }
+    ctx->staging = st;
+    return st;
+}
+
+void gpufw_staging_destroy(gpufw_ctx *ctx) {
+    struct gpufw_staging *st = ctx ? ctx->staging : NULL;
+    if (!st) return;
+    for (unsigned i = 0; i < STAGING_SLOTS; ++i) {
+        struct staging_slot *s = &st->slot[i];
+        if (s->busy) { clWaitForEvents(1, &s->busy); clReleaseEvent(s->busy); }
+        if (s->ptr) clEnqueueUnmapMemObject(ctx->queue, s->mem, s->ptr, 0, NULL, NULL);
+        if (s->mem) clReleaseMemObject(s->mem);
+    }
+    if (ctx->queue) clFinish(ctx->queue);
+    free(st);
+    ctx->staging = NULL;
+}
+
+/* Claim the next ring slot, waiting for its previous transfer to drain. */
+static struct staging_slot *slot_acquire(struct gpufw_staging *st) {
+    struct staging_slot *s = &st->slot[st->next];
+    st->next = (st->next + 1) % STAGING_SLOTS;
+    if (s->busy) {
+        clWaitForEvents(1, &s->busy);
+        clReleaseEvent(s->busy);
+        s->busy = NULL;
+    }
+    return s;
+}
+
+/* Host -> device through the pinned ring: the memcpy into slot i+1 overlaps
+   the DMA out of slot i. Returns once the last chunk is enqueued. */
+static int staging_write(gpufw_ctx *ctx, cl_mem buf, size_t offset, const void *src, size_t size) {
+    struct gpufw_staging *st = staging_get(ctx);
+    if (!st) return -1;
+    const char *p = src;
+    for (size_t done = 0; done < size; ) {
+        size_t len = size - done < st->slot_size ? size - done : st->slot_size;
+        struct staging_slot *s = slot_acquire(st);
+        memcpy(s->ptr, p + done, len);
+        cl_int err = clEnqueueWriteBuffer(gpufw_queue(ctx), buf, CL_FALSE, offset + done, len, s->ptr, 0, NULL, &s->busy);
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "gpufw_staging_write: clEnqueueWriteBuffer failed (%d)\n", err);
+            return err;
+        }
+        gpufw_prof_track(ctx, GPUFW_OP_WRITE, "write(staged)", len, s->busy);
+        clFlush(gpufw_queue(ctx));
+        done += len;
+    }
+    return 0;
+}
+
+/* Device -> host through the pinned ring: keeps up to STAGING_SLOTS reads in
+   flight and copies each chunk out as it lands. Blocks until dst is filled. */
+static int staging_read(gpufw_ctx *ctx, cl_mem buf, size_t offset, void *dst, size_t size) {
+    struct gpufw_staging *st = staging_get(ctx);
+    if (!st) return -1;
+    char *p = dst;
+    size_t issued = 0, landed = 0;
+    size_t chunk_off[STAGING_SLOTS], chunk_len[STAGING_SLOTS];
+    struct staging_slot *inflight[STAGING_SLOTS];
+    unsigned head = 0, count = 0;
+    cl_int err = CL_SUCCESS;
+
+    while (landed < size) {
+        while (issued < size && count < STAGING_SLOTS) {
+            size_t len = size - issued < st->slot_size ? size - issued : st->slot_size;
+            struct staging_slot *s = slot_acquire(st);
+            err = clEnqueueReadBuffer(gpufw_queue(ctx), buf, CL_FALSE, offset + issued, len, s->ptr, 0, NULL, &s->busy);
+            if (err != CL_SUCCESS) {
+                fprintf(stderr, "gpufw_staging_read: clEnqueueReadBuffer failed (%d)\n", err);
+                break;
+            }
+            gpufw_prof_track(ctx, GPUFW_OP_READ, "read(staged)", len, s->busy);
+            unsigned idx = (head + count) % STAGING_SLOTS;
+            inflight[idx] = s;
+            chunk_off[idx] = issued;
+            chunk_len[idx] = len;
+            count++;
+            issued += len;
+        }
+        if (count == 0) break;
+        clFlush(gpufw_queue(ctx));
+        struct staging_slot *s = inflight[head];
+        clWaitForEvents(1, &s->busy);
+        clReleaseEvent(s->busy);
+        s->busy = NULL;
+        memcpy(p + chunk_off[head], s->ptr, chunk_len[head]);
+        landed += chunk_len[head];
+        head = (head + 1) % STAGING_SLOTS;
+        count--;
+        if (err != CL_SUCCESS) break;
+    }
+    while (count > 0) {     /* error path: drain what was issued */
+        struct staging_slot *s = inflight[head];
+        clWaitForEvents(1, &s->busy);
+        clReleaseEvent(s->busy);
+        s->busy = NULL;
+        head = (head + 1) % STAGING_SLOTS;
+        count--;
+    }
+    return err;
+}
+
+/* The ring is shared, so threads take turns; each still enqueues on its own queue. */
+int gpufw_staging_write(gpufw_ctx *ctx, cl_mem buf, size_t offset, const void *src, size_t size) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("bytes", size);
+    if (!ctx || !ctx->queue || !buf || !src) return -1;
+    gpufw_staging_lock(ctx, 1);
+    int err = staging_write(ctx, buf, offset, src, size);
+    gpufw_staging_lock(ctx, 0);
+    return err;
+}
+
+int gpufw_staging_read(gpufw_ctx *ctx, cl_mem buf, size_t offset, void *dst, size_t size) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("bytes", size);
+    if (!ctx || !ctx->queue || !buf || !dst) return -1;
+    gpufw_staging_lock(ctx, 1);
+    int err = staging_read(ctx, buf, offset, dst, size);
+    gpufw_staging_lock(ctx, 0);
+    return err;
+}
+
+/* Used by gpufw_write_buffer/gpufw_read_buffer to decide on the ring. */
+int gpufw_use_staging(gpufw_ctx *ctx, size_t size) {
+    return size >= STAGING_MIN_XFER && gpufw_get_xfer_mode(ctx) == GPUFW_XFER_STAGED;
+}
+
+gpufw_xfer_mode gpufw_buffer_xfer_path(gpufw_ctx *ctx, size_t size) {
+    if (!ctx || !ctx->device) return GPUFW_XFER_COPY;
+    if (gpufw_use_staging(ctx, size)) return GPUFW_XFER_STAGED;
+    return gpufw_use_mapping(ctx) ? GPUFW_XFER_MAP : GPUFW_XFER_COPY;
+}
+
+/* ---- mapped transfers ---- */
+
+/* Used by gpufw_write_buffer/gpufw_read_buffer: in the MAP and USE_HOST modes
+   pooled buffers are host-allocated, so mapping them costs no transfer. */
+int gpufw_use_mapping(gpufw_ctx *ctx) {
+    gpufw_xfer_mode mode = gpufw_get_xfer_mode(ctx);
+    return mode == GPUFW_XFER_MAP || mode == GPUFW_XFER_USE_HOST;
+}
+
+/* Host -> device as a single memcpy into the mapped buffer. The unmap is
+   not waited for; the in-order queue keeps later commands behind it. */
+int gpufw_map_write(gpufw_ctx *ctx, cl_mem buf, size_t offset, const void *src, size_t size) {
+    cl_command_queue q = gpufw_queue(ctx);
+    cl_event ev = NULL;
+    cl_event *evp = ctx->prof ? &ev : NULL;
+    cl_int err;
+    void *p = clEnqueueMapBuffer(q, buf, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, offset, size, 0, NULL, evp, &err);
+    if (ev) { gpufw_prof_track(ctx, GPUFW_OP_MAP, "write(map)", size, ev); clReleaseEvent(ev); ev = NULL; }
+    if (err != CL_SUCCESS || !p) {
+        fprintf(stderr, "gpufw_write_buffer: clEnqueueMapBuffer failed (%d)\n", err);
+        return err ? err : -1;
+    }
+    memcpy(p, src, size);
+    err = clEnqueueUnmapMemObject(q, buf, p, 0, NULL, evp);
+    if (err != CL_SUCCESS) fprintf(stderr, "gpufw_write_buffer: clEnqueueUnmapMemObject failed (%d)\n", err);
+    if (ev) { gpufw_prof_track(ctx, GPUFW_OP_UNMAP, "write(unmap)", size, ev); clReleaseEvent(ev); }
+    return err;
+}
+
+/* Device -> host as a single memcpy out of the mapped buffer. */
+int gpufw_map_read(gpufw_ctx *ctx, cl_mem buf, size_t offset, void *dst, size_t size) {
+    cl_command_queue q = gpufw_queue(ctx);
+    cl_event ev = NULL;
+    cl_event *evp = ctx->prof ? &ev : NULL;
+    cl_int err;
+    void *p = clEnqueueMapBuffer(q, buf, CL_TRUE, CL_MAP_READ, offset, size, 0, NULL, evp, &err);
+    if (ev) { gpufw_prof_track(ctx, GPUFW_OP_MAP, "read(map)", size, ev); clReleaseEvent(ev); ev = NULL; }
+    if (err != CL_SUCCESS || !p) {
+        fprintf(stderr, "gpufw_read_buffer: clEnqueueMapBuffer failed (%d)\n", err);
+        return err ? err : -1;
+    }
+    memcpy(dst, p, size);
+    err = clEnqueueUnmapMemObject(q, buf, p, 0, NULL, evp);
+    if (err != CL_SUCCESS) fprintf(stderr, "gpufw_read_buffer: clEnqueueUnmapMemObject failed (%d)\n", err);
+    if (ev) { gpufw_prof_track(ctx, GPUFW_OP_UNMAP, "read(unmap)", size, ev); clReleaseEvent(ev); }
+    return err;
+}
+
+/* ---- host-visible buffers ---- */
+
+/* A STAGED unmap leaves its upload running; the shadow may not be handed out
+   or freed until the DMA has finished reading it. */
+static cl_int hbuf_wait_upload(gpufw_hbuf *hb) {
+    if (!hb->upload) return CL_SUCCESS;
+    cl_int err = clWaitForEvents(1, &hb->upload);
+    clReleaseEvent(hb->upload);
+    hb->upload = NULL;
+    return err;
+}
+
+int gpufw_hbuf_alloc(gpufw_ctx *ctx, size_t size, cl_mem_flags access, gpufw_xfer_mode mode, gpufw_hbuf *out) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("bytes", size);
+    if (!ctx || !ctx->context || !out || size == 0) return -1;
+    memset(out, 0, sizeof(*out));
+    if (mode == GPUFW_XFER_AUTO) mode = gpufw_get_xfer_mode(ctx);
+    access &= (CL_MEM_READ_WRITE | CL_MEM_WRITE_ONLY | CL_MEM_READ_ONLY);
+    if (!access) access = CL_MEM_READ_WRITE;
+
+    cl_int err = CL_SUCCESS;
+    out->size = size;
+    out->mode = mode;
+    switch (mode) {
+    case GPUFW_XFER_MAP:
+        out->mem = clCreateBuffer(ctx->context, access | CL_MEM_ALLOC_HOST_PTR, size, NULL, &err);
+        break;
+    case GPUFW_XFER_USE_HOST: {
+        cl_uint align_bits = 0;
+        size_t align = USE_HOST_ALIGN;
+        if (clGetDeviceInfo(ctx->device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(align_bits), &align_bits, NULL) == CL_SUCCESS &&
+            align_bits / 8 > align)
+            align = align_bits / 8;
+        size_t padded = (size + USE_HOST_SIZE_ALIGN - 1) / USE_HOST_SIZE_ALIGN * USE_HOST_SIZE_ALIGN;
+        if (posix_memalign(&out->host_alloc, align, padded) != 0) return -1;
+        out->mem = clCreateBuffer(ctx->context, access | CL_MEM_USE_HOST_PTR, padded, out->host_alloc, &err);
+        break;
+    }
+    case GPUFW_XFER_STAGED:
+        /* device-resident buffer with its own pinned host shadow */
+        out->mem = clCreateBuffer(ctx->context, access, size, NULL, &err);
+        if (err == CL_SUCCESS)
+            out->pinned = clCreateBuffer(ctx->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, NULL, &err);
+        if (err == CL_SUCCESS)
+            out->host_alloc = clEnqueueMapBuffer(gpufw_queue(ctx), out->pinned, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0,
+                                                 size, 0, NULL, NULL, &err);
+        break;
+    default:
+        out->mode = GPUFW_XFER_COPY;
+        out->mem = clCreateBuffer(ctx->context, access, size, NULL, &err);
+        if (err == CL_SUCCESS && posix_memalign(&out->host_alloc, USE_HOST_ALIGN, size) != 0) err = CL_OUT_OF_HOST_MEMORY;
+        break;
+    }
+    if (err != CL_SUCCESS || !out->mem) {
+        fprintf(stderr, "gpufw_hbuf_alloc: %s buffer setup failed (%d)\n", gpufw_xfer_mode_name(mode), err);
+        gpufw_hbuf_free(ctx, out);
+        return err ? err : -1;
+    }
+    return 0;
+}
+
+/* Returns a host pointer to the buffer contents. With CL_MAP_READ the data
+   reflects the device copy; with CL_MAP_WRITE_INVALIDATE_REGION nothing is
+   fetched. Zero-copy modes map in place; the others fetch into a host shadow. */
+void *gpufw_hbuf_map(gpufw_ctx *ctx, gpufw_hbuf *hb, cl_map_flags flags) {
+    GPUFW_TRACE_CALL();
+    if (!ctx || !ctx->queue || !hb || !hb->mem || hb->host) return NULL;
+    cl_int err = hbuf_wait_upload(hb);
+    cl_event ev = NULL;
+    cl_event *evp = ctx->prof ? &ev : NULL;
+    switch (hb->mode) {
+    case GPUFW_XFER_MAP:
+    case GPUFW_XFER_USE_HOST:
+        hb->host = clEnqueueMapBuffer(gpufw_queue(ctx), hb->mem, CL_TRUE, flags, 0, hb->size, 0, NULL, evp, &err);
+        if (ev) gpufw_prof_track(ctx, GPUFW_OP_MAP, NULL, hb->size, ev);
+        break;
+    default:
+        if (err == CL_SUCCESS && (flags & CL_MAP_READ)) {
+            err = clEnqueueReadBuffer(gpufw_queue(ctx), hb->mem, CL_TRUE, 0, hb->size, hb->host_alloc, 0, NULL, evp);
+            if (ev) gpufw_prof_track(ctx, GPUFW_OP_READ, NULL, hb->size, ev);
+        }
+        if (err == CL_SUCCESS) hb->host = hb->host_alloc;
+        break;
+    }
+    if (ev) clReleaseEvent(ev);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_hbuf_map: %s map failed (%d)\n", gpufw_xfer_mode_name(hb->mode), err);
+        hb->host = NULL;
+        return NULL;
+    }
+    hb->map_flags = flags;
+    return hb->host;
+}
+
+/* Makes host writes visible to the device again. Non-blocking for the
+   zero-copy modes; the shadow modes enqueue an upload when the map was writable. */
+int gpufw_hbuf_unmap(gpufw_ctx *ctx, gpufw_hbuf *hb) {
+    GPUFW_TRACE_CALL();
+    if (!ctx || !ctx->queue || !hb || !hb->host) return -1;
+    cl_int err = CL_SUCCESS;
+    cl_event ev = NULL;
+    cl_event *evp = ctx->prof ? &ev : NULL;
+    gpufw_op_kind kind = GPUFW_OP_WRITE;
+    int wrote = (hb->map_flags & (CL_MAP_WRITE | CL_MAP_WRITE_INVALIDATE_REGION)) != 0;
+    switch (hb->mode) {
+    case GPUFW_XFER_MAP:
+    case GPUFW_XFER_USE_HOST:
+        err = clEnqueueUnmapMemObject(gpufw_queue(ctx), hb->mem, hb->host, 0, NULL, evp);
+        kind = GPUFW_OP_UNMAP;
+        break;
+    case GPUFW_XFER_STAGED:
+        /* host_alloc is pinned, so this is a straight DMA; the next map or
+           the free waits for it */
+        if (wrote) {
+            err = clEnqueueWriteBuffer(gpufw_queue(ctx), hb->mem, CL_FALSE, 0, hb->size, hb->host_alloc, 0, NULL,
+                                       &hb->upload);
+            if (err == CL_SUCCESS && ctx->prof) {
+                ev = hb->upload;
+                clRetainEvent(ev);
+            }
+        }
+        break;
+    default:
+        if (wrote) err = clEnqueueWriteBuffer(gpufw_queue(ctx), hb->mem, CL_TRUE, 0, hb->size, hb->host_alloc, 0, NULL, evp);
+        break;
+    }
+    if (ev) {
+        if (err == CL_SUCCESS) gpufw_prof_track(ctx, kind, NULL, hb->size, ev);
+        clReleaseEvent(ev);
+    }
+    if (err != CL_SUCCESS)
+        fprintf(stderr, "gpufw_hbuf_unmap: %s unmap failed (%d)\n", gpufw_xfer_mode_name(hb->mode), err);
+    hb->host = NULL;
+    hb->map_flags = 0;
+    return err;
+}
+
+void gpufw_hbuf_free(gpufw_ctx *ctx, gpufw_hbuf *hb) {
+    if (!hb) return;
+    if (hb->host && ctx) gpufw_hbuf_unmap(ctx, hb);
+    hbuf_wait_upload(hb);
+    if (hb->mode == GPUFW_XFER_STAGED) {
+        if (hb->pinned && hb->host_alloc && ctx && ctx->queue) {
+            clEnqueueUnmapMemObject(gpufw_queue(ctx), hb->pinned, hb->host_alloc, 0, NULL, NULL);
+            clFinish(gpufw_queue(ctx));
+        }
+        hb->host_alloc = NULL;
+    } else if (hb->mem && ctx && ctx->queue) {
+        clFinish(gpufw_queue(ctx));   /* USE_HOST memory must outlive pending commands */
+    }
+    if (hb->pinned) clReleaseMemObject(hb->pinned);
+    if (hb->mem) clReleaseMemObject(hb->mem);
+    free(hb->host_alloc);
+    memset(hb, 0, sizeof(*hb));
+}
@@ -0,0 +1,293 @@
+// gpufw_hybrid.c - split jobs between the native CPU backend and the OpenCL device
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#define HYBRID_ALIGN       256      /* the device slice stays a multiple of this many elements */
+#define HYBRID_EWMA_ALPHA  0.3      /* weight of the latest measurement */
+#define HYBRID_MIN_SHARE   0.02     /* keep both sides busy enough to stay measured */
+#define HYBRID_CPU_CHUNKS  8        /* host part runs in this many pieces, polling the device between them */
+#define HYBRID_CPU_MIN     65536    /* smallest host piece, in elements */
+#define HYBRID_DB_MAGIC    "# gpufw hybrid v1"
+
+/* One job shape: the device half is enqueued first, the host half runs on
+   the CPU pool meanwhile, then the device half is waited for. */
+struct hybrid_ops {
+    const char *name;
+    int (*cpu)(void *arg, size_t begin, size_t end);
+    int (*gpu)(gpufw_ctx *ctx, void *arg, size_t begin, size_t end, gpufw_event *done);
+    void (*gpu_release)(gpufw_ctx *ctx, void *arg);     /* after *done completed */
+};
+
+struct gpufw_hybrid {
+    gpufw_hybrid_entry *entries;
+    size_t count, cap;
+    char path[4200];            /* empty when ratios are not persisted */
+    int dirty;
+};
+
+/* Ratios only carry over between runs on the same device/driver and the same
+   CPU setup, so each combination gets its own file. */
+static void db_path(gpufw_ctx *ctx, char *out, size_t out_len) {
+    char cpu[64];
+    snprintf(cpu, sizeof(cpu), "%s/%u", gpufw_cpu_isa_name(gpufw_cpu_detect_isa()), gpufw_cpu_threads());
+    if (gpufw_state_path(ctx, "GPUFW_HYBRID_DB", "hybrid", cpu, out, out_len) != 0) out[0] = '\0';
+}
+
+static gpufw_hybrid_entry *add_entry(struct gpufw_hybrid *h, const char *workload, unsigned bucket) {
+    if (h->count == h->cap) {
+        size_t cap = h->cap ? h->cap * 2 : 16;
+        gpufw_hybrid_entry *ne = realloc(h->entries, cap * sizeof(*ne));
+        if (!ne) return NULL;
+        h->entries = ne;
+        h->cap = cap;
+    }
+    gpufw_hybrid_entry *e = &h->entries[h->count++];
+    memset(e, 0, sizeof(*e));
+    snprintf(e->workload, sizeof(e->workload), "%s", workload);
+    e->bucket = bucket;
+    e->ratio = 0.5;
+    return e;
+}
+
+static gpufw_hybrid_entry *find_entry(struct gpufw_hybrid *h, const char *workload, unsigned bucket) {
+    for (size_t i = 0; i < h->count; ++i)
+        if (h->entries[i].bucket == bucket && strcmp(h->entries[i].workload, workload) == 0)
+            return &h->entries[i];
+    return NULL;
+}
+
+static double ratio_of(double cpu_rate, double gpu_rate) {
+    double r = gpu_rate / (cpu_rate + gpu_rate);
+    if (r < HYBRID_MIN_SHARE) r = HYBRID_MIN_SHARE;
+    if (r > 1.0 - HYBRID_MIN_SHARE) r = 1.0 - HYBRID_MIN_SHARE;
+    return r;
+}
+
+static void db_load(struct gpufw_hybrid *h) {
+    FILE *f = h->path[0] ? fopen(h->path, "r") : NULL;
+    if (!f) return;
+    char line[256], name[GPUFW_HYBRID_NAME_LEN];
+    if (!fgets(line, sizeof(line), f) || strncmp(line, HYBRID_DB_MAGIC, strlen(HYBRID_DB_MAGIC)) != 0) {
+        fprintf(stderr, "gpufw_hybrid: ignoring '%s' (unknown format)\n", h->path);
+        fclose(f);
+        return;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        unsigned bucket;
+        double cpu_rate, gpu_rate;
+        unsigned long runs;
+        if (sscanf(line, "%31s %u %lf %lf %lu", name, &bucket, &cpu_rate, &gpu_rate, &runs) != 5) continue;
+        if (bucket >= 64 || cpu_rate <= 0.0 || gpu_rate <= 0.0 || find_entry(h, name, bucket)) continue;
+        gpufw_hybrid_entry *e = add_entry(h, name, bucket);
+        if (!e) break;
+        e->cpu_rate = cpu_rate;
+        e->gpu_rate = gpu_rate;
+        e->runs = runs;
+        e->ratio = ratio_of(cpu_rate, gpu_rate);
+    }
+    fclose(f);
+}
+
+static struct gpufw_hybrid *hybrid_get(gpufw_ctx *ctx) {
+    if (ctx->hybrid) return ctx->hybrid;
+    struct gpufw_hybrid *h = calloc(1, sizeof(*h));
+    if (!h) return NULL;
+    db_path(ctx, h->path, sizeof(h->path));
+    db_load(h);
+    ctx->hybrid = h;
+    return h;
+}
+
+static int db_save(struct gpufw_hybrid *h) {
+    char tmp[4300];
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", h->path, (long)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        fprintf(stderr, "gpufw_hybrid_save: cannot write '%s'\n", tmp);
+        return -1;
+    }
+    fprintf(f, "%s\n", HYBRID_DB_MAGIC);
+    for (size_t i = 0; i < h->count; ++i) {
+        const gpufw_hybrid_entry *e = &h->entries[i];
+        if (e->cpu_rate > 0.0 && e->gpu_rate > 0.0)
+            fprintf(f, "%s %u %.6g %.6g %lu\n", e->workload, e->bucket, e->cpu_rate, e->gpu_rate, e->runs);
+    }
+    int err = ferror(f);
+    if (fclose(f) != 0 || err || rename(tmp, h->path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    h->dirty = 0;
+    return 0;
+}
+
+int gpufw_hybrid_save(gpufw_ctx *ctx) {
+    struct gpufw_hybrid *h = ctx ? ctx->hybrid : NULL;
+    if (!h || !h->path[0]) return -1;
+    gpufw_lock(ctx);
+    int err = db_save(h);
+    gpufw_unlock(ctx);
+    return err;
+}
+
+void gpufw_hybrid_destroy(gpufw_ctx *ctx) {
+    struct gpufw_hybrid *h = ctx ? ctx->hybrid : NULL;
+    if (!h) return;
+    if (h->dirty) gpufw_hybrid_save(ctx);
+    free(h->entries);
+    free(h);
+    ctx->hybrid = NULL;
+}
+
+const gpufw_hybrid_entry *gpufw_hybrid_entries(gpufw_ctx *ctx, size_t *count) {
+    if (count) *count = 0;
+    if (!ctx) return NULL;
+    gpufw_lock(ctx);
+    struct gpufw_hybrid *h = hybrid_get(ctx);
+    gpufw_unlock(ctx);
+    if (!h) return NULL;
+    if (count) *count = h->count;
+    return h->entries;
+}
+
+void gpufw_hybrid_print(gpufw_ctx *ctx, FILE *out) {
+    size_t n = 0;
+    const gpufw_hybrid_entry *e = gpufw_hybrid_entries(ctx, &n);
+    if (!out) return;
+    int has_device = ctx && ctx->backend == GPUFW_BACKEND_OPENCL && ctx->queue;
+    if (!has_device) fprintf(out, "no OpenCL device: every job runs on the host\n");
+    fprintf(out, "%-16s %12s %7s %14s %14s %6s\n", "workload", "n >=", "device", "cpu_elem/ms", "dev_elem/ms", "runs");
+    for (size_t i = 0; i < n; ++i) {
+        /* no device rate yet: no element of this bucket has gone to the device */
+        double share = has_device && e[i].gpu_rate > 0.0 ? e[i].ratio : 0.0;
+        fprintf(out, "%-16s %12zu %6.1f%% %14.1f %14.1f %6lu\n", e[i].workload, (size_t)1 << e[i].bucket,
+                share * 100.0, e[i].cpu_rate, e[i].gpu_rate, e[i].runs);
+    }
+}
+
+static unsigned size_bucket(size_t n) {
+    unsigned b = 0;
+    while (n >>= 1) ++b;
+    return b;
+}
+
+static double ewma(double old, double sample) {
+    return old > 0.0 ? (1.0 - HYBRID_EWMA_ALPHA) * old + HYBRID_EWMA_ALPHA * sample : sample;
+}
+
+static int hybrid_run(gpufw_ctx *ctx, const struct hybrid_ops *ops, void *arg, size_t n) {
+    if (n == 0) return 0;
+    int has_device = ctx->backend == GPUFW_BACKEND_OPENCL && ctx->queue;
+    /* Other threads may add entries (moving the table) while this job runs,
+       so the entry is looked up again for the update. */
+    gpufw_lock(ctx);
+    struct gpufw_hybrid *h = hybrid_get(ctx);
+    unsigned bucket = size_bucket(n);
+    gpufw_hybrid_entry *e = h ? find_entry(h, ops->name, bucket) : NULL;
+    if (h && !e) e = add_entry(h, ops->name, bucket);
+    if (e && !has_device) e->ratio = 0.0;      /* nothing is sent anywhere but the host */
+    double ratio = e ? e->ratio : 0.0;
+    gpufw_unlock(ctx);
+    if (!e) return -1;
+
+    /* Device takes [0, split), host takes [split, n). */
+    size_t split = 0;
+    if (has_device) {
+        split = (size_t)((double)n * ratio + HYBRID_ALIGN / 2) / HYBRID_ALIGN * HYBRID_ALIGN;
+        if (split > n) split = n;
+    }
+
+    gpufw_event done = NULL;
+    double t0 = gpufw_now_ms(), t_gpu = 0.0;
+    int err = 0;
+    if (split > 0) {
+        err = ops->gpu(ctx, arg, 0, split, &done);
+        if (err == 0) {
+            gpufw_flush(ctx);
+        } else {
+            fprintf(stderr, "gpufw_hybrid: device part of %s failed (%d), running it on the host\n", ops->name, err);
+            gpufw_finish(ctx);
+            ops->gpu_release(ctx, arg);
+            gpufw_event_release(done);
+            done = NULL;
+            split = 0;
+            err = 0;        /* the host covers the whole range; only its result counts */
+        }
+    }
+
+    /* The host part runs in pieces so a device part that finishes first is
+       timed to within one piece rather than charged the whole host time. */
+    double t1 = gpufw_now_ms();
+    int cpu_err = 0;
+    size_t piece = (n - split) / HYBRID_CPU_CHUNKS;
+    if (piece < HYBRID_CPU_MIN) piece = HYBRID_CPU_MIN;
+    for (size_t pos = split; pos < n && cpu_err == 0; pos += piece) {
+        cpu_err = ops->cpu(arg, pos, n - pos > piece ? pos + piece : n);
+        if (done && t_gpu == 0.0 && gpufw_event_query(done) != 0) t_gpu = gpufw_now_ms();
+    }
+    double cpu_ms = gpufw_now_ms() - t1;
+
+    if (done) {
+        err = gpufw_event_wait(1, &done);
+        if (t_gpu == 0.0) t_gpu = gpufw_now_ms();
+        gpufw_event_release(done);
+        ops->gpu_release(ctx, arg);
+    }
+    if (err == 0) err = cpu_err;
+    if (err != 0) return err;
+
+    double gpu_ms = t_gpu - t0;
+    gpufw_lock(ctx);
+    e = find_entry(h, ops->name, bucket);
+    if (split > 0 && gpu_ms > 0.0) e->gpu_rate = ewma(e->gpu_rate, (double)split / gpu_ms);
+    if (split < n && cpu_ms > 0.0) e->cpu_rate = ewma(e->cpu_rate, (double)(n - split) / cpu_ms);
+    if (e->cpu_rate > 0.0 && e->gpu_rate > 0.0) e->ratio = ratio_of(e->cpu_rate, e->gpu_rate);
+    e->runs++;
+    h->dirty = 1;
+    gpufw_unlock(ctx);
+    return 0;
+}
+
+/* ---- workloads ---- */
+
+struct vecadd_args {
+    const float *a, *b;
+    float *c;
+    cl_mem bufs[3];
+};
+
+static int vecadd_cpu(void *p, size_t begin, size_t end) {
+    struct vecadd_args *v = p;
+    return gpufw_cpu_vecadd(v->a + begin, v->b + begin, v->c + begin, end - begin);
+}
+
+static int vecadd_gpu(gpufw_ctx *ctx, void *p, size_t begin, size_t end, gpufw_event *done) {
+    struct vecadd_args *v = p;
+    cl_kernel kernel;
+    if (gpufw_get_kernel(ctx, "vecadd", &kernel) != 0) return -1;
+    return gpufw_vecadd_enqueue(ctx, kernel, v->a + begin, v->b + begin, v->c + begin, end - begin, v->bufs, done);
+}
+
+static void vecadd_release(gpufw_ctx *ctx, void *p) {
+    struct vecadd_args *v = p;
+    for (int i = 0; i < 3; ++i) {
+        if (v->bufs[i]) gpufw_release_buffer(ctx, v->bufs[i]);
+        v->bufs[i] = NULL;
+    }
+}
+
+static const struct hybrid_ops vecadd_ops = { "vecadd", vecadd_cpu, vecadd_gpu, vecadd_release };
+
+int gpufw_hybrid_vecadd(gpufw_ctx *ctx, const float *a, const float *b, float *c, size_t n) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("n", n);
+    if (!ctx || !a || !b || !c) return -1;
+    struct vecadd_args v = { a, b, c, { NULL, NULL, NULL } };
+    return hybrid_run(ctx, &vecadd_ops, &v, n);
+}
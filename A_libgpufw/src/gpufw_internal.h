@@ -0,0 +1,132 @@
+// gpufw_internal.h - helpers shared between libgpufw translation units (not installed)
+#ifndef GPUFW_INTERNAL_H
+#define GPUFW_INTERNAL_H
+
+#include <stdint.h>
+#include "libgpufw.h"
+
+// Init pieces (libgpufw.c)
+char *gpufw_read_kernel_source(const char *filename, size_t *length);
+unsigned gpufw_init_flags(const gpufw_init_opts *opts);
+int gpufw_init_device(gpufw_ctx *ctx, cl_platform_id platform, cl_device_id device,
+                      const char *src, size_t src_size, unsigned flags);
+
+// Startup (gpufw_startup.c). Platform and per-type device lists are cached for
+// the life of the process; the returned arrays must not be freed.
+cl_int gpufw_platforms(const cl_platform_id **platforms, cl_uint *count, int *cached);
+cl_int gpufw_devices(cl_platform_id platform, cl_device_type type, const cl_device_id **devices, cl_uint *count);
+// Kernel source for an init: "embed:<name>" or a path (see gpufw_init_ex); malloc'd
+char *gpufw_load_kernel_source(const char *kernel_file, size_t *length, int *embedded);
+gpufw_build_mode gpufw_build_mode_of(unsigned flags);
+// Hand the program build to gpufw_program; the source is copied
+int gpufw_startup_defer(gpufw_ctx *ctx, const char *src, size_t src_len, int background);
+void gpufw_startup_destroy(gpufw_ctx *ctx);
+
+// Sources from kernels/, generated into gpufw_kernels_embed.c by the Makefile;
+// the table ends with a NULL name
+typedef struct {
+    const char *name;       // file name, e.g. "vecadd.cl"
+    const char *src;
+} gpufw_embedded_kernel;
+extern const gpufw_embedded_kernel gpufw_embedded_kernels[];
+
+// Monotonic wall clock in milliseconds
+double gpufw_now_ms(void);
+
+// 64-bit FNV-1a hash; pass the previous result as seed to chain buffers
+uint64_t gpufw_hash64(const void *data, size_t len, uint64_t seed);
+#define GPUFW_HASH_SEED 0xcbf29ce484222325ULL
+
+// Resolve (and create) the directory holding the program cache and other
+// persisted state: $GPUFW_CACHE_DIR, $XDG_CACHE_HOME/gpufw or ~/.cache/gpufw
+int gpufw_cache_dir(char *out, size_t out_len);
+
+// <cache dir>/<prefix>-<hash of device, driver and extra>.db for state that
+// only carries over on the same device; $env overrides, $env=0 returns -1
+int gpufw_state_path(const gpufw_ctx *ctx, const char *env, const char *prefix, const char *extra,
+                     char *out, size_t out_len);
+
+// Print the build log of a failed clBuildProgram
+void gpufw_print_build_log(cl_program program, cl_device_id device, cl_int err, const char *who);
+
+// Enqueue c = a + b through pooled buffers on the calling thread's queue, with the vecadd_vec
+// variant for n when there is one and kernel otherwise. *done completes when
+// c is back on the host; release bufs[0..2] with gpufw_release_buffer after that.
+int gpufw_vecadd_enqueue(gpufw_ctx *ctx, cl_kernel kernel, const float *a, const float *b, float *c,
+                         size_t n, cl_mem bufs[3], gpufw_event *done);
+
+// Buffer pool (gpufw_pool.c)
+cl_mem gpufw_pool_alloc(gpufw_ctx *ctx, size_t size, cl_mem_flags flags);
+void gpufw_pool_destroy(gpufw_ctx *ctx);
+
+// Host transfer paths (gpufw_hostmem.c)
+int gpufw_use_staging(gpufw_ctx *ctx, size_t size);
+int gpufw_use_mapping(gpufw_ctx *ctx);
+int gpufw_map_write(gpufw_ctx *ctx, cl_mem buf, size_t offset, const void *src, size_t size);
+int gpufw_map_read(gpufw_ctx *ctx, cl_mem buf, size_t offset, void *dst, size_t size);
+void gpufw_staging_destroy(gpufw_ctx *ctx);
+
+// Profiling (gpufw_profile.c); the track calls are no-ops unless ctx->prof is set
+int gpufw_prof_enable(gpufw_ctx *ctx);
+void gpufw_prof_track(gpufw_ctx *ctx, gpufw_op_kind kind, const char *name, size_t bytes, cl_event ev);
+void gpufw_prof_track_kernel(gpufw_ctx *ctx, cl_kernel kernel, size_t global_work_size, cl_event ev);
+void gpufw_prof_destroy(gpufw_ctx *ctx);
+
+// Tracing (gpufw_trace.c). GPUFW_TRACE_CALL opens a span named after the
+// calling function; with tracing off it costs a load and a branch, as the
+// flag is read inline. gpufw_trace_flow_begin marks an enqueue on the calling
+// thread and returns the id that gpufw_trace_device ends the arrow with
+// (0 when off); device times are already on the host clock.
+extern int gpufw_trace_active __attribute__((visibility("hidden")));
+uint64_t gpufw_trace_now_ns(void);
+uint64_t gpufw_trace_flow_begin(void);
+void gpufw_trace_device(cl_device_id device, cl_command_queue queue, const char *name, const char *arg_name,
+                        uint64_t arg, uint64_t start_ns, uint64_t end_ns, uint64_t flow);
+
+static inline int gpufw_tracing(void) {
+    return __atomic_load_n(&gpufw_trace_active, __ATOMIC_RELAXED);
+}
+
+static inline gpufw_trace_span gpufw_trace_call_begin(const char *name) {
+    gpufw_trace_span s = { "gpufw", name, NULL, 0, 0 };
+    if (gpufw_tracing()) s.start_ns = gpufw_trace_now_ns();
+    return s;
+}
+
+static inline void gpufw_trace_call_end(gpufw_trace_span *span) {
+    if (span->start_ns) gpufw_trace_span_end(span);
+}
+
+#define GPUFW_TRACE_CALL() \
+    gpufw_trace_span gpufw_trace_scope_ __attribute__((cleanup(gpufw_trace_call_end))) = gpufw_trace_call_begin(__func__)
+
+// Streaming queues (gpufw_stream.c)
+void gpufw_stream_destroy(gpufw_ctx *ctx);
+
+// Work-group tuning (gpufw_tune.c); gpufw_tune_pick returns the local size for
+// a launch that asked for 0, sweeping first when autotuning is enabled
+int gpufw_tune_enable(gpufw_ctx *ctx);
+size_t gpufw_tune_pick(gpufw_ctx *ctx, cl_kernel kernel, size_t global_work_size,
+                       cl_uint num_wait, const cl_event *wait_list);
+void gpufw_tune_destroy(gpufw_ctx *ctx);
+
+// Kernel variants (gpufw_variant.c); keeps a copy of the program source
+int gpufw_variant_init(gpufw_ctx *ctx, const char *src, size_t src_len);
+void gpufw_variant_destroy(gpufw_ctx *ctx);
+
+// Threads (gpufw_thread.c). gpufw_queue is the calling thread's queue, which
+// is ctx->queue unless GPUFW_INIT_THREADS; the locks are no-ops without it.
+// gpufw_lock guards shared ctx state and is recursive.
+int gpufw_threads_enable(gpufw_ctx *ctx);
+cl_command_queue gpufw_queue(gpufw_ctx *ctx);
+int gpufw_thread_kernel(gpufw_ctx *ctx, cl_program program, const char *kernel_name, cl_kernel *out_kernel);
+void gpufw_lock(const gpufw_ctx *ctx);
+void gpufw_unlock(const gpufw_ctx *ctx);
+void gpufw_staging_lock(gpufw_ctx *ctx, int lock);
+void gpufw_stream_lock(gpufw_ctx *ctx, int lock);
+void gpufw_threads_destroy(gpufw_ctx *ctx);
+
+// Hybrid scheduler state (gpufw_hybrid.c); saves learned ratios before freeing
+void gpufw_hybrid_destroy(gpufw_ctx *ctx);
+
+#endif // GPUFW_INTERNAL_H
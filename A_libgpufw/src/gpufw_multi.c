@@ -0,0 +1,238 @@
+// gpufw_multi.c - split 1-D jobs across every discovered OpenCL device
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#define MULTI_ALIGN      256    /* slice boundaries stay multiples of this many elements */
+#define MULTI_EWMA_ALPHA 0.5    /* weight of the latest measurement when rebalancing */
+#define MULTI_POLL_NS    50000  /* sleep between completion polls */
+
+/* Each device gets its own gpufw_ctx (devices on different platforms cannot
+   share a cl_context), so pool, cache and profiling work per device as usual. */
+
+static double device_score(cl_device_id dev) {
+    cl_uint cu = 1, mhz = 1;
+    clGetDeviceInfo(dev, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cu), &cu, NULL);
+    clGetDeviceInfo(dev, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(mhz), &mhz, NULL);
+    if (cu == 0) cu = 1;
+    if (mhz == 0) mhz = 1;
+    return (double)cu * (double)mhz;
+}
+
+static void normalize(gpufw_multi_ctx *m) {
+    double sum = 0.0;
+    for (unsigned d = 0; d < m->count; ++d) sum += m->weight[d];
+    for (unsigned d = 0; d < m->count; ++d)
+        m->weight[d] = sum > 0.0 ? m->weight[d] / sum : 1.0 / m->count;
+}
+
+int gpufw_multi_init(gpufw_multi_ctx *m, const char *kernel_file, cl_device_type type, const gpufw_init_opts *opts) {
+    GPUFW_TRACE_CALL();
+    if (!m || !kernel_file) return -1;
+    memset(m, 0, sizeof(*m));
+    if (type == 0) type = CL_DEVICE_TYPE_ALL;
+    unsigned flags = gpufw_init_flags(opts);
+
+    const cl_platform_id *platforms = NULL;
+    cl_uint num_platforms = 0;
+    cl_int err = gpufw_platforms(&platforms, &num_platforms, NULL);
+    if (err != CL_SUCCESS || num_platforms == 0) {
+        fprintf(stderr, "gpufw_multi_init: clGetPlatformIDs found none (err=%d)\n", err);
+        return -1;
+    }
+
+    size_t src_size = 0;
+    int embedded = 0;
+    char *src = gpufw_load_kernel_source(kernel_file, &src_size, &embedded);
+    if (!src) {
+        fprintf(stderr, "gpufw_multi_init: Failed to read kernel file '%s'\n", kernel_file);
+        return -1;
+    }
+
+    /* With GPUFW_INIT_BACKGROUND_BUILD the devices build their programs in parallel */
+    for (cl_uint p = 0; p < num_platforms && m->count < GPUFW_MAX_DEVICES; ++p) {
+        const cl_device_id *devs = NULL;
+        cl_uint dev_count = 0;
+        if (gpufw_devices(platforms[p], type, &devs, &dev_count) != CL_SUCCESS) continue;
+        for (cl_uint i = 0; i < dev_count && m->count < GPUFW_MAX_DEVICES; ++i) {
+            gpufw_ctx *ctx = &m->dev[m->count];
+            memset(ctx, 0, sizeof(*ctx));
+            ctx->init_stats.embedded_source = embedded;
+            if (gpufw_init_device(ctx, platforms[p], devs[i], src, src_size, flags) != 0) {
+                fprintf(stderr, "gpufw_multi_init: skipping device %u of platform %u\n", i, p);
+                continue;
+            }
+            m->weight[m->count] = device_score(devs[i]);
+            m->count++;
+        }
+    }
+    free(src);
+
+    if (m->count == 0) {
+        fprintf(stderr, "gpufw_multi_init: no usable OpenCL device found\n");
+        return -1;
+    }
+    normalize(m);
+    return 0;
+}
+
+static cl_kernel device_kernel(gpufw_multi_ctx *m, unsigned d, const char *kernel_name) {
+    if (m->kernel[d] && strcmp(m->kernel_name, kernel_name) == 0) return m->kernel[d];
+    if (strcmp(m->kernel_name, kernel_name) != 0) {
+        for (unsigned i = 0; i < m->count; ++i)
+            if (m->kernel[i]) { clReleaseKernel(m->kernel[i]); m->kernel[i] = NULL; }
+        snprintf(m->kernel_name, sizeof(m->kernel_name), "%s", kernel_name);
+    }
+    if (gpufw_create_kernel(&m->dev[d], kernel_name, &m->kernel[d]) != 0) m->kernel[d] = NULL;
+    return m->kernel[d];
+}
+
+/* Split the element range by weight; slices are MULTI_ALIGN-aligned and the
+   last device takes the remainder. */
+static void split(const gpufw_multi_ctx *m, size_t n, size_t *off, size_t *len) {
+    size_t pos = 0;
+    for (unsigned d = 0; d < m->count; ++d) {
+        size_t want = (d + 1 == m->count) ? n - pos : (size_t)((double)n * m->weight[d]);
+        want = want / MULTI_ALIGN * MULTI_ALIGN;
+        if (want > n - pos || d + 1 == m->count) want = n - pos;
+        off[d] = pos;
+        len[d] = want;
+        pos += want;
+    }
+}
+
+int gpufw_multi_run(gpufw_multi_ctx *m, const char *kernel_name, size_t n, size_t elem_size,
+                    unsigned num_inputs, const void *const *inputs, void *output, size_t local_work_size) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("n", n);
+    if (!m || m->count == 0 || !kernel_name || !elem_size || !inputs || !output ||
+        num_inputs == 0 || num_inputs > GPUFW_STREAM_MAX_INPUTS)
+        return -1;
+    if (n == 0) return 0;
+
+    size_t off[GPUFW_MAX_DEVICES], len[GPUFW_MAX_DEVICES];
+    cl_mem in[GPUFW_MAX_DEVICES][GPUFW_STREAM_MAX_INPUTS];
+    cl_mem out[GPUFW_MAX_DEVICES];
+    cl_event done[GPUFW_MAX_DEVICES];
+    double t_done[GPUFW_MAX_DEVICES];
+    int finished[GPUFW_MAX_DEVICES];
+    memset(in, 0, sizeof(in));
+    memset(out, 0, sizeof(out));
+    memset(done, 0, sizeof(done));
+    split(m, n, off, len);
+
+    cl_int err = CL_SUCCESS;
+    double t0 = gpufw_now_ms();
+    for (unsigned d = 0; d < m->count; ++d) {
+        t_done[d] = t0;
+        finished[d] = 0;
+    }
+
+    /* Enqueue every device's slice before waiting on any of them. */
+    for (unsigned d = 0; d < m->count && err == CL_SUCCESS; ++d) {
+        if (len[d] == 0) continue;
+        gpufw_ctx *ctx = &m->dev[d];
+        cl_kernel k = device_kernel(m, d, kernel_name);
+        if (!k) { err = -1; break; }
+        size_t bytes = len[d] * elem_size;
+
+        for (unsigned i = 0; i < num_inputs && err == CL_SUCCESS; ++i) {
+            in[d][i] = gpufw_alloc_buffer(ctx, bytes, CL_MEM_READ_ONLY);
+            if (!in[d][i]) { err = -1; break; }
+            err = gpufw_write_buffer_async(ctx, in[d][i], 0, (const char *)inputs[i] + off[d] * elem_size,
+                                           bytes, 0, NULL, NULL);
+            if (err == CL_SUCCESS) err = gpufw_set_kernel_arg(ctx, k, i, sizeof(cl_mem), &in[d][i]);
+        }
+        if (err != CL_SUCCESS) break;
+        out[d] = gpufw_alloc_buffer(ctx, bytes, CL_MEM_WRITE_ONLY);
+        if (!out[d]) { err = -1; break; }
+        int n_arg = (int)len[d];
+        err = gpufw_set_kernel_arg(ctx, k, num_inputs, sizeof(cl_mem), &out[d]);
+        if (err == CL_SUCCESS) err = gpufw_set_kernel_arg(ctx, k, num_inputs + 1, sizeof(int), &n_arg);
+
+        size_t gws = local_work_size ? (len[d] + local_work_size - 1) / local_work_size * local_work_size : len[d];
+        if (err == CL_SUCCESS) err = gpufw_launch_kernel_async(ctx, k, gws, local_work_size, 0, NULL, NULL);
+        /* merge: each device reads its slice straight into place in output */
+        if (err == CL_SUCCESS)
+            err = gpufw_read_buffer_async(ctx, out[d], 0, (char *)output + off[d] * elem_size, bytes, 0, NULL, &done[d]);
+        if (err == CL_SUCCESS) gpufw_flush(ctx);
+    }
+
+    /* Poll rather than wait on one device after another, so a slice that
+       finishes while another device is still busy is timed when it finished. */
+    unsigned pending = 0;
+    for (unsigned d = 0; d < m->count; ++d) {
+        if (done[d]) ++pending;
+        else if (len[d]) gpufw_finish(&m->dev[d]);
+    }
+    while (pending > 0) {
+        unsigned seen = 0;
+        for (unsigned d = 0; d < m->count; ++d) {
+            if (!done[d] || finished[d]) continue;
+            int st = gpufw_event_query(done[d]);
+            if (st == 0) continue;
+            t_done[d] = gpufw_now_ms();
+            finished[d] = 1;
+            if (st < 0 && err == CL_SUCCESS) {
+                fprintf(stderr, "gpufw_multi_run: device %u failed (%d)\n", d, st);
+                err = st;
+            }
+            ++seen;
+        }
+        pending -= seen;
+        if (pending > 0 && seen == 0) {
+            struct timespec ts = { 0, MULTI_POLL_NS };
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    /* Rebalance: move each weight toward the device's measured throughput. */
+    if (err == CL_SUCCESS && m->count > 1) {
+        double rate[GPUFW_MAX_DEVICES], total = 0.0;
+        for (unsigned d = 0; d < m->count; ++d) {
+            double ms = t_done[d] - t0;
+            rate[d] = (len[d] > 0 && ms > 0.0) ? (double)len[d] / ms : 0.0;
+            total += rate[d];
+        }
+        if (total > 0.0) {
+            for (unsigned d = 0; d < m->count; ++d)
+                if (len[d] > 0)
+                    m->weight[d] = (1.0 - MULTI_EWMA_ALPHA) * m->weight[d] + MULTI_EWMA_ALPHA * rate[d] / total;
+            normalize(m);
+        }
+    }
+    for (unsigned d = 0; d < m->count; ++d) {
+        m->last_ms[d] = t_done[d] - t0;
+        m->last_elems[d] = len[d];
+        gpufw_event_release(done[d]);
+        for (unsigned i = 0; i < num_inputs; ++i)
+            if (in[d][i]) gpufw_release_buffer(&m->dev[d], in[d][i]);
+        if (out[d]) gpufw_release_buffer(&m->dev[d], out[d]);
+    }
+    return err;
+}
+
+void gpufw_multi_print(const gpufw_multi_ctx *m, FILE *out) {
+    if (!m || !out) return;
+    for (unsigned d = 0; d < m->count; ++d) {
+        char name[128] = "?";
+        clGetDeviceInfo(m->dev[d].device, CL_DEVICE_NAME, sizeof(name), name, NULL);
+        name[sizeof(name) - 1] = '\0';
+        fprintf(out, "device %u: %-32s weight=%.3f last_elems=%zu last_ms=%.3f\n",
+                d, name, m->weight[d], m->last_elems[d], m->last_ms[d]);
+    }
+}
+
+void gpufw_multi_cleanup(gpufw_multi_ctx *m) {
+    if (!m) return;
+    for (unsigned d = 0; d < m->count; ++d) {
+        if (m->kernel[d]) clReleaseKernel(m->kernel[d]);
+        gpufw_cleanup(&m->dev[d]);
+    }
+    memset(m, 0, sizeof(*m));
+}
@@ -0,0 +1,362 @@
+// gpufw_pool.c - recycling allocator for device buffers
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+/* Requests up to small_limit bytes are carved out of large slab buffers with
+   clCreateSubBuffer; larger ones get a buffer of their own. Either way the
+   cl_mem is rounded up to a size class and, when released to the pool, parked
+   on that class's free list instead of going back to the driver. */
+
+#define POOL_DEFAULT_SLAB   (8u << 20)
+#define POOL_MIN_CLASS      256
+#define POOL_HASH_BUCKETS   1024
+
+/* Flags the pool understands; anything touching host pointers bypasses it. */
+#define POOL_ACCESS_FLAGS   (CL_MEM_READ_WRITE | CL_MEM_WRITE_ONLY | CL_MEM_READ_ONLY)
+
+struct pool_slab {
+    cl_mem mem;
+    size_t size;
+    size_t used;            /* bump offset */
+    unsigned ncarved;       /* sub-buffers cut from this slab that still exist */
+    unsigned nlive;         /* of those, how many are handed out */
+    struct pool_slab *next;
+};
+
+struct pool_entry {
+    cl_mem mem;
+    size_t size;            /* size class */
+    cl_mem_flags flags;
+    struct pool_slab *slab; /* NULL for whole buffers */
+    struct pool_entry *next;
+};
+
+struct pool_class {
+    size_t size;
+    cl_mem_flags flags;
+    struct pool_entry *free;
+    struct pool_class *next;
+};
+
+struct gpufw_pool {
+    size_t slab_size;
+    size_t small_limit;
+    size_t align;           /* CL_DEVICE_MEM_BASE_ADDR_ALIGN in bytes */
+    size_t max_alloc;
+    cl_mem_flags host_flags;    /* CL_MEM_ALLOC_HOST_PTR when transfers map the buffers */
+    int disabled;
+    struct pool_slab *slabs;
+    struct pool_class *classes;
+    struct pool_entry *live[POOL_HASH_BUCKETS];
+    gpufw_pool_stats stats;
+};
+
+/* Size classes: powers of two split into four steps (256, 320, 384, 448, 512, ...),
+   so rounding wastes at most 25%. */
+static size_t size_class(size_t size) {
+    if (size <= POOL_MIN_CLASS) return POOL_MIN_CLASS;
+    size_t p = POOL_MIN_CLASS;
+    while (p * 2 < size) p *= 2;
+    size_t step = p / 4;
+    return (size + step - 1) / step * step;
+}
+
+static size_t align_up(size_t v, size_t a) {
+    return (v + a - 1) / a * a;
+}
+
+static unsigned live_bucket(cl_mem mem) {
+    uintptr_t p = (uintptr_t)mem;
+    return (unsigned)((p >> 4) ^ (p >> 14)) % POOL_HASH_BUCKETS;
+}
+
+static struct gpufw_pool *pool_get(gpufw_ctx *ctx) {
+    if (ctx->pool) return ctx->pool;
+    struct gpufw_pool *pool = calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+
+    cl_uint align_bits = 0;
+    cl_ulong max_alloc = 0;
+    if (clGetDeviceInfo(ctx->device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(align_bits), &align_bits, NULL) != CL_SUCCESS ||
+        align_bits < 8)
+        align_bits = 1024;
+    if (clGetDeviceInfo(ctx->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL) != CL_SUCCESS)
+        max_alloc = 0;
+    pool->align = align_bits / 8;
+    pool->max_alloc = (size_t)max_alloc;
+    pool->slab_size = POOL_DEFAULT_SLAB;
+    if (pool->max_alloc && pool->slab_size > pool->max_alloc) pool->slab_size = pool->max_alloc;
+    pool->small_limit = pool->slab_size / 8;
+    /* host-allocated buffers make the map/unmap transfers of the MAP and
+       USE_HOST modes zero-copy; sub-buffers inherit it from their slab */
+    gpufw_xfer_mode mode = gpufw_get_xfer_mode(ctx);
+    if (mode == GPUFW_XFER_MAP || mode == GPUFW_XFER_USE_HOST) pool->host_flags = CL_MEM_ALLOC_HOST_PTR;
+
+    const char *e = getenv("GPUFW_POOL");
+    pool->disabled = (e && strcmp(e, "0") == 0);
+    ctx->pool = pool;
+    return pool;
+}
+
+static struct pool_class *class_get(struct gpufw_pool *pool, size_t size, cl_mem_flags flags) {
+    for (struct pool_class *c = pool->classes; c; c = c->next)
+        if (c->size == size && c->flags == flags) return c;
+    struct pool_class *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->size = size;
+    c->flags = flags;
+    c->next = pool->classes;
+    pool->classes = c;
+    return c;
+}
+
+static void live_insert(struct gpufw_pool *pool, struct pool_entry *e) {
+    unsigned b = live_bucket(e->mem);
+    e->next = pool->live[b];
+    pool->live[b] = e;
+}
+
+static struct pool_entry *live_remove(struct gpufw_pool *pool, cl_mem mem) {
+    unsigned b = live_bucket(mem);
+    for (struct pool_entry **pp = &pool->live[b]; *pp; pp = &(*pp)->next) {
+        if ((*pp)->mem == mem) {
+            struct pool_entry *e = *pp;
+            *pp = e->next;
+            e->next = NULL;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/* Carve a sub-buffer of csize bytes from a slab with room, adding a slab if needed. */
+static cl_mem carve(gpufw_ctx *ctx, struct gpufw_pool *pool, size_t csize, cl_mem_flags flags,
+                    struct pool_slab **out_slab) {
+    cl_int err;
+    struct pool_slab *s;
+    for (s = pool->slabs; s; s = s->next)
+        if (align_up(s->used, pool->align) + csize <= s->size) break;
+
+    if (!s) {
+        s = calloc(1, sizeof(*s));
+        if (!s) return NULL;
+        s->size = pool->slab_size;
+        s->mem = clCreateBuffer(ctx->context, CL_MEM_READ_WRITE | pool->host_flags, s->size, NULL, &err);
+        if (err != CL_SUCCESS || !s->mem) {
+            fprintf(stderr, "gpufw_alloc_buffer: slab clCreateBuffer failed (%d)\n", err);
+            free(s);
+            return NULL;
+        }
+        s->next = pool->slabs;
+        pool->slabs = s;
+        pool->stats.driver_allocs++;
+        pool->stats.slabs++;
+        pool->stats.bytes_reserved += s->size;
+    }
+
+    cl_buffer_region region;
+    region.origin = align_up(s->used, pool->align);
+    region.size = csize;
+    cl_mem sub = clCreateSubBuffer(s->mem, flags, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
+    if (err != CL_SUCCESS || !sub) {
+        fprintf(stderr, "gpufw_alloc_buffer: clCreateSubBuffer failed (%d)\n", err);
+        return NULL;
+    }
+    s->used = region.origin + csize;
+    s->ncarved++;
+    pool->stats.sub_allocs++;
+    *out_slab = s;
+    return sub;
+}
+
+static cl_mem raw_alloc(gpufw_ctx *ctx, size_t size, cl_mem_flags flags) {
+    cl_int err;
+    cl_mem buf = clCreateBuffer(ctx->context, flags, size, NULL, &err);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_alloc_buffer: clCreateBuffer failed (%d)\n", err);
+        return NULL;
+    }
+    return buf;
+}
+
+static cl_mem pool_alloc(gpufw_ctx *ctx, size_t size, cl_mem_flags flags) {
+    struct gpufw_pool *pool = pool_get(ctx);
+    if (!pool || size == 0 || (flags & ~(cl_mem_flags)POOL_ACCESS_FLAGS))
+        return raw_alloc(ctx, size, flags);
+    if (pool->disabled) return raw_alloc(ctx, size, flags | pool->host_flags);
+
+    size_t csize = size_class(size);
+    if (pool->max_alloc && csize > pool->max_alloc) csize = size;
+    struct pool_class *cls = class_get(pool, csize, flags);
+    if (!cls) return raw_alloc(ctx, size, flags | pool->host_flags);
+    pool->stats.allocs++;
+
+    struct pool_entry *e = cls->free;
+    if (e) {
+        cls->free = e->next;
+        pool->stats.hits++;
+        pool->stats.bytes_cached -= e->size;
+    } else {
+        e = calloc(1, sizeof(*e));
+        if (!e) return NULL;
+        e->size = csize;
+        e->flags = flags;
+        if (csize <= pool->small_limit) {
+            e->mem = carve(ctx, pool, csize, flags, &e->slab);
+        } else {
+            e->mem = raw_alloc(ctx, csize, flags | pool->host_flags);
+            if (e->mem) pool->stats.driver_allocs++;
+        }
+        if (!e->mem) { free(e); return NULL; }
+    }
+    if (e->slab) e->slab->nlive++;
+    pool->stats.bytes_in_use += e->size;
+    live_insert(pool, e);
+    return e->mem;
+}
+
+/* Pooled allocation behind gpufw_alloc_buffer. */
+cl_mem gpufw_pool_alloc(gpufw_ctx *ctx, size_t size, cl_mem_flags flags) {
+    gpufw_lock(ctx);
+    cl_mem mem = pool_alloc(ctx, size, flags);
+    gpufw_unlock(ctx);
+    return mem;
+}
+
+static int pool_release(gpufw_ctx *ctx, cl_mem buf) {
+    struct gpufw_pool *pool = ctx->pool;
+    struct pool_entry *e = pool ? live_remove(pool, buf) : NULL;
+    if (!e) {
+        /* not from the pool (or pooling disabled): hand it straight back */
+        return clReleaseMemObject(buf);
+    }
+    struct pool_class *cls = class_get(pool, e->size, e->flags);
+    if (!cls) {
+        if (e->slab) { e->slab->nlive--; e->slab->ncarved--; }
+        clReleaseMemObject(e->mem);
+        pool->stats.bytes_in_use -= e->size;
+        free(e);
+        return 0;
+    }
+    if (e->slab) e->slab->nlive--;
+    e->next = cls->free;
+    cls->free = e;
+    pool->stats.frees++;
+    pool->stats.bytes_in_use -= e->size;
+    pool->stats.bytes_cached += e->size;
+    return 0;
+}
+
+int gpufw_release_buffer(gpufw_ctx *ctx, cl_mem buf) {
+    GPUFW_TRACE_CALL();
+    if (!ctx || !buf) return -1;
+    gpufw_lock(ctx);
+    int err = pool_release(ctx, buf);
+    gpufw_unlock(ctx);
+    return err;
+}
+
+/* Give cached buffers back to the driver. Sub-buffers are only dropped when
+   their whole slab is idle, since a slab's space cannot be reused piecemeal. */
+void gpufw_pool_trim(gpufw_ctx *ctx) {
+    if (!ctx || !ctx->pool) return;
+    struct gpufw_pool *pool = ctx->pool;
+    gpufw_lock(ctx);
+
+    for (struct pool_class *c = pool->classes; c; c = c->next) {
+        struct pool_entry **pp = &c->free;
+        while (*pp) {
+            struct pool_entry *e = *pp;
+            if (e->slab && e->slab->nlive > 0) { pp = &e->next; continue; }
+            *pp = e->next;
+            clReleaseMemObject(e->mem);
+            pool->stats.bytes_cached -= e->size;
+            if (e->slab) {
+                e->slab->ncarved--;
+            } else {
+                pool->stats.driver_frees++;
+            }
+            free(e);
+        }
+    }
+
+    struct pool_slab **sp = &pool->slabs;
+    while (*sp) {
+        struct pool_slab *s = *sp;
+        if (s->ncarved > 0) { sp = &s->next; continue; }
+        *sp = s->next;
+        clReleaseMemObject(s->mem);
+        pool->stats.driver_frees++;
+        pool->stats.slabs--;
+        pool->stats.bytes_reserved -= s->size;
+        free(s);
+    }
+    gpufw_unlock(ctx);
+}
+
+int gpufw_pool_configure(gpufw_ctx *ctx, size_t slab_size, size_t small_limit) {
+    if (!ctx || !ctx->context) return -1;
+    gpufw_lock(ctx);
+    struct gpufw_pool *pool = pool_get(ctx);
+    if (!pool) {
+        gpufw_unlock(ctx);
+        return -1;
+    }
+    if (slab_size) {
+        if (pool->max_alloc && slab_size > pool->max_alloc) slab_size = pool->max_alloc;
+        pool->slab_size = slab_size;
+    }
+    pool->small_limit = small_limit ? small_limit : pool->slab_size / 8;
+    if (pool->small_limit > pool->slab_size) pool->small_limit = pool->slab_size;
+    gpufw_unlock(ctx);
+    return 0;
+}
+
+void gpufw_pool_get_stats(const gpufw_ctx *ctx, gpufw_pool_stats *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!ctx || !ctx->pool) return;
+    gpufw_lock(ctx);
+    *out = ctx->pool->stats;
+    gpufw_unlock(ctx);
+}
+
+/* Called from gpufw_cleanup. Buffers still handed out belong to the caller and
+   are not released here; an outstanding sub-buffer keeps its slab alive. */
+void gpufw_pool_destroy(gpufw_ctx *ctx) {
+    if (!ctx || !ctx->pool) return;
+    struct gpufw_pool *pool = ctx->pool;
+
+    for (unsigned b = 0; b < POOL_HASH_BUCKETS; ++b) {
+        while (pool->live[b]) {
+            struct pool_entry *e = pool->live[b];
+            pool->live[b] = e->next;
+            free(e);
+        }
+    }
+    while (pool->classes) {
+        struct pool_class *c = pool->classes;
+        pool->classes = c->next;
+        while (c->free) {
+            struct pool_entry *e = c->free;
+            c->free = e->next;
+            clReleaseMemObject(e->mem);
+            free(e);
+        }
+        free(c);
+    }
+    while (pool->slabs) {
+        struct pool_slab *s = pool->slabs;
+        pool->slabs = s->next;
+        clReleaseMemObject(s->mem);
+        free(s);
+    }
+    free(pool);
+    ctx->pool = NULL;
+}
@@ -0,0 +1,268 @@
+// gpufw_profile.c - per-command OpenCL profiling records and per-kernel summaries
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+/* Events are retained when the command is enqueued and only read back in
+   gpufw_profile_collect, so tracking never adds a host sync to the hot path. */
+#define PROF_PENDING_MAX 4096
+#define PROF_OFFSET_MIN_SAMPLES 16     /* smaller batches only lower the trace clock offset */
+
+struct prof_pending {
+    cl_event ev;
+    gpufw_op_kind kind;
+    size_t bytes;
+    char name[GPUFW_PROF_NAME_LEN];
+    uint64_t host_ns;           /* tracing: host clock right after the enqueue, else 0 */
+    uint64_t flow;
+    cl_command_queue queue;
+    int recorded;               /* collect: index of the record, -1 if none */
+};
+
+struct gpufw_prof {
+    struct prof_pending *pending;
+    size_t npending;
+    gpufw_prof_record *records;
+    size_t nrecords, cap;
+    int64_t clock_offset;       /* tracing: host ns - device ns */
+    int have_offset;
+};
+
+static const char *kind_names[] = { "write", "read", "kernel", "copy", "map", "unmap" };
+
+const char *gpufw_op_kind_name(gpufw_op_kind kind) {
+    if ((unsigned)kind >= sizeof(kind_names) / sizeof(kind_names[0])) return "?";
+    return kind_names[kind];
+}
+
+int gpufw_prof_enable(gpufw_ctx *ctx) {
+    if (ctx->prof) return 0;
+    ctx->prof = calloc(1, sizeof(*ctx->prof));
+    if (!ctx->prof) return -1;
+    ctx->prof->pending = calloc(PROF_PENDING_MAX, sizeof(struct prof_pending));
+    if (!ctx->prof->pending) { free(ctx->prof); ctx->prof = NULL; return -1; }
+    return 0;
+}
+
+static int push_record(struct gpufw_prof *p, const gpufw_prof_record *r) {
+    if (p->nrecords == p->cap) {
+        size_t cap = p->cap ? p->cap * 2 : 256;
+        gpufw_prof_record *nr = realloc(p->records, cap * sizeof(*nr));
+        if (!nr) return -1;
+        p->records = nr;
+        p->cap = cap;
+    }
+    p->records[p->nrecords++] = *r;
+    return 0;
+}
+
+void gpufw_prof_track(gpufw_ctx *ctx, gpufw_op_kind kind, const char *name, size_t bytes, cl_event ev) {
+    struct gpufw_prof *p = ctx ? ctx->prof : NULL;
+    if (!p || !ev) return;
+    gpufw_lock(ctx);
+    if (p->npending == PROF_PENDING_MAX) gpufw_profile_collect(ctx);
+    struct prof_pending *pe = &p->pending[p->npending++];
+    clRetainEvent(ev);
+    pe->ev = ev;
+    pe->kind = kind;
+    pe->bytes = bytes;
+    snprintf(pe->name, sizeof(pe->name), "%s", name ? name : gpufw_op_kind_name(kind));
+    pe->host_ns = 0;
+    pe->flow = 0;
+    if (gpufw_tracing()) {
+        pe->host_ns = gpufw_trace_now_ns();
+        pe->flow = gpufw_trace_flow_begin();
+    }
+    gpufw_unlock(ctx);
+}
+
+void gpufw_prof_track_kernel(gpufw_ctx *ctx, cl_kernel kernel, size_t global_work_size, cl_event ev) {
+    if (!ctx || !ctx->prof || !ev) return;
+    char name[GPUFW_PROF_NAME_LEN] = "kernel";
+    if (clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, sizeof(name), name, NULL) != CL_SUCCESS)
+        strcpy(name, "kernel");
+    name[sizeof(name) - 1] = '\0';
+    gpufw_prof_track(ctx, GPUFW_OP_KERNEL, name, global_work_size, ev);
+}
+
+/* QUEUED is stamped inside the enqueue call and host_ns right after it, so
+   host_ns - QUEUED overestimates the clock offset by the time the call took
+   to return; the smallest difference is the estimate. It is taken afresh for
+   every collected batch so drift between the device timer and the host
+   clock does not build up; a batch with few samples can only lower it. */
+static void trace_commands(gpufw_ctx *ctx, struct gpufw_prof *p) {
+    int64_t best = 0;
+    size_t samples = 0;
+    for (size_t i = 0; i < p->npending; ++i) {
+        const struct prof_pending *pe = &p->pending[i];
+        if (pe->recorded < 0 || !pe->host_ns) continue;
+        int64_t off = (int64_t)pe->host_ns - (int64_t)p->records[pe->recorded].queued;
+        if (samples++ == 0 || off < best) best = off;
+    }
+    if (samples && (!p->have_offset || samples >= PROF_OFFSET_MIN_SAMPLES || best < p->clock_offset))
+        p->clock_offset = best;
+    p->have_offset |= samples > 0;
+    if (!p->have_offset) return;
+    for (size_t i = 0; i < p->npending; ++i) {
+        const struct prof_pending *pe = &p->pending[i];
+        if (pe->recorded < 0) continue;
+        const gpufw_prof_record *r = &p->records[pe->recorded];
+        gpufw_trace_device(ctx->device, pe->queue, r->name, r->kind == GPUFW_OP_KERNEL ? "items" : "bytes", r->bytes,
+                           (uint64_t)((int64_t)r->start + p->clock_offset),
+                           (uint64_t)((int64_t)r->end + p->clock_offset), pe->flow);
+    }
+}
+
+int gpufw_profile_collect(gpufw_ctx *ctx) {
+    struct gpufw_prof *p = ctx ? ctx->prof : NULL;
+    if (!p) return -1;
+    int rc = 0;
+    gpufw_lock(ctx);
+    int tracing = gpufw_tracing();
+    for (size_t i = 0; i < p->npending; ++i) {
+        struct prof_pending *pe = &p->pending[i];
+        pe->recorded = -1;
+        gpufw_prof_record r;
+        memset(&r, 0, sizeof(r));
+        r.kind = pe->kind;
+        r.bytes = pe->bytes;
+        memcpy(r.name, pe->name, sizeof(r.name));
+        cl_int err = clWaitForEvents(1, &pe->ev);
+        if (err == CL_SUCCESS) err = clGetEventProfilingInfo(pe->ev, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &r.queued, NULL);
+        if (err == CL_SUCCESS) err = clGetEventProfilingInfo(pe->ev, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &r.submit, NULL);
+        if (err == CL_SUCCESS) err = clGetEventProfilingInfo(pe->ev, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &r.start, NULL);
+        if (err == CL_SUCCESS) err = clGetEventProfilingInfo(pe->ev, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &r.end, NULL);
+        if (tracing && clGetEventInfo(pe->ev, CL_EVENT_COMMAND_QUEUE, sizeof(pe->queue), &pe->queue, NULL) != CL_SUCCESS)
+            pe->queue = ctx->queue;
+        clReleaseEvent(pe->ev);
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "gpufw_profile_collect: profiling info for '%s' unavailable (%d)\n", pe->name, err);
+            rc = err;
+            continue;
+        }
+        if (push_record(p, &r) != 0) rc = -1;
+        else pe->recorded = (int)(p->nrecords - 1);
+    }
+    if (tracing) trace_commands(ctx, p);
+    p->npending = 0;
+    gpufw_unlock(ctx);
+    return rc;
+}
+
+const gpufw_prof_record *gpufw_profile_records(gpufw_ctx *ctx, size_t *count) {
+    if (count) *count = 0;
+    if (!ctx || !ctx->prof) return NULL;
+    gpufw_lock(ctx);
+    gpufw_profile_collect(ctx);
+    if (count) *count = ctx->prof->nrecords;
+    gpufw_unlock(ctx);
+    return ctx->prof->records;
+}
+
+void gpufw_profile_reset(gpufw_ctx *ctx) {
+    if (!ctx || !ctx->prof) return;
+    gpufw_lock(ctx);
+    gpufw_profile_collect(ctx);
+    ctx->prof->nrecords = 0;
+    gpufw_unlock(ctx);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile over an ascending array. */
+static double percentile(const double *v, size_t n, double pct) {
+    if (n == 0) return 0.0;
+    size_t rank = (size_t)(pct / 100.0 * (double)n + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    return v[rank - 1];
+}
+
+static int summarize(gpufw_ctx *ctx, gpufw_prof_summary **out, size_t *count) {
+    size_t nrec = 0;
+    const gpufw_prof_record *rec = gpufw_profile_records(ctx, &nrec);
+    if (!rec || nrec == 0) return 0;
+
+    gpufw_prof_summary *sum = calloc(nrec, sizeof(*sum));
+    double *dur = malloc(nrec * sizeof(double));
+    char *done = calloc(nrec, 1);
+    if (!sum || !dur || !done) { free(sum); free(dur); free(done); return -1; }
+
+    size_t ns = 0;
+    for (size_t i = 0; i < nrec; ++i) {
+        if (done[i]) continue;
+        gpufw_prof_summary *s = &sum[ns++];
+        memcpy(s->name, rec[i].name, sizeof(s->name));
+        s->kind = rec[i].kind;
+        size_t nd = 0;
+        double overhead = 0.0;
+        for (size_t j = i; j < nrec; ++j) {
+            if (done[j] || rec[j].kind != rec[i].kind || strcmp(rec[j].name, rec[i].name) != 0) continue;
+            done[j] = 1;
+            dur[nd++] = (double)(rec[j].end - rec[j].start) / 1e6;
+            overhead += (double)(rec[j].start - rec[j].queued) / 1e6;
+            s->bytes += rec[j].bytes;
+        }
+        qsort(dur, nd, sizeof(double), cmp_double);
+        s->count = nd;
+        for (size_t k = 0; k < nd; ++k) s->total_ms += dur[k];
+        s->min_ms = dur[0];
+        s->max_ms = dur[nd - 1];
+        s->mean_ms = s->total_ms / (double)nd;
+        s->p50_ms = percentile(dur, nd, 50.0);
+        s->p95_ms = percentile(dur, nd, 95.0);
+        s->p99_ms = percentile(dur, nd, 99.0);
+        s->queue_ms = overhead / (double)nd;
+    }
+    free(dur);
+    free(done);
+    *out = sum;
+    *count = ns;
+    return 0;
+}
+
+/* Records stay put while summarizing, so other threads' tracking waits. */
+int gpufw_profile_summarize(gpufw_ctx *ctx, gpufw_prof_summary **out, size_t *count) {
+    if (!out || !count) return -1;
+    *out = NULL;
+    *count = 0;
+    if (!ctx) return 0;
+    gpufw_lock(ctx);
+    int err = summarize(ctx, out, count);
+    gpufw_unlock(ctx);
+    return err;
+}
+
+void gpufw_profile_print(gpufw_ctx *ctx, FILE *out) {
+    if (!ctx || !ctx->prof || !out) return;
+    gpufw_prof_summary *sum = NULL;
+    size_t n = 0;
+    if (gpufw_profile_summarize(ctx, &sum, &n) != 0) return;
+    fprintf(out, "%-6s %-24s %7s %10s %10s %10s %10s %10s %10s %10s\n",
+            "op", "name", "count", "total_ms", "min_ms", "p50_ms", "p95_ms", "p99_ms", "max_ms", "queue_ms");
+    for (size_t i = 0; i < n; ++i) {
+        const gpufw_prof_summary *s = &sum[i];
+        fprintf(out, "%-6s %-24s %7lu %10.4f %10.4f %10.4f %10.4f %10.4f %10.4f %10.4f\n",
+                gpufw_op_kind_name(s->kind), s->name, s->count, s->total_ms, s->min_ms, s->p50_ms,
+                s->p95_ms, s->p99_ms, s->max_ms, s->queue_ms);
+    }
+    free(sum);
+}
+
+void gpufw_prof_destroy(gpufw_ctx *ctx) {
+    struct gpufw_prof *p = ctx ? ctx->prof : NULL;
+    if (!p) return;
+    if (gpufw_tracing()) gpufw_profile_collect(ctx);     /* device commands still pending go into the trace */
+    for (size_t i = 0; i < p->npending; ++i) clReleaseEvent(p->pending[i].ev);
+    free(p->pending);
+    free(p->records);
+    free(p);
+    ctx->prof = NULL;
+}
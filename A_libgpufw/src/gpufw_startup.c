@@ -0,0 +1,259 @@
+// gpufw_startup.c - cached device discovery, embedded kernel sources and deferred program builds
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#define DISCOVER_MAX_LISTS 32   /* (platform, device type) lists kept */
+
+/* Platform and device lists do not change while a process runs, so they are
+   enumerated once: a second context, the multi-device init and every
+   gpudrv job after the first skip the ICD round trips. Failed platform
+   enumerations are not cached and get retried. */
+struct device_list {
+    cl_platform_id platform;
+    cl_device_type type;
+    cl_device_id *devs;
+    cl_uint count;
+};
+
+static struct {
+    pthread_mutex_t mu;
+    cl_platform_id *platforms;
+    cl_uint nplatforms;
+    struct device_list lists[DISCOVER_MAX_LISTS];
+    unsigned nlists;
+} disc = { PTHREAD_MUTEX_INITIALIZER, NULL, 0, { { NULL, 0, NULL, 0 } }, 0 };
+
+cl_int gpufw_platforms(const cl_platform_id **platforms, cl_uint *count, int *cached) {
+    cl_int err = CL_SUCCESS;
+    pthread_mutex_lock(&disc.mu);
+    if (cached) *cached = disc.platforms != NULL;
+    if (!disc.platforms) {
+        cl_uint n = 0;
+        err = clGetPlatformIDs(0, NULL, &n);
+        cl_platform_id *p = err == CL_SUCCESS && n ? malloc(sizeof(cl_platform_id) * n) : NULL;
+        if (p && (err = clGetPlatformIDs(n, p, NULL)) == CL_SUCCESS) {
+            disc.platforms = p;
+            disc.nplatforms = n;
+        } else {
+            free(p);
+        }
+    }
+    *platforms = disc.platforms;
+    *count = disc.nplatforms;
+    pthread_mutex_unlock(&disc.mu);
+    return err;
+}
+
+cl_int gpufw_devices(cl_platform_id platform, cl_device_type type, const cl_device_id **devices, cl_uint *count) {
+    cl_int err = CL_SUCCESS;
+    *devices = NULL;
+    *count = 0;
+    pthread_mutex_lock(&disc.mu);
+    for (unsigned i = 0; i < disc.nlists; ++i) {
+        if (disc.lists[i].platform == platform && disc.lists[i].type == type) {
+            *devices = disc.lists[i].devs;
+            *count = disc.lists[i].count;
+            pthread_mutex_unlock(&disc.mu);
+            return CL_SUCCESS;
+        }
+    }
+    cl_uint n = 0;
+    cl_device_id *devs = NULL;
+    err = clGetDeviceIDs(platform, type, 0, NULL, &n);
+    if (err == CL_SUCCESS && n > 0) {
+        if (!(devs = malloc(sizeof(cl_device_id) * n))) err = CL_OUT_OF_HOST_MEMORY;
+        else err = clGetDeviceIDs(platform, type, n, devs, NULL);
+    }
+    if (err == CL_DEVICE_NOT_FOUND) {
+        err = CL_SUCCESS;
+        n = 0;
+    }
+    if (err != CL_SUCCESS) {
+        free(devs);
+        pthread_mutex_unlock(&disc.mu);
+        return err;
+    }
+    /* past DISCOVER_MAX_LISTS pairs lists are handed out uncached (and never freed) */
+    if (disc.nlists < DISCOVER_MAX_LISTS) {
+        struct device_list *l = &disc.lists[disc.nlists++];
+        l->platform = platform;
+        l->type = type;
+        l->devs = devs;
+        l->count = n;
+    }
+    *devices = devs;
+    *count = n;
+    pthread_mutex_unlock(&disc.mu);
+    return CL_SUCCESS;
+}
+
+/* ---- kernel sources ---- */
+
+const char *gpufw_embedded_source(const char *name, size_t *length) {
+    if (!name) return NULL;
+    const char *slash = strrchr(name, '/');
+    const char *base = slash ? slash + 1 : name;
+    size_t blen = strlen(base);
+    for (const gpufw_embedded_kernel *k = gpufw_embedded_kernels; k->name; ++k) {
+        /* "vecadd.cl", or "vecadd" without the extension */
+        if (strcmp(k->name, base) == 0 || (strncmp(k->name, base, blen) == 0 && strcmp(k->name + blen, ".cl") == 0)) {
+            if (length) *length = strlen(k->src);
+            return k->src;
+        }
+    }
+    return NULL;
+}
+
+char *gpufw_load_kernel_source(const char *kernel_file, size_t *length, int *embedded) {
+    int only_embedded = strncmp(kernel_file, "embed:", 6) == 0;
+    const char *name = only_embedded ? kernel_file + 6 : kernel_file;
+    const char *env = getenv("GPUFW_EMBEDDED");
+    int prefer = only_embedded || (env && strcmp(env, "0") != 0);
+    size_t len = 0;
+    const char *builtin = gpufw_embedded_source(name, &len);
+    *embedded = 0;
+    if (only_embedded && !builtin) {
+        fprintf(stderr, "gpufw_init: no embedded kernel source '%s'\n", name);
+        return NULL;
+    }
+    if (!builtin || (!prefer && access(kernel_file, R_OK) == 0))
+        return gpufw_read_kernel_source(kernel_file, length);
+
+    char *copy = malloc(len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, builtin, len + 1);
+    *length = len;
+    *embedded = 1;
+    return copy;
+}
+
+/* ---- deferred program build ---- */
+
+gpufw_build_mode gpufw_build_mode_of(unsigned flags) {
+    if (flags & GPUFW_INIT_BACKGROUND_BUILD) return GPUFW_BUILD_BACKGROUND;
+    if (flags & GPUFW_INIT_LAZY_BUILD) return GPUFW_BUILD_LAZY;
+    return GPUFW_BUILD_EAGER;
+}
+
+/* The build runs against a shadow context holding only the device handles,
+   so a background build never touches ctx while the owner uses it; its
+   cache counters are folded into ctx when the program is collected. */
+struct gpufw_startup {
+    pthread_mutex_t mu;
+    pthread_t thread;
+    int started;                /* build thread running or not yet joined */
+    int done;                   /* program collected into ctx */
+    char *src;
+    size_t src_len;
+    gpufw_ctx shadow;
+    cl_program program;
+    cl_int err;
+    double build_ms;
+};
+
+static void *build_main(void *arg) {
+    struct gpufw_startup *st = arg;
+    double t0 = gpufw_now_ms();
+    st->err = gpufw_build_program(&st->shadow, st->src, st->src_len, NULL, &st->program);
+    st->build_ms = gpufw_now_ms() - t0;
+    if (st->err != CL_SUCCESS) st->program = NULL;
+    return NULL;
+}
+
+static void *build_thread(void *arg) {
+    gpufw_trace_thread_name("gpufw build");
+    return build_main(arg);
+}
+
+int gpufw_startup_defer(gpufw_ctx *ctx, const char *src, size_t src_len, int background) {
+    struct gpufw_startup *st = calloc(1, sizeof(*st));
+    if (!st) return -1;
+    if (!(st->src = malloc(src_len + 1)) || pthread_mutex_init(&st->mu, NULL) != 0) {
+        free(st->src);
+        free(st);
+        return -1;
+    }
+    memcpy(st->src, src, src_len);
+    st->src[src_len] = '\0';
+    st->src_len = src_len;
+    st->shadow.platform = ctx->platform;
+    st->shadow.device = ctx->device;
+    st->shadow.context = ctx->context;
+    if (background && pthread_create(&st->thread, NULL, build_thread, st) == 0) st->started = 1;
+    else if (background) ctx->init_stats.build_mode = GPUFW_BUILD_LAZY;    /* no thread: build on first use */
+    ctx->startup = st;
+    return 0;
+}
+
+cl_program gpufw_program(gpufw_ctx *ctx) {
+    if (!ctx) return NULL;
+    struct gpufw_startup *st = ctx->startup;
+    if (!st) return ctx->program;
+    pthread_mutex_lock(&st->mu);
+    if (!st->done) {
+        GPUFW_TRACE_SCOPE("gpufw", "gpufw_program wait");
+        double t0 = gpufw_now_ms();
+        if (st->started) pthread_join(st->thread, NULL);
+        else build_main(st);
+        st->started = 0;
+        ctx->init_stats.wait_ms += gpufw_now_ms() - t0;
+        ctx->init_stats.build_ms = st->build_ms;
+
+        gpufw_lock(ctx);
+        gpufw_cache_stats *c = &ctx->cache_stats;
+        const gpufw_cache_stats *s = &st->shadow.cache_stats;
+        c->hits += s->hits;
+        c->misses += s->misses;
+        c->rejected += s->rejected;
+        c->stores += s->stores;
+        c->build_ms += s->build_ms;
+        c->load_ms += s->load_ms;
+        c->saved_ms += s->saved_ms;
+        gpufw_unlock(ctx);
+
+        ctx->program = st->program;
+        free(st->src);
+        st->src = NULL;
+        st->done = 1;
+        if (!ctx->program) fprintf(stderr, "gpufw_program: deferred program build failed (%d)\n", st->err);
+    }
+    cl_program program = ctx->program;
+    pthread_mutex_unlock(&st->mu);
+    return program;
+}
+
+void gpufw_startup_destroy(gpufw_ctx *ctx) {
+    struct gpufw_startup *st = ctx ? ctx->startup : NULL;
+    if (!st) return;
+    /* a running build is collected so cleanup can release its program; a
+       lazy build nobody asked for is simply dropped */
+    if (st->started) gpufw_program(ctx);
+    pthread_mutex_destroy(&st->mu);
+    free(st->src);
+    free(st);
+    ctx->startup = NULL;
+}
+
+void gpufw_init_print_stats(const gpufw_ctx *ctx, FILE *out) {
+    if (!ctx || !out) return;
+    static const char *modes[] = { "eager", "lazy", "background" };
+    const gpufw_init_stats *s = &ctx->init_stats;
+    int pending = 0;
+    if (ctx->startup) {
+        pthread_mutex_lock(&ctx->startup->mu);
+        pending = !ctx->startup->done;
+        pthread_mutex_unlock(&ctx->startup->mu);
+    }
+    fprintf(out, "Init: total_ms=%.3f discover_ms=%.3f%s source_ms=%.3f%s context_ms=%.3f queue_ms=%.3f "
+            "build_ms=%.3f (%s%s) setup_ms=%.3f wait_ms=%.3f\n",
+            s->total_ms, s->discover_ms, s->discovery_cached ? " (cached)" : "", s->source_ms,
+            s->embedded_source ? " (embedded)" : "", s->context_ms, s->queue_ms, s->build_ms,
+            modes[s->build_mode], pending ? ", pending" : "", s->setup_ms, s->wait_ms);
+}
@@ -0,0 +1,212 @@
+// gpufw_stream.c - chunked, pipelined execution of 1-D elementwise kernels
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#define STREAM_DEFAULT_CHUNK  (1u << 20)    /* elements */
+#define STREAM_DEFAULT_DEPTH  3
+
+/* Extra queues used by the streaming path; created on first use and kept
+   for the life of the context. */
+struct gpufw_stream {
+    cl_command_queue up;        /* host -> device */
+    cl_command_queue down;      /* device -> host */
+    cl_command_queue ooo;       /* single out-of-order queue, when requested */
+};
+
+static cl_command_queue make_queue(gpufw_ctx *ctx, cl_command_queue_properties extra) {
+    cl_int err;
+    cl_queue_properties props[] = { CL_QUEUE_PROPERTIES, extra | (ctx->prof ? CL_QUEUE_PROFILING_ENABLE : 0), 0 };
+    cl_command_queue q = clCreateCommandQueueWithProperties(ctx->context, ctx->device, props, &err);
+    if (err != CL_SUCCESS) return NULL;
+    return q;
+}
+
+static struct gpufw_stream *stream_get(gpufw_ctx *ctx) {
+    if (!ctx->stream) ctx->stream = calloc(1, sizeof(*ctx->stream));
+    return ctx->stream;
+}
+
+void gpufw_stream_destroy(gpufw_ctx *ctx) {
+    struct gpufw_stream *st = ctx ? ctx->stream : NULL;
+    if (!st) return;
+    if (st->up)   clReleaseCommandQueue(st->up);
+    if (st->down) clReleaseCommandQueue(st->down);
+    if (st->ooo)  clReleaseCommandQueue(st->ooo);
+    free(st);
+    ctx->stream = NULL;
+}
+
+/* Resolve the upload/compute/download queues for the requested layout.
+   Falls back to fewer queues if the device refuses to create more. */
+static int pick_queues(gpufw_ctx *ctx, unsigned nqueues, cl_command_queue q[3]) {
+    struct gpufw_stream *st = stream_get(ctx);
+    if (!st) return -1;
+    q[0] = q[1] = q[2] = gpufw_queue(ctx);
+    if (nqueues == 1) {
+        if (!st->ooo) st->ooo = make_queue(ctx, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE);
+        if (st->ooo) q[0] = q[1] = q[2] = st->ooo;
+        return 0;
+    }
+    if (!st->up) st->up = make_queue(ctx, 0);
+    if (st->up) q[0] = st->up;
+    if (nqueues >= 3) {
+        if (!st->down) st->down = make_queue(ctx, 0);
+        q[2] = st->down ? st->down : q[0];
+    } else {
+        q[2] = q[0];
+    }
+    return 0;
+}
+
+static void release_ev(cl_event *ev) {
+    if (*ev) { clReleaseEvent(*ev); *ev = NULL; }
+}
+
+/* Enqueue the input copies for chunk i into one slot's buffers. */
+static cl_int upload_chunk(gpufw_ctx *ctx, cl_command_queue q, size_t i, size_t chunk, size_t n, size_t elem_size,
+                           unsigned num_inputs, const void *const *inputs, cl_mem *in, cl_event *up_ev, cl_event run_ev) {
+    size_t off = i * chunk;
+    size_t bytes = (n - off < chunk ? n - off : chunk) * elem_size;
+    for (unsigned k = 0; k < num_inputs; ++k) {
+        cl_event ev;
+        const char *src = (const char *)inputs[k] + off * elem_size;
+        cl_int err = clEnqueueWriteBuffer(q, in[k], CL_FALSE, 0, bytes, src,
+                                          run_ev ? 1 : 0, run_ev ? &run_ev : NULL, &ev);
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "gpufw_stream_run: upload of chunk %zu failed (%d)\n", i, err);
+            return err;
+        }
+        gpufw_prof_track(ctx, GPUFW_OP_WRITE, "write(stream)", bytes, ev);
+        release_ev(&up_ev[k]);
+        up_ev[k] = ev;
+    }
+    return CL_SUCCESS;
+}
+
+int gpufw_stream_run(gpufw_ctx *ctx, cl_kernel kernel, size_t n, size_t elem_size,
+                     unsigned num_inputs, const void *const *inputs, void *output,
+                     const gpufw_stream_opts *opts) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("n", n);
+    if (!ctx || !ctx->queue || !kernel || !elem_size || !inputs || !output ||
+        num_inputs == 0 || num_inputs > GPUFW_STREAM_MAX_INPUTS)
+        return -1;
+    if (n == 0) return 0;
+
+    size_t chunk = (opts && opts->chunk_elems) ? opts->chunk_elems : STREAM_DEFAULT_CHUNK;
+    unsigned depth = (opts && opts->depth) ? opts->depth : STREAM_DEFAULT_DEPTH;
+    unsigned nqueues = (opts && opts->num_queues) ? opts->num_queues : 3;
+    size_t lws = opts ? opts->local_work_size : 0;
+    if (depth < 2) depth = 2;
+    if (depth > GPUFW_STREAM_MAX_DEPTH) depth = GPUFW_STREAM_MAX_DEPTH;
+    if (chunk > n) chunk = n;
+
+    /* The copy queues are shared by the context's threads, so runs take turns. */
+    gpufw_stream_lock(ctx, 1);
+    cl_command_queue q[3];
+    if (pick_queues(ctx, nqueues, q) != 0) {
+        gpufw_stream_lock(ctx, 0);
+        return -1;
+    }
+
+    cl_mem in[GPUFW_STREAM_MAX_DEPTH][GPUFW_STREAM_MAX_INPUTS];
+    cl_mem out[GPUFW_STREAM_MAX_DEPTH];
+    cl_event up_ev[GPUFW_STREAM_MAX_DEPTH][GPUFW_STREAM_MAX_INPUTS];
+    cl_event run_ev[GPUFW_STREAM_MAX_DEPTH], down_ev[GPUFW_STREAM_MAX_DEPTH];
+    memset(in, 0, sizeof(in));
+    memset(out, 0, sizeof(out));
+    memset(up_ev, 0, sizeof(up_ev));
+    memset(run_ev, 0, sizeof(run_ev));
+    memset(down_ev, 0, sizeof(down_ev));
+
+    cl_int err = CL_SUCCESS;
+    size_t chunk_bytes = chunk * elem_size;
+    for (unsigned s = 0; s < depth && err == CL_SUCCESS; ++s) {
+        for (unsigned k = 0; k < num_inputs; ++k)
+            if (!(in[s][k] = gpufw_alloc_buffer(ctx, chunk_bytes, CL_MEM_READ_ONLY))) err = -1;
+        if (!(out[s] = gpufw_alloc_buffer(ctx, chunk_bytes, CL_MEM_WRITE_ONLY))) err = -1;
+    }
+
+    /* Slot s = i % depth holds chunk i. Upload i waits for the kernel of chunk
+       i - depth (same input buffers); the kernel waits for its uploads and for
+       the download of chunk i - depth (same output buffer). Uploads run one
+       chunk ahead so that, even when copies share a queue, upload i+1 is
+       queued before download i. */
+    size_t nchunks = (n + chunk - 1) / chunk;
+    if (err == CL_SUCCESS)
+        err = upload_chunk(ctx, q[0], 0, chunk, n, elem_size, num_inputs, inputs, in[0], up_ev[0], run_ev[0]);
+    for (size_t i = 0; i < nchunks && err == CL_SUCCESS; ++i) {
+        unsigned s = (unsigned)(i % depth);
+        size_t off = i * chunk;
+        size_t len = n - off < chunk ? n - off : chunk;
+        size_t bytes = len * elem_size;
+        cl_event ev;
+
+        if (i + 1 < nchunks) {
+            unsigned ns = (unsigned)((i + 1) % depth);
+            err = upload_chunk(ctx, q[0], i + 1, chunk, n, elem_size, num_inputs, inputs, in[ns], up_ev[ns], run_ev[ns]);
+            if (err != CL_SUCCESS) break;
+        }
+
+        cl_event wait[GPUFW_STREAM_MAX_INPUTS + 1];
+        cl_uint nwait = 0;
+        for (unsigned k = 0; k < num_inputs; ++k) wait[nwait++] = up_ev[s][k];
+        if (down_ev[s]) wait[nwait++] = down_ev[s];
+
+        int len_arg = (int)len;
+        for (unsigned k = 0; k < num_inputs && err == CL_SUCCESS; ++k)
+            err = clSetKernelArg(kernel, k, sizeof(cl_mem), &in[s][k]);
+        if (err == CL_SUCCESS) err = clSetKernelArg(kernel, num_inputs, sizeof(cl_mem), &out[s]);
+        if (err == CL_SUCCESS) err = clSetKernelArg(kernel, num_inputs + 1, sizeof(int), &len_arg);
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "gpufw_stream_run: clSetKernelArg failed (%d)\n", err);
+            break;
+        }
+        size_t gws = lws ? (len + lws - 1) / lws * lws : len;
+        err = clEnqueueNDRangeKernel(q[1], kernel, 1, NULL, &gws, lws ? &lws : NULL, nwait, wait, &ev);
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "gpufw_stream_run: launch of chunk %zu failed (%d)\n", i, err);
+            break;
+        }
+        gpufw_prof_track_kernel(ctx, kernel, gws, ev);
+        release_ev(&run_ev[s]);
+        run_ev[s] = ev;
+
+        char *dst = (char *)output + off * elem_size;
+        err = clEnqueueReadBuffer(q[2], out[s], CL_FALSE, 0, bytes, dst, 1, &run_ev[s], &ev);
+        if (err != CL_SUCCESS) {
+            fprintf(stderr, "gpufw_stream_run: download of chunk %zu failed (%d)\n", i, err);
+            break;
+        }
+        gpufw_prof_track(ctx, GPUFW_OP_READ, "read(stream)", bytes, ev);
+        release_ev(&down_ev[s]);
+        down_ev[s] = ev;
+
+        clFlush(q[0]);
+        if (q[1] != q[0]) clFlush(q[1]);
+        if (q[2] != q[0] && q[2] != q[1]) clFlush(q[2]);
+    }
+
+    /* Drain everything before the buffers go back to the pool. */
+    for (unsigned s = 0; s < depth; ++s) {
+        cl_int werr = CL_SUCCESS;
+        if (down_ev[s]) werr = clWaitForEvents(1, &down_ev[s]);
+        if (run_ev[s]) clWaitForEvents(1, &run_ev[s]);
+        if (err == CL_SUCCESS && werr != CL_SUCCESS) err = werr;
+        release_ev(&down_ev[s]);
+        release_ev(&run_ev[s]);
+        for (unsigned k = 0; k < num_inputs; ++k) {
+            if (up_ev[s][k]) clWaitForEvents(1, &up_ev[s][k]);
+            release_ev(&up_ev[s][k]);
+            if (in[s][k]) gpufw_release_buffer(ctx, in[s][k]);
+        }
+        if (out[s]) gpufw_release_buffer(ctx, out[s]);
+    }
+    gpufw_stream_lock(ctx, 0);
+    return err;
+}
@@ -0,0 +1,249 @@
+// gpufw_thread.c - per-thread queues and kernel instances over one shared context
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+struct thread_kernel {
+    cl_program program;
+    char name[GPUFW_PROF_NAME_LEN];
+    cl_kernel kernel;
+};
+
+/* What one host thread enqueues through: its queue and the kernel instances
+   it has set arguments on. Slots outlive their thread and are handed to the
+   next new thread, so thread churn does not grow the number of queues. */
+struct thread_slot {
+    struct gpufw_threads *owner;
+    cl_command_queue queue;
+    struct thread_kernel *kernels;
+    size_t nkernels, cap;
+    struct thread_slot *next_free;
+};
+
+struct gpufw_threads {
+    int enabled;                /* GPUFW_INIT_THREADS: locks and per-thread slots */
+    pthread_mutex_t lock;       /* shared context state; recursive */
+    pthread_mutex_t staging_lock;
+    pthread_mutex_t stream_lock;
+    pthread_key_t key;          /* the calling thread's slot */
+    struct thread_slot **slots; /* every slot, for cleanup */
+    size_t nslots, cap;
+    struct thread_slot *free_slots;
+    struct thread_slot main;    /* single-threaded contexts: ctx->queue and a kernel cache */
+    cl_command_queue_properties queue_props;
+    cl_context context;
+    cl_device_id device;
+};
+
+static void slot_free_kernels(struct thread_slot *s) {
+    for (size_t i = 0; i < s->nkernels; ++i)
+        if (s->kernels[i].kernel) clReleaseKernel(s->kernels[i].kernel);
+    free(s->kernels);
+    s->kernels = NULL;
+    s->nkernels = s->cap = 0;
+}
+
+/* pthread key destructor: park the exiting thread's slot for reuse. */
+static void slot_park(void *p) {
+    struct thread_slot *s = p;
+    struct gpufw_threads *t = s->owner;
+    if (s->queue) clFinish(s->queue);
+    pthread_mutex_lock(&t->lock);
+    s->next_free = t->free_slots;
+    t->free_slots = s;
+    pthread_mutex_unlock(&t->lock);
+}
+
+static int init_locks(struct gpufw_threads *t) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    int err = pthread_mutex_init(&t->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (err) return -1;
+    if (pthread_mutex_init(&t->staging_lock, NULL) != 0) {
+        pthread_mutex_destroy(&t->lock);
+        return -1;
+    }
+    if (pthread_mutex_init(&t->stream_lock, NULL) != 0) {
+        pthread_mutex_destroy(&t->staging_lock);
+        pthread_mutex_destroy(&t->lock);
+        return -1;
+    }
+    if (pthread_key_create(&t->key, slot_park) != 0) {
+        pthread_mutex_destroy(&t->stream_lock);
+        pthread_mutex_destroy(&t->staging_lock);
+        pthread_mutex_destroy(&t->lock);
+        return -1;
+    }
+    return 0;
+}
+
+static struct gpufw_threads *threads_get(gpufw_ctx *ctx) {
+    if (ctx->threads) return ctx->threads;
+    struct gpufw_threads *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    t->main.owner = t;
+    t->main.queue = ctx->queue;
+    ctx->threads = t;
+    return t;
+}
+
+int gpufw_threads_enable(gpufw_ctx *ctx) {
+    struct gpufw_threads *t = threads_get(ctx);
+    if (!t) return -1;
+    if (t->enabled) return 0;
+    if (init_locks(t) != 0) return -1;
+    t->context = ctx->context;
+    t->device = ctx->device;
+    clGetCommandQueueInfo(ctx->queue, CL_QUEUE_PROPERTIES, sizeof(t->queue_props), &t->queue_props, NULL);
+    gpufw_get_xfer_mode(ctx);       /* resolve now rather than racing on first use */
+    /* the initializing thread keeps ctx->queue, so code using it directly still orders */
+    pthread_setspecific(t->key, &t->main);
+    t->enabled = 1;
+    return 0;
+}
+
+static struct thread_slot *slot_new(struct gpufw_threads *t) {
+    if (t->free_slots) {
+        struct thread_slot *s = t->free_slots;
+        t->free_slots = s->next_free;
+        s->next_free = NULL;
+        return s;
+    }
+    if (t->nslots == t->cap) {
+        size_t cap = t->cap ? t->cap * 2 : 8;
+        struct thread_slot **ns = realloc(t->slots, cap * sizeof(*ns));
+        if (!ns) return NULL;
+        t->slots = ns;
+        t->cap = cap;
+    }
+    struct thread_slot *s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->owner = t;
+    cl_queue_properties props[] = { CL_QUEUE_PROPERTIES, t->queue_props, 0 };
+    cl_int err;
+    s->queue = clCreateCommandQueueWithProperties(t->context, t->device, t->queue_props ? props : NULL, &err);
+    if (err != CL_SUCCESS || !s->queue) {
+        fprintf(stderr, "gpufw_threads: clCreateCommandQueueWithProperties failed (%d)\n", err);
+        free(s);
+        return NULL;
+    }
+    t->slots[t->nslots++] = s;
+    return s;
+}
+
+static struct thread_slot *slot_get(gpufw_ctx *ctx) {
+    struct gpufw_threads *t = threads_get(ctx);
+    if (!t) return NULL;
+    if (!t->enabled) return &t->main;
+    struct thread_slot *s = pthread_getspecific(t->key);
+    if (s) return s;
+    pthread_mutex_lock(&t->lock);
+    s = slot_new(t);
+    pthread_mutex_unlock(&t->lock);
+    if (s) pthread_setspecific(t->key, s);
+    return s;
+}
+
+cl_command_queue gpufw_queue(gpufw_ctx *ctx) {
+    if (!ctx->threads || !ctx->threads->enabled) return ctx->queue;
+    struct thread_slot *s = slot_get(ctx);
+    return s ? s->queue : NULL;
+}
+
+cl_command_queue gpufw_get_queue(gpufw_ctx *ctx) {
+    return ctx && ctx->queue ? gpufw_queue(ctx) : NULL;
+}
+
+int gpufw_thread_kernel(gpufw_ctx *ctx, cl_program program, const char *kernel_name, cl_kernel *out_kernel) {
+    struct thread_slot *s = slot_get(ctx);
+    if (!s) return -1;
+    for (size_t i = 0; i < s->nkernels; ++i) {
+        if (s->kernels[i].program == program && strcmp(s->kernels[i].name, kernel_name) == 0) {
+            *out_kernel = s->kernels[i].kernel;
+            return 0;
+        }
+    }
+    if (s->nkernels == s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 8;
+        struct thread_kernel *nk = realloc(s->kernels, cap * sizeof(*nk));
+        if (!nk) return -1;
+        s->kernels = nk;
+        s->cap = cap;
+    }
+    cl_int err;
+    cl_kernel k = clCreateKernel(program, kernel_name, &err);
+    if (err != CL_SUCCESS || !k) {
+        fprintf(stderr, "gpufw_get_kernel: clCreateKernel('%s') failed (%d)\n", kernel_name, err);
+        return err != CL_SUCCESS ? err : -1;
+    }
+    struct thread_kernel *e = &s->kernels[s->nkernels++];
+    e->program = program;
+    snprintf(e->name, sizeof(e->name), "%s", kernel_name);
+    e->kernel = k;
+    *out_kernel = k;
+    return 0;
+}
+
+int gpufw_get_kernel(gpufw_ctx *ctx, const char *kernel_name, cl_kernel *out_kernel) {
+    GPUFW_TRACE_CALL();
+    if (!ctx || !kernel_name || !out_kernel) return -1;
+    cl_program program = gpufw_program(ctx);
+    if (!program) return -1;
+    return gpufw_thread_kernel(ctx, program, kernel_name, out_kernel);
+}
+
+unsigned gpufw_thread_queues(const gpufw_ctx *ctx) {
+    const struct gpufw_threads *t = ctx ? ctx->threads : NULL;
+    if (!ctx || !ctx->queue) return 0;
+    return t && t->enabled ? (unsigned)t->nslots + 1 : 1;
+}
+
+void gpufw_lock(const gpufw_ctx *ctx) {
+    if (ctx->threads && ctx->threads->enabled) pthread_mutex_lock(&ctx->threads->lock);
+}
+
+void gpufw_unlock(const gpufw_ctx *ctx) {
+    if (ctx->threads && ctx->threads->enabled) pthread_mutex_unlock(&ctx->threads->lock);
+}
+
+void gpufw_staging_lock(gpufw_ctx *ctx, int lock) {
+    if (!ctx->threads || !ctx->threads->enabled) return;
+    if (lock) pthread_mutex_lock(&ctx->threads->staging_lock);
+    else pthread_mutex_unlock(&ctx->threads->staging_lock);
+}
+
+void gpufw_stream_lock(gpufw_ctx *ctx, int lock) {
+    if (!ctx->threads || !ctx->threads->enabled) return;
+    if (lock) pthread_mutex_lock(&ctx->threads->stream_lock);
+    else pthread_mutex_unlock(&ctx->threads->stream_lock);
+}
+
+/* Every submitting thread must have been joined by now. */
+void gpufw_threads_destroy(gpufw_ctx *ctx) {
+    struct gpufw_threads *t = ctx ? ctx->threads : NULL;
+    if (!t) return;
+    if (t->enabled) {
+        pthread_key_delete(t->key);
+        for (size_t i = 0; i < t->nslots; ++i) {
+            struct thread_slot *s = t->slots[i];
+            clFinish(s->queue);
+            slot_free_kernels(s);
+            clReleaseCommandQueue(s->queue);
+            free(s);
+        }
+        free(t->slots);
+        pthread_mutex_destroy(&t->stream_lock);
+        pthread_mutex_destroy(&t->staging_lock);
+        pthread_mutex_destroy(&t->lock);
+    }
+    slot_free_kernels(&t->main);      /* its queue is ctx->queue */
+    free(t);
+    ctx->threads = NULL;
+}
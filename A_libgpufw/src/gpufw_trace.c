@@ -0,0 +1,412 @@
+// gpufw_trace.c - Chrome trace-event export of host spans, device commands and application events
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#define TRACE_CHUNK_EVENTS 1024
+#define TRACE_MAX_EVENTS   (1u << 20)   /* per thread and trace; later events are counted as dropped */
+#define TRACE_MAX_TRACKS   64           /* device queues with a track of their own */
+#define TRACE_TRACK_TID    1000000000L  /* tid of the first device track */
+#define TRACE_MAX_NAMES    256          /* interned command names */
+
+/* 64 bytes. Strings are never copied while recording: they are literals,
+   __func__ or interned names. */
+struct trace_event {
+    uint64_t ts, dur;           /* ns, CLOCK_MONOTONIC */
+    uint64_t id;                /* async and flow events */
+    uint64_t arg;
+    const char *cat, *name, *arg_name;
+    int32_t track;              /* -1: the recording thread, else a device track */
+    char ph;                    /* X, i, b, e, s, f */
+};
+
+struct trace_chunk {
+    struct trace_chunk *next;
+    struct trace_event ev[TRACE_CHUNK_EVENTS];
+};
+
+/* Each thread appends to its own buffer and publishes an event by storing
+   count with release order; the writer loads count with acquire and reads
+   nothing past it, so recording takes no locks. Chunks are kept and reused
+   by the next trace. A buffer outlives its thread until a trace has been
+   written after the thread exited. */
+struct trace_buf {
+    struct trace_buf *next;
+    long tid;
+    char name[32];
+    unsigned epoch;             /* trace the events belong to */
+    size_t count;
+    size_t dropped;
+    struct trace_chunk *head, *cur;
+    int exited;
+};
+
+struct trace_track {
+    cl_command_queue queue;
+    char name[96];
+};
+
+int gpufw_trace_active;
+
+static struct {
+    unsigned epoch;             /* bumped by every gpufw_trace_start */
+    pthread_mutex_t mu;         /* buffer list, tracks, names, path */
+    pthread_key_t key;          /* marks a thread's buffer when it exits */
+    int have_key;
+    int from_env;               /* started by GPUFW_TRACE: written at exit */
+    int pid;
+    uint64_t flow_seq;
+    char path[4096];
+    struct trace_buf *bufs;
+    struct trace_track tracks[TRACE_MAX_TRACKS];
+    unsigned ntracks;
+    char *names[TRACE_MAX_NAMES];
+    unsigned nnames;
+} trace = { .mu = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread struct trace_buf *tls_buf;
+
+uint64_t gpufw_trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int gpufw_trace_enabled(void) {
+    return gpufw_tracing();
+}
+
+/* ---- per-thread buffers ---- */
+
+static void buf_exit(void *p) {
+    struct trace_buf *b = p;
+    tls_buf = NULL;
+    __atomic_store_n(&b->exited, 1, __ATOMIC_RELEASE);
+}
+
+/* The calling thread's buffer, emptied first if it holds an older trace. */
+static struct trace_buf *thread_buf(void) {
+    struct trace_buf *b = tls_buf;
+    if (!b) {
+        if (!(b = calloc(1, sizeof(*b)))) return NULL;
+        b->tid = (long)syscall(SYS_gettid);
+        char comm[17] = "";
+        if (prctl(PR_GET_NAME, comm) == 0) snprintf(b->name, sizeof(b->name), "%s", comm);
+        pthread_mutex_lock(&trace.mu);
+        b->next = trace.bufs;
+        trace.bufs = b;
+        pthread_mutex_unlock(&trace.mu);
+        if (trace.have_key) pthread_setspecific(trace.key, b);
+        tls_buf = b;
+    }
+    unsigned epoch = __atomic_load_n(&trace.epoch, __ATOMIC_ACQUIRE);
+    if (b->epoch != epoch) {
+        __atomic_store_n(&b->count, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&b->dropped, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&b->epoch, epoch, __ATOMIC_RELEASE);
+        b->cur = b->head;
+    }
+    return b;
+}
+
+static void record(char ph, const char *cat, const char *name, uint64_t ts, uint64_t dur, uint64_t id,
+                   const char *arg_name, uint64_t arg, int32_t track) {
+    struct trace_buf *b = thread_buf();
+    if (!b) return;
+    size_t n = b->count;
+    if (n >= TRACE_MAX_EVENTS) {
+        __atomic_store_n(&b->dropped, b->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    size_t i = n % TRACE_CHUNK_EVENTS;
+    if (i == 0) {
+        struct trace_chunk *c = n == 0 ? b->head : b->cur->next;
+        if (!c) {
+            if (!(c = malloc(sizeof(*c)))) {
+                __atomic_store_n(&b->dropped, b->dropped + 1, __ATOMIC_RELAXED);
+                return;
+            }
+            c->next = NULL;
+            if (n == 0) b->head = c;
+            else b->cur->next = c;
+        }
+        b->cur = c;
+    }
+    struct trace_event *e = &b->cur->ev[i];
+    e->ts = ts;
+    e->dur = dur;
+    e->id = id;
+    e->arg = arg;
+    e->cat = cat;
+    e->name = name;
+    e->arg_name = arg_name;
+    e->track = track;
+    e->ph = ph;
+    __atomic_store_n(&b->count, n + 1, __ATOMIC_RELEASE);
+}
+
+/* ---- recording API ---- */
+
+gpufw_trace_span gpufw_trace_span_begin(const char *cat, const char *name) {
+    gpufw_trace_span s = { cat, name, NULL, 0, 0 };
+    if (gpufw_tracing()) s.start_ns = gpufw_trace_now_ns();
+    return s;
+}
+
+void gpufw_trace_span_end(gpufw_trace_span *span) {
+    if (!span->start_ns || !gpufw_tracing()) return;
+    uint64_t now = gpufw_trace_now_ns();
+    record('X', span->cat, span->name, span->start_ns, now - span->start_ns, 0, span->arg_name, span->arg, -1);
+}
+
+void gpufw_trace_instant(const char *cat, const char *name, const char *arg_name, uint64_t arg) {
+    if (gpufw_tracing()) record('i', cat, name, gpufw_trace_now_ns(), 0, 0, arg_name, arg, -1);
+}
+
+void gpufw_trace_async_begin(const char *cat, const char *name, uint64_t id, const char *arg_name, uint64_t arg) {
+    if (gpufw_tracing()) record('b', cat, name, gpufw_trace_now_ns(), 0, id, arg_name, arg, -1);
+}
+
+void gpufw_trace_async_end(const char *cat, const char *name, uint64_t id) {
+    if (gpufw_tracing()) record('e', cat, name, gpufw_trace_now_ns(), 0, id, NULL, 0, -1);
+}
+
+void gpufw_trace_thread_name(const char *name) {
+    struct trace_buf *b = name ? thread_buf() : NULL;
+    if (b) snprintf(b->name, sizeof(b->name), "%s", name);
+}
+
+/* ---- device commands ---- */
+
+uint64_t gpufw_trace_flow_begin(void) {
+    if (!gpufw_tracing()) return 0;
+    uint64_t id = ((uint64_t)(uint32_t)trace.pid << 32) | (__atomic_add_fetch(&trace.flow_seq, 1, __ATOMIC_RELAXED) & 0xffffffffu);
+    record('s', "flow", "enqueue", gpufw_trace_now_ns(), 0, id, NULL, 0, -1);
+    return id;
+}
+
+static int32_t device_track(cl_device_id device, cl_command_queue queue) {
+    unsigned i;
+    pthread_mutex_lock(&trace.mu);
+    for (i = 0; i < trace.ntracks; ++i)
+        if (trace.tracks[i].queue == queue) break;
+    if (i == trace.ntracks && i < TRACE_MAX_TRACKS) {
+        char dev[64] = "device";
+        if (clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(dev), dev, NULL) != CL_SUCCESS) strcpy(dev, "device");
+        dev[sizeof(dev) - 1] = '\0';
+        trace.tracks[i].queue = queue;
+        snprintf(trace.tracks[i].name, sizeof(trace.tracks[i].name), "queue %u: %s", i, dev);
+        trace.ntracks++;
+    }
+    pthread_mutex_unlock(&trace.mu);
+    /* past TRACE_MAX_TRACKS queues share the last track */
+    return (int32_t)(i < TRACE_MAX_TRACKS ? i : TRACE_MAX_TRACKS - 1);
+}
+
+/* Command names come from reused profiling slots, so they are copied once
+   and kept for the life of the process. */
+static const char *intern(const char *name) {
+    const char *out = "command";
+    pthread_mutex_lock(&trace.mu);
+    unsigned i;
+    for (i = 0; i < trace.nnames; ++i)
+        if (strcmp(trace.names[i], name) == 0) break;
+    if (i < trace.nnames) out = trace.names[i];
+    else if (i < TRACE_MAX_NAMES && (trace.names[i] = strdup(name)) != NULL) out = trace.names[trace.nnames++];
+    pthread_mutex_unlock(&trace.mu);
+    return out;
+}
+
+void gpufw_trace_device(cl_device_id device, cl_command_queue queue, const char *name, const char *arg_name,
+                        uint64_t arg, uint64_t start_ns, uint64_t end_ns, uint64_t flow) {
+    if (!gpufw_tracing()) return;
+    int32_t track = device_track(device, queue);
+    record('X', "device", intern(name), start_ns, end_ns > start_ns ? end_ns - start_ns : 0, 0, arg_name, arg, track);
+    if (flow) record('f', "flow", "enqueue", start_ns, 0, flow, NULL, 0, track);
+}
+
+/* ---- JSON output ---- */
+
+static void put_str(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+/* Chrome trace timestamps are microseconds; keep the nanoseconds as decimals. */
+static void put_us(FILE *f, const char *key, uint64_t ns) {
+    fprintf(f, ",\"%s\":%llu.%03u", key, (unsigned long long)(ns / 1000), (unsigned)(ns % 1000));
+}
+
+static void put_meta(FILE *f, const char *what, long tid, const char *name) {
+    fprintf(f, ",\n{\"ph\":\"M\",\"name\":\"%s\",\"pid\":%d,\"tid\":%ld,\"args\":{\"name\":", what, trace.pid, tid);
+    put_str(f, name);
+    fputs("}}", f);
+}
+
+static void put_event(FILE *f, const struct trace_event *e, long tid) {
+    fprintf(f, ",\n{\"ph\":\"%c\",\"cat\":", e->ph);
+    put_str(f, e->cat ? e->cat : "");
+    fputs(",\"name\":", f);
+    put_str(f, e->name ? e->name : "");
+    fprintf(f, ",\"pid\":%d,\"tid\":%ld", trace.pid, e->track >= 0 ? TRACE_TRACK_TID + e->track : tid);
+    put_us(f, "ts", e->ts);
+    switch (e->ph) {
+    case 'X': put_us(f, "dur", e->dur); break;
+    case 'i': fputs(",\"s\":\"t\"", f); break;
+    case 'b': case 'e': fprintf(f, ",\"id2\":{\"local\":\"0x%llx\"}", (unsigned long long)e->id); break;
+    case 's': fprintf(f, ",\"id\":\"0x%llx\"", (unsigned long long)e->id); break;
+    case 'f': fprintf(f, ",\"id\":\"0x%llx\",\"bp\":\"e\"", (unsigned long long)e->id); break;
+    }
+    if (e->arg_name) {
+        fputs(",\"args\":{", f);
+        put_str(f, e->arg_name);
+        fprintf(f, ":%llu}", (unsigned long long)e->arg);
+    }
+    fputc('}', f);
+}
+
+/* Called with trace.mu held and recording switched off; threads that saw
+   the flag just before still append, which is safe past the counts read. */
+static int write_json(void) {
+    FILE *f = fopen(trace.path, "w");
+    if (!f) {
+        fprintf(stderr, "gpufw_trace_stop: cannot write '%s'\n", trace.path);
+        return -1;
+    }
+    static char iobuf[1 << 16];
+    setvbuf(f, iobuf, _IOFBF, sizeof(iobuf));
+    char comm[64] = "gpufw";
+    FILE *cf = fopen("/proc/self/comm", "r");
+    if (cf) {
+        if (fgets(comm, sizeof(comm), cf)) comm[strcspn(comm, "\n")] = '\0';
+        fclose(cf);
+    }
+
+    unsigned epoch = trace.epoch;
+    size_t events = 0, dropped = 0;
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(f, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":", trace.pid);
+    put_str(f, comm);
+    fputs("}}", f);
+    for (unsigned i = 0; i < trace.ntracks; ++i) {
+        put_meta(f, "thread_name", TRACE_TRACK_TID + (long)i, trace.tracks[i].name);
+        fprintf(f, ",\n{\"ph\":\"M\",\"name\":\"thread_sort_index\",\"pid\":%d,\"tid\":%ld,\"args\":{\"sort_index\":%u}}",
+                trace.pid, TRACE_TRACK_TID + (long)i, 1000 + i);
+    }
+    for (struct trace_buf *b = trace.bufs; b; b = b->next) {
+        if (__atomic_load_n(&b->epoch, __ATOMIC_ACQUIRE) != epoch) continue;
+        size_t n = __atomic_load_n(&b->count, __ATOMIC_ACQUIRE);
+        dropped += __atomic_load_n(&b->dropped, __ATOMIC_RELAXED);
+        if (n == 0) continue;
+        if (b->name[0]) put_meta(f, "thread_name", b->tid, b->name);
+        struct trace_chunk *c = b->head;
+        for (size_t k = 0; k < n; ++k) {
+            if (k && k % TRACE_CHUNK_EVENTS == 0) c = c->next;
+            put_event(f, &c->ev[k % TRACE_CHUNK_EVENTS], b->tid);
+        }
+        events += n;
+    }
+    fprintf(f, "\n]}\n");
+    int err = ferror(f) ? -1 : 0;
+    if (fclose(f) != 0) err = -1;
+    if (err) fprintf(stderr, "gpufw_trace_stop: writing '%s' failed\n", trace.path);
+    if (dropped)
+        fprintf(stderr, "gpufw_trace_stop: %zu events dropped (limit %u per thread), %zu written\n",
+                dropped, TRACE_MAX_EVENTS, events);
+    return err;
+}
+
+/* ---- start / stop ---- */
+
+int gpufw_trace_start(const char *path) {
+    if (!path || !*path) return -1;
+    pthread_mutex_lock(&trace.mu);
+    if (gpufw_tracing()) {
+        pthread_mutex_unlock(&trace.mu);
+        fprintf(stderr, "gpufw_trace_start: already tracing to '%s'\n", trace.path);
+        return -1;
+    }
+    /* "%p" becomes the pid, so every process of a run gets its own file */
+    char out[sizeof(trace.path)];
+    size_t o = 0;
+    trace.pid = (int)getpid();
+    for (const char *p = path; *p && o < sizeof(out) - 1; ++p) {
+        if (p[0] == '%' && p[1] == 'p') {
+            o += (size_t)snprintf(out + o, sizeof(out) - o, "%d", trace.pid);
+            ++p;
+        } else {
+            out[o++] = *p;
+        }
+    }
+    out[o < sizeof(out) ? o : sizeof(out) - 1] = '\0';
+    FILE *f = fopen(out, "w");      /* fail now rather than after the run */
+    if (!f) {
+        pthread_mutex_unlock(&trace.mu);
+        fprintf(stderr, "gpufw_trace_start: cannot create '%s'\n", out);
+        return -1;
+    }
+    fclose(f);
+    memcpy(trace.path, out, sizeof(out));
+    __atomic_add_fetch(&trace.epoch, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&gpufw_trace_active, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&trace.mu);
+    return 0;
+}
+
+int gpufw_trace_stop(void) {
+    pthread_mutex_lock(&trace.mu);
+    if (!gpufw_tracing()) {
+        pthread_mutex_unlock(&trace.mu);
+        return -1;
+    }
+    __atomic_store_n(&gpufw_trace_active, 0, __ATOMIC_RELEASE);
+    trace.from_env = 0;
+    int err = write_json();
+
+    /* buffers of exited threads have been written out and have no owner */
+    for (struct trace_buf **pb = &trace.bufs; *pb;) {
+        struct trace_buf *b = *pb;
+        if (!__atomic_load_n(&b->exited, __ATOMIC_ACQUIRE)) {
+            pb = &b->next;
+            continue;
+        }
+        *pb = b->next;
+        for (struct trace_chunk *c = b->head, *next; c; c = next) {
+            next = c->next;
+            free(c);
+        }
+        free(b);
+    }
+    pthread_mutex_unlock(&trace.mu);
+    return err;
+}
+
+static void trace_at_exit(void) {
+    if (trace.from_env) gpufw_trace_stop();
+}
+
+/* GPUFW_TRACE=<path> traces from library load to process exit. */
+__attribute__((constructor)) static void trace_env(void) {
+    trace.have_key = pthread_key_create(&trace.key, buf_exit) == 0;
+    const char *env = getenv("GPUFW_TRACE");
+    if (!env || !*env || strcmp(env, "0") == 0) return;
+    if (gpufw_trace_start(env) == 0) {
+        trace.from_env = 1;
+        atexit(trace_at_exit);
+    }
+}
@@ -0,0 +1,310 @@
+// gpufw_tune.c - work-group size autotuning with a persisted tuning database
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#define TUNE_REPS           3       /* timed runs per candidate after one warm-up; the best counts */
+#define TUNE_MAX_CANDIDATES 32
+#define TUNE_DB_MAGIC       "# gpufw tune v2"
+#define TUNE_DB_MAGIC_V1    "# gpufw tune v1"   /* no options column; its entries load with options 0 */
+
+struct gpufw_tune {
+    gpufw_tune_entry *entries;
+    size_t count, cap;
+    char path[4200];            /* empty when results are not persisted */
+    int dirty;
+    int autotune;               /* sweep on a miss when launching with local size 0 */
+};
+
+static struct gpufw_tune *tune_get(gpufw_ctx *ctx);
+
+int gpufw_tune_enable(gpufw_ctx *ctx) {
+    struct gpufw_tune *t = tune_get(ctx);
+    if (!t) return -1;
+    t->autotune = 1;
+    return 0;
+}
+
+static gpufw_tune_entry *find_entry(struct gpufw_tune *t, const char *kernel, uint64_t options,
+                                    unsigned size_class) {
+    for (size_t i = 0; i < t->count; ++i)
+        if (t->entries[i].size_class == size_class && t->entries[i].options == options &&
+            strcmp(t->entries[i].kernel, kernel) == 0)
+            return &t->entries[i];
+    return NULL;
+}
+
+static gpufw_tune_entry *set_entry(struct gpufw_tune *t, const char *kernel, uint64_t options, unsigned size_class,
+                                   size_t local_size, double ms) {
+    gpufw_tune_entry *e = find_entry(t, kernel, options, size_class);
+    if (!e) {
+        if (t->count == t->cap) {
+            size_t cap = t->cap ? t->cap * 2 : 16;
+            gpufw_tune_entry *ne = realloc(t->entries, cap * sizeof(*ne));
+            if (!ne) return NULL;
+            t->entries = ne;
+            t->cap = cap;
+        }
+        e = &t->entries[t->count++];
+        memset(e, 0, sizeof(*e));
+        snprintf(e->kernel, sizeof(e->kernel), "%s", kernel);
+        e->options = options;
+        e->size_class = size_class;
+    }
+    e->local_size = local_size;
+    e->ms = ms;
+    return e;
+}
+
+static void db_load(struct gpufw_tune *t) {
+    FILE *f = t->path[0] ? fopen(t->path, "r") : NULL;
+    if (!f) return;
+    char line[256], name[GPUFW_PROF_NAME_LEN];
+    int v1 = 0;
+    if (!fgets(line, sizeof(line), f) ||
+        (strncmp(line, TUNE_DB_MAGIC, strlen(TUNE_DB_MAGIC)) != 0 &&
+         !(v1 = strncmp(line, TUNE_DB_MAGIC_V1, strlen(TUNE_DB_MAGIC_V1)) == 0))) {
+        fprintf(stderr, "gpufw_tune: ignoring '%s' (unknown format)\n", t->path);
+        fclose(f);
+        return;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        unsigned size_class;
+        unsigned long long options = 0;
+        size_t local_size;
+        double ms;
+        if (v1 ? sscanf(line, "%47s %u %zu %lf", name, &size_class, &local_size, &ms) != 4
+               : sscanf(line, "%47s %llx %u %zu %lf", name, &options, &size_class, &local_size, &ms) != 5)
+            continue;
+        if (size_class >= 64 || !set_entry(t, name, options, size_class, local_size, ms)) continue;
+    }
+    fclose(f);
+}
+
+static struct gpufw_tune *tune_get(gpufw_ctx *ctx) {
+    if (ctx->tune) return ctx->tune;
+    struct gpufw_tune *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    if (gpufw_state_path(ctx, "GPUFW_TUNE_DB", "tune", NULL, t->path, sizeof(t->path)) != 0) t->path[0] = '\0';
+    db_load(t);
+    __atomic_store_n(&ctx->tune, t, __ATOMIC_RELEASE);     /* gpufw_tune_pick checks it unlocked */
+    return t;
+}
+
+static int db_save(struct gpufw_tune *t) {
+    char tmp[4300];
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", t->path, (long)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        fprintf(stderr, "gpufw_tune_save: cannot write '%s'\n", tmp);
+        return -1;
+    }
+    fprintf(f, "%s\n", TUNE_DB_MAGIC);
+    for (size_t i = 0; i < t->count; ++i) {
+        const gpufw_tune_entry *e = &t->entries[i];
+        fprintf(f, "%s %016llx %u %zu %.6g\n", e->kernel, (unsigned long long)e->options, e->size_class,
+                e->local_size, e->ms);
+    }
+    int err = ferror(f);
+    if (fclose(f) != 0 || err || rename(tmp, t->path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    t->dirty = 0;
+    return 0;
+}
+
+int gpufw_tune_save(gpufw_ctx *ctx) {
+    struct gpufw_tune *t = ctx ? ctx->tune : NULL;
+    if (!t || !t->path[0]) return -1;
+    gpufw_lock(ctx);
+    int err = db_save(t);
+    gpufw_unlock(ctx);
+    return err;
+}
+
+void gpufw_tune_destroy(gpufw_ctx *ctx) {
+    struct gpufw_tune *t = ctx ? ctx->tune : NULL;
+    if (!t) return;
+    if (t->dirty) gpufw_tune_save(ctx);
+    free(t->entries);
+    free(t);
+    ctx->tune = NULL;
+}
+
+const gpufw_tune_entry *gpufw_tune_entries(gpufw_ctx *ctx, size_t *count) {
+    if (count) *count = 0;
+    if (!ctx) return NULL;
+    gpufw_lock(ctx);
+    struct gpufw_tune *t = tune_get(ctx);
+    gpufw_unlock(ctx);
+    if (!t) return NULL;
+    if (count) *count = t->count;
+    return t->entries;
+}
+
+void gpufw_tune_print(gpufw_ctx *ctx, FILE *out) {
+    size_t n = 0;
+    const gpufw_tune_entry *e = gpufw_tune_entries(ctx, &n);
+    if (!out) return;
+    fprintf(out, "%-24s %-8s %12s %8s %10s\n", "kernel", "options", "gws >=", "local", "best_ms");
+    for (size_t i = 0; i < n; ++i) {
+        char local[24] = "runtime", opts[12] = "-";
+        if (e[i].local_size) snprintf(local, sizeof(local), "%zu", e[i].local_size);
+        if (e[i].options) snprintf(opts, sizeof(opts), "%08llx", (unsigned long long)(e[i].options >> 32));
+        fprintf(out, "%-24s %-8s %12zu %8s %10.4f\n", e[i].kernel, opts, (size_t)1 << e[i].size_class, local,
+                e[i].ms);
+    }
+}
+
+static unsigned size_class_of(size_t n) {
+    unsigned b = 0;
+    while (n >>= 1) ++b;
+    return b;
+}
+
+/* Entries are keyed by function name and the program's build options, so
+   builds of one kernel with different -D settings (the vecadd_vec variants)
+   are tuned separately; *options is a hash of the options, 0 when empty. */
+static int kernel_key(gpufw_ctx *ctx, cl_kernel kernel, char *name, size_t len, uint64_t *options) {
+    if (clGetKernelInfo(kernel, CL_KERNEL_FUNCTION_NAME, len, name, NULL) != CL_SUCCESS) return -1;
+    name[len - 1] = '\0';
+    *options = 0;
+    cl_program program = NULL;
+    size_t olen = 0;
+    if (clGetKernelInfo(kernel, CL_KERNEL_PROGRAM, sizeof(program), &program, NULL) != CL_SUCCESS ||
+        clGetProgramBuildInfo(program, ctx->device, CL_PROGRAM_BUILD_OPTIONS, 0, NULL, &olen) != CL_SUCCESS ||
+        olen <= 1)
+        return 0;
+    char stack[256];
+    char *opts = olen <= sizeof(stack) ? stack : malloc(olen);
+    if (!opts) return -1;
+    if (clGetProgramBuildInfo(program, ctx->device, CL_PROGRAM_BUILD_OPTIONS, olen, opts, NULL) == CL_SUCCESS) {
+        size_t n = strnlen(opts, olen);
+        while (n > 0 && opts[n - 1] == ' ') --n;
+        if (n > 0) *options = gpufw_hash64(opts, n, GPUFW_HASH_SEED);
+    }
+    if (opts != stack) free(opts);
+    return 0;
+}
+
+/* Best time of TUNE_REPS runs, after a warm-up; device timestamps when the
+   queue has profiling enabled, host wall time otherwise. */
+static cl_int time_launch(gpufw_ctx *ctx, cl_kernel kernel, size_t gws, size_t lws, double *best_ms) {
+    *best_ms = 0.0;
+    for (int rep = 0; rep <= TUNE_REPS; ++rep) {
+        cl_event ev = NULL;
+        double t0 = gpufw_now_ms();
+        cl_int err = clEnqueueNDRangeKernel(gpufw_queue(ctx), kernel, 1, NULL, &gws, lws ? &lws : NULL, 0, NULL, &ev);
+        if (err == CL_SUCCESS) err = clWaitForEvents(1, &ev);
+        double ms = gpufw_now_ms() - t0;
+        if (err == CL_SUCCESS && ctx->prof) {
+            cl_ulong start = 0, end = 0;
+            if (clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL) == CL_SUCCESS &&
+                clGetEventProfilingInfo(ev, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL) == CL_SUCCESS)
+                ms = (double)(end - start) / 1e6;
+        }
+        if (ev) clReleaseEvent(ev);
+        if (err != CL_SUCCESS) return err;
+        if (rep > 0 && (rep == 1 || ms < *best_ms)) *best_ms = ms;
+    }
+    return CL_SUCCESS;
+}
+
+/* Multiples of the preferred size (x1, x1.5 steps up the powers of two) that
+   fit the kernel's work-group limit and divide gws. */
+static unsigned candidates(gpufw_ctx *ctx, cl_kernel kernel, size_t gws, size_t *out) {
+    size_t max_wg = 0, multiple = 0;
+    if (clGetKernelWorkGroupInfo(kernel, ctx->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_wg), &max_wg, NULL) != CL_SUCCESS)
+        return 0;
+    if (clGetKernelWorkGroupInfo(kernel, ctx->device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+                                 sizeof(multiple), &multiple, NULL) != CL_SUCCESS || multiple == 0)
+        multiple = 1;
+    unsigned n = 0;
+    for (size_t k = 1; multiple * k <= max_wg && n + 2 <= TUNE_MAX_CANDIDATES; k *= 2) {
+        size_t lws = multiple * k;
+        if (gws % lws == 0) out[n++] = lws;
+        if (k >= 2) {
+            lws = multiple * (k + k / 2);
+            if (lws <= max_wg && gws % lws == 0) out[n++] = lws;
+        }
+    }
+    return n;
+}
+
+int gpufw_autotune(gpufw_ctx *ctx, cl_kernel kernel, size_t global_work_size, size_t *best_local) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("items", global_work_size);
+    if (!ctx || !ctx->queue || !kernel || global_work_size == 0) return -1;
+    gpufw_lock(ctx);
+    struct gpufw_tune *t = tune_get(ctx);
+    gpufw_unlock(ctx);
+    char name[GPUFW_PROF_NAME_LEN];
+    uint64_t options;
+    if (!t || kernel_key(ctx, kernel, name, sizeof(name), &options) != 0) return -1;
+
+    size_t cand[TUNE_MAX_CANDIDATES];
+    unsigned ncand = candidates(ctx, kernel, global_work_size, cand);
+
+    /* Start from the runtime's own choice so a sweep never picks something slower. */
+    size_t best = 0;
+    double best_ms = 0.0;
+    cl_int err = time_launch(ctx, kernel, global_work_size, 0, &best_ms);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_autotune: '%s' does not run with gws=%zu (%d)\n", name, global_work_size, err);
+        return err;
+    }
+    for (unsigned i = 0; i < ncand; ++i) {
+        double ms;
+        if (time_launch(ctx, kernel, global_work_size, cand[i], &ms) != CL_SUCCESS) continue;
+        if (ms < best_ms) { best = cand[i]; best_ms = ms; }
+    }
+    /* other threads may have swept the same kernel meanwhile; the last result wins */
+    gpufw_lock(ctx);
+    gpufw_tune_entry *e = set_entry(t, name, options, size_class_of(global_work_size), best, best_ms);
+    if (e) t->dirty = 1;
+    gpufw_unlock(ctx);
+    if (!e) return -1;
+    if (best_local) *best_local = best;
+    return 0;
+}
+
+size_t gpufw_tuned_local_size(gpufw_ctx *ctx, cl_kernel kernel, size_t global_work_size) {
+    char name[GPUFW_PROF_NAME_LEN];
+    uint64_t options;
+    if (!ctx || !kernel || kernel_key(ctx, kernel, name, sizeof(name), &options) != 0) return 0;
+    gpufw_lock(ctx);
+    struct gpufw_tune *t = tune_get(ctx);
+    const gpufw_tune_entry *e = t ? find_entry(t, name, options, size_class_of(global_work_size)) : NULL;
+    size_t local = e ? e->local_size : 0;
+    gpufw_unlock(ctx);
+    if (!local || global_work_size % local != 0) return 0;
+    return local;
+}
+
+size_t gpufw_tune_pick(gpufw_ctx *ctx, cl_kernel kernel, size_t global_work_size,
+                       cl_uint num_wait, const cl_event *wait_list) {
+    /* Without GPUFW_INIT_AUTOTUNE or an explicit gpufw_autotune there is no
+       tuning state: leave the size to the runtime before any query or lock. */
+    if (!__atomic_load_n(&ctx->tune, __ATOMIC_ACQUIRE)) return 0;
+    char name[GPUFW_PROF_NAME_LEN];
+    uint64_t options;
+    if (kernel_key(ctx, kernel, name, sizeof(name), &options) != 0) return 0;
+    gpufw_lock(ctx);
+    struct gpufw_tune *t = tune_get(ctx);
+    int sweep = t && t->autotune && !find_entry(t, name, options, size_class_of(global_work_size));
+    gpufw_unlock(ctx);
+    if (!t) return 0;
+    if (sweep) {
+        /* the sweep runs the kernel with its current arguments, so inputs must be ready */
+        if (num_wait && clWaitForEvents(num_wait, wait_list) != CL_SUCCESS) return 0;
+        size_t best = 0;
+        if (gpufw_autotune(ctx, kernel, global_work_size, &best) != 0) return 0;
+    }
+    return gpufw_tuned_local_size(ctx, kernel, global_work_size);
+}
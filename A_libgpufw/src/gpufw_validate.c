@@ -0,0 +1,365 @@
+// gpufw_validate.c - parallel SIMD comparison of device results with a host reference
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GPUFW_X86 1
+#endif
+
+#define VAL_MIN_PARALLEL  (256u << 10)  /* elements; smaller arrays are checked inline */
+#define VAL_BLOCK         1024          /* elements per SIMD pass; a multiple of 16 */
+#define VAL_EDGES         (GPUFW_VALIDATE_HIST_BINS - 1)
+
+/* Upper ulp distance of each histogram bin but the last. */
+static const uint32_t hist_edges[VAL_EDGES] = { 0, 1, 3, 15, 255, 65535 };
+static const char *hist_names[GPUFW_VALIDATE_HIST_BINS] = { "0", "1", "2-3", "4-15", "16-255", "256-65535", ">65535" };
+
+struct val_cfg {
+    uint32_t max_ulp;
+    float max_abs, max_rel;
+    gpufw_nan_policy nan;
+    gpufw_inf_policy inf;
+    unsigned max_report;
+};
+
+struct val_stats {
+    size_t mismatches, nan_got, inf_got, skipped;
+    uint32_t max_ulp;
+    size_t max_ulp_index;
+    float max_abs_err, max_rel_err;
+    size_t hist[GPUFW_VALIDATE_HIST_BINS];
+    gpufw_mismatch first[GPUFW_VALIDATE_MAX_REPORT];
+    unsigned nfirst;
+};
+
+/* What a SIMD pass found in one block: lanes within each histogram edge and
+   the maxima. clean is 0 when a lane was NaN/infinite or out of tolerance;
+   such blocks are redone by the scalar path, which handles the policies and
+   records mismatches, so the fast path only has to be right for good data. */
+struct block_sum {
+    int clean;
+    size_t le[VAL_EDGES];
+    uint32_t max_ulp;
+    float max_abs, max_rel;
+};
+
+typedef void (*block_fn)(const struct val_cfg *c, const float *got, const float *want, size_t len,
+                         struct block_sum *b);
+
+/* ---- scalar path ---- */
+
+/* Float bits as a signed integer that orders like the float; +0 and -0 both map to 0. */
+static int32_t ordered(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    int32_t mag = (int32_t)(bits & 0x7fffffffu);
+    return (bits >> 31) ? -mag : mag;
+}
+
+static uint32_t ulp_dist(float a, float b) {
+    int64_t d = (int64_t)ordered(a) - ordered(b);
+    return (uint32_t)(d < 0 ? -d : d);
+}
+
+static unsigned hist_bin(uint32_t d) {
+    unsigned k = 0;
+    while (k < VAL_EDGES && d > hist_edges[k]) k++;
+    return k;
+}
+
+static void record_mismatch(const struct val_cfg *c, struct val_stats *s, size_t i, float got, float want, uint32_t ulp) {
+    s->mismatches++;
+    if (s->nfirst < c->max_report) {
+        gpufw_mismatch *m = &s->first[s->nfirst++];
+        m->index = i;
+        m->got = got;
+        m->want = want;
+        m->ulp = ulp;
+    }
+}
+
+static void check_scalar(const struct val_cfg *c, struct val_stats *s, const float *got, const float *want,
+                         size_t base, size_t len) {
+    for (size_t k = 0; k < len; ++k) {
+        float g = got[k], w = want[k];
+        size_t i = base + k;
+        if (isnan(g)) s->nan_got++;
+        else if (isinf(g)) s->inf_got++;
+        if (isnan(g) || isnan(w)) {
+            if (c->nan == GPUFW_NAN_SKIP) s->skipped++;
+            else if (c->nan == GPUFW_NAN_FAIL || !(isnan(g) && isnan(w))) record_mismatch(c, s, i, g, w, UINT32_MAX);
+            continue;
+        }
+        if ((isinf(g) || isinf(w)) && c->inf == GPUFW_INF_EXACT) {
+            if (g != w) record_mismatch(c, s, i, g, w, UINT32_MAX);
+            else s->hist[0]++;
+            continue;
+        }
+        uint32_t d = ulp_dist(g, w);
+        float diff = fabsf(g - w), rel = diff / fabsf(w);
+        s->hist[hist_bin(d)]++;
+        if (d > s->max_ulp) {
+            s->max_ulp = d;
+            s->max_ulp_index = i;
+        }
+        if (diff > s->max_abs_err) s->max_abs_err = diff;
+        if (rel > s->max_rel_err) s->max_rel_err = rel;
+        if (!(d <= c->max_ulp || diff <= c->max_abs || diff <= c->max_rel * fabsf(w)))
+            record_mismatch(c, s, i, g, w, d);
+    }
+}
+
+/* ---- SIMD passes ---- */
+
+#ifdef GPUFW_X86
+__attribute__((target("avx2")))
+static void block_avx2(const struct val_cfg *c, const float *got, const float *want, size_t len, struct block_sum *b) {
+    const __m256i expm = _mm256_set1_epi32(0x7f800000), magm = _mm256_set1_epi32(0x7fffffff);
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m256i tol_ulp = _mm256_set1_epi32((int)c->max_ulp);
+    const __m256 absm = _mm256_castsi256_ps(magm);
+    const __m256 tol_abs = _mm256_set1_ps(c->max_abs), tol_rel = _mm256_set1_ps(c->max_rel);
+    __m256i edge[VAL_EDGES], le[VAL_EDGES];
+    for (int k = 0; k < VAL_EDGES; ++k) {
+        edge[k] = _mm256_set1_epi32((int)hist_edges[k]);
+        le[k] = _mm256_setzero_si256();
+    }
+    __m256i bad = _mm256_setzero_si256(), maxu = _mm256_setzero_si256();
+    __m256 maxa = _mm256_setzero_ps(), maxr = _mm256_setzero_ps();
+    for (size_t i = 0; i < len; i += 8) {
+        __m256 g = _mm256_loadu_ps(got + i), w = _mm256_loadu_ps(want + i);
+        __m256i gi = _mm256_castps_si256(g), wi = _mm256_castps_si256(w);
+        bad = _mm256_or_si256(bad, _mm256_cmpeq_epi32(_mm256_and_si256(gi, expm), expm));
+        bad = _mm256_or_si256(bad, _mm256_cmpeq_epi32(_mm256_and_si256(wi, expm), expm));
+        /* ordered(): negate the magnitude of negative floats */
+        __m256i gs = _mm256_srai_epi32(gi, 31), ws = _mm256_srai_epi32(wi, 31);
+        __m256i go = _mm256_sub_epi32(_mm256_xor_si256(_mm256_and_si256(gi, magm), gs), gs);
+        __m256i wo = _mm256_sub_epi32(_mm256_xor_si256(_mm256_and_si256(wi, magm), ws), ws);
+        /* |go - wo| < 2^32 for finite floats, so the unsigned difference is exact */
+        __m256i d = _mm256_blendv_epi8(_mm256_sub_epi32(wo, go), _mm256_sub_epi32(go, wo), _mm256_cmpgt_epi32(go, wo));
+        for (int k = 0; k < VAL_EDGES; ++k)
+            le[k] = _mm256_sub_epi32(le[k], _mm256_cmpeq_epi32(_mm256_min_epu32(d, edge[k]), d));
+        maxu = _mm256_max_epu32(maxu, d);
+        __m256 diff = _mm256_and_ps(_mm256_sub_ps(g, w), absm), aw = _mm256_and_ps(w, absm);
+        __m256i ok = _mm256_cmpeq_epi32(_mm256_min_epu32(d, tol_ulp), d);
+        ok = _mm256_or_si256(ok, _mm256_castps_si256(_mm256_cmp_ps(diff, tol_abs, _CMP_LE_OQ)));
+        ok = _mm256_or_si256(ok, _mm256_castps_si256(_mm256_cmp_ps(diff, _mm256_mul_ps(tol_rel, aw), _CMP_LE_OQ)));
+        bad = _mm256_or_si256(bad, _mm256_xor_si256(ok, ones));
+        maxa = _mm256_max_ps(diff, maxa);
+        maxr = _mm256_max_ps(_mm256_div_ps(diff, aw), maxr);    /* 0/0 keeps maxr */
+    }
+    b->clean = _mm256_testz_si256(bad, bad);
+    uint32_t lanes[8];
+    float fl[8];
+    for (int k = 0; k < VAL_EDGES; ++k) {
+        _mm256_storeu_si256((__m256i *)lanes, le[k]);
+        b->le[k] = 0;
+        for (int l = 0; l < 8; ++l) b->le[k] += lanes[l];
+    }
+    _mm256_storeu_si256((__m256i *)lanes, maxu);
+    b->max_ulp = 0;
+    for (int l = 0; l < 8; ++l) if (lanes[l] > b->max_ulp) b->max_ulp = lanes[l];
+    _mm256_storeu_ps(fl, maxa);
+    b->max_abs = 0.0f;
+    for (int l = 0; l < 8; ++l) if (fl[l] > b->max_abs) b->max_abs = fl[l];
+    _mm256_storeu_ps(fl, maxr);
+    b->max_rel = 0.0f;
+    for (int l = 0; l < 8; ++l) if (fl[l] > b->max_rel) b->max_rel = fl[l];
+}
+
+__attribute__((target("avx512f")))
+static void block_avx512(const struct val_cfg *c, const float *got, const float *want, size_t len, struct block_sum *b) {
+    const __m512i expm = _mm512_set1_epi32(0x7f800000), magm = _mm512_set1_epi32(0x7fffffff);
+    const __m512i zero = _mm512_setzero_si512(), tol_ulp = _mm512_set1_epi32((int)c->max_ulp);
+    const __m512 tol_abs = _mm512_set1_ps(c->max_abs), tol_rel = _mm512_set1_ps(c->max_rel);
+    __m512i edge[VAL_EDGES];
+    for (int k = 0; k < VAL_EDGES; ++k) {
+        edge[k] = _mm512_set1_epi32((int)hist_edges[k]);
+        b->le[k] = 0;
+    }
+    __mmask16 bad = 0;
+    __m512i maxu = zero;
+    __m512 maxa = _mm512_setzero_ps(), maxr = _mm512_setzero_ps();
+    for (size_t i = 0; i < len; i += 16) {
+        __m512 g = _mm512_loadu_ps(got + i), w = _mm512_loadu_ps(want + i);
+        __m512i gi = _mm512_castps_si512(g), wi = _mm512_castps_si512(w);
+        bad |= _mm512_cmpeq_epi32_mask(_mm512_and_si512(gi, expm), expm);
+        bad |= _mm512_cmpeq_epi32_mask(_mm512_and_si512(wi, expm), expm);
+        __m512i gm = _mm512_and_si512(gi, magm), wm = _mm512_and_si512(wi, magm);
+        __m512i go = _mm512_mask_sub_epi32(gm, _mm512_cmplt_epi32_mask(gi, zero), zero, gm);
+        __m512i wo = _mm512_mask_sub_epi32(wm, _mm512_cmplt_epi32_mask(wi, zero), zero, wm);
+        __m512i d = _mm512_mask_sub_epi32(_mm512_sub_epi32(wo, go), _mm512_cmpgt_epi32_mask(go, wo), go, wo);
+        for (int k = 0; k < VAL_EDGES; ++k)
+            b->le[k] += (size_t)__builtin_popcount(_mm512_cmple_epu32_mask(d, edge[k]));
+        maxu = _mm512_max_epu32(maxu, d);
+        __m512 diff = _mm512_abs_ps(_mm512_sub_ps(g, w)), aw = _mm512_abs_ps(w);
+        __mmask16 ok = _mm512_cmple_epu32_mask(d, tol_ulp) |
+                       _mm512_cmp_ps_mask(diff, tol_abs, _CMP_LE_OQ) |
+                       _mm512_cmp_ps_mask(diff, _mm512_mul_ps(tol_rel, aw), _CMP_LE_OQ);
+        bad |= (__mmask16)~ok;
+        maxa = _mm512_max_ps(diff, maxa);
+        maxr = _mm512_max_ps(_mm512_div_ps(diff, aw), maxr);
+    }
+    b->clean = bad == 0;
+    b->max_ulp = _mm512_reduce_max_epu32(maxu);
+    b->max_abs = _mm512_reduce_max_ps(maxa);
+    b->max_rel = _mm512_reduce_max_ps(maxr);
+}
+#endif
+
+static block_fn pick_block(void) {
+    switch (gpufw_cpu_detect_isa()) {
+#ifdef GPUFW_X86
+    case GPUFW_ISA_AVX512: return block_avx512;
+    case GPUFW_ISA_AVX2:   return block_avx2;
+#endif
+    default:               return NULL;     /* SSE2 lacks unsigned 32-bit min/max; scalar it is */
+    }
+}
+
+/* ---- driver ---- */
+
+struct val_job {
+    const struct val_cfg *cfg;
+    block_fn fn;
+    const float *got, *want;
+    pthread_mutex_t mu;
+    struct val_stats total;
+};
+
+static void merge_block(const float *got, const float *want, size_t base, size_t len,
+                        const struct block_sum *b, struct val_stats *s) {
+    size_t prev = 0;
+    for (int k = 0; k < VAL_EDGES; ++k) {
+        s->hist[k] += b->le[k] - prev;
+        prev = b->le[k];
+    }
+    s->hist[VAL_EDGES] += len - prev;
+    if (b->max_abs > s->max_abs_err) s->max_abs_err = b->max_abs;
+    if (b->max_rel > s->max_rel_err) s->max_rel_err = b->max_rel;
+    if (b->max_ulp > s->max_ulp) {
+        s->max_ulp = b->max_ulp;
+        for (size_t k = 0; k < len; ++k) {
+            if (ulp_dist(got[k], want[k]) == b->max_ulp) {
+                s->max_ulp_index = base + k;
+                break;
+            }
+        }
+    }
+}
+
+/* Fold one range's stats into the total; ranges finish in any order. */
+static void merge_stats(const struct val_cfg *c, struct val_stats *t, const struct val_stats *s) {
+    t->mismatches += s->mismatches;
+    t->nan_got += s->nan_got;
+    t->inf_got += s->inf_got;
+    t->skipped += s->skipped;
+    for (int k = 0; k < GPUFW_VALIDATE_HIST_BINS; ++k) t->hist[k] += s->hist[k];
+    if (s->max_ulp > t->max_ulp || (s->max_ulp == t->max_ulp && s->max_ulp && s->max_ulp_index < t->max_ulp_index)) {
+        t->max_ulp = s->max_ulp;
+        t->max_ulp_index = s->max_ulp_index;
+    }
+    if (s->max_abs_err > t->max_abs_err) t->max_abs_err = s->max_abs_err;
+    if (s->max_rel_err > t->max_rel_err) t->max_rel_err = s->max_rel_err;
+
+    gpufw_mismatch merged[GPUFW_VALIDATE_MAX_REPORT];
+    unsigned n = 0, a = 0, b = 0;
+    while (n < c->max_report && (a < t->nfirst || b < s->nfirst)) {
+        if (b == s->nfirst || (a < t->nfirst && t->first[a].index < s->first[b].index)) merged[n++] = t->first[a++];
+        else merged[n++] = s->first[b++];
+    }
+    memcpy(t->first, merged, n * sizeof(merged[0]));
+    t->nfirst = n;
+}
+
+static void val_range(void *p, size_t begin, size_t end) {
+    struct val_job *j = p;
+    struct val_stats s;
+    memset(&s, 0, sizeof(s));
+    size_t i = begin;
+    if (j->fn) {
+        while (end - i >= 16) {
+            size_t len = end - i < VAL_BLOCK ? (end - i) / 16 * 16 : VAL_BLOCK;
+            struct block_sum b;
+            j->fn(j->cfg, j->got + i, j->want + i, len, &b);
+            if (b.clean) merge_block(j->got + i, j->want + i, i, len, &b, &s);
+            else check_scalar(j->cfg, &s, j->got + i, j->want + i, i, len);
+            i += len;
+        }
+    }
+    check_scalar(j->cfg, &s, j->got + i, j->want + i, i, end - i);
+    pthread_mutex_lock(&j->mu);
+    merge_stats(j->cfg, &j->total, &s);
+    pthread_mutex_unlock(&j->mu);
+}
+
+int gpufw_validate_f32(const float *got, const float *want, size_t n, const gpufw_validate_opts *opts,
+                       gpufw_validate_report *report) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("n", n);
+    if (!report || (n && (!got || !want))) return -1;
+    memset(report, 0, sizeof(*report));
+    struct val_cfg cfg = { 0, 0.0f, 0.0f, GPUFW_NAN_MATCH, GPUFW_INF_EXACT, GPUFW_VALIDATE_MAX_REPORT };
+    if (opts) {
+        cfg.max_ulp = opts->max_ulp;
+        cfg.max_abs = (float)opts->max_abs;
+        cfg.max_rel = (float)opts->max_rel;
+        cfg.nan = opts->nan;
+        cfg.inf = opts->inf;
+        if (opts->max_report && opts->max_report < GPUFW_VALIDATE_MAX_REPORT) cfg.max_report = opts->max_report;
+    }
+
+    double t0 = gpufw_now_ms();
+    struct val_job job;
+    memset(&job, 0, sizeof(job));
+    job.cfg = &cfg;
+    job.fn = pick_block();
+    job.got = got;
+    job.want = want;
+    if (pthread_mutex_init(&job.mu, NULL) != 0) return -1;
+    gpufw_cpu_parallel_for(n, VAL_MIN_PARALLEL, val_range, &job);
+    pthread_mutex_destroy(&job.mu);
+
+    const struct val_stats *t = &job.total;
+    report->n = n;
+    report->mismatches = t->mismatches;
+    report->nan_got = t->nan_got;
+    report->inf_got = t->inf_got;
+    report->skipped = t->skipped;
+    report->max_ulp = t->max_ulp;
+    report->max_ulp_index = t->max_ulp_index;
+    report->max_abs_err = t->max_abs_err;
+    report->max_rel_err = t->max_rel_err;
+    memcpy(report->hist, t->hist, sizeof(report->hist));
+    memcpy(report->first, t->first, t->nfirst * sizeof(t->first[0]));
+    report->nfirst = t->nfirst;
+    report->ms = gpufw_now_ms() - t0;
+    report->gbps = report->ms > 0 ? 2.0 * n * sizeof(float) / (report->ms * 1e6) : 0.0;
+    return t->mismatches ? 1 : 0;
+}
+
+void gpufw_validate_print(const gpufw_validate_report *r, const char *name, FILE *out) {
+    fprintf(out, "validate %s: %zu elements, %zu mismatches, max %u ulp (at %zu), max abs %g, max rel %g, "
+            "%.2f ms (%.1f GB/s)\n", name ? name : "", r->n, r->mismatches, r->max_ulp, r->max_ulp_index,
+            r->max_abs_err, r->max_rel_err, r->ms, r->gbps);
+    if (r->nan_got || r->inf_got || r->skipped)
+        fprintf(out, "  output NaN %zu, Inf %zu, skipped %zu\n", r->nan_got, r->inf_got, r->skipped);
+    fprintf(out, "  ulp histogram:");
+    for (int k = 0; k < GPUFW_VALIDATE_HIST_BINS; ++k) fprintf(out, " %s:%zu", hist_names[k], r->hist[k]);
+    fprintf(out, "\n");
+    for (unsigned i = 0; i < r->nfirst; ++i) {
+        const gpufw_mismatch *m = &r->first[i];
+        if (m->ulp == UINT32_MAX)
+            fprintf(out, "  [%zu] got %.9g, want %.9g (NaN/Inf)\n", m->index, m->got, m->want);
+        else
+            fprintf(out, "  [%zu] got %.9g, want %.9g (%u ulp)\n", m->index, m->got, m->want, m->ulp);
+    }
+    if (r->mismatches > r->nfirst) fprintf(out, "  ... %zu more\n", r->mismatches - r->nfirst);
+}
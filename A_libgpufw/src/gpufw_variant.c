@@ -0,0 +1,161 @@
+// gpufw_variant.c - compile-time specialized kernel variants
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/cl.h>
+#include "libgpufw.h"
+#include "gpufw_internal.h"
+
+#define VARIANT_MAX_BUILDS   64     /* option sets built per context */
+#define VARIANT_MAX_WIDTH    16
+#define VARIANT_MAX_PER_ITEM 16
+#define VARIANT_AUTO_PER_ITEM 4     /* largest per-item count gpufw_variant_pick tries */
+/* Work-items to keep per compute unit before packing more work into each:
+   enough resident wavefronts to hide memory latency on a GPU, a few
+   work-groups per core on a CPU. */
+#define VARIANT_GPU_ITEMS_PER_CU 2048
+#define VARIANT_CPU_ITEMS_PER_CU 64
+
+struct variant_build {
+    char options[64];
+    cl_program program;
+    int failed;                 /* build failed once; not retried */
+};
+
+struct gpufw_variants {
+    char *src;                  /* the context's program source, rebuilt with -D options */
+    size_t src_len;
+    unsigned pref_width;        /* CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, rounded to a power of two */
+    size_t min_items;
+    int off;                    /* GPUFW_VARIANT=off */
+    unsigned fixed_width, fixed_per_item;   /* GPUFW_VARIANT=<w>x<e>, 0 = pick automatically */
+    struct variant_build builds[VARIANT_MAX_BUILDS];
+    unsigned nbuilds;
+};
+
+static int valid_width(unsigned w) {
+    return w == 1 || w == 2 || w == 4 || w == 8 || w == 16;
+}
+
+static void parse_env(struct gpufw_variants *vs) {
+    const char *e = getenv("GPUFW_VARIANT");
+    if (!e || !*e || strcmp(e, "auto") == 0) return;
+    if (strcmp(e, "0") == 0 || strcmp(e, "off") == 0) {
+        vs->off = 1;
+        return;
+    }
+    unsigned w = 0, per = 0;
+    char extra;
+    if (sscanf(e, "%ux%u%c", &w, &per, &extra) == 2 && valid_width(w) && per >= 1 && per <= VARIANT_MAX_PER_ITEM) {
+        vs->fixed_width = w;
+        vs->fixed_per_item = per;
+        return;
+    }
+    fprintf(stderr, "gpufw_variant: ignoring GPUFW_VARIANT='%s' (want off, auto or <width>x<per-item>)\n", e);
+}
+
+int gpufw_variant_init(gpufw_ctx *ctx, const char *src, size_t src_len) {
+    struct gpufw_variants *vs = calloc(1, sizeof(*vs));
+    if (!vs) return -1;
+    vs->src = malloc(src_len + 1);
+    if (!vs->src) {
+        free(vs);
+        return -1;
+    }
+    memcpy(vs->src, src, src_len);
+    vs->src[src_len] = '\0';
+    vs->src_len = src_len;
+
+    cl_uint pref = 1, cus = 1;
+    cl_device_type type = CL_DEVICE_TYPE_GPU;
+    clGetDeviceInfo(ctx->device, CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT, sizeof(pref), &pref, NULL);
+    clGetDeviceInfo(ctx->device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cus), &cus, NULL);
+    clGetDeviceInfo(ctx->device, CL_DEVICE_TYPE, sizeof(type), &type, NULL);
+    vs->pref_width = 1;
+    while (vs->pref_width * 2 <= pref && vs->pref_width < VARIANT_MAX_WIDTH) vs->pref_width *= 2;
+    vs->min_items = (size_t)(cus ? cus : 1) *
+                    ((type & CL_DEVICE_TYPE_CPU) ? VARIANT_CPU_ITEMS_PER_CU : VARIANT_GPU_ITEMS_PER_CU);
+    parse_env(vs);
+    ctx->variants = vs;
+    return 0;
+}
+
+void gpufw_variant_destroy(gpufw_ctx *ctx) {
+    struct gpufw_variants *vs = ctx ? ctx->variants : NULL;
+    if (!vs) return;
+    for (unsigned i = 0; i < vs->nbuilds; ++i) {
+        struct variant_build *b = &vs->builds[i];
+        if (b->program) clReleaseProgram(b->program);
+    }
+    free(vs->src);
+    free(vs);
+    ctx->variants = NULL;
+}
+
+int gpufw_variant_fixed(size_t n, unsigned vec_width, unsigned per_item, gpufw_variant *out) {
+    if (!out || !valid_width(vec_width) || per_item < 1 || per_item > VARIANT_MAX_PER_ITEM) return -1;
+    out->vec_width = vec_width;
+    out->per_item = per_item;
+    out->exact = n % ((size_t)vec_width * per_item) == 0;
+    return 0;
+}
+
+/* Widest vectors the device prefers and up to VARIANT_AUTO_PER_ITEM of them
+   per work-item, backing off while that would leave fewer than min_items
+   work-items to spread over the compute units. */
+int gpufw_variant_pick(gpufw_ctx *ctx, size_t n, gpufw_variant *out) {
+    struct gpufw_variants *vs = ctx ? ctx->variants : NULL;
+    if (!vs || !out || n == 0 || vs->off) return -1;
+    if (vs->fixed_width) return gpufw_variant_fixed(n, vs->fixed_width, vs->fixed_per_item, out);
+    unsigned w = vs->pref_width, per = VARIANT_AUTO_PER_ITEM;
+    while (per > 1 && n / ((size_t)w * per) < vs->min_items) per /= 2;
+    while (w > 1 && n / w < vs->min_items) w /= 2;
+    return gpufw_variant_fixed(n, w, per, out);
+}
+
+size_t gpufw_variant_global_size(const gpufw_variant *v, size_t n) {
+    size_t per = (size_t)v->vec_width * v->per_item;
+    return v->exact ? n / per : (n + per - 1) / per;
+}
+
+const char *gpufw_variant_str(const gpufw_variant *v, char *buf, size_t len) {
+    if (v->vec_width == 1) snprintf(buf, len, "floatx%u%s", v->per_item, v->exact ? " exact" : "");
+    else snprintf(buf, len, "float%ux%u%s", v->vec_width, v->per_item, v->exact ? " exact" : "");
+    return buf;
+}
+
+static struct variant_build *get_build(gpufw_ctx *ctx, struct gpufw_variants *vs, const char *options) {
+    for (unsigned i = 0; i < vs->nbuilds; ++i)
+        if (strcmp(vs->builds[i].options, options) == 0) return &vs->builds[i];
+    if (vs->nbuilds == VARIANT_MAX_BUILDS) return NULL;
+    struct variant_build *b = &vs->builds[vs->nbuilds++];
+    memset(b, 0, sizeof(*b));
+    snprintf(b->options, sizeof(b->options), "%s", options);
+    if (gpufw_build_program(ctx, vs->src, vs->src_len, options, &b->program) != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_variant: build with '%s' failed, using the generic kernel\n", options);
+        b->program = NULL;
+        b->failed = 1;
+    }
+    return b;
+}
+
+int gpufw_variant_kernel(gpufw_ctx *ctx, const char *kernel_name, const gpufw_variant *v, cl_kernel *out_kernel) {
+    GPUFW_TRACE_CALL();
+    struct gpufw_variants *vs = ctx ? ctx->variants : NULL;
+    if (!vs || !kernel_name || !v || !out_kernel) return -1;
+    if (!valid_width(v->vec_width) || v->per_item < 1 || v->per_item > VARIANT_MAX_PER_ITEM) return -1;
+    /* Sources without the kernel (another kernel file) quietly use the generic path */
+    if (!strstr(vs->src, kernel_name)) return -1;
+
+    char options[64];
+    snprintf(options, sizeof(options), "-DGPUFW_VW=%u -DGPUFW_EPT=%u -DGPUFW_EXACT=%d",
+             v->vec_width, v->per_item, v->exact ? 1 : 0);
+    gpufw_lock(ctx);
+    struct variant_build *b = get_build(ctx, vs, options);
+    cl_program program = b && !b->failed ? b->program : NULL;
+    gpufw_unlock(ctx);
+    if (!program) return -1;
+    /* builds live until cleanup; the kernel instance belongs to this thread */
+    return gpufw_thread_kernel(ctx, program, kernel_name, out_kernel) == 0 ? 0 : -1;
+}
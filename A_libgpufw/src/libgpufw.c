@@ -6,8 +6,9 @@
 #include <errno.h>
 #include <CL/cl.h>
 #include "libgpufw.h"   // must define gpufw_ctx struct (platform, device, context, queue, program, kernel optional)
+#include "gpufw_internal.h"
 
-static char* read_kernel_source(const char *filename, size_t *length) {
+char* gpufw_read_kernel_source(const char *filename, size_t *length) {
     if (!filename || !length) return NULL;
     FILE *f = fopen(filename, "rb");
     if (!f) {
@@ -29,154 +30,177 @@ static char* read_kernel_source(const char *filename, size_t *length) {
     return source;
 }
 
+/* Option flags plus the ones switched on from the environment. */
+unsigned gpufw_init_flags(const gpufw_init_opts *opts) {
+    unsigned flags = opts ? opts->flags : 0;
+    const char *prof_env = getenv("GPUFW_PROFILE");
+    if (prof_env && strcmp(prof_env, "0") != 0) flags |= GPUFW_INIT_PROFILING;
+    if (gpufw_tracing()) flags |= GPUFW_INIT_PROFILING;    /* device commands for the trace */
+    const char *tune_env = getenv("GPUFW_AUTOTUNE");
+    if (tune_env && strcmp(tune_env, "0") != 0) flags |= GPUFW_INIT_AUTOTUNE;
+    const char *threads_env = getenv("GPUFW_THREADS");
+    if (threads_env && strcmp(threads_env, "0") != 0) flags |= GPUFW_INIT_THREADS;
+    const char *build_env = getenv("GPUFW_BUILD");
+    if (build_env && *build_env) {
+        unsigned build = 0;
+        if (strcmp(build_env, "lazy") == 0) build = GPUFW_INIT_LAZY_BUILD;
+        else if (strcmp(build_env, "background") == 0) build = GPUFW_INIT_BACKGROUND_BUILD;
+        else if (strcmp(build_env, "eager") != 0)
+            fprintf(stderr, "gpufw_init: ignoring GPUFW_BUILD='%s' (want eager, lazy or background)\n", build_env);
+        if (build || strcmp(build_env, "eager") == 0)
+            flags = (flags & ~(GPUFW_INIT_LAZY_BUILD | GPUFW_INIT_BACKGROUND_BUILD)) | build;
+    }
+    return flags;
+}
+
+int gpufw_init_from_file(gpufw_ctx *ctx, const char *kernel_file, int device_index) {
+    return gpufw_init_ex(ctx, kernel_file, device_index, NULL);
+}
+
+/* First platform with devices of this type; device_index picks among them. */
+static int pick_of_type(cl_device_type type, int device_index, cl_platform_id *platform, cl_device_id *device) {
+    const cl_platform_id *platforms = NULL;
+    cl_uint num_platforms = 0;
+    gpufw_platforms(&platforms, &num_platforms, NULL);
+    for (cl_uint i = 0; i < num_platforms; ++i) {
+        const cl_device_id *devs = NULL;
+        cl_uint dev_count = 0;
+        if (gpufw_devices(platforms[i], type, &devs, &dev_count) != CL_SUCCESS || dev_count == 0) continue;
+        *device = devs[(device_index >= 0) ? (device_index % dev_count) : 0];
+        *platform = platforms[i];
+        return 0;
+    }
+    return -1;
+}
+
 /* Prefer GPU across all platforms; if none, fall back to CPU.
    device_index selects among multiple devices of chosen type. */
-int gpufw_init_from_file(gpufw_ctx *ctx, const char *kernel_file, int device_index) {
+int gpufw_init_ex(gpufw_ctx *ctx, const char *kernel_file, int device_index, const gpufw_init_opts *opts) {
+    GPUFW_TRACE_CALL();
     if (!ctx || !kernel_file) return -1;
-    cl_int err;
+    memset(ctx, 0, sizeof(*ctx));
+    gpufw_init_stats *st = &ctx->init_stats;
+    double t0 = gpufw_now_ms();
+    unsigned flags = gpufw_init_flags(opts);
+    if (flags & GPUFW_INIT_NATIVE_CPU) {
+        ctx->backend = GPUFW_BACKEND_NATIVE_CPU;
+        st->total_ms = gpufw_now_ms() - t0;
+        return 0;
+    }
+    int fallback = (flags & GPUFW_INIT_CPU_FALLBACK) != 0;
+
+    /* 1) device, from the process-wide discovery cache after the first init */
+    const cl_platform_id *platforms = NULL;
     cl_uint num_platforms = 0;
-    err = clGetPlatformIDs(0, NULL, &num_platforms);
+    cl_int err = gpufw_platforms(&platforms, &num_platforms, &st->discovery_cached);
     if (err != CL_SUCCESS || num_platforms == 0) {
-        fprintf(stderr, "gpufw_init: clGetPlatformIDs found none (err=%d)\n", err);
+        fprintf(stderr, "gpufw_init: clGetPlatformIDs found none (err=%d)%s\n", err,
+                fallback ? ", using native CPU backend" : "");
+        if (fallback) { ctx->backend = GPUFW_BACKEND_NATIVE_CPU; return 0; }
         return -1;
     }
-
-    cl_platform_id *platforms = malloc(sizeof(cl_platform_id) * num_platforms);
-    if (!platforms) return -1;
-    err = clGetPlatformIDs(num_platforms, platforms, NULL);
-    if (err != CL_SUCCESS) {
-        fprintf(stderr, "gpufw_init: clGetPlatformIDs failed (%d)\n", err);
-        free(platforms);
+    cl_platform_id platform = NULL;
+    cl_device_id device = NULL;
+    if (pick_of_type(CL_DEVICE_TYPE_GPU, device_index, &platform, &device) != 0 &&
+        pick_of_type(CL_DEVICE_TYPE_CPU, device_index, &platform, &device) != 0) {
+        fprintf(stderr, "gpufw_init: no suitable OpenCL device found (gpu or cpu)%s\n",
+                fallback ? ", using native CPU backend" : "");
+        if (fallback) { ctx->backend = GPUFW_BACKEND_NATIVE_CPU; return 0; }
         return -1;
     }
+    double t1 = gpufw_now_ms();
+    st->discover_ms = t1 - t0;
 
-    cl_device_id chosen_device = NULL;
-    cl_platform_id chosen_platform = NULL;
-    cl_uint dev_count = 0;
-
-    /* 1) Try to find any GPU on any platform */
-    for (cl_uint i = 0; i < num_platforms && !chosen_device; ++i) {
-        err = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, 0, NULL, &dev_count);
-        if (err == CL_SUCCESS && dev_count > 0) {
-            cl_device_id *devs = malloc(sizeof(cl_device_id) * dev_count);
-            if (!devs) continue;
-            err = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_GPU, dev_count, devs, NULL);
-            if (err == CL_SUCCESS) {
-                chosen_device = devs[(device_index >= 0) ? (device_index % dev_count) : 0];
-                chosen_platform = platforms[i];
-            }
-            free(devs);
-            break;
-        }
-    }
-
-    /* 2) If no GPU found, try CPU on any platform */
-    if (!chosen_device) {
-        for (cl_uint i = 0; i < num_platforms && !chosen_device; ++i) {
-            err = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_CPU, 0, NULL, &dev_count);
-            if (err == CL_SUCCESS && dev_count > 0) {
-                cl_device_id *devs = malloc(sizeof(cl_device_id) * dev_count);
-                if (!devs) continue;
-                err = clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_CPU, dev_count, devs, NULL);
-                if (err == CL_SUCCESS) {
-                    chosen_device = devs[(device_index >= 0) ? (device_index % dev_count) : 0];
-                    chosen_platform = platforms[i];
-                }
-                free(devs);
-                break;
-            }
-        }
-    }
-
-    if (!chosen_device) {
-        fprintf(stderr, "gpufw_init: no suitable OpenCL device found (gpu or cpu)\n");
-        free(platforms);
+    /* 2) kernel source, from the file or the library's embedded copy */
+    size_t src_size = 0;
+    char *src = gpufw_load_kernel_source(kernel_file, &src_size, &st->embedded_source);
+    if (!src) {
+        fprintf(stderr, "gpufw_init: Failed to read kernel file '%s'\n", kernel_file);
         return -1;
     }
+    st->source_ms = gpufw_now_ms() - t1;
+
+    /* 3) context, queue, program (maybe deferred) and per-context state */
+    err = gpufw_init_device(ctx, platform, device, src, src_size, flags);
+    free(src);
+    ctx->init_stats.total_ms = gpufw_now_ms() - t0;
+    return err;
+}
 
-    /* fill ctx fields */
-    ctx->platform = chosen_platform;
-    ctx->device   = chosen_device;
+/* Context, queue and program for one device. ctx must be zeroed (init_stats
+   may already hold the discovery and source timings). On failure everything
+   created so far is released through gpufw_cleanup. */
+int gpufw_init_device(gpufw_ctx *ctx, cl_platform_id platform, cl_device_id device,
+                      const char *src, size_t src_size, unsigned flags) {
+    GPUFW_TRACE_CALL();
+    cl_int err;
+    gpufw_init_stats *st = &ctx->init_stats;
+    ctx->platform = platform;
+    ctx->device   = device;
 
-    /* Create context */
+    double t = gpufw_now_ms();
     ctx->context = clCreateContext(NULL, 1, &ctx->device, NULL, NULL, &err);
     if (err != CL_SUCCESS || ctx->context == NULL) {
         fprintf(stderr, "gpufw_init: clCreateContext failed (%d)\n", err);
-        free(platforms);
-        return -1;
+        ctx->context = NULL;
+        goto fail;
     }
+    st->context_ms = gpufw_now_ms() - t;
 
-    /* Create command queue (no special properties). If profiling required, set CL_QUEUE_PROFILING_ENABLE via properties. */
-    /* Note: clCreateCommandQueueWithProperties returns error code in err. */
-    //cl_command_queue_properties props[] = { 0 }; // placeholder, use NULL in call
-    ctx->queue = clCreateCommandQueueWithProperties(ctx->context, ctx->device, NULL, &err);
+    /* Create command queue, with profiling when requested. */
+    t = gpufw_now_ms();
+    cl_queue_properties props[] = { CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0 };
+    int profiling = (flags & GPUFW_INIT_PROFILING) != 0;
+    ctx->queue = clCreateCommandQueueWithProperties(ctx->context, ctx->device, profiling ? props : NULL, &err);
     if (err != CL_SUCCESS || ctx->queue == NULL) {
         fprintf(stderr, "gpufw_init: clCreateCommandQueueWithProperties failed (%d)\n", err);
-        clReleaseContext(ctx->context);
-        ctx->context = NULL;
-        free(platforms);
-        return -1;
+        ctx->queue = NULL;
+        goto fail;
     }
+    st->queue_ms = gpufw_now_ms() - t;
 
-    /* Read kernel source */
-    size_t src_size = 0;
-    char *src = read_kernel_source(kernel_file, &src_size);
-    if (!src) {
-        fprintf(stderr, "gpufw_init: Failed to read kernel file '%s'\n", kernel_file);
-        clReleaseCommandQueue(ctx->queue);
-        clReleaseContext(ctx->context);
-        ctx->queue = NULL; ctx->context = NULL;
-        free(platforms);
-        return -1;
-    }
-
-    /* Create & build program */
-    ctx->program = clCreateProgramWithSource(ctx->context, 1, (const char**)&src, &src_size, &err);
-    free(src);
-    if (err != CL_SUCCESS || ctx->program == NULL) {
-        fprintf(stderr, "gpufw_init: clCreateProgramWithSource failed (%d)\n", err);
-        clReleaseCommandQueue(ctx->queue);
-        clReleaseContext(ctx->context);
-        ctx->queue = NULL; ctx->context = NULL;
-        free(platforms);
-        return -1;
-    }
-
-    err = clBuildProgram(ctx->program, 1, &ctx->device, NULL, NULL, NULL);
-    if (err != CL_SUCCESS) {
-        /* retrieve build log */
-        size_t log_size = 0;
-        clGetProgramBuildInfo(ctx->program, ctx->device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-        if (log_size > 0) {
-            char *log = malloc(log_size + 1);
-            if (log) {
-                clGetProgramBuildInfo(ctx->program, ctx->device, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
-                log[log_size] = '\0';
-                fprintf(stderr, "gpufw_init: clBuildProgram failed (%d). Build log:\n%s\n", err, log);
-                free(log);
-            }
-        } else {
-            fprintf(stderr, "gpufw_init: clBuildProgram failed (%d), no build log available\n", err);
+    /* Program (through the binary cache), now or handed to gpufw_program */
+    t = gpufw_now_ms();
+    st->build_mode = gpufw_build_mode_of(flags);
+    if (st->build_mode == GPUFW_BUILD_EAGER) {
+        err = gpufw_build_program(ctx, src, src_size, NULL, &ctx->program);
+        if (err != CL_SUCCESS) {
+            ctx->program = NULL;
+            goto fail;
         }
-        clReleaseProgram(ctx->program);
-        ctx->program = NULL;
-        clReleaseCommandQueue(ctx->queue);
-        clReleaseContext(ctx->context);
-        ctx->queue = NULL; ctx->context = NULL;
-        free(platforms);
-        return err;
+        st->build_ms = gpufw_now_ms() - t;
+    } else if ((err = gpufw_startup_defer(ctx, src, src_size, st->build_mode == GPUFW_BUILD_BACKGROUND)) != 0) {
+        fprintf(stderr, "gpufw_init: could not defer the program build\n");
+        goto fail;
     }
 
-    /* success */
-    free(platforms);
+    t = gpufw_now_ms();
+    if (profiling && gpufw_prof_enable(ctx) != 0)
+        fprintf(stderr, "gpufw_init: could not allocate profiling state, profiling disabled\n");
+    if ((flags & GPUFW_INIT_AUTOTUNE) && gpufw_tune_enable(ctx) != 0)
+        fprintf(stderr, "gpufw_init: could not allocate tuning state, autotuning disabled\n");
+    if (gpufw_variant_init(ctx, src, src_size) != 0)
+        fprintf(stderr, "gpufw_init: could not keep the program source, kernel variants disabled\n");
+    if ((flags & GPUFW_INIT_THREADS) && (err = gpufw_threads_enable(ctx)) != 0) {
+        fprintf(stderr, "gpufw_init: could not set up per-thread queues\n");
+        goto fail;
+    }
+    st->setup_ms = gpufw_now_ms() - t;
     return 0;
+
+fail:
+    gpufw_cleanup(ctx);
+    return err ? err : -1;
 }
 
-/* Helper: create kernel object from ctx->program */
+/* Helper: create kernel object from the context's program */
 int gpufw_create_kernel(gpufw_ctx *ctx, const char *kernel_name, cl_kernel *out_kernel) {
-    if (!ctx || !ctx->program || !kernel_name || !out_kernel) return -1;
+    GPUFW_TRACE_CALL();
+    if (!ctx || !kernel_name || !out_kernel) return -1;
+    cl_program program = gpufw_program(ctx);
+    if (!program) return -1;
     cl_int err;
-    cl_kernel k = clCreateKernel(ctx->program, kernel_name, &err);
+    cl_kernel k = clCreateKernel(program, kernel_name, &err);
     if (err != CL_SUCCESS || k == NULL) {
         fprintf(stderr, "gpufw_create_kernel: clCreateKernel('%s') failed (%d)\n", kernel_name, err);
         return err;
@@ -187,37 +211,49 @@ int gpufw_create_kernel(gpufw_ctx *ctx, const char *kernel_name, cl_kernel *out_
 
 /* Buffer helpers */
 cl_mem gpufw_alloc_buffer(gpufw_ctx *ctx, size_t size, cl_mem_flags flags) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("bytes", size);
     if (!ctx || !ctx->context) return NULL;
-    cl_int err;
-    cl_mem buf = clCreateBuffer(ctx->context, flags, size, NULL, &err);
-    if (err != CL_SUCCESS) {
-        fprintf(stderr, "gpufw_alloc_buffer: clCreateBuffer failed (%d)\n", err);
-        return NULL;
-    }
-    return buf;
+    return gpufw_pool_alloc(ctx, size, flags);
 }
 
 int gpufw_write_buffer(gpufw_ctx *ctx, cl_mem buf, const void *host_ptr, size_t size) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("bytes", size);
     if (!ctx || !ctx->queue || !buf) return -1;
-    cl_int err = clEnqueueWriteBuffer(ctx->queue, buf, CL_TRUE, 0, size, host_ptr, 0, NULL, NULL);
+    if (gpufw_use_staging(ctx, size)) {
+        /* source is already copied out when this returns; in-order queue keeps later commands behind it */
+        return gpufw_staging_write(ctx, buf, 0, host_ptr, size);
+    }
+    if (gpufw_use_mapping(ctx)) return gpufw_map_write(ctx, buf, 0, host_ptr, size);
+    cl_event ev = NULL;
+    cl_int err = clEnqueueWriteBuffer(gpufw_queue(ctx), buf, CL_TRUE, 0, size, host_ptr, 0, NULL, ctx->prof ? &ev : NULL);
     if (err != CL_SUCCESS) {
         fprintf(stderr, "gpufw_write_buffer: clEnqueueWriteBuffer failed (%d)\n", err);
     }
+    if (ev) { gpufw_prof_track(ctx, GPUFW_OP_WRITE, NULL, size, ev); clReleaseEvent(ev); }
     return err;
 }
 
 int gpufw_read_buffer(gpufw_ctx *ctx, cl_mem buf, void *host_ptr, size_t size) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("bytes", size);
     if (!ctx || !ctx->queue || !buf) return -1;
-    cl_int err = clEnqueueReadBuffer(ctx->queue, buf, CL_TRUE, 0, size, host_ptr, 0, NULL, NULL);
+    if (gpufw_use_staging(ctx, size)) return gpufw_staging_read(ctx, buf, 0, host_ptr, size);
+    if (gpufw_use_mapping(ctx)) return gpufw_map_read(ctx, buf, 0, host_ptr, size);
+    cl_event ev = NULL;
+    cl_int err = clEnqueueReadBuffer(gpufw_queue(ctx), buf, CL_TRUE, 0, size, host_ptr, 0, NULL, ctx->prof ? &ev : NULL);
     if (err != CL_SUCCESS) {
         fprintf(stderr, "gpufw_read_buffer: clEnqueueReadBuffer failed (%d)\n", err);
     }
+    if (ev) { gpufw_prof_track(ctx, GPUFW_OP_READ, NULL, size, ev); clReleaseEvent(ev); }
     return err;
 }
 
 /* Set kernel arg wrapper */
 int gpufw_set_kernel_arg(gpufw_ctx *ctx, cl_kernel kernel, cl_uint index,
                          size_t arg_size, const void *arg_val){
+    GPUFW_TRACE_CALL();
     if (!kernel) return -1;
     cl_int err = clSetKernelArg(kernel, index, arg_size, arg_val);
     if (err != CL_SUCCESS) {
@@ -229,30 +265,222 @@ int gpufw_set_kernel_arg(gpufw_ctx *ctx, cl_kernel kernel, cl_uint index,
 /* Launch kernel with optional local size.
    If local_work_size == 0, pass NULL for local size letting runtime decide. */
 int gpufw_launch_kernel(gpufw_ctx *ctx, cl_kernel kernel, size_t global_work_size, size_t local_work_size) {
-    if (!ctx || !ctx->queue || !kernel) return -1;
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("items", global_work_size);
+    gpufw_event ev = NULL;
+    int err = gpufw_launch_kernel_async(ctx, kernel, global_work_size, local_work_size, 0, NULL, &ev);
+    if (err != CL_SUCCESS) return err;
+    /* Wait for completion for simplicity; use gpufw_launch_kernel_async to chain work instead */
+    err = gpufw_event_wait(1, &ev);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_launch_kernel: wait for completion failed (%d)\n", err);
+    }
+    gpufw_event_release(ev);
+    return err;
+}
+
+int gpufw_launch_kernel_nd(gpufw_ctx *ctx, cl_kernel kernel, cl_uint work_dim, const size_t *global_work_size,
+                           const size_t *local_work_size) {
+    GPUFW_TRACE_CALL();
+    gpufw_event ev = NULL;
+    int err = gpufw_launch_kernel_nd_async(ctx, kernel, work_dim, global_work_size, local_work_size, 0, NULL, &ev);
+    if (err != CL_SUCCESS) return err;
+    err = gpufw_event_wait(1, &ev);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_launch_kernel_nd: wait for completion failed (%d)\n", err);
+    }
+    gpufw_event_release(ev);
+    return err;
+}
+
+/* Async variants: same as the blocking calls but never wait on the host.
+   wait_list orders this command after earlier ones (also across queues). */
+int gpufw_write_buffer_async(gpufw_ctx *ctx, cl_mem buf, size_t offset, const void *host_ptr, size_t size,
+                             cl_uint num_wait, const gpufw_event *wait_list, gpufw_event *out_event) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("bytes", size);
+    if (!ctx || !ctx->queue || !buf || (num_wait > 0 && !wait_list)) return -1;
+    cl_event tmp = NULL;
+    cl_event *evp = out_event ? out_event : (ctx->prof ? &tmp : NULL);
+    cl_int err = clEnqueueWriteBuffer(gpufw_queue(ctx), buf, CL_FALSE, offset, size, host_ptr,
+                                      num_wait, num_wait ? wait_list : NULL, evp);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_write_buffer_async: clEnqueueWriteBuffer failed (%d)\n", err);
+    }
+    if (err == CL_SUCCESS && evp) gpufw_prof_track(ctx, GPUFW_OP_WRITE, NULL, size, *evp);
+    if (tmp) clReleaseEvent(tmp);
+    return err;
+}
+
+int gpufw_read_buffer_async(gpufw_ctx *ctx, cl_mem buf, size_t offset, void *host_ptr, size_t size,
+                            cl_uint num_wait, const gpufw_event *wait_list, gpufw_event *out_event) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("bytes", size);
+    if (!ctx || !ctx->queue || !buf || (num_wait > 0 && !wait_list)) return -1;
+    cl_event tmp = NULL;
+    cl_event *evp = out_event ? out_event : (ctx->prof ? &tmp : NULL);
+    cl_int err = clEnqueueReadBuffer(gpufw_queue(ctx), buf, CL_FALSE, offset, size, host_ptr,
+                                     num_wait, num_wait ? wait_list : NULL, evp);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_read_buffer_async: clEnqueueReadBuffer failed (%d)\n", err);
+    }
+    if (err == CL_SUCCESS && evp) gpufw_prof_track(ctx, GPUFW_OP_READ, NULL, size, *evp);
+    if (tmp) clReleaseEvent(tmp);
+    return err;
+}
+
+int gpufw_launch_kernel_async(gpufw_ctx *ctx, cl_kernel kernel, size_t global_work_size, size_t local_work_size,
+                              cl_uint num_wait, const gpufw_event *wait_list, gpufw_event *out_event) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("items", global_work_size);
+    if (!ctx || !ctx->queue || !kernel || (num_wait > 0 && !wait_list)) return -1;
     size_t gws = global_work_size;
-    cl_int err;
-    if (local_work_size == 0) {
-        err = clEnqueueNDRangeKernel(ctx->queue, kernel, 1, NULL, &gws, NULL, 0, NULL, NULL);
-    } else {
-        size_t lws = local_work_size;
-        err = clEnqueueNDRangeKernel(ctx->queue, kernel, 1, NULL, &gws, &lws, 0, NULL, NULL);
+    size_t lws = local_work_size ? local_work_size : gpufw_tune_pick(ctx, kernel, gws, num_wait, wait_list);
+    cl_event tmp = NULL;
+    cl_event *evp = out_event ? out_event : (ctx->prof ? &tmp : NULL);
+    cl_int err = clEnqueueNDRangeKernel(gpufw_queue(ctx), kernel, 1, NULL, &gws, lws ? &lws : NULL,
+                                        num_wait, num_wait ? wait_list : NULL, evp);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_launch_kernel_async: clEnqueueNDRangeKernel failed (%d)\n", err);
     }
+    if (err == CL_SUCCESS && evp) gpufw_prof_track_kernel(ctx, kernel, global_work_size, *evp);
+    if (tmp) clReleaseEvent(tmp);
+    return err;
+}
+
+int gpufw_launch_kernel_nd_async(gpufw_ctx *ctx, cl_kernel kernel, cl_uint work_dim, const size_t *global_work_size,
+                                 const size_t *local_work_size, cl_uint num_wait, const gpufw_event *wait_list,
+                                 gpufw_event *out_event) {
+    GPUFW_TRACE_CALL();
+    if (!ctx || !ctx->queue || !kernel || !global_work_size || work_dim < 1 || work_dim > 3 ||
+        (num_wait > 0 && !wait_list))
+        return -1;
+    size_t items = 1;
+    for (cl_uint d = 0; d < work_dim; d++) items *= global_work_size[d];
+    cl_event tmp = NULL;
+    cl_event *evp = out_event ? out_event : (ctx->prof ? &tmp : NULL);
+    cl_int err = clEnqueueNDRangeKernel(gpufw_queue(ctx), kernel, work_dim, NULL, global_work_size, local_work_size,
+                                        num_wait, num_wait ? wait_list : NULL, evp);
     if (err != CL_SUCCESS) {
-        fprintf(stderr, "gpufw_launch_kernel: clEnqueueNDRangeKernel failed (%d)\n", err);
-        return err;
+        fprintf(stderr, "gpufw_launch_kernel_nd_async: clEnqueueNDRangeKernel failed (%d)\n", err);
     }
-    /* Wait for completion for simplicity; caller may want to use events instead */
-    err = clFinish(ctx->queue);
+    if (err == CL_SUCCESS && evp) gpufw_prof_track_kernel(ctx, kernel, items, *evp);
+    if (tmp) clReleaseEvent(tmp);
+    return err;
+}
+
+/* Event helpers */
+int gpufw_event_wait(cl_uint num_events, const gpufw_event *events) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("events", num_events);
+    if (num_events == 0) return 0;
+    if (!events) return -1;
+    cl_int err = clWaitForEvents(num_events, events);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_event_wait: clWaitForEvents failed (%d)\n", err);
+    }
+    return err;
+}
+
+int gpufw_event_query(gpufw_event ev) {
+    if (!ev) return -1;
+    cl_int status = CL_QUEUED;
+    cl_int err = clGetEventInfo(ev, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, NULL);
+    if (err != CL_SUCCESS) return err;
+    if (status < 0) return status;      /* command terminated abnormally */
+    return status == CL_COMPLETE ? 1 : 0;
+}
+
+int gpufw_event_set_callback(gpufw_event ev, gpufw_event_callback cb, void *user_data) {
+    if (!ev || !cb) return -1;
+    cl_int err = clSetEventCallback(ev, CL_COMPLETE, cb, user_data);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "gpufw_event_set_callback: clSetEventCallback failed (%d)\n", err);
+    }
+    return err;
+}
+
+void gpufw_event_release(gpufw_event ev) {
+    if (ev) clReleaseEvent(ev);
+}
+
+int gpufw_flush(gpufw_ctx *ctx) {
+    GPUFW_TRACE_CALL();
+    if (!ctx || !ctx->queue) return -1;
+    return clFlush(gpufw_queue(ctx));
+}
+
+int gpufw_finish(gpufw_ctx *ctx) {
+    GPUFW_TRACE_CALL();
+    if (!ctx || !ctx->queue) return -1;
+    cl_int err = clFinish(gpufw_queue(ctx));
     if (err != CL_SUCCESS) {
-        fprintf(stderr, "gpufw_launch_kernel: clFinish failed (%d)\n", err);
+        fprintf(stderr, "gpufw_finish: clFinish failed (%d)\n", err);
     }
     return err;
 }
 
+int gpufw_vecadd_enqueue(gpufw_ctx *ctx, cl_kernel kernel, const float *a, const float *b, float *c,
+                         size_t n, cl_mem bufs[3], gpufw_event *done) {
+    size_t bytes = n * sizeof(float);
+    int n_arg = (int)n;
+    /* Specialized build of vecadd_vec when the kernel file has one */
+    gpufw_variant v;
+    cl_kernel vk = NULL;
+    size_t gws = n;
+    if (gpufw_variant_pick(ctx, n, &v) == 0 && gpufw_variant_kernel(ctx, "vecadd_vec", &v, &vk) == 0) {
+        kernel = vk;
+        gws = gpufw_variant_global_size(&v, n);
+    }
+    bufs[0] = gpufw_alloc_buffer(ctx, bytes, CL_MEM_READ_ONLY);
+    bufs[1] = gpufw_alloc_buffer(ctx, bytes, CL_MEM_READ_ONLY);
+    bufs[2] = gpufw_alloc_buffer(ctx, bytes, CL_MEM_WRITE_ONLY);
+    int err = (bufs[0] && bufs[1] && bufs[2]) ? 0 : -1;
+    if (!err) err = gpufw_write_buffer_async(ctx, bufs[0], 0, a, bytes, 0, NULL, NULL);
+    if (!err) err = gpufw_write_buffer_async(ctx, bufs[1], 0, b, bytes, 0, NULL, NULL);
+    for (cl_uint i = 0; i < 3 && !err; ++i)
+        err = gpufw_set_kernel_arg(ctx, kernel, i, sizeof(cl_mem), &bufs[i]);
+    if (!err) err = gpufw_set_kernel_arg(ctx, kernel, 3, sizeof(int), &n_arg);
+    if (!err) err = gpufw_launch_kernel_async(ctx, kernel, gws, 0, 0, NULL, NULL);
+    if (!err) err = gpufw_read_buffer_async(ctx, bufs[2], 0, c, bytes, 0, NULL, done);
+    return err;
+}
+
+/* c = a + b over n floats on the context's backend; blocks until c is written. */
+int gpufw_vecadd(gpufw_ctx *ctx, const float *a, const float *b, float *c, size_t n) {
+    GPUFW_TRACE_CALL();
+    GPUFW_TRACE_ARG("n", n);
+    if (!ctx || !a || !b || !c) return -1;
+    if (n == 0) return 0;
+    if (ctx->backend == GPUFW_BACKEND_NATIVE_CPU) return gpufw_cpu_vecadd(a, b, c, n);
+
+    cl_kernel kernel = NULL;
+    int err = gpufw_get_kernel(ctx, "vecadd", &kernel);
+    if (err != 0) return err;
+    cl_mem bufs[3] = { NULL, NULL, NULL };
+    gpufw_event ev = NULL;
+    err = gpufw_vecadd_enqueue(ctx, kernel, a, b, c, n, bufs, &ev);
+    if (!err) err = gpufw_event_wait(1, &ev);
+    else gpufw_finish(ctx);
+    gpufw_event_release(ev);
+    for (int i = 0; i < 3; ++i)
+        if (bufs[i]) gpufw_release_buffer(ctx, bufs[i]);
+    return err;
+}
+
 /* Cleanup all objects in ctx */
 void gpufw_cleanup(gpufw_ctx *ctx) {
+    GPUFW_TRACE_CALL();
     if (!ctx) return;
+    gpufw_startup_destroy(ctx);
+    gpufw_threads_destroy(ctx);
+    gpufw_hybrid_destroy(ctx);
+    gpufw_tune_destroy(ctx);
+    gpufw_variant_destroy(ctx);
+    gpufw_stream_destroy(ctx);
+    gpufw_prof_destroy(ctx);
+    gpufw_staging_destroy(ctx);
+    gpufw_pool_destroy(ctx);
     if (ctx->program) { clReleaseProgram(ctx->program); ctx->program = NULL; }
     if (ctx->queue)   { clReleaseCommandQueue(ctx->queue); ctx->queue = NULL; }
     if (ctx->context) { clReleaseContext(ctx->context); ctx->context = NULL; }
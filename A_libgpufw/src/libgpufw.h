@@ -3,6 +3,81 @@
 
 #include <CL/cl.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Program binary cache counters (see gpufw_build_program)
+typedef struct {
+    unsigned hits;          // programs loaded from a cached binary
+    unsigned misses;        // no usable entry, built from source
+    unsigned rejected;      // entry found but refused by the driver (entry is dropped)
+    unsigned stores;        // binaries written to the cache
+    double build_ms;        // time spent in source builds
+    double load_ms;         // time spent loading cached binaries
+    double saved_ms;        // recorded source build time minus load time, summed over hits
+} gpufw_cache_stats;
+
+// Device buffer pool counters (see gpufw_alloc_buffer)
+typedef struct {
+    unsigned long allocs;          // pooled gpufw_alloc_buffer calls
+    unsigned long hits;            // served from a free list
+    unsigned long frees;           // gpufw_release_buffer calls returned to the pool
+    unsigned long sub_allocs;      // sub-buffers carved out of slabs
+    unsigned long driver_allocs;   // clCreateBuffer calls made by the pool
+    unsigned long driver_frees;    // buffers/slabs handed back by gpufw_pool_trim
+    unsigned slabs;                // slabs currently held
+    size_t bytes_in_use;           // size-class bytes handed out
+    size_t bytes_cached;           // size-class bytes parked on free lists
+    size_t bytes_reserved;         // bytes held in slabs
+} gpufw_pool_stats;
+
+struct gpufw_pool;
+struct gpufw_staging;
+struct gpufw_prof;
+struct gpufw_stream;
+struct gpufw_hybrid;
+struct gpufw_tune;
+struct gpufw_variants;
+struct gpufw_threads;
+struct gpufw_startup;
+
+// Host <-> device transfer paths
+typedef enum {
+    GPUFW_XFER_AUTO = 0,    // pick per device (see gpufw_get_xfer_mode)
+    GPUFW_XFER_COPY,        // clEnqueueRead/WriteBuffer from pageable memory
+    GPUFW_XFER_MAP,         // CL_MEM_ALLOC_HOST_PTR + map/unmap, zero-copy on CPU/integrated devices
+    GPUFW_XFER_USE_HOST,    // CL_MEM_USE_HOST_PTR over page-aligned host memory
+    GPUFW_XFER_STAGED,      // DMA from pinned host memory, for discrete devices
+} gpufw_xfer_mode;
+
+// Execution backend of a context
+typedef enum {
+    GPUFW_BACKEND_OPENCL = 0,
+    GPUFW_BACKEND_NATIVE_CPU,   // host SIMD kernels, no OpenCL objects in the context
+} gpufw_backend;
+
+// How the context's program gets built
+typedef enum {
+    GPUFW_BUILD_EAGER = 0,      // inside init
+    GPUFW_BUILD_LAZY,           // on the first kernel request
+    GPUFW_BUILD_BACKGROUND,     // on a helper thread started by init; kernel requests wait for it
+} gpufw_build_mode;
+
+// Where init spent its time. The build is timed whenever it runs, which for
+// lazy and background builds is after init has returned.
+typedef struct {
+    double discover_ms;     // platform and device enumeration (near 0 when cached)
+    double source_ms;       // reading the kernel file or finding the embedded copy
+    double context_ms;      // clCreateContext
+    double queue_ms;        // command queue creation
+    double build_ms;        // program build or binary cache load
+    double setup_ms;        // profiling, tuning, variant and thread state
+    double wait_ms;         // kernel requests blocked on a lazy or background build
+    double total_ms;        // the init call itself
+    int discovery_cached;   // device lists came from an earlier init in this process
+    int embedded_source;    // source compiled into the library, no file read
+    gpufw_build_mode build_mode;
+} gpufw_init_stats;
 
 // OpenCL context structure
 typedef struct {
@@ -11,19 +86,533 @@ typedef struct {
     cl_context context;
     cl_command_queue queue;
     cl_program program;
+    gpufw_cache_stats cache_stats;
+    struct gpufw_pool *pool;    // created on first gpufw_alloc_buffer
+    gpufw_xfer_mode xfer_mode;  // resolved on first use unless set explicitly
+    struct gpufw_staging *staging;  // pinned staging ring, created on first staged transfer
+    struct gpufw_prof *prof;    // non-NULL when the queue has profiling enabled
+    struct gpufw_stream *stream;    // extra queues for gpufw_stream_run
+    gpufw_backend backend;
+    struct gpufw_hybrid *hybrid;    // learned CPU/device split ratios, loaded on first hybrid run
+    struct gpufw_tune *tune;        // tuned local sizes, loaded by GPUFW_INIT_AUTOTUNE or gpufw_autotune
+    struct gpufw_variants *variants;    // program source and the specialized builds made from it
+    struct gpufw_threads *threads;  // per-thread queues and kernel instances, locks with GPUFW_INIT_THREADS
+    gpufw_init_stats init_stats;
+    struct gpufw_startup *startup;  // deferred program build, see gpufw_program
 } gpufw_ctx;
 
+// Init options
+#define GPUFW_INIT_PROFILING  (1u << 0)   // CL_QUEUE_PROFILING_ENABLE + per-command records (also GPUFW_PROFILE=1)
+#define GPUFW_INIT_NATIVE_CPU (1u << 1)   // skip OpenCL, run workloads on the native CPU backend
+#define GPUFW_INIT_CPU_FALLBACK (1u << 2) // use the native CPU backend when no OpenCL device is usable
+#define GPUFW_INIT_AUTOTUNE   (1u << 3)   // tune untuned kernels on their first launch with local size 0 (also GPUFW_AUTOTUNE=1)
+#define GPUFW_INIT_THREADS    (1u << 4)   // share the context between host threads, each with its own queue (also GPUFW_THREADS=1)
+#define GPUFW_INIT_LAZY_BUILD (1u << 5)   // build the program on the first kernel request (also GPUFW_BUILD=lazy)
+#define GPUFW_INIT_BACKGROUND_BUILD (1u << 6)   // build it on a helper thread while init returns (also GPUFW_BUILD=background)
+
+typedef struct {
+    unsigned flags;         // GPUFW_INIT_*
+} gpufw_init_opts;
+
 // Initialization from kernel file
+// Platform and device lists are enumerated once per process and reused by
+// later inits. kernel_file is a path, or "embed:<name>" (e.g. embed:vecadd.cl)
+// for a kernels/ source compiled into the library; a path that does not exist
+// falls back to the embedded file of the same name, and GPUFW_EMBEDDED=1
+// prefers embedded copies over files. GPUFW_BUILD=eager|lazy|background
+// overrides the build flags.
 int gpufw_init_from_file(gpufw_ctx *ctx, const char *kernel_file, int device_index);
+int gpufw_init_ex(gpufw_ctx *ctx, const char *kernel_file, int device_index, const gpufw_init_opts *opts);
+const char *gpufw_embedded_source(const char *name, size_t *length);
+// The context's program, finishing a lazy or background build first (NULL if it failed).
+// gpufw_create_kernel and gpufw_get_kernel go through it; use it instead of ctx->program.
+cl_program gpufw_program(gpufw_ctx *ctx);
+void gpufw_init_print_stats(const gpufw_ctx *ctx, FILE *out);
+
+// Program build with on-disk binary cache.
+// Binaries are keyed by source hash, build options, device name, driver version
+// and platform. The cache lives in $GPUFW_CACHE_DIR, else $XDG_CACHE_HOME/gpufw,
+// else ~/.cache/gpufw; set GPUFW_CACHE=0 to always build from source.
+int gpufw_build_program(gpufw_ctx *ctx, const char *src, size_t src_len, const char *options, cl_program *out_program);
+void gpufw_cache_print_stats(const gpufw_ctx *ctx, FILE *out);
 
 // Buffer management
+// Buffers come from a per-context pool: small sizes are sub-allocated from slab
+// buffers, everything is rounded up to a size class and recycled through
+// gpufw_release_buffer. Flags involving host pointers bypass the pool, as does
+// every allocation when GPUFW_POOL=0. A released buffer may be handed out again
+// immediately, so release only after the commands using it have been enqueued
+// on ctx->queue (or have completed, if other queues touch it, which includes
+// every context initialized with GPUFW_INIT_THREADS). In the MAP and USE_HOST
+// transfer modes buffers are host-allocated and gpufw_write_buffer/
+// gpufw_read_buffer map them instead of copying; the async transfers copy.
 cl_mem gpufw_alloc_buffer(gpufw_ctx *ctx, size_t size, cl_mem_flags flags);
+int gpufw_release_buffer(gpufw_ctx *ctx, cl_mem buf);
+int gpufw_pool_configure(gpufw_ctx *ctx, size_t slab_size, size_t small_limit);   // 0 keeps the default
+void gpufw_pool_trim(gpufw_ctx *ctx);
+void gpufw_pool_get_stats(const gpufw_ctx *ctx, gpufw_pool_stats *out);
 int gpufw_write_buffer(gpufw_ctx *ctx, cl_mem buf, const void *host_ptr, size_t size);
 int gpufw_read_buffer(gpufw_ctx *ctx, cl_mem buf, void *host_ptr, size_t size);
 
+// Host-visible buffers
+// A device buffer paired with host memory reachable through map/unmap. The
+// same fill -> unmap -> launch -> map(READ) sequence works in every mode:
+// MAP and USE_HOST map in place (no copy), COPY and STAGED keep a host shadow
+// that is uploaded on unmap and fetched on map. STAGED shadows are pinned.
+typedef struct {
+    cl_mem mem;             // pass this to kernels
+    void *host;             // valid between gpufw_hbuf_map and gpufw_hbuf_unmap
+    size_t size;
+    gpufw_xfer_mode mode;
+    cl_map_flags map_flags;
+    void *host_alloc;       // shadow / USE_HOST backing memory
+    cl_mem pinned;          // STAGED: ALLOC_HOST_PTR buffer backing host_alloc
+    cl_event upload;        // STAGED: upload from host_alloc still reading it
+} gpufw_hbuf;
+
+// GPUFW_XFER_MAP on CPU or unified-memory devices, GPUFW_XFER_STAGED otherwise;
+// GPUFW_XFER=copy|map|usehost|staged overrides the choice.
+gpufw_xfer_mode gpufw_get_xfer_mode(gpufw_ctx *ctx);
+void gpufw_set_xfer_mode(gpufw_ctx *ctx, gpufw_xfer_mode mode);
+const char *gpufw_xfer_mode_name(gpufw_xfer_mode mode);
+// Path gpufw_write_buffer/gpufw_read_buffer take for size bytes: STAGED, MAP
+// (also in USE_HOST mode) or COPY
+gpufw_xfer_mode gpufw_buffer_xfer_path(gpufw_ctx *ctx, size_t size);
+
+int gpufw_hbuf_alloc(gpufw_ctx *ctx, size_t size, cl_mem_flags access, gpufw_xfer_mode mode, gpufw_hbuf *out);
+void *gpufw_hbuf_map(gpufw_ctx *ctx, gpufw_hbuf *hb, cl_map_flags flags);
+int gpufw_hbuf_unmap(gpufw_ctx *ctx, gpufw_hbuf *hb);
+void gpufw_hbuf_free(gpufw_ctx *ctx, gpufw_hbuf *hb);
+
+// Transfers from/to ordinary pageable memory through a ring of pinned chunks.
+// gpufw_write_buffer/gpufw_read_buffer use this automatically for large sizes
+// when the transfer mode is GPUFW_XFER_STAGED.
+int gpufw_staging_write(gpufw_ctx *ctx, cl_mem buf, size_t offset, const void *src, size_t size);
+int gpufw_staging_read(gpufw_ctx *ctx, cl_mem buf, size_t offset, void *dst, size_t size);
+
 // Kernel argument & launch
+int gpufw_create_kernel(gpufw_ctx *ctx, const char *kernel_name, cl_kernel *out_kernel);
 int gpufw_set_kernel_arg(gpufw_ctx *ctx, cl_kernel kernel, cl_uint index, size_t size, const void *value);
 int gpufw_launch_kernel(gpufw_ctx *ctx, cl_kernel kernel, size_t global_work_size, size_t local_work_size);
+// 1-3 dimensional NDRange; local_work_size may be NULL to let the runtime pick (no autotuning)
+int gpufw_launch_kernel_nd(gpufw_ctx *ctx, cl_kernel kernel, cl_uint work_dim, const size_t *global_work_size,
+                           const size_t *local_work_size);
+
+// Asynchronous operations
+// Each call enqueues without blocking the host. Work starts only after every
+// event in wait_list has completed; if out_event is non-NULL it receives a
+// handle the caller must release with gpufw_event_release. Host memory passed
+// to the async transfers must stay valid until the returned event completes.
+typedef cl_event gpufw_event;
+typedef void (CL_CALLBACK *gpufw_event_callback)(gpufw_event ev, cl_int status, void *user_data);
+
+int gpufw_write_buffer_async(gpufw_ctx *ctx, cl_mem buf, size_t offset, const void *host_ptr, size_t size,
+                             cl_uint num_wait, const gpufw_event *wait_list, gpufw_event *out_event);
+int gpufw_read_buffer_async(gpufw_ctx *ctx, cl_mem buf, size_t offset, void *host_ptr, size_t size,
+                            cl_uint num_wait, const gpufw_event *wait_list, gpufw_event *out_event);
+int gpufw_launch_kernel_async(gpufw_ctx *ctx, cl_kernel kernel, size_t global_work_size, size_t local_work_size,
+                              cl_uint num_wait, const gpufw_event *wait_list, gpufw_event *out_event);
+int gpufw_launch_kernel_nd_async(gpufw_ctx *ctx, cl_kernel kernel, cl_uint work_dim, const size_t *global_work_size,
+                                 const size_t *local_work_size, cl_uint num_wait, const gpufw_event *wait_list,
+                                 gpufw_event *out_event);
+
+// Event handling
+int gpufw_event_wait(cl_uint num_events, const gpufw_event *events);
+int gpufw_event_query(gpufw_event ev);   // 1 = complete, 0 = pending, <0 = error code
+int gpufw_event_set_callback(gpufw_event ev, gpufw_event_callback cb, void *user_data);
+void gpufw_event_release(gpufw_event ev);
+
+// Queue synchronization
+int gpufw_flush(gpufw_ctx *ctx);
+int gpufw_finish(gpufw_ctx *ctx);
+
+// Streaming execution
+// Runs a 1-D elementwise kernel over n elements in chunks, overlapping the
+// upload of chunk i+1, the kernel on chunk i and the download of chunk i-1.
+// Only depth chunks are resident on the device at once, so n may exceed
+// device memory. The kernel must take (in_0, ..., in_{k-1}, out, int n), like
+// vecadd, and guard on gid < n.
+#define GPUFW_STREAM_MAX_INPUTS 8
+#define GPUFW_STREAM_MAX_DEPTH  4
+
+typedef struct {
+    size_t chunk_elems;         // elements per chunk (0 = 1M)
+    unsigned depth;             // buffer sets in flight, 2..GPUFW_STREAM_MAX_DEPTH (0 = 3)
+    unsigned num_queues;        // 3 = upload/compute/download queues (default),
+                                // 2 = shared copy queue, 1 = one out-of-order queue
+    size_t local_work_size;     // 0 lets the runtime choose
+} gpufw_stream_opts;
+
+int gpufw_stream_run(gpufw_ctx *ctx, cl_kernel kernel, size_t n, size_t elem_size,
+                     unsigned num_inputs, const void *const *inputs, void *output,
+                     const gpufw_stream_opts *opts);
+
+// Out-of-core streaming between files
+// gpufw_stream_files runs the same kind of kernel over binary files of
+// elements: every input file must hold the same number of elements, and the
+// output file is created (or truncated) to that size. The files are mapped
+// one window at a time with sequential readahead, each window goes through
+// gpufw_stream_run, and the window is unmapped before the next one is mapped.
+// Resident memory therefore stays near (inputs + 1) * window bytes above
+// where it started, whatever the file sizes. Results reach the output file
+// through the page cache; a full disk shows up as SIGBUS while writing.
+typedef struct {
+    size_t window_elems;        // elements mapped per file at a time (0 = 64 MiB worth)
+    gpufw_stream_opts stream;   // chunking within a window
+} gpufw_file_stream_opts;
+
+typedef struct {
+    size_t elems, windows;
+    double ms, gbps;            // wall time; file bytes read + written per second
+    size_t base_rss;            // resident bytes before the run
+    size_t peak_rss;            // highest resident bytes sampled after each window
+} gpufw_file_stream_stats;
+
+int gpufw_stream_files(gpufw_ctx *ctx, cl_kernel kernel, size_t elem_size, unsigned num_inputs,
+                       const char *const *input_paths, const char *output_path,
+                       const gpufw_file_stream_opts *opts, gpufw_file_stream_stats *stats);
+
+// Workloads
+// Whole-job entry points that run on whichever backend ctx was set up with:
+// the kernels in ctx->program, or the native CPU kernels below.
+int gpufw_vecadd(gpufw_ctx *ctx, const float *a, const float *b, float *c, size_t n);
+
+// Native CPU backend
+// Hand-vectorized kernels chosen by runtime CPU feature detection (capped by
+// GPUFW_CPU_ISA=scalar|sse2|avx2|avx512) and split across a persistent worker
+// pool sized to the online CPUs (GPUFW_CPU_THREADS overrides).
+typedef enum {
+    GPUFW_ISA_SCALAR = 0,
+    GPUFW_ISA_SSE2,
+    GPUFW_ISA_AVX2,
+    GPUFW_ISA_AVX512,
+} gpufw_cpu_isa;
+
+typedef void (*gpufw_cpu_range_fn)(void *arg, size_t begin, size_t end);
+
+gpufw_cpu_isa gpufw_cpu_detect_isa(void);
+const char *gpufw_cpu_isa_name(gpufw_cpu_isa isa);
+unsigned gpufw_cpu_threads(void);
+// Runs fn over [0, n) in contiguous ranges, one per thread; inline below min_parallel.
+void gpufw_cpu_parallel_for(size_t n, size_t min_parallel, gpufw_cpu_range_fn fn, void *arg);
+int gpufw_cpu_vecadd(const float *a, const float *b, float *c, size_t n);
+void gpufw_cpu_shutdown(void);     // joins the workers; later calls run single-threaded
+
+// Result validation
+// gpufw_validate_f32 compares every element of a device output with a host
+// reference on the CPU worker pool, with AVX2/AVX-512 comparisons where the
+// CPU has them, so checking runs at about host memory bandwidth. An element
+// matches when it is within max_ulp units in the last place, or within
+// max_abs, or within max_rel * |want|; zeroed options mean exact (+0 == -0).
+// ULP histograms and the maximum errors cover elements where both values are
+// finite or, with GPUFW_INF_ULP, infinite.
+typedef enum {
+    GPUFW_NAN_MATCH = 0,    // NaN matches NaN only
+    GPUFW_NAN_FAIL,         // any NaN in the output is a mismatch
+    GPUFW_NAN_SKIP,         // elements where either side is NaN are skipped
+} gpufw_nan_policy;
+
+typedef enum {
+    GPUFW_INF_EXACT = 0,    // an infinity matches the same infinity only
+    GPUFW_INF_ULP,          // compared like finite values (FLT_MAX is 1 ulp from INFINITY)
+} gpufw_inf_policy;
+
+#define GPUFW_VALIDATE_MAX_REPORT 16
+#define GPUFW_VALIDATE_HIST_BINS  7    // ulp distance 0, 1, 2-3, 4-15, 16-255, 256-65535, more
+
+typedef struct {
+    uint32_t max_ulp;
+    double max_abs;
+    double max_rel;
+    gpufw_nan_policy nan;
+    gpufw_inf_policy inf;
+    unsigned max_report;    // mismatches to record in detail (0 or more = GPUFW_VALIDATE_MAX_REPORT)
+} gpufw_validate_opts;
+
+typedef struct {
+    size_t index;
+    float got, want;
+    uint32_t ulp;           // UINT32_MAX for NaN/infinity mismatches
+} gpufw_mismatch;
+
+typedef struct {
+    size_t n, mismatches;
+    size_t nan_got, inf_got;    // NaNs and infinities in the output
+    size_t skipped;             // GPUFW_NAN_SKIP
+    uint32_t max_ulp;
+    size_t max_ulp_index;
+    double max_abs_err, max_rel_err;
+    size_t hist[GPUFW_VALIDATE_HIST_BINS];
+    gpufw_mismatch first[GPUFW_VALIDATE_MAX_REPORT];    // lowest indices first
+    unsigned nfirst;
+    double ms, gbps;            // gbps counts both arrays
+} gpufw_validate_report;
+
+// 0 when every element matches, 1 on mismatches, -1 on bad arguments
+int gpufw_validate_f32(const float *got, const float *want, size_t n, const gpufw_validate_opts *opts,
+                       gpufw_validate_report *report);
+void gpufw_validate_print(const gpufw_validate_report *report, const char *name, FILE *out);
+
+// Hybrid execution
+// Splits one job between the native CPU backend and the OpenCL device of ctx,
+// running both halves concurrently. The device share is learned per workload
+// and size bucket (floor(log2 n)) from an EWMA of each side's measured
+// throughput, so both finish at about the same time. Ratios are loaded from
+// and saved to hybrid.db in the cache directory ($GPUFW_HYBRID_DB overrides
+// the path, GPUFW_HYBRID_DB=0 keeps them in memory only).
+#define GPUFW_HYBRID_NAME_LEN 32
+
+typedef struct {
+    char workload[GPUFW_HYBRID_NAME_LEN];
+    unsigned bucket;            // floor(log2 n)
+    double ratio;               // share of the elements sent to the OpenCL device
+    double cpu_rate, gpu_rate;  // EWMA throughput in elements/ms (0 until measured)
+    unsigned long runs;
+} gpufw_hybrid_entry;
+
+int gpufw_hybrid_vecadd(gpufw_ctx *ctx, const float *a, const float *b, float *c, size_t n);
+const gpufw_hybrid_entry *gpufw_hybrid_entries(gpufw_ctx *ctx, size_t *count);
+int gpufw_hybrid_save(gpufw_ctx *ctx);
+void gpufw_hybrid_print(gpufw_ctx *ctx, FILE *out);
+
+// Multi-device execution
+// One gpufw_ctx per discovered device (any platform), each with its own queue
+// and program build. gpufw_multi_run splits an elementwise job of the same
+// shape as gpufw_stream_run across them: the first split is weighted by
+// compute units x clock, later splits follow each device's measured throughput.
+// Every device reads its slice directly into place in output.
+#define GPUFW_MAX_DEVICES 16
+
+typedef struct {
+    unsigned count;
+    gpufw_ctx dev[GPUFW_MAX_DEVICES];
+    double weight[GPUFW_MAX_DEVICES];       // share of the NDRange, sums to 1
+    double last_ms[GPUFW_MAX_DEVICES];      // wall time of each device's slice in the last run
+    size_t last_elems[GPUFW_MAX_DEVICES];
+    cl_kernel kernel[GPUFW_MAX_DEVICES];    // cached per device for kernel_name
+    char kernel_name[64];
+} gpufw_multi_ctx;
+
+int gpufw_multi_init(gpufw_multi_ctx *m, const char *kernel_file, cl_device_type type, const gpufw_init_opts *opts);
+int gpufw_multi_run(gpufw_multi_ctx *m, const char *kernel_name, size_t n, size_t elem_size,
+                    unsigned num_inputs, const void *const *inputs, void *output, size_t local_work_size);
+void gpufw_multi_print(const gpufw_multi_ctx *m, FILE *out);
+void gpufw_multi_cleanup(gpufw_multi_ctx *m);
+
+// Profiling
+// With GPUFW_INIT_PROFILING every write, read, launch and map issued through
+// libgpufw keeps its event; gpufw_profile_collect reads the QUEUED/SUBMIT/
+// START/END timestamps (waiting for outstanding commands) into records.
+#define GPUFW_PROF_NAME_LEN 48
+
+typedef enum {
+    GPUFW_OP_WRITE,
+    GPUFW_OP_READ,
+    GPUFW_OP_KERNEL,
+    GPUFW_OP_COPY,
+    GPUFW_OP_MAP,
+    GPUFW_OP_UNMAP,
+} gpufw_op_kind;
+
+typedef struct {
+    gpufw_op_kind kind;
+    char name[GPUFW_PROF_NAME_LEN];     // kernel function name, or the op kind
+    size_t bytes;                       // transfer size; global work size for kernels
+    cl_ulong queued, submit, start, end;    // device timestamps in ns
+} gpufw_prof_record;
+
+typedef struct {
+    gpufw_op_kind kind;
+    char name[GPUFW_PROF_NAME_LEN];
+    unsigned long count;
+    size_t bytes;
+    double total_ms, mean_ms, min_ms, max_ms;
+    double p50_ms, p95_ms, p99_ms;      // execution time (END - START) percentiles
+    double queue_ms;                    // mean START - QUEUED: host/driver overhead before execution
+} gpufw_prof_summary;
+
+int gpufw_profile_collect(gpufw_ctx *ctx);
+const gpufw_prof_record *gpufw_profile_records(gpufw_ctx *ctx, size_t *count);
+int gpufw_profile_summarize(gpufw_ctx *ctx, gpufw_prof_summary **out, size_t *count);  // caller frees *out
+void gpufw_profile_print(gpufw_ctx *ctx, FILE *out);
+void gpufw_profile_reset(gpufw_ctx *ctx);
+const char *gpufw_op_kind_name(gpufw_op_kind kind);
+
+// Work-group size tuning
+// gpufw_autotune times the runtime's default and every local size that is a
+// multiple of CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, fits
+// CL_KERNEL_WORK_GROUP_SIZE and divides the global size, then records the
+// fastest per kernel name, program build options, device and size class
+// (floor(log2 gws)) in tune-*.db in the cache directory ($GPUFW_TUNE_DB
+// overrides the path, GPUFW_TUNE_DB=0 keeps results in memory only). Once a
+// context has tuning state (GPUFW_INIT_AUTOTUNE, or a gpufw_autotune call),
+// launches with local size 0 use the recorded size; without it they leave the
+// choice to the runtime at no extra cost. With GPUFW_INIT_AUTOTUNE, such a
+// launch on an untuned kernel waits for its wait list and sweeps first,
+// re-running the kernel with its current arguments, so only use it with
+// kernels that can safely run more than once.
+typedef struct {
+    char kernel[GPUFW_PROF_NAME_LEN];
+    uint64_t options;           // hash of the program's build options, 0 = none
+    unsigned size_class;        // floor(log2 global_work_size)
+    size_t local_size;          // 0 = the runtime's choice was fastest
+    double ms;                  // best measured time
+} gpufw_tune_entry;
+
+int gpufw_autotune(gpufw_ctx *ctx, cl_kernel kernel, size_t global_work_size, size_t *best_local);
+size_t gpufw_tuned_local_size(gpufw_ctx *ctx, cl_kernel kernel, size_t global_work_size);  // 0 if none
+const gpufw_tune_entry *gpufw_tune_entries(gpufw_ctx *ctx, size_t *count);
+int gpufw_tune_save(gpufw_ctx *ctx);
+void gpufw_tune_print(gpufw_ctx *ctx, FILE *out);
+
+// Specialized kernel variants
+// Kernels such as vecadd_vec are written against three build-time macros:
+// GPUFW_VW floats per vector load (1, 2, 4, 8 or 16), GPUFW_EPT vectors per
+// work-item, and GPUFW_EXACT=1 to drop the bounds checks when n is a
+// multiple of GPUFW_VW * GPUFW_EPT. gpufw_variant_pick chooses the width from
+// CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT and packs more work into each
+// work-item only while enough remain to fill the compute units
+// (GPUFW_VARIANT=off|<width>x<per-item> overrides). Each option set is built
+// once per context, through the binary cache; gpufw_vecadd uses this
+// automatically when its kernel file has vecadd_vec.
+typedef struct {
+    unsigned vec_width;     // floats per vector load
+    unsigned per_item;      // vectors handled by each work-item
+    int exact;              // n is a multiple of vec_width * per_item: no bounds checks
+} gpufw_variant;
+
+int gpufw_variant_pick(gpufw_ctx *ctx, size_t n, gpufw_variant *out);     // -1: use the generic kernel
+int gpufw_variant_fixed(size_t n, unsigned vec_width, unsigned per_item, gpufw_variant *out);
+size_t gpufw_variant_global_size(const gpufw_variant *v, size_t n);
+// Kernel kernel_name from the build for v, one instance per calling thread;
+// owned by ctx, do not release it
+int gpufw_variant_kernel(gpufw_ctx *ctx, const char *kernel_name, const gpufw_variant *v, cl_kernel *out_kernel);
+const char *gpufw_variant_str(const gpufw_variant *v, char *buf, size_t len);      // e.g. "float4x2 exact"
+
+// Device characterization
+// gpufw_characterize measures what the device can do: host <-> device
+// bandwidth from pageable memory, from pinned (ALLOC_HOST_PTR) memory and
+// through map/unmap, device-memory copy bandwidth, FP32 FMA throughput and the
+// enqueue-to-completion time of an empty kernel. Rates are the best of a few
+// runs. Profiles are stored per device and driver in device-*.db in the cache
+// directory ($GPUFW_DEVICE_PROFILE overrides the path).
+typedef struct {
+    char device[128];
+    size_t bytes;                               // transfer size measured
+    double h2d_pageable_gbps, h2d_pinned_gbps, h2d_mapped_gbps;
+    double d2h_pageable_gbps, d2h_pinned_gbps, d2h_mapped_gbps;
+    double d2d_gbps;                            // clEnqueueCopyBuffer, read + write bytes
+    double fp32_gflops;                         // FMA counts as 2 FLOPs
+    double launch_us;                           // median
+} gpufw_device_profile;
+
+int gpufw_characterize(gpufw_ctx *ctx, size_t bytes, gpufw_device_profile *out);   // bytes 0 = 64 MiB
+int gpufw_device_profile_save(gpufw_ctx *ctx, const gpufw_device_profile *p);
+int gpufw_device_profile_load(gpufw_ctx *ctx, gpufw_device_profile *p);      // -1 if none stored
+void gpufw_device_profile_print(const gpufw_device_profile *p, FILE *out);
+// Roofline lower bound for a kernel moving bytes through device memory and
+// doing flops: max(bytes / d2d bandwidth, flops / FP32 peak)
+double gpufw_roofline_ms(const gpufw_device_profile *p, double bytes, double flops, int *compute_bound);
+// Host transfer rate of the path a transfer mode uses (STAGED = pinned, MAP/USE_HOST = mapped);
+// pass gpufw_buffer_xfer_path for the rate gpufw_write/read_buffer get
+double gpufw_xfer_gbps(const gpufw_device_profile *p, gpufw_xfer_mode mode, int to_device);
+
+// Multi-threaded use
+// A context initialized with GPUFW_INIT_THREADS may be used by several host
+// threads at once. Every thread that enqueues gets its own in-order queue on
+// first use (the initializing thread keeps ctx->queue), so commands from
+// different threads run concurrently and gpufw_finish waits only for the
+// caller's own work. Shared state - the buffer pool, staging ring, profiling
+// records, tuning and hybrid tables - is locked. A cl_kernel carries its
+// arguments, so each thread must launch its own instance: gpufw_get_kernel
+// returns one per thread, cached and owned by ctx. Queues of exited threads
+// are reused by later ones. Join all threads before gpufw_cleanup. Without the
+// flag there are no locks and every call uses ctx->queue.
+cl_command_queue gpufw_get_queue(gpufw_ctx *ctx);      // the calling thread's queue
+int gpufw_get_kernel(gpufw_ctx *ctx, const char *kernel_name, cl_kernel *out_kernel);  // do not release
+unsigned gpufw_thread_queues(const gpufw_ctx *ctx);    // queues created so far, including ctx->queue
+
+// Command graphs
+// A graph records a job pipeline - writes, kernel arguments, launches and
+// reads - once and replays it per job with a single call. Buffers and host
+// pointers are parameter slots bound at replay through gpufw_graph_args, and
+// transfer sizes, offsets, global sizes and integer kernel arguments scale with
+// the replay's element count n. Replay enqueues straight from the recorded
+// steps on the calling thread's queue without blocking and without re-checking
+// the pipeline. Runs of consecutive launches go through cl_khr_command_buffer
+// when the device has it (GPUFW_GRAPH_CMDBUF=0 disables), keeping a few
+// finalized command buffers per run keyed by the bindings; otherwise they are
+// enqueued one by one. Arguments recorded for a kernel are set right before its
+// next recorded launch; arguments set outside the graph persist as usual. A
+// graph and the kernels it launches belong to one thread at a time, and
+// graphs must be released before gpufw_cleanup.
+#define GPUFW_GRAPH_MAX_PARAMS 8
+typedef struct gpufw_graph gpufw_graph;
+
+typedef struct {
+    size_t mul, div, add;       // ceil(n * mul / div) + add
+} gpufw_graph_size;
+#define GPUFW_GRAPH_FIXED(v)    ((gpufw_graph_size){ 0, 1, (v) })
+#define GPUFW_GRAPH_N(mul)      ((gpufw_graph_size){ (mul), 1, 0 })    // n * mul, e.g. bytes of n floats
+#define GPUFW_GRAPH_N_DIV(div)  ((gpufw_graph_size){ 1, (div), 0 })    // ceil(n / div), e.g. items per work-item
+
+typedef struct {
+    cl_mem mem[GPUFW_GRAPH_MAX_PARAMS];
+    const void *src[GPUFW_GRAPH_MAX_PARAMS];    // write sources, valid until *done completes
+    void *dst[GPUFW_GRAPH_MAX_PARAMS];          // read destinations
+    size_t n;
+} gpufw_graph_args;
+
+gpufw_graph *gpufw_graph_begin(gpufw_ctx *ctx);
+int gpufw_graph_write(gpufw_graph *g, unsigned mem, gpufw_graph_size offset, unsigned src, gpufw_graph_size bytes);
+int gpufw_graph_read(gpufw_graph *g, unsigned mem, gpufw_graph_size offset, unsigned dst, gpufw_graph_size bytes);
+int gpufw_graph_arg(gpufw_graph *g, cl_kernel kernel, cl_uint index, size_t size, const void *value);  // constant
+int gpufw_graph_arg_mem(gpufw_graph *g, cl_kernel kernel, cl_uint index, unsigned mem);
+int gpufw_graph_arg_size(gpufw_graph *g, cl_kernel kernel, cl_uint index, size_t size, gpufw_graph_size value);  // 4 or 8 bytes
+int gpufw_graph_launch(gpufw_graph *g, cl_kernel kernel, gpufw_graph_size global, size_t local);  // local 0 = tuned
+int gpufw_graph_end(gpufw_graph *g);       // fails if any recording call failed
+int gpufw_graph_uses_cmdbuf(const gpufw_graph *g);
+// *done (may be NULL) completes with the last step; release it with gpufw_event_release
+int gpufw_graph_replay(gpufw_ctx *ctx, gpufw_graph *g, const gpufw_graph_args *args, gpufw_event *done);
+void gpufw_graph_release(gpufw_graph *g);
+
+// Tracing
+// Records the run as a Chrome trace-event JSON file that opens in Perfetto
+// (ui.perfetto.dev) or chrome://tracing. It holds a span for every libgpufw
+// call on the thread that made it and the application's own events. It also
+// holds every device command of contexts initialized while tracing is on
+// (they get GPUFW_INIT_PROFILING), one track per queue, with the OpenCL
+// timestamps shifted onto the host clock and an arrow from the enqueueing
+// call. Device commands reach the trace when their records are collected:
+// by the profiling calls, every 4096 commands, or in gpufw_cleanup. Events go
+// to per-thread buffers without locks and are formatted only when the file
+// is written; with tracing off a call pays one flag test. GPUFW_TRACE=<path>
+// traces from library load to exit, with "%p" in the path replaced by the
+// pid. Timestamps are CLOCK_MONOTONIC, so files written by processes on the
+// same machine line up when merged. cat, name and arg_name must outlive the
+// trace (string literals, __func__). Start and stop from one thread at a time.
+typedef struct {
+    const char *cat, *name;
+    const char *arg_name;       // optional number shown with the span
+    uint64_t arg;
+    uint64_t start_ns;          // 0 when tracing was off at the start
+} gpufw_trace_span;
+
+int gpufw_trace_start(const char *path);
+int gpufw_trace_stop(void);     // writes the file; -1 if not tracing or the write failed
+int gpufw_trace_enabled(void);
+void gpufw_trace_thread_name(const char *name);    // copied; labels the calling thread's track
+gpufw_trace_span gpufw_trace_span_begin(const char *cat, const char *name);
+void gpufw_trace_span_end(gpufw_trace_span *span);
+void gpufw_trace_instant(const char *cat, const char *name, const char *arg_name, uint64_t arg);
+// Spans that may begin and end on different threads; those sharing an id nest
+void gpufw_trace_async_begin(const char *cat, const char *name, uint64_t id, const char *arg_name, uint64_t arg);
+void gpufw_trace_async_end(const char *cat, const char *name, uint64_t id);
+// A span over the rest of the enclosing block; GPUFW_TRACE_ARG attaches a number to it
+#define GPUFW_TRACE_SCOPE(cat, name) \
+    gpufw_trace_span gpufw_trace_scope_ __attribute__((cleanup(gpufw_trace_span_end))) = gpufw_trace_span_begin(cat, name)
+#define GPUFW_TRACE_ARG(key, value) \
+    (gpufw_trace_scope_.arg_name = (key), gpufw_trace_scope_.arg = (uint64_t)(value))
 
 // Cleanup
 void gpufw_cleanup(gpufw_ctx *ctx);
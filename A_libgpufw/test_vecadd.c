@@ -1,18 +1,249 @@
 #include "src/libgpufw.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define FILE_BLOCK (1 << 20)    // floats per stdio block when generating/checking files
+
+// Write a[i] = i and b[i] = n - i to two files, one block at a time
+static int gen_files(size_t n, const char *path_a, const char *path_b) {
+    FILE *fa = fopen(path_a, "wb"), *fb = fopen(path_b, "wb");
+    float *blk = (float*)malloc(2 * FILE_BLOCK * sizeof(float));
+    int ok = fa && fb && blk;
+    for(size_t off = 0; ok && off < n; off += FILE_BLOCK) {
+        size_t len = n - off < FILE_BLOCK ? n - off : FILE_BLOCK;
+        for(size_t i = 0; i < len; i++) {
+            blk[i] = (float)(off + i);
+            blk[FILE_BLOCK + i] = (float)(n - off - i);
+        }
+        ok = fwrite(blk, sizeof(float), len, fa) == len && fwrite(blk + FILE_BLOCK, sizeof(float), len, fb) == len;
+    }
+    if(fa && fclose(fa) != 0) ok = 0;
+    if(fb && fclose(fb) != 0) ok = 0;
+    free(blk);
+    return ok ? 0 : -1;
+}
+
+// Compare out = a + b over the whole files; returns mismatches, or -1 on I/O errors
+static long check_files(const char *path_a, const char *path_b, const char *path_out) {
+    FILE *f[3] = { fopen(path_a, "rb"), fopen(path_b, "rb"), fopen(path_out, "rb") };
+    float *blk = (float*)malloc(3 * FILE_BLOCK * sizeof(float));
+    long bad = (f[0] && f[1] && f[2] && blk) ? 0 : -1;
+    size_t idx = 0;
+    while(bad >= 0) {
+        size_t len[3];
+        for(int k = 0; k < 3; k++) len[k] = fread(blk + k * FILE_BLOCK, sizeof(float), FILE_BLOCK, f[k]);
+        if(len[0] != len[1] || len[0] != len[2]) { bad = -1; break; }
+        if(len[0] == 0) break;
+        for(size_t i = 0; i < len[0]; i++) {
+            if(blk[2 * FILE_BLOCK + i] != blk[i] + blk[FILE_BLOCK + i]) bad++;
+            if(idx + i < 10) printf("%f + %f = %f\n", blk[i], blk[FILE_BLOCK + i], blk[2 * FILE_BLOCK + i]);
+        }
+        idx += len[0];
+    }
+    for(int k = 0; k < 3; k++) if(f[k]) fclose(f[k]);
+    free(blk);
+    return bad;
+}
+
+// Out-of-core run: a.bin + b.bin -> out.bin through memory-mapped windows
+static int run_files(const char *kernel_file, char **paths, size_t window) {
+    gpufw_ctx ctx;
+    gpufw_init_opts opts = { GPUFW_INIT_PROFILING };
+    if(gpufw_init_ex(&ctx, kernel_file, 0, &opts) != 0) {
+        printf("GPU init failed\n");
+        return -1;
+    }
+    cl_kernel kernel = clCreateKernel(gpufw_program(&ctx), "vecadd", NULL);
+    const char *inputs[2] = { paths[0], paths[1] };
+    gpufw_file_stream_opts fopts = { window, { 0, 3, 3, 64 } };
+    gpufw_file_stream_stats st;
+    int rc = gpufw_stream_files(&ctx, kernel, sizeof(float), 2, inputs, paths[2], &fopts, &st);
+    if(rc != 0) {
+        printf("vecadd file stream failed\n");
+    } else {
+        printf("Streamed %zu elements in %zu windows: %.1f ms, %.2f GB/s\n", st.elems, st.windows, st.ms, st.gbps);
+        printf("Peak resident: %.1f MiB (%.1f MiB at start)\n", st.peak_rss / 1048576.0, st.base_rss / 1048576.0);
+        long bad = check_files(paths[0], paths[1], paths[2]);
+        if(bad != 0) {
+            printf("check failed: %ld mismatches\n", bad);
+            rc = -1;
+        }
+    }
+    gpufw_profile_print(&ctx, stdout);
+    clReleaseKernel(kernel);
+    gpufw_cleanup(&ctx);
+    return rc;
+}
+
+// Zero-copy run: inputs are written in place through gpufw_hbuf mappings and
+// the result is read back the same way, in the device's transfer mode
+static int run_hbuf(const char *kernel_file, size_t n) {
+    gpufw_ctx ctx;
+    if(gpufw_init_from_file(&ctx, kernel_file, 0) != 0) {
+        printf("GPU init failed\n");
+        return -1;
+    }
+    size_t bytes = n * sizeof(float);
+    gpufw_hbuf hb[3];
+    memset(hb, 0, sizeof(hb));
+    cl_kernel kernel = NULL;
+    float *a = (float*)malloc(bytes), *b = (float*)malloc(bytes), *ref = (float*)malloc(bytes);
+    int rc = (a && b && ref) ? 0 : -1;
+    cl_mem_flags access[3] = { CL_MEM_READ_ONLY, CL_MEM_READ_ONLY, CL_MEM_WRITE_ONLY };
+    for(int k = 0; k < 3 && rc == 0; k++)
+        rc = gpufw_hbuf_alloc(&ctx, bytes, access[k], GPUFW_XFER_AUTO, &hb[k]);
+    if(rc == 0) rc = gpufw_create_kernel(&ctx, "vecadd", &kernel);
+
+    for(int k = 0; k < 2 && rc == 0; k++) {
+        float *p = (float*)gpufw_hbuf_map(&ctx, &hb[k], CL_MAP_WRITE_INVALIDATE_REGION);
+        if(!p) { rc = -1; break; }
+        for(size_t i = 0; i < n; i++) p[i] = k == 0 ? (float)i : (float)(n - i);
+        memcpy(k == 0 ? a : b, p, bytes);
+        rc = gpufw_hbuf_unmap(&ctx, &hb[k]);
+    }
+    int n_arg = (int)n;
+    for(cl_uint k = 0; k < 3 && rc == 0; k++) rc = gpufw_set_kernel_arg(&ctx, kernel, k, sizeof(cl_mem), &hb[k].mem);
+    if(rc == 0) rc = gpufw_set_kernel_arg(&ctx, kernel, 3, sizeof(int), &n_arg);
+    if(rc == 0) rc = gpufw_launch_kernel(&ctx, kernel, n, 0);
+
+    const float *c = rc == 0 ? (const float*)gpufw_hbuf_map(&ctx, &hb[2], CL_MAP_READ) : NULL;
+    if(c) {
+        gpufw_validate_report rep;
+        gpufw_validate_opts vopts = { 0, 0.0, 0.0, GPUFW_NAN_MATCH, GPUFW_INF_EXACT, 10 };
+        gpufw_cpu_vecadd(a, b, ref, n);
+        if(gpufw_validate_f32(c, ref, n, &vopts, &rep) != 0) rc = 1;
+        printf("hbuf mode: %s\n", gpufw_xfer_mode_name(hb[2].mode));
+        gpufw_validate_print(&rep, "vecadd", stdout);
+        gpufw_hbuf_unmap(&ctx, &hb[2]);
+    } else {
+        printf("vecadd through host-visible buffers failed\n");
+        rc = -1;
+    }
+
+    for(int k = 0; k < 3; k++) gpufw_hbuf_free(&ctx, &hb[k]);
+    if(kernel) clReleaseKernel(kernel);
+    gpufw_cleanup(&ctx);
+    free(a); free(b); free(ref);
+    return rc;
+}
+
+// Hybrid run: each call splits vecadd between the device and the host thread
+// pool. With a kernel file that has no vecadd the device part fails every
+// time and the host has to cover the whole range, which must still succeed.
+static int run_hybrid(const char *kernel_file, size_t n) {
+    gpufw_ctx ctx;
+    gpufw_init_opts opts = { GPUFW_INIT_CPU_FALLBACK };
+    if(gpufw_init_ex(&ctx, kernel_file, 0, &opts) != 0) {
+        printf("GPU init failed\n");
+        return -1;
+    }
+    size_t bytes = n * sizeof(float);
+    float *a = (float*)malloc(bytes), *b = (float*)malloc(bytes);
+    float *c = (float*)malloc(bytes), *ref = (float*)malloc(bytes);
+    int rc = (a && b && c && ref) ? 0 : -1;
+    for(size_t i = 0; rc == 0 && i < n; i++) { a[i] = (float)i; b[i] = (float)(n - i); }
+    if(rc == 0) rc = gpufw_cpu_vecadd(a, b, ref, n);
+
+    gpufw_validate_opts vopts = { 0, 0.0, 0.0, GPUFW_NAN_MATCH, GPUFW_INF_EXACT, 10 };
+    gpufw_validate_report rep;
+    for(int run = 0; run < 3 && rc == 0; run++) {
+        memset(c, 0, bytes);
+        int err = gpufw_hybrid_vecadd(&ctx, a, b, c, n);
+        if(err != 0) {
+            printf("hybrid vecadd run %d failed (%d)\n", run, err);
+            rc = 1;
+        } else if(gpufw_validate_f32(c, ref, n, &vopts, &rep) != 0) {
+            gpufw_validate_print(&rep, "hybrid vecadd", stdout);
+            rc = 1;
+        }
+    }
+    if(rc == 0) {
+        gpufw_validate_print(&rep, "hybrid vecadd", stdout);
+        gpufw_hybrid_print(&ctx, stdout);
+    }
+    gpufw_cleanup(&ctx);
+    free(a); free(b); free(c); free(ref);
+    return rc;
+}
+
+// Multi-device run: vecadd split across every OpenCL device, each slice read
+// straight into place in the output. The second size leaves a remainder when
+// divided by the device count, so the slices cannot all be equal; each size
+// runs twice so the second split follows the measured throughput.
+static int run_multi(const char *kernel_file, size_t n) {
+    gpufw_multi_ctx *m = (gpufw_multi_ctx*)malloc(sizeof(*m));
+    if(!m || gpufw_multi_init(m, kernel_file, 0, NULL) != 0) {
+        printf("multi-device init failed\n");
+        free(m);
+        return -1;
+    }
+    size_t sizes[2] = { n, n - n % m->count + (m->count > 1 ? m->count - 1 : 1) };
+    size_t max_n = sizes[0] > sizes[1] ? sizes[0] : sizes[1];
+    size_t bytes = max_n * sizeof(float);
+    float *a = (float*)malloc(bytes), *b = (float*)malloc(bytes);
+    float *c = (float*)malloc(bytes), *ref = (float*)malloc(bytes);
+    int rc = (a && b && c && ref) ? 0 : -1;
+    for(size_t i = 0; rc == 0 && i < max_n; i++) { a[i] = (float)i; b[i] = (float)(max_n - i); }
+    if(rc == 0) rc = gpufw_cpu_vecadd(a, b, ref, max_n);
+
+    const void *inputs[2] = { a, b };
+    gpufw_validate_opts vopts = { 0, 0.0, 0.0, GPUFW_NAN_MATCH, GPUFW_INF_EXACT, 10 };
+    gpufw_validate_report rep;
+    printf("%u device(s)\n", m->count);
+    for(int k = 0; k < 2 && rc == 0; k++) {
+        for(int run = 0; run < 2 && rc == 0; run++) {
+            memset(c, 0, bytes);
+            if(gpufw_multi_run(m, "vecadd", sizes[k], sizeof(float), 2, inputs, c, 0) != 0) {
+                printf("multi-device vecadd of %zu elements failed\n", sizes[k]);
+                rc = 1;
+                break;
+            }
+            if(gpufw_validate_f32(c, ref, sizes[k], &vopts, &rep) != 0) rc = 1;
+        }
+        gpufw_validate_print(&rep, "multi vecadd", stdout);
+        gpufw_multi_print(m, stdout);
+    }
+    gpufw_multi_cleanup(m);
+    free(m);
+    free(a); free(b); free(c); free(ref);
+    return rc;
+}
 
 int main(int argc, char **argv) {
-    if(argc != 3) {
-        printf("Usage: %s <kernel_file> <vector_size>\n", argv[0]);
+    if(argc == 4 && strcmp(argv[2], "-z") == 0)
+        return run_hbuf(argv[1], (size_t)atol(argv[3]));
+    if(argc == 4 && strcmp(argv[2], "-m") == 0)
+        return run_multi(argv[1], (size_t)atol(argv[3]));
+    if(argc == 4 && strcmp(argv[2], "-y") == 0)
+        return run_hybrid(argv[1], (size_t)atol(argv[3]));
+    if(argc >= 6 && strcmp(argv[2], "-f") == 0)
+        return run_files(argv[1], argv + 3, argc >= 7 ? (size_t)atol(argv[6]) : 0);
+    if(argc == 6 && strcmp(argv[2], "-g") == 0)
+        return gen_files((size_t)atol(argv[3]), argv[4], argv[5]);
+    if(argc != 3 && argc != 4) {
+        printf("Usage: %s <kernel_file> <vector_size> [chunk_elems]\n", argv[0]);
+        printf("       %s <kernel_file> -g <vector_size> <a.bin> <b.bin>\n", argv[0]);
+        printf("       %s <kernel_file> -f <a.bin> <b.bin> <out.bin> [window_elems]\n", argv[0]);
+        printf("       %s <kernel_file> -z <vector_size>\n", argv[0]);
+        printf("       %s <kernel_file> -y <vector_size>\n", argv[0]);
+        printf("       %s <kernel_file> -m <vector_size>\n", argv[0]);
+        printf("  chunk_elems > 0 streams the vectors through the device in pipelined chunks\n");
+        printf("  -g writes float input files, -f streams them from disk through mapped windows\n");
+        printf("  -z fills and reads host-visible buffers in place (zero-copy on CPU/unified devices)\n");
+        printf("  -y splits vecadd between device and host; a kernel file without vecadd forces the\n");
+        printf("     host to take over the device part\n");
+        printf("  -m splits vecadd across every OpenCL device and checks the merged output\n");
         return -1;
     }
 
     const char *kernel_file = argv[1];
     int n = atoi(argv[2]);
+    size_t chunk = (argc == 4) ? (size_t)atol(argv[3]) : 0;
 
     gpufw_ctx ctx;
-    if(gpufw_init_from_file(&ctx, kernel_file, 0) != 0) {
+    gpufw_init_opts opts = { GPUFW_INIT_PROFILING | GPUFW_INIT_AUTOTUNE };
+    if(gpufw_init_ex(&ctx, kernel_file, 0, &opts) != 0) {
         printf("GPU init failed\n");
         return -1;
     }
@@ -24,32 +255,77 @@ int main(int argc, char **argv) {
 
     for(int i = 0; i < n; i++) { a[i] = i; b[i] = n - i; }
 
-    cl_kernel kernel = clCreateKernel(ctx.program, "vecadd", NULL);
-    cl_mem buf_a = gpufw_alloc_buffer(&ctx, bytes, CL_MEM_READ_ONLY);
-    cl_mem buf_b = gpufw_alloc_buffer(&ctx, bytes, CL_MEM_READ_ONLY);
-    cl_mem buf_c = gpufw_alloc_buffer(&ctx, bytes, CL_MEM_WRITE_ONLY);
+    cl_kernel kernel = clCreateKernel(gpufw_program(&ctx), "vecadd", NULL);
+    cl_mem buf_a = NULL, buf_b = NULL, buf_c = NULL;
+
+    if (chunk > 0) {
+        // Overlap upload / compute / download chunk by chunk
+        const void *inputs[2] = { a, b };
+        gpufw_stream_opts sopts = { chunk, 3, 3, 64 };
+        if (gpufw_stream_run(&ctx, kernel, n, sizeof(float), 2, inputs, c, &sopts) != 0)
+            printf("vecadd stream failed\n");
+    } else {
+        buf_a = gpufw_alloc_buffer(&ctx, bytes, CL_MEM_READ_ONLY);
+        buf_b = gpufw_alloc_buffer(&ctx, bytes, CL_MEM_READ_ONLY);
+        buf_c = gpufw_alloc_buffer(&ctx, bytes, CL_MEM_WRITE_ONLY);
 
-    gpufw_write_buffer(&ctx, buf_a, a, bytes);
-    gpufw_write_buffer(&ctx, buf_b, b, bytes);
+        gpufw_set_kernel_arg(&ctx, kernel, 0, sizeof(cl_mem), &buf_a);
+        gpufw_set_kernel_arg(&ctx, kernel, 1, sizeof(cl_mem), &buf_b);
+        gpufw_set_kernel_arg(&ctx, kernel, 2, sizeof(cl_mem), &buf_c);
+        gpufw_set_kernel_arg(&ctx, kernel, 3, sizeof(int), &n);
 
-    gpufw_set_kernel_arg(&ctx, kernel, 0, sizeof(cl_mem), &buf_a);
-    gpufw_set_kernel_arg(&ctx, kernel, 1, sizeof(cl_mem), &buf_b);
-    gpufw_set_kernel_arg(&ctx, kernel, 2, sizeof(cl_mem), &buf_c);
-    gpufw_set_kernel_arg(&ctx, kernel, 3, sizeof(int), &n);
+        // Enqueue write -> launch -> read as one chain and sync only once at the end;
+        // local size 0 takes the tuned size (the first run for a size class tunes it)
+        gpufw_event ev_in[2] = { NULL, NULL }, ev_run = NULL, ev_out = NULL;
+        gpufw_write_buffer_async(&ctx, buf_a, 0, a, bytes, 0, NULL, &ev_in[0]);
+        gpufw_write_buffer_async(&ctx, buf_b, 0, b, bytes, 0, NULL, &ev_in[1]);
+        gpufw_launch_kernel_async(&ctx, kernel, n, 0, 2, ev_in, &ev_run);
+        gpufw_read_buffer_async(&ctx, buf_c, 0, c, bytes, 1, &ev_run, &ev_out);
 
-    gpufw_launch_kernel(&ctx, kernel, n, 64);
+        if (gpufw_event_wait(1, &ev_out) != 0)
+            printf("vecadd pipeline failed\n");
 
-    gpufw_read_buffer(&ctx, buf_c, c, bytes);
+        gpufw_event_release(ev_in[0]);
+        gpufw_event_release(ev_in[1]);
+        gpufw_event_release(ev_run);
+        gpufw_event_release(ev_out);
+    }
 
     for(int i = 0; i < 10; i++)
         printf("%d + %d = %f\n", i, n-i, c[i]);
 
-    clReleaseMemObject(buf_a);
-    clReleaseMemObject(buf_b);
-    clReleaseMemObject(buf_c);
+    // Check every element against the host result; vecadd must match exactly
+    int rc = 0;
+    float *ref = (float*)malloc(bytes);
+    gpufw_validate_report rep;
+    if (ref && gpufw_cpu_vecadd(a, b, ref, (size_t)n) == 0) {
+        gpufw_validate_opts vopts = { 0, 0.0, 0.0, GPUFW_NAN_MATCH, GPUFW_INF_EXACT, 10 };
+        if (gpufw_validate_f32(c, ref, (size_t)n, &vopts, &rep) != 0) rc = 1;
+        gpufw_validate_print(&rep, "vecadd", stdout);
+    }
+    free(ref);
+
+    gpufw_init_print_stats(&ctx, stdout);
+    gpufw_cache_print_stats(&ctx, stdout);
+
+    // Device-side timings; run_bench.pl picks up the "Kernel time:" line
+    gpufw_prof_summary *prof = NULL;
+    size_t nprof = 0;
+    if (gpufw_profile_summarize(&ctx, &prof, &nprof) == 0) {
+        for (size_t i = 0; i < nprof; i++)
+            if (prof[i].kind == GPUFW_OP_KERNEL)
+                printf("Kernel time: %.3f ms (%s)\n", prof[i].total_ms, prof[i].name);
+        free(prof);
+    }
+    gpufw_profile_print(&ctx, stdout);
+    gpufw_tune_print(&ctx, stdout);
+
+    if (buf_a) gpufw_release_buffer(&ctx, buf_a);
+    if (buf_b) gpufw_release_buffer(&ctx, buf_b);
+    if (buf_c) gpufw_release_buffer(&ctx, buf_c);
     clReleaseKernel(kernel);
     gpufw_cleanup(&ctx);
 
     free(a); free(b); free(c);
-    return 0;
+    return rc;
 }
\ No newline at end of file
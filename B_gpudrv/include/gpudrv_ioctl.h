@@ -10,14 +10,41 @@
  */
 
 #include <linux/ioctl.h> /* for _IOW/_IOR on kernel side; user side will include <sys/ioctl.h> */
+#include <linux/types.h>
 
 #define GPUDRV_IOC_MAGIC  'G'
 
-/* Set mode (write int) */
+/* Set mode (write int) for this file and as the device default */
 #define GPUDRV_IOC_SET_MODE _IOW(GPUDRV_IOC_MAGIC, 1, int)
-/* Get mode (read int) */
+/* Get mode (read int): this file's, or the device default if it set none */
 #define GPUDRV_IOC_GET_MODE _IOR(GPUDRV_IOC_MAGIC, 2, int)
 
+/* Shared-memory rings (see gpudrv_ring.h) */
+struct gpudrv_ring_params;
+/* Create the ring (or fetch the existing one's layout), then mmap it */
+#define GPUDRV_IOC_RING_SETUP _IOWR(GPUDRV_IOC_MAGIC, 3, struct gpudrv_ring_params)
+/* Sleep until the given queue (GPUDRV_RING_SQ/CQ, write __u32) is non-empty */
+#define GPUDRV_IOC_RING_WAIT  _IOW(GPUDRV_IOC_MAGIC, 4, __u32)
+/* Wake every RING_WAIT sleeper */
+#define GPUDRV_IOC_RING_WAKE  _IO(GPUDRV_IOC_MAGIC, 5)
+
+/* Vectored job queue (see gpudrv_job.h) */
+struct gpudrv_submit_vec;
+struct gpudrv_status_vec;
+struct gpudrv_job_vec;
+#define GPUDRV_IOC_SUBMIT       _IOWR(GPUDRV_IOC_MAGIC, 6, struct gpudrv_submit_vec)
+#define GPUDRV_IOC_STATUS       _IOWR(GPUDRV_IOC_MAGIC, 7, struct gpudrv_status_vec)
+/* Signal this eventfd once per completed job of this file (write int, -1 to clear) */
+#define GPUDRV_IOC_SET_EVENTFD  _IOW(GPUDRV_IOC_MAGIC, 8, int)
+#define GPUDRV_IOC_FETCH        _IOWR(GPUDRV_IOC_MAGIC, 9, struct gpudrv_job_vec)
+#define GPUDRV_IOC_COMPLETE     _IOWR(GPUDRV_IOC_MAGIC, 10, struct gpudrv_job_vec)
+/* Priority (GPUDRV_PRIO_*, write int) of jobs this file submits from now on */
+#define GPUDRV_IOC_SET_PRIO     _IOW(GPUDRV_IOC_MAGIC, 11, int)
+
+/* Telemetry (see gpudrv_stats.h) */
+struct gpudrv_stats;
+#define GPUDRV_IOC_STATS        _IOR(GPUDRV_IOC_MAGIC, 12, struct gpudrv_stats)
+
 #define GPUDRV_MODE_CPU    0
 #define GPUDRV_MODE_GPU    1
 #define GPUDRV_MODE_HYBRID 2
@@ -0,0 +1,92 @@
+// gpudrv_job.h - vectored job submission/status for /dev/gpudrv
+#ifndef GPUDRV_JOB_H
+#define GPUDRV_JOB_H
+
+/* Jobs are gpudrv_sqe descriptors whose data lives in the shared ring payload
+ * (gpudrv_ring.h); the driver only tracks their state. Every call takes an
+ * array, so one syscall moves up to GPUDRV_VEC_MAX jobs:
+ *
+ *   client:  GPUDRV_IOC_SUBMIT  -> ids          GPUDRV_IOC_STATUS <- states/results
+ *   daemon:  GPUDRV_IOC_FETCH   -> queued jobs  GPUDRV_IOC_COMPLETE -> results
+ *
+ * Completion is reported per open file. The file polls readable (POLLIN)
+ * while it owns finished jobs that have not been reaped through STATUS, and
+ * a registered eventfd (GPUDRV_IOC_SET_EVENTFD) is signalled as they finish,
+ * so a client waits on any number of jobs with one poll(). Treat the eventfd
+ * count as a wakeup and collect results with GPUDRV_STATUS_ANY.
+ * A file that has called FETCH also polls readable while jobs are queued.
+ *
+ * Jobs belong to the file that submitted them: closing it cancels queued
+ * jobs and discards results. Jobs fetched by a daemon that exits without
+ * completing them go back to the queue.
+ */
+
+#include <linux/types.h>
+#include "gpudrv_ring.h"
+
+#define GPUDRV_VEC_MAX           1024      /* entries per call */
+#define GPUDRV_JOB_MAX_INFLIGHT  65536     /* queued + running + unreaped */
+
+/* gpudrv_status_ent.state */
+#define GPUDRV_JOB_UNKNOWN  0       /* never submitted, reaped, or not ours */
+#define GPUDRV_JOB_QUEUED   1
+#define GPUDRV_JOB_RUNNING  2
+#define GPUDRV_JOB_DONE     3
+
+/* job priority (GPUDRV_IOC_SET_PRIO, per file); FETCH drains higher levels first */
+#define GPUDRV_PRIO_LOW     0
+#define GPUDRV_PRIO_NORMAL  1       /* default */
+#define GPUDRV_PRIO_HIGH    2
+#define GPUDRV_PRIO_LEVELS  3
+
+/* gpudrv_status_vec.flags */
+#define GPUDRV_STATUS_REAP  (1u << 0)   /* forget DONE jobs once reported */
+#define GPUDRV_STATUS_ANY   (1u << 1)   /* ignore ids; report any DONE jobs, oldest first */
+
+/* GPUDRV_IOC_SUBMIT: queue sqes[0..count); ids[i] receives the id of sqes[i].
+ * done is the number queued, which is short only when the driver is full. */
+struct gpudrv_submit_vec {
+    __u64 sqes;             /* user pointer: const struct gpudrv_sqe[count] */
+    __u64 ids;              /* user pointer: __u64[count] */
+    __u32 count;
+    __u32 done;
+};
+
+struct gpudrv_status_ent {
+    __u64 id;
+    __u64 user_data;        /* from the sqe, once DONE */
+    __u32 state;            /* GPUDRV_JOB_* */
+    __s32 res;              /* 0 or -errno, once DONE */
+};
+
+/* GPUDRV_IOC_STATUS: fill state/res for ents[0..count). done is the number
+ * of entries reported DONE (with GPUDRV_STATUS_ANY, the number filled). */
+struct gpudrv_status_vec {
+    __u64 ents;             /* user pointer: struct gpudrv_status_ent[count] */
+    __u32 count;
+    __u32 flags;            /* GPUDRV_STATUS_* */
+    __u32 done;
+    __u32 pad;
+};
+
+struct gpudrv_fetch_ent {
+    __u64 id;
+    struct gpudrv_sqe sqe;
+};
+
+struct gpudrv_complete_ent {
+    __u64 id;
+    __s32 res;
+    __u32 pad;
+};
+
+/* GPUDRV_IOC_FETCH (ents: gpudrv_fetch_ent) takes up to count queued jobs,
+ * oldest first; GPUDRV_IOC_COMPLETE (ents: gpudrv_complete_ent) finishes
+ * fetched ones. done is the number taken / completed. */
+struct gpudrv_job_vec {
+    __u64 ents;
+    __u32 count;
+    __u32 done;
+};
+
+#endif // GPUDRV_JOB_H
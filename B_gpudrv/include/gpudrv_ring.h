@@ -0,0 +1,115 @@
+// gpudrv_ring.h - shared-memory submission/completion rings for /dev/gpudrv
+#ifndef GPUDRV_RING_H
+#define GPUDRV_RING_H
+
+/* One mmap-able region holds a header page, the submission queue (SQ), the
+ * completion queue (CQ) and a payload area that job descriptors point into:
+ *
+ *   [ header | SQ: sq_entries x gpudrv_sqe | CQ: cq_entries x gpudrv_cqe | payload ]
+ *
+ * Each queue has exactly one producer and one consumer. Indices are free
+ * running __u32 counters, masked with entries - 1 on access. A producer fills
+ * the entry at tail and then publishes tail + 1 with a release store; the
+ * consumer reads tail with an acquire load, consumes entries up to it and
+ * publishes its head the same way. The SQ is produced by the client and
+ * consumed by the daemon, the CQ the other way round, so no job needs a
+ * syscall or a copy.
+ *
+ * A consumer that runs dry sets GPUDRV_RING_NEED_WAKEUP in the queue's flags,
+ * re-checks the queue, and only then sleeps (GPUDRV_IOC_RING_WAIT, or a futex
+ * on the tail word for the in-process ring). A producer that sees the flag
+ * after publishing issues one GPUDRV_IOC_RING_WAKE / futex wake.
+ */
+
+#include <linux/types.h>
+
+#define GPUDRV_RING_MAGIC         0x31565247u    /* "GRV1" */
+#define GPUDRV_RING_VERSION       1
+#define GPUDRV_RING_HDR_SIZE      4096
+#define GPUDRV_RING_DEF_ENTRIES   256
+#define GPUDRV_RING_MAX_ENTRIES   4096
+#define GPUDRV_RING_DEF_PAYLOAD   (4u << 20)
+#define GPUDRV_RING_MAX_PAYLOAD   (64u << 20)
+
+/* which queue a wait refers to */
+#define GPUDRV_RING_SQ  0
+#define GPUDRV_RING_CQ  1
+
+/* gpudrv_ring_queue.flags */
+#define GPUDRV_RING_NEED_WAKEUP   (1u << 0)
+
+/* gpudrv_sqe.op */
+#define GPUDRV_OP_NOP     0
+#define GPUDRV_OP_VECADD  1     /* float out[n] = in[0..n) + in[n..2n) */
+
+struct gpudrv_sqe {
+    __u64 user_data;        /* echoed in the completion */
+    __u32 op;               /* GPUDRV_OP_* */
+    __u32 flags;
+    __u64 in_off;           /* payload offsets/lengths in bytes */
+    __u64 in_len;
+    __u64 out_off;
+    __u64 out_len;
+    __u32 n;                /* element count */
+    __u32 mode;             /* GPUDRV_MODE_* to run in, or -1 for the driver's mode */
+};
+
+struct gpudrv_cqe {
+    __u64 user_data;
+    __s32 res;              /* 0 or -errno */
+    __u32 flags;
+};
+
+/* Head and tail of one queue, each on its own cache line. */
+struct gpudrv_ring_queue {
+    __u32 head;
+    __u32 pad0[15];
+    __u32 tail;
+    __u32 flags;
+    __u32 pad1[14];
+};
+
+struct gpudrv_ring_hdr {
+    __u32 magic;
+    __u32 version;
+    __u32 sq_entries;
+    __u32 cq_entries;
+    __u64 sq_off;
+    __u64 cq_off;
+    __u64 payload_off;
+    __u64 payload_size;
+    __u64 total_size;
+    __u64 pad[2];
+    struct gpudrv_ring_queue sq;
+    struct gpudrv_ring_queue cq;
+};
+
+/* GPUDRV_IOC_RING_SETUP argument: entries and payload_size in (0 = default),
+ * the resulting layout out. mmap total_size bytes at offset 0 afterwards. */
+struct gpudrv_ring_params {
+    __u32 entries;
+    __u32 pad;
+    __u64 payload_size;
+    __u64 sq_off;
+    __u64 cq_off;
+    __u64 payload_off;
+    __u64 total_size;
+};
+
+/* Fill in the layout for the requested sizes; returns 0 or -1 if invalid. */
+static inline int gpudrv_ring_layout(struct gpudrv_ring_params *p)
+{
+    __u32 e = p->entries ? p->entries : GPUDRV_RING_DEF_ENTRIES;
+    __u64 pl = p->payload_size ? p->payload_size : GPUDRV_RING_DEF_PAYLOAD;
+    if (e > GPUDRV_RING_MAX_ENTRIES || (e & (e - 1)) != 0 || pl > GPUDRV_RING_MAX_PAYLOAD)
+        return -1;
+    p->entries = e;
+    p->payload_size = (pl + 4095) & ~(__u64)4095;
+    p->sq_off = GPUDRV_RING_HDR_SIZE;
+    p->cq_off = (p->sq_off + (__u64)e * sizeof(struct gpudrv_sqe) + 63) & ~(__u64)63;
+    p->payload_off = (p->cq_off + (__u64)e * sizeof(struct gpudrv_cqe) + 4095) & ~(__u64)4095;
+    p->total_size = p->payload_off + p->payload_size;
+    return 0;
+}
+
+#endif // GPUDRV_RING_H
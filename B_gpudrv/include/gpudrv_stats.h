@@ -0,0 +1,43 @@
+// gpudrv_stats.h - driver telemetry returned by GPUDRV_IOC_STATS
+#ifndef GPUDRV_STATS_H
+#define GPUDRV_STATS_H
+
+/* Counters are kept per CPU and summed on read, so the submit/complete paths
+ * never share a cache line for accounting. Histograms are log2 buckets:
+ * bucket 0 counts values below 1, bucket k (k >= 1) counts [2^(k-1), 2^k),
+ * and the last bucket also takes everything larger. Times are in
+ * microseconds; queue depth is the number of queued jobs seen by a submit.
+ * The same numbers appear in /sys/kernel/debug/gpudrv/stats.
+ */
+
+#include <linux/types.h>
+#include "gpudrv_job.h"
+
+#define GPUDRV_HIST_BUCKETS  32
+
+struct gpudrv_stats {
+    /* device-wide, cumulative */
+    __u64 ioctls;
+    __u64 submits;              /* jobs accepted */
+    __u64 rejects;              /* jobs refused because the driver was full */
+    __u64 fetches;              /* jobs handed to a daemon */
+    __u64 completions;
+    /* device-wide, current */
+    __u32 queued[GPUDRV_PRIO_LEVELS];
+    __u32 running;
+    __u32 unreaped;             /* finished, waiting for STATUS */
+    __u32 files;
+    /* the calling file */
+    __u64 file_submits;
+    __u64 file_completions;
+    __u32 file_inflight;        /* submitted and not yet reaped */
+    __s32 file_mode;            /* effective mode for this file */
+    __u32 file_prio;
+    __u32 pad;
+    /* device-wide histograms */
+    __u64 queue_us[GPUDRV_HIST_BUCKETS];      /* submit -> fetch */
+    __u64 total_us[GPUDRV_HIST_BUCKETS];      /* submit -> complete */
+    __u64 depth[GPUDRV_HIST_BUCKETS];         /* queue depth at submit */
+};
+
+#endif // GPUDRV_STATS_H
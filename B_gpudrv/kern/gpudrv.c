@@ -5,7 +5,26 @@
 #include <linux/cdev.h>
 #include <linux/device.h>
 #include <linux/uaccess.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/slab.h>
+#include <linux/idr.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/poll.h>
+#include <linux/eventfd.h>
+#include <linux/version.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include "../include/gpudrv_ioctl.h"
+#include "../include/gpudrv_ring.h"
+#include "../include/gpudrv_job.h"
+#include "../include/gpudrv_stats.h"
 
 #define DEVICE_NAME "gpudrv"
 #define CLASS_NAME "gpudrvcls"
@@ -15,60 +34,801 @@ static struct class *gpudrv_class;
 static struct device *gpudrv_device;
 static struct cdev gpudrv_cdev;
 
-/* current mode (0=CPU,1=GPU,2=HYBRID) */
-static int current_mode = GPUDRV_MODE_CPU;
+/* device default mode (0=CPU,1=GPU,2=HYBRID), followed by every file that
+ * has not set its own; plain int, accessed with READ_ONCE/WRITE_ONCE */
+static int default_mode = GPUDRV_MODE_CPU;
+static struct dentry *gpudrv_debugfs;
+
+/* Vectored job queue (gpudrv_job.h). One spinlock covers the id table, the
+ * queue and every file's done list; each call takes it once per batch (a
+ * submit drops it only to refill its id preload). */
+struct gpudrv_file {
+    struct list_head done;          /* finished, unreaped jobs, oldest first */
+    unsigned int ndone;
+    bool server;                    /* has fetched: also readable on queued jobs */
+    struct eventfd_ctx *efd;
+    wait_queue_head_t wq;           /* completions of this file's jobs */
+    int mode;                       /* -1: follow default_mode */
+    u32 prio;                       /* GPUDRV_PRIO_* of the jobs it submits */
+    u64 submits;
+    u64 completions;
+    unsigned int inflight;          /* submitted and not yet reaped */
+    struct mutex ring_lock;
+    void *ring;                     /* this file's job ring, NULL until RING_SETUP */
+    struct gpudrv_ring_params ring_params;
+    wait_queue_head_t ring_wq;
+};
+
+struct gpudrv_job {
+    int id;
+    u32 state;
+    s32 res;
+    struct gpudrv_file *owner;      /* NULL once the submitter has closed */
+    struct gpudrv_file *runner;     /* file that fetched it, while RUNNING */
+    struct list_head node;          /* job_queue while QUEUED, owner->done while DONE */
+    u32 prio;
+    u64 t_submit;                   /* ktime ns */
+    struct gpudrv_sqe sqe;
+};
+
+/* Submission/completion ring of one open file, created on its first
+ * RING_SETUP. Only processes sharing that file (forked children, or one the
+ * fd was passed to) can map it, so clients that open the device separately
+ * never produce into the same queue. A mapping holds a reference to the
+ * file, so release, which frees the ring, only runs once every mapping is
+ * gone. The kernel never parses the entries; it only provides the memory
+ * and the sleep/wake doorbells. */
+static int gpudrv_ring_setup(struct gpudrv_file *gf, struct gpudrv_ring_params *p)
+{
+    struct gpudrv_ring_hdr *hdr;
+    void *mem;
+    int ret = 0;
+
+    mutex_lock(&gf->ring_lock);
+    if (gf->ring) {
+        *p = gf->ring_params;
+        goto out;
+    }
+    if (gpudrv_ring_layout(p) != 0) {
+        ret = -EINVAL;
+        goto out;
+    }
+    mem = vmalloc_user(p->total_size);      /* zeroed, mappable */
+    if (!mem) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    hdr = mem;
+    hdr->magic = GPUDRV_RING_MAGIC;
+    hdr->version = GPUDRV_RING_VERSION;
+    hdr->sq_entries = p->entries;
+    hdr->cq_entries = p->entries;
+    hdr->sq_off = p->sq_off;
+    hdr->cq_off = p->cq_off;
+    hdr->payload_off = p->payload_off;
+    hdr->payload_size = p->payload_size;
+    hdr->total_size = p->total_size;
+    gf->ring_params = *p;
+    smp_store_release(&gf->ring, mem);      /* RING_WAIT reads it without the mutex */
+    pr_debug("ring: %u entries, %llu byte payload\n", p->entries, p->payload_size);
+out:
+    mutex_unlock(&gf->ring_lock);
+    return ret;
+}
+
+static bool gpudrv_ring_ready(struct gpudrv_ring_hdr *hdr, __u32 which)
+{
+    struct gpudrv_ring_queue *q = which == GPUDRV_RING_SQ ? &hdr->sq : &hdr->cq;
+    return READ_ONCE(q->tail) != READ_ONCE(q->head);
+}
+
+static int gpudrv_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct gpudrv_file *gf = file->private_data;
+    unsigned long len = vma->vm_end - vma->vm_start;
+    int ret;
+
+    if (vma->vm_pgoff != 0)
+        return -EINVAL;
+    mutex_lock(&gf->ring_lock);
+    if (!gf->ring)
+        ret = -ENODEV;
+    else if (len > PAGE_ALIGN(gf->ring_params.total_size))
+        ret = -EINVAL;
+    else
+        ret = remap_vmalloc_range(vma, gf->ring, 0);
+    mutex_unlock(&gf->ring_lock);
+    return ret;
+}
+
+static DEFINE_SPINLOCK(job_lock);
+static DEFINE_IDR(job_idr);
+static struct list_head job_queue[GPUDRV_PRIO_LEVELS];
+static unsigned int job_count;                      /* every live job */
+static unsigned int job_queued[GPUDRV_PRIO_LEVELS];
+static unsigned int job_running;
+static unsigned int job_files;
+static DECLARE_WAIT_QUEUE_HEAD(job_wq);    /* daemons waiting for queued jobs */
+
+/* Telemetry (gpudrv_stats.h): per-CPU so the hot paths only touch local
+ * memory with this_cpu ops; readers sum over every CPU. */
+struct gpudrv_pcpu_stats {
+    u64 ioctls;
+    u64 submits;
+    u64 rejects;
+    u64 fetches;
+    u64 completions;
+    u64 queue_us[GPUDRV_HIST_BUCKETS];
+    u64 total_us[GPUDRV_HIST_BUCKETS];
+    u64 depth[GPUDRV_HIST_BUCKETS];
+};
+static DEFINE_PER_CPU(struct gpudrv_pcpu_stats, gpudrv_pcpu);
+
+static unsigned int gpudrv_hist_bucket(u64 v)
+{
+    return v ? min_t(unsigned int, fls64(v), GPUDRV_HIST_BUCKETS - 1) : 0;
+}
+
+static unsigned int gpudrv_queued_total(void)
+{
+    unsigned int i, n = 0;
+
+    for (i = 0; i < GPUDRV_PRIO_LEVELS; i++)
+        n += job_queued[i];
+    return n;
+}
+
+static int gpudrv_file_mode(struct gpudrv_file *gf)
+{
+    int mode = READ_ONCE(gf->mode);
+
+    return mode >= 0 ? mode : READ_ONCE(default_mode);
+}
+
+/* Sum the per-CPU counters and, under job_lock, the gauges; gf may be NULL. */
+static void gpudrv_stats_fill(struct gpudrv_stats *st, struct gpudrv_file *gf)
+{
+    unsigned int cpu, b;
+
+    memset(st, 0, sizeof(*st));
+    for_each_possible_cpu(cpu) {
+        const struct gpudrv_pcpu_stats *pc = per_cpu_ptr(&gpudrv_pcpu, cpu);
+
+        st->ioctls += READ_ONCE(pc->ioctls);
+        st->submits += READ_ONCE(pc->submits);
+        st->rejects += READ_ONCE(pc->rejects);
+        st->fetches += READ_ONCE(pc->fetches);
+        st->completions += READ_ONCE(pc->completions);
+        for (b = 0; b < GPUDRV_HIST_BUCKETS; b++) {
+            st->queue_us[b] += READ_ONCE(pc->queue_us[b]);
+            st->total_us[b] += READ_ONCE(pc->total_us[b]);
+            st->depth[b] += READ_ONCE(pc->depth[b]);
+        }
+    }
+    spin_lock(&job_lock);
+    for (b = 0; b < GPUDRV_PRIO_LEVELS; b++)
+        st->queued[b] = job_queued[b];
+    st->running = job_running;
+    st->unreaped = job_count - gpudrv_queued_total() - job_running;
+    st->files = job_files;
+    if (gf) {
+        st->file_submits = gf->submits;
+        st->file_completions = gf->completions;
+        st->file_inflight = gf->inflight;
+        st->file_prio = gf->prio;
+    }
+    spin_unlock(&job_lock);
+    if (gf)
+        st->file_mode = gpudrv_file_mode(gf);
+}
+
+static void gpudrv_efd_signal(struct eventfd_ctx *ctx)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+    eventfd_signal(ctx);
+#else
+    eventfd_signal(ctx, 1);
+#endif
+}
+
+/* job_lock held; the job must already be off any list */
+static void gpudrv_job_free(struct gpudrv_job *job)
+{
+    idr_remove(&job_idr, job->id);
+    job_count--;
+    kfree(job);
+}
+
+static struct gpudrv_job *gpudrv_job_find(__u64 id)
+{
+    if (id == 0 || id > INT_MAX)
+        return NULL;
+    return idr_find(&job_idr, (int)id);
+}
+
+static long gpudrv_job_submit(struct gpudrv_file *gf, void __user *arg)
+{
+    struct gpudrv_submit_vec v;
+    struct gpudrv_sqe *sqes = NULL;
+    struct gpudrv_job **jobs = NULL;
+    __u64 *ids = NULL;
+    long ret = 0;
+    u32 i, n = 0;
+    int mode = gpudrv_file_mode(gf);
+    unsigned int depth;
+    u64 now;
+
+    if (copy_from_user(&v, arg, sizeof(v)))
+        return -EFAULT;
+    if (v.count == 0 || v.count > GPUDRV_VEC_MAX)
+        return -EINVAL;
+    sqes = kvmalloc_array(v.count, sizeof(*sqes), GFP_KERNEL);
+    jobs = kvmalloc_array(v.count, sizeof(*jobs), GFP_KERNEL);
+    ids = kvmalloc_array(v.count, sizeof(*ids), GFP_KERNEL);
+    if (!sqes || !jobs || !ids) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    if (copy_from_user(sqes, u64_to_user_ptr(v.sqes), v.count * sizeof(*sqes))) {
+        ret = -EFAULT;
+        goto out;
+    }
+    for (i = 0; i < v.count; i++) {
+        jobs[i] = kmalloc(sizeof(**jobs), GFP_KERNEL);
+        if (!jobs[i])
+            break;
+        jobs[i]->state = GPUDRV_JOB_QUEUED;
+        jobs[i]->res = 0;
+        jobs[i]->owner = gf;
+        jobs[i]->runner = NULL;
+        jobs[i]->sqe = sqes[i];
+        if (jobs[i]->sqe.mode == (__u32)-1)
+            jobs[i]->sqe.mode = mode;     /* the submitter's mode, fixed at submit */
+    }
+    if (i < v.count) {
+        /* out of memory is an error, not a short count */
+        while (i--)
+            kfree(jobs[i]);
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    now = ktime_get_ns();
+    idr_preload(GFP_KERNEL);
+    spin_lock(&job_lock);
+    depth = gpudrv_hist_bucket(gpudrv_queued_total());
+    while (n < i && job_count < GPUDRV_JOB_MAX_INFLIGHT) {
+        int id = idr_alloc_cyclic(&job_idr, jobs[n], 1, 0, GFP_NOWAIT);
+        if (id == -ENOMEM) {
+            /* one preload covers one allocation: refill it outside the lock
+             * and retry, so the count is short only when the driver is full */
+            spin_unlock(&job_lock);
+            idr_preload_end();
+            idr_preload(GFP_KERNEL);
+            spin_lock(&job_lock);
+            id = idr_alloc_cyclic(&job_idr, jobs[n], 1, 0, GFP_NOWAIT);
+        }
+        if (id < 0)
+            break;
+        jobs[n]->id = id;
+        jobs[n]->prio = gf->prio;
+        jobs[n]->t_submit = now;
+        /* accounted per job: the lock may have been dropped in between */
+        list_add_tail(&jobs[n]->node, &job_queue[gf->prio]);
+        job_queued[gf->prio]++;
+        job_count++;
+        gf->submits++;
+        gf->inflight++;
+        ids[n++] = id;
+    }
+    this_cpu_add(gpudrv_pcpu.depth[depth], n);
+    if (n < v.count && job_count >= GPUDRV_JOB_MAX_INFLIGHT)
+        this_cpu_add(gpudrv_pcpu.rejects, v.count - n);
+    spin_unlock(&job_lock);
+    idr_preload_end();
+    this_cpu_add(gpudrv_pcpu.submits, n);
+
+    for (i = n; i < v.count && jobs[i]; i++)
+        kfree(jobs[i]);
+    if (n == 0) {
+        ret = READ_ONCE(job_count) >= GPUDRV_JOB_MAX_INFLIGHT ? -EAGAIN : -ENOMEM;
+        goto out;
+    }
+    wake_up_interruptible_all(&job_wq);
+    v.done = n;
+    /* the jobs are live now; on a bad pointer the caller loses the ids */
+    if (copy_to_user(u64_to_user_ptr(v.ids), ids, n * sizeof(*ids)) ||
+        copy_to_user(arg, &v, sizeof(v)))
+        ret = -EFAULT;
+out:
+    kvfree(sqes);
+    kvfree(jobs);
+    kvfree(ids);
+    return ret;
+}
+
+static void gpudrv_status_fill(struct gpudrv_status_ent *e, struct gpudrv_job *job)
+{
+    e->id = job->id;
+    e->user_data = job->sqe.user_data;
+    e->state = job->state;
+    e->res = job->state == GPUDRV_JOB_DONE ? job->res : 0;
+}
+
+/* job_lock held */
+static void gpudrv_job_reap(struct gpudrv_file *gf, struct gpudrv_job *job)
+{
+    list_del(&job->node);
+    gf->ndone--;
+    gf->inflight--;
+    gpudrv_job_free(job);
+}
+
+static long gpudrv_job_status(struct gpudrv_file *gf, void __user *arg)
+{
+    struct gpudrv_status_vec v;
+    struct gpudrv_status_ent *ents;
+    struct gpudrv_job *job, *tmp;
+    bool reap;
+    long ret = 0;
+    u32 i;
+
+    if (copy_from_user(&v, arg, sizeof(v)))
+        return -EFAULT;
+    if (v.count == 0 || v.count > GPUDRV_VEC_MAX)
+        return -EINVAL;
+    ents = kvmalloc_array(v.count, sizeof(*ents), GFP_KERNEL);
+    if (!ents)
+        return -ENOMEM;
+    if (!(v.flags & GPUDRV_STATUS_ANY) &&
+        copy_from_user(ents, u64_to_user_ptr(v.ents), v.count * sizeof(*ents))) {
+        ret = -EFAULT;
+        goto out;
+    }
+
+    reap = v.flags & GPUDRV_STATUS_REAP;
+    v.done = 0;
+    spin_lock(&job_lock);
+    if (v.flags & GPUDRV_STATUS_ANY) {
+        list_for_each_entry_safe(job, tmp, &gf->done, node) {
+            if (v.done == v.count)
+                break;
+            gpudrv_status_fill(&ents[v.done++], job);
+            if (reap)
+                gpudrv_job_reap(gf, job);
+        }
+    } else {
+        for (i = 0; i < v.count; i++) {
+            job = gpudrv_job_find(ents[i].id);
+            if (!job || job->owner != gf) {
+                ents[i].state = GPUDRV_JOB_UNKNOWN;
+                ents[i].res = 0;
+                continue;
+            }
+            gpudrv_status_fill(&ents[i], job);
+            if (job->state != GPUDRV_JOB_DONE)
+                continue;
+            v.done++;
+            if (reap)
+                gpudrv_job_reap(gf, job);
+        }
+    }
+    spin_unlock(&job_lock);
+
+    i = (v.flags & GPUDRV_STATUS_ANY) ? v.done : v.count;
+    if ((i && copy_to_user(u64_to_user_ptr(v.ents), ents, i * sizeof(*ents))) ||
+        copy_to_user(arg, &v, sizeof(v)))
+        ret = -EFAULT;
+out:
+    kvfree(ents);
+    return ret;
+}
+
+static long gpudrv_job_fetch(struct gpudrv_file *gf, void __user *arg)
+{
+    struct gpudrv_job_vec v;
+    struct gpudrv_fetch_ent *ents;
+    struct gpudrv_job *job;
+    long ret = 0;
+    u64 now;
+    int prio;
+
+    if (copy_from_user(&v, arg, sizeof(v)))
+        return -EFAULT;
+    if (v.count == 0 || v.count > GPUDRV_VEC_MAX)
+        return -EINVAL;
+    ents = kvmalloc_array(v.count, sizeof(*ents), GFP_KERNEL);
+    if (!ents)
+        return -ENOMEM;
+
+    v.done = 0;
+    now = ktime_get_ns();
+    spin_lock(&job_lock);
+    gf->server = true;
+    for (prio = GPUDRV_PRIO_LEVELS - 1; prio >= 0; prio--) {
+        while (v.done < v.count && !list_empty(&job_queue[prio])) {
+            job = list_first_entry(&job_queue[prio], struct gpudrv_job, node);
+            list_del_init(&job->node);
+            job_queued[prio]--;
+            job_running++;
+            job->state = GPUDRV_JOB_RUNNING;
+            job->runner = gf;
+            ents[v.done].id = job->id;
+            ents[v.done].sqe = job->sqe;
+            v.done++;
+            this_cpu_inc(gpudrv_pcpu.queue_us[gpudrv_hist_bucket((now - job->t_submit) / NSEC_PER_USEC)]);
+        }
+    }
+    spin_unlock(&job_lock);
+    this_cpu_add(gpudrv_pcpu.fetches, v.done);
+
+    /* on a bad pointer the jobs stay RUNNING until this file is closed */
+    if ((v.done && copy_to_user(u64_to_user_ptr(v.ents), ents, v.done * sizeof(*ents))) ||
+        copy_to_user(arg, &v, sizeof(v)))
+        ret = -EFAULT;
+    kvfree(ents);
+    return ret;
+}
+
+static long gpudrv_job_complete(struct gpudrv_file *gf, void __user *arg)
+{
+    struct gpudrv_job_vec v;
+    struct gpudrv_complete_ent *ents;
+    struct gpudrv_job *job;
+    struct gpudrv_file *owner;
+    long ret = 0;
+    u64 now;
+    u32 i;
+
+    if (copy_from_user(&v, arg, sizeof(v)))
+        return -EFAULT;
+    if (v.count == 0 || v.count > GPUDRV_VEC_MAX)
+        return -EINVAL;
+    ents = kvmalloc_array(v.count, sizeof(*ents), GFP_KERNEL);
+    if (!ents)
+        return -ENOMEM;
+    if (copy_from_user(ents, u64_to_user_ptr(v.ents), v.count * sizeof(*ents))) {
+        ret = -EFAULT;
+        goto out;
+    }
+
+    v.done = 0;
+    now = ktime_get_ns();
+    spin_lock(&job_lock);
+    for (i = 0; i < v.count; i++) {
+        job = gpudrv_job_find(ents[i].id);
+        if (!job || job->state != GPUDRV_JOB_RUNNING || job->runner != gf)
+            continue;
+        v.done++;
+        job_running--;
+        this_cpu_inc(gpudrv_pcpu.total_us[gpudrv_hist_bucket((now - job->t_submit) / NSEC_PER_USEC)]);
+        owner = job->owner;
+        if (!owner) {
+            gpudrv_job_free(job);
+            continue;
+        }
+        job->state = GPUDRV_JOB_DONE;
+        job->res = ents[i].res;
+        job->runner = NULL;
+        list_add_tail(&job->node, &owner->done);
+        owner->ndone++;
+        owner->completions++;
+        if (owner->efd)
+            gpudrv_efd_signal(owner->efd);
+        wake_up_interruptible(&owner->wq);
+    }
+    spin_unlock(&job_lock);
+    this_cpu_add(gpudrv_pcpu.completions, v.done);
+
+    if (copy_to_user(arg, &v, sizeof(v)))
+        ret = -EFAULT;
+out:
+    kvfree(ents);
+    return ret;
+}
+
+static long gpudrv_job_set_eventfd(struct gpudrv_file *gf, int __user *arg)
+{
+    struct eventfd_ctx *ctx = NULL, *old;
+    int fd;
+
+    if (copy_from_user(&fd, arg, sizeof(fd)))
+        return -EFAULT;
+    if (fd >= 0) {
+        ctx = eventfd_ctx_fdget(fd);
+        if (IS_ERR(ctx))
+            return PTR_ERR(ctx);
+    }
+    spin_lock(&job_lock);
+    old = gf->efd;
+    gf->efd = ctx;
+    if (ctx && gf->ndone)
+        gpudrv_efd_signal(ctx);     /* results that finished before registration */
+    spin_unlock(&job_lock);
+    if (old)
+        eventfd_ctx_put(old);
+    return 0;
+}
+
+static __poll_t gpudrv_poll(struct file *file, poll_table *wait)
+{
+    struct gpudrv_file *gf = file->private_data;
+    __poll_t mask = 0;
+
+    poll_wait(file, &gf->wq, wait);
+    if (READ_ONCE(gf->server))
+        poll_wait(file, &job_wq, wait);
+    spin_lock(&job_lock);
+    if (gf->ndone || (gf->server && gpudrv_queued_total()))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    spin_unlock(&job_lock);
+    return mask;
+}
 
 static int gpudrv_open(struct inode *inode, struct file *file)
 {
-    pr_info("device opened\n");
+    struct gpudrv_file *gf = kzalloc(sizeof(*gf), GFP_KERNEL);
+
+    if (!gf)
+        return -ENOMEM;
+    INIT_LIST_HEAD(&gf->done);
+    init_waitqueue_head(&gf->wq);
+    mutex_init(&gf->ring_lock);
+    init_waitqueue_head(&gf->ring_wq);
+    gf->mode = -1;
+    gf->prio = GPUDRV_PRIO_NORMAL;
+    file->private_data = gf;
+    spin_lock(&job_lock);
+    job_files++;
+    spin_unlock(&job_lock);
+    pr_debug("device opened\n");
     return 0;
 }
 
 static int gpudrv_release(struct inode *inode, struct file *file)
 {
-    pr_info("device closed\n");
+    struct gpudrv_file *gf = file->private_data;
+    struct gpudrv_job *job;
+    bool requeued = false;
+    int id;
+
+    /* Drop this file's queued and finished jobs, orphan the ones a daemon is
+     * still running, and hand back the ones this file fetched but never
+     * completed. */
+    spin_lock(&job_lock);
+    idr_for_each_entry(&job_idr, job, id) {
+        if (job->state == GPUDRV_JOB_RUNNING && job->runner == gf) {
+            job_running--;
+            if (job->owner == gf) {
+                gpudrv_job_free(job);
+            } else {
+                job->state = GPUDRV_JOB_QUEUED;
+                job->runner = NULL;
+                list_add(&job->node, &job_queue[job->prio]);
+                job_queued[job->prio]++;
+                requeued = true;
+            }
+        } else if (job->owner == gf) {
+            if (job->state == GPUDRV_JOB_RUNNING) {
+                job->owner = NULL;
+            } else {
+                if (job->state == GPUDRV_JOB_QUEUED)
+                    job_queued[job->prio]--;
+                list_del(&job->node);
+                gpudrv_job_free(job);
+            }
+        }
+    }
+    job_files--;
+    spin_unlock(&job_lock);
+    if (requeued)
+        wake_up_interruptible_all(&job_wq);
+    if (gf->efd)
+        eventfd_ctx_put(gf->efd);
+    vfree(gf->ring);
+    kfree(gf);
+    pr_debug("device closed\n");
     return 0;
 }
 
 static long gpudrv_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
-    int user_mode;
+    struct gpudrv_file *gf = file->private_data;
+    int user_mode, prio;
+    struct gpudrv_ring_params params;
+    struct gpudrv_stats *st;
+    struct gpudrv_ring_hdr *hdr;
+    __u32 which;
+    int ret;
+
+    this_cpu_inc(gpudrv_pcpu.ioctls);
     switch (cmd) {
     case GPUDRV_IOC_SET_MODE:
         if (copy_from_user(&user_mode, (int __user *)arg, sizeof(int)))
             return -EFAULT;
         if (user_mode != GPUDRV_MODE_CPU && user_mode != GPUDRV_MODE_GPU && user_mode != GPUDRV_MODE_HYBRID)
             return -EINVAL;
-        current_mode = user_mode;
-        if (current_mode == GPUDRV_MODE_CPU)
-            pr_info("IOCTL: set mode CPU\n");
-        else if (current_mode == GPUDRV_MODE_GPU)
-            pr_info("IOCTL: set mode GPU\n");
-        else
-            pr_info("IOCTL: set mode HYBRID\n");
+        WRITE_ONCE(gf->mode, user_mode);       /* this file only; sysfs sets the default */
         return 0;
 
     case GPUDRV_IOC_GET_MODE:
-        if (copy_to_user((int __user *)arg, &current_mode, sizeof(int)))
+        user_mode = gpudrv_file_mode(gf);
+        if (copy_to_user((int __user *)arg, &user_mode, sizeof(int)))
             return -EFAULT;
-        pr_info("IOCTL: get mode -> %d\n", current_mode);
         return 0;
 
+    case GPUDRV_IOC_SET_PRIO:
+        if (copy_from_user(&prio, (int __user *)arg, sizeof(int)))
+            return -EFAULT;
+        if (prio < 0 || prio >= GPUDRV_PRIO_LEVELS)
+            return -EINVAL;
+        spin_lock(&job_lock);
+        gf->prio = prio;
+        spin_unlock(&job_lock);
+        return 0;
+
+    case GPUDRV_IOC_STATS:
+        st = kmalloc(sizeof(*st), GFP_KERNEL);
+        if (!st)
+            return -ENOMEM;
+        gpudrv_stats_fill(st, gf);
+        ret = copy_to_user((void __user *)arg, st, sizeof(*st)) ? -EFAULT : 0;
+        kfree(st);
+        return ret;
+
+    case GPUDRV_IOC_RING_SETUP:
+        if (copy_from_user(&params, (void __user *)arg, sizeof(params)))
+            return -EFAULT;
+        ret = gpudrv_ring_setup(gf, &params);
+        if (ret)
+            return ret;
+        if (copy_to_user((void __user *)arg, &params, sizeof(params)))
+            return -EFAULT;
+        return 0;
+
+    case GPUDRV_IOC_RING_WAIT:
+        if (copy_from_user(&which, (__u32 __user *)arg, sizeof(which)))
+            return -EFAULT;
+        if (which != GPUDRV_RING_SQ && which != GPUDRV_RING_CQ)
+            return -EINVAL;
+        hdr = smp_load_acquire(&gf->ring);
+        if (!hdr)
+            return -ENODEV;
+        return wait_event_interruptible(gf->ring_wq, gpudrv_ring_ready(hdr, which));
+
+    case GPUDRV_IOC_RING_WAKE:
+        wake_up_interruptible_all(&gf->ring_wq);
+        return 0;
+
+    case GPUDRV_IOC_SUBMIT:
+        return gpudrv_job_submit(gf, (void __user *)arg);
+
+    case GPUDRV_IOC_STATUS:
+        return gpudrv_job_status(gf, (void __user *)arg);
+
+    case GPUDRV_IOC_SET_EVENTFD:
+        return gpudrv_job_set_eventfd(gf, (int __user *)arg);
+
+    case GPUDRV_IOC_FETCH:
+        return gpudrv_job_fetch(gf, (void __user *)arg);
+
+    case GPUDRV_IOC_COMPLETE:
+        return gpudrv_job_complete(gf, (void __user *)arg);
+
     default:
         return -ENOTTY;
     }
 }
 
+static void gpudrv_show_hist(struct seq_file *m, const char *name, const u64 *hist)
+{
+    unsigned int b;
+
+    seq_printf(m, "%s:\n", name);
+    for (b = 0; b < GPUDRV_HIST_BUCKETS; b++) {
+        if (!hist[b])
+            continue;
+        if (b == 0)
+            seq_printf(m, "  [0, 1) %llu\n", hist[b]);
+        else if (b == GPUDRV_HIST_BUCKETS - 1)
+            seq_printf(m, "  [%llu, inf) %llu\n", 1ULL << (b - 1), hist[b]);
+        else
+            seq_printf(m, "  [%llu, %llu) %llu\n", 1ULL << (b - 1), 1ULL << b, hist[b]);
+    }
+}
+
+static int gpudrv_debug_stats_show(struct seq_file *m, void *unused)
+{
+    struct gpudrv_stats *st = kmalloc(sizeof(*st), GFP_KERNEL);
+
+    if (!st)
+        return -ENOMEM;
+    gpudrv_stats_fill(st, NULL);
+    seq_printf(m, "mode %d\n", READ_ONCE(default_mode));
+    seq_printf(m, "files %u\n", st->files);
+    seq_printf(m, "ioctls %llu\n", st->ioctls);
+    seq_printf(m, "submits %llu\n", st->submits);
+    seq_printf(m, "rejects %llu\n", st->rejects);
+    seq_printf(m, "fetches %llu\n", st->fetches);
+    seq_printf(m, "completions %llu\n", st->completions);
+    seq_printf(m, "queued %u %u %u (low normal high)\n",
+               st->queued[GPUDRV_PRIO_LOW], st->queued[GPUDRV_PRIO_NORMAL], st->queued[GPUDRV_PRIO_HIGH]);
+    seq_printf(m, "running %u\n", st->running);
+    seq_printf(m, "unreaped %u\n", st->unreaped);
+    gpudrv_show_hist(m, "queue_us", st->queue_us);
+    gpudrv_show_hist(m, "total_us", st->total_us);
+    gpudrv_show_hist(m, "depth", st->depth);
+    kfree(st);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(gpudrv_debug_stats);
+
+/* /sys/class/gpudrvcls/gpudrv/: the default mode plus a few headline numbers */
+static ssize_t mode_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%d\n", READ_ONCE(default_mode));
+}
+
+static ssize_t mode_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t len)
+{
+    int mode, ret = kstrtoint(buf, 0, &mode);
+
+    if (ret)
+        return ret;
+    if (mode != GPUDRV_MODE_CPU && mode != GPUDRV_MODE_GPU && mode != GPUDRV_MODE_HYBRID)
+        return -EINVAL;
+    WRITE_ONCE(default_mode, mode);
+    return len;
+}
+static DEVICE_ATTR_RW(mode);
+
+#define GPUDRV_STAT_ATTR(field)                                                     \
+static ssize_t field##_show(struct device *dev, struct device_attribute *attr, char *buf) \
+{                                                                                   \
+    u64 sum = 0;                                                                    \
+    unsigned int cpu;                                                               \
+    for_each_possible_cpu(cpu)                                                      \
+        sum += READ_ONCE(per_cpu_ptr(&gpudrv_pcpu, cpu)->field);                    \
+    return sysfs_emit(buf, "%llu\n", sum);                                          \
+}                                                                                   \
+static DEVICE_ATTR_RO(field)
+
+GPUDRV_STAT_ATTR(submits);
+GPUDRV_STAT_ATTR(completions);
+GPUDRV_STAT_ATTR(rejects);
+
+static ssize_t queued_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%u\n", READ_ONCE(job_queued[GPUDRV_PRIO_LOW]) +
+                      READ_ONCE(job_queued[GPUDRV_PRIO_NORMAL]) + READ_ONCE(job_queued[GPUDRV_PRIO_HIGH]));
+}
+static DEVICE_ATTR_RO(queued);
+
+static struct attribute *gpudrv_attrs[] = {
+    &dev_attr_mode.attr,
+    &dev_attr_submits.attr,
+    &dev_attr_completions.attr,
+    &dev_attr_rejects.attr,
+    &dev_attr_queued.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(gpudrv);
+
 static const struct file_operations gpudrv_fops = {
     .owner = THIS_MODULE,
     .open = gpudrv_open,
     .release = gpudrv_release,
     .unlocked_ioctl = gpudrv_ioctl,
+    .mmap = gpudrv_mmap,
+    .poll = gpudrv_poll,
 };
 
 static int __init gpudrv_init(void)
 {
-    int ret;
+    int ret, i;
+
+    for (i = 0; i < GPUDRV_PRIO_LEVELS; i++)
+        INIT_LIST_HEAD(&job_queue[i]);
 
     ret = alloc_chrdev_region(&dev_number, 0, 1, DEVICE_NAME);
     if (ret) {
@@ -94,7 +854,7 @@ static int __init gpudrv_init(void)
         return PTR_ERR(gpudrv_class);
     }
 
-    gpudrv_device = device_create(gpudrv_class, NULL, dev_number, NULL, DEVICE_NAME);
+    gpudrv_device = device_create_with_groups(gpudrv_class, NULL, dev_number, NULL, gpudrv_groups, DEVICE_NAME);
     if (IS_ERR(gpudrv_device)) {
         pr_err("device_create failed\n");
         class_destroy(gpudrv_class);
@@ -103,16 +863,21 @@ static int __init gpudrv_init(void)
         return PTR_ERR(gpudrv_device);
     }
 
+    gpudrv_debugfs = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("stats", 0444, gpudrv_debugfs, NULL, &gpudrv_debug_stats_fops);
+
     pr_info("module loaded, device /dev/%s ready\n", DEVICE_NAME);
     return 0;
 }
 
 static void __exit gpudrv_exit(void)
 {
+    debugfs_remove_recursive(gpudrv_debugfs);
     device_destroy(gpudrv_class, dev_number);
     class_destroy(gpudrv_class);
     cdev_del(&gpudrv_cdev);
     unregister_chrdev_region(dev_number, 1);
+    idr_destroy(&job_idr);
     pr_info("module unloaded\n");
 }
 
@@ -121,4 +886,4 @@ module_exit(gpudrv_exit);
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("You");
-MODULE_DESCRIPTION("gpudrv - prototype IOCTL mode control");
\ No newline at end of file
+MODULE_DESCRIPTION("gpudrv - per-file mode control, shared-memory job rings, vectored job queue and telemetry");
\ No newline at end of file
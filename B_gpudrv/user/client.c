@@ -1,32 +1,65 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include "../include/gpudrv_ioctl.h"
+#include "libgpudrv.h"
 
-// From libgpudrv
-int gpudrv_open(void);
-void gpudrv_close(void);
-int gpudrv_run_cpu(void);
-int gpudrv_run_gpu(void);
-int gpudrv_run_hybrid(void);
+#define DEFAULT_N 1048576
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        printf("Usage: %s [cpu|gpu|hybrid]\n", argv[0]);
+        printf("Usage: %s [cpu|gpu|hybrid] [n]\n", argv[0]);
+        printf("       %s daemon [n] [jobs]   (submit to a running gpudrv daemon)\n", argv[0]);
+        printf("       %s stats   (driver telemetry)\n", argv[0]);
+        printf("       %s <n>   (runs in the driver's current mode)\n", argv[0]);
         return 1;
     }
 
+    if (strcmp(argv[1], "stats") == 0) {
+        if (gpudrv_open() < 0) return 1;
+        int err = gpudrv_print_stats(stdout);
+        gpudrv_close();
+        return err == 0 ? 0 : 1;
+    }
+
+    const char *mode = argv[1];
+    const char *n_arg = argc > 2 ? argv[2] : NULL;
+    if (isdigit((unsigned char)argv[1][0])) {
+        mode = NULL;
+        n_arg = argv[1];
+    }
+    size_t n = n_arg ? strtoull(n_arg, NULL, 10) : DEFAULT_N;
+    if (n == 0) {
+        printf("Invalid size: %s\n", n_arg);
+        return 1;
+    }
+
+    if (mode && strcmp(mode, "daemon") == 0) {
+        unsigned jobs = argc > 3 ? (unsigned)strtoul(argv[3], NULL, 10) : 64;
+        return gpudrv_run_daemon(n, jobs ? jobs : 1) == 0 ? 0 : 1;
+    }
+
     if (gpudrv_open() < 0) return 1;
 
-    if (strcmp(argv[1], "cpu") == 0) {
-        gpudrv_run_cpu();
-    } else if (strcmp(argv[1], "gpu") == 0) {
-        gpudrv_run_gpu();
-    } else if (strcmp(argv[1], "hybrid") == 0) {
-        gpudrv_run_hybrid();
+    int m = -1;
+    if (!mode) m = gpudrv_get_mode();
+    else if (strcmp(mode, "cpu") == 0) m = GPUDRV_MODE_CPU;
+    else if (strcmp(mode, "gpu") == 0) m = GPUDRV_MODE_GPU;
+    else if (strcmp(mode, "hybrid") == 0) m = GPUDRV_MODE_HYBRID;
+
+    int err;
+    if (m == GPUDRV_MODE_CPU) {
+        err = gpudrv_run_cpu(n);
+    } else if (m == GPUDRV_MODE_GPU) {
+        err = gpudrv_run_gpu(n);
+    } else if (m == GPUDRV_MODE_HYBRID) {
+        err = gpudrv_run_hybrid(n);
     } else {
-        printf("Unknown mode: %s\n", argv[1]);
+        printf("Unknown mode: %s\n", mode ? mode : "?");
+        err = -1;
     }
 
     gpudrv_close();
-    return 0;
-}
\ No newline at end of file
+    return err == 0 ? 0 : 1;
+}
@@ -1,44 +1,842 @@
-// daemon.c (user-space)
+// daemon.c (user-space) - pulls jobs from the gpudrv ring and/or a local
+// socket, coalesces small same-kind jobs and runs them through libgpufw
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <errno.h>
 #include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
 #include "../include/gpudrv_ioctl.h" // copy/symlink from kern/
+#include "../include/gpudrv_ring.h"
+#include "../include/gpudrv_job.h"
+#include "libgpufw.h"
+#include "ring.h"
+#include "jobq.h"
+#include "daemon_proto.h"
 
-static void do_set_mode(int fd, int mode, const char *name)
+#define DEFAULT_KERNEL   "kernels/vecadd.cl"
+#define BATCH_MAX_JOBS   64
+#define BATCH_SMALL_N    (64u << 10)    /* larger jobs always run on their own */
+#define BATCH_MAX_ELEMS  (1u << 20)
+#define MODE_REFRESH_MS  50.0
+#define JOBQ_FETCH       256
+#define GRAPH_CACHE      16             /* recorded single-job pipelines per worker */
+
+/* A connection on the local socket; jobs hold a reference until completed. */
+struct conn {
+    int fd;
+    pthread_mutex_t wmu;        /* one completion written at a time */
+    int refs;
+};
+
+/* A connection's reader thread, kept joinable so shutdown can wait for it. */
+struct conn_thread {
+    pthread_t thread;
+    struct conn *c;             /* NULL once the reader has let go of it */
+    int done;
+    struct conn_thread *next;
+};
+
+enum job_src { SRC_RING, SRC_JOBQ, SRC_SOCKET };
+
+struct job {
+    struct gpudrv_sqe sqe;
+    enum job_src src;
+    __u64 jq_id;                /* SRC_JOBQ: driver job id */
+    int mode;
+    const float *a, *b;
+    float *out;
+    struct conn *conn;          /* SRC_SOCKET */
+    void *buf;                  /* owned in/out storage for socket jobs */
+    struct job *next;
+};
+
+/* The single-job pipeline recorded for one kernel choice. */
+struct job_graph {
+    gpufw_variant v;            /* vec_width 0: the plain vecadd kernel */
+    gpufw_graph *g;
+};
+
+struct worker {
+    pthread_t thread;
+    unsigned id;
+    gpufw_ctx *ctx;             /* shared; each worker thread gets its own queue */
+    struct job_graph graphs[GRAPH_CACHE];
+    unsigned ngraphs;
+    struct gpudrv_complete_ent jq_done[BATCH_MAX_JOBS];    /* one COMPLETE per batch */
+    unsigned jq_ndone;
+};
+
+static struct {
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+    struct job *head, *tail;
+    unsigned long queued;
+    int stop;
+} jq = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0 };
+
+static struct {
+    int fd;                     /* /dev/gpudrv, -1 without the module */
+    struct gpudrv_ring ring;
+    int have_ring;
+    struct gpudrv_jobq jobq;    /* on its own open file: the FETCH/COMPLETE side */
+    int have_jobq;
+    pthread_mutex_t cq_mu;      /* workers share the single CQ producer slot */
+    int stop;                   /* intake threads: take no more jobs */
+    pthread_mutex_t mode_mu;    /* mode and mode_at: ring, jobq and connection threads all ask */
+    int mode;                   /* driver mode, refreshed at most every MODE_REFRESH_MS */
+    double mode_at;
+} drv = { -1, { 0 }, 0, { -1, NULL, NULL }, 0, PTHREAD_MUTEX_INITIALIZER, 0, PTHREAD_MUTEX_INITIALIZER,
+          GPUDRV_MODE_GPU, 0.0 };
+
+static struct {
+    pthread_mutex_t mu;
+    struct conn_thread *head;
+} conns = { PTHREAD_MUTEX_INITIALIZER, NULL };
+
+static struct {
+    unsigned long jobs, batches, batched_jobs, errors;
+} stats;
+static pthread_mutex_t stats_mu = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *kernel_file = DEFAULT_KERNEL;
+
+static int intake_stopped(void)
+{
+    return __atomic_load_n(&drv.stop, __ATOMIC_ACQUIRE);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static int current_mode(void)
 {
-    printf("Requesting %s mode...\n", name);
-    if (ioctl(fd, GPUDRV_IOC_SET_MODE, &mode) == -1) {
-        fprintf(stderr, "ioctl SET_MODE(%s) failed: %s\n", name, strerror(errno));
+    double t = now_ms();
+    pthread_mutex_lock(&drv.mode_mu);
+    if (drv.fd >= 0 && t - drv.mode_at > MODE_REFRESH_MS) {
+        int cur;
+        if (ioctl(drv.fd, GPUDRV_IOC_GET_MODE, &cur) == 0) drv.mode = cur;
+        drv.mode_at = t;
+    }
+    int mode = drv.mode;
+    pthread_mutex_unlock(&drv.mode_mu);
+    return mode;
+}
+
+/* ---- job queue ---- */
+
+/* In a trace each job is an async span keyed by its address from intake to
+   completion, with "queue" and "run" nested inside it. */
+static void job_push(struct job *j)
+{
+    gpufw_trace_async_begin("daemon", "queue", (uintptr_t)j, NULL, 0);
+    j->next = NULL;
+    pthread_mutex_lock(&jq.mu);
+    if (jq.tail) jq.tail->next = j;
+    else jq.head = j;
+    jq.tail = j;
+    jq.queued++;
+    pthread_cond_signal(&jq.cv);
+    pthread_mutex_unlock(&jq.mu);
+}
+
+static int batchable(const struct job *j)
+{
+    return j->sqe.op == GPUDRV_OP_VECADD && j->mode == GPUDRV_MODE_GPU && j->sqe.n <= BATCH_SMALL_N;
+}
+
+/* Pop the oldest job plus, if it is small, every queued job it can share a
+   launch with. Returns the batch as a list, or NULL once stopped. */
+static struct job *job_pop_batch(unsigned *count)
+{
+    pthread_mutex_lock(&jq.mu);
+    while (!jq.head && !jq.stop) pthread_cond_wait(&jq.cv, &jq.mu);
+    struct job *first = jq.head;
+    if (!first) {
+        pthread_mutex_unlock(&jq.mu);
+        return NULL;
+    }
+    jq.head = first->next;
+    if (!jq.head) jq.tail = NULL;
+    first->next = NULL;
+    *count = 1;
+
+    if (batchable(first)) {
+        size_t elems = first->sqe.n;
+        struct job *last = first, *prev = NULL;
+        for (struct job *j = jq.head; j && *count < BATCH_MAX_JOBS;) {
+            struct job *next = j->next;
+            if (batchable(j) && elems + j->sqe.n <= BATCH_MAX_ELEMS) {
+                if (prev) prev->next = next;
+                else jq.head = next;
+                if (jq.tail == j) jq.tail = prev;
+                j->next = NULL;
+                last->next = j;
+                last = j;
+                elems += j->sqe.n;
+                (*count)++;
+            } else {
+                prev = j;
+            }
+            j = next;
+        }
+    }
+    jq.queued -= *count;
+    pthread_mutex_unlock(&jq.mu);
+    for (struct job *j = first; j; j = j->next) {
+        gpufw_trace_async_end("daemon", "queue", (uintptr_t)j);
+        gpufw_trace_async_begin("daemon", "run", (uintptr_t)j, NULL, 0);
+    }
+    return first;
+}
+
+/* ---- completions ---- */
+
+static void conn_put(struct conn *c)
+{
+    pthread_mutex_lock(&c->wmu);
+    int last = --c->refs == 0;
+    pthread_mutex_unlock(&c->wmu);
+    if (last) {
+        close(c->fd);
+        pthread_mutex_destroy(&c->wmu);
+        free(c);
+    }
+}
+
+static int write_all(int fd, const void *p, size_t len)
+{
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        p = (const char *)p + w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *p, size_t len)
+{
+    while (len > 0) {
+        ssize_t r = read(fd, p, len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        p = (char *)p + r;
+        len -= (size_t)r;
+    }
+    return 0;
+}
+
+static void job_account(int res)
+{
+    pthread_mutex_lock(&stats_mu);
+    stats.jobs++;
+    if (res != 0) stats.errors++;
+    pthread_mutex_unlock(&stats_mu);
+}
+
+static void jobq_flush(struct worker *w)
+{
+    if (w->jq_ndone && gpudrv_jobq_complete(&drv.jobq, w->jq_done, w->jq_ndone) < 0)
+        fprintf(stderr, "daemon: COMPLETE of %u jobs failed: %s\n", w->jq_ndone, strerror(errno));
+    w->jq_ndone = 0;
+}
+
+static void job_complete(struct job *j, int res)
+{
+    gpufw_trace_async_end("daemon", "job", (uintptr_t)j);
+    if (j->src == SRC_SOCKET) {
+        struct gpudrv_cqe cqe = { j->sqe.user_data, res, 0 };
+        pthread_mutex_lock(&j->conn->wmu);
+        if (write_all(j->conn->fd, &cqe, sizeof(cqe)) == 0 && res == 0)
+            write_all(j->conn->fd, j->out, j->sqe.out_len);
+        pthread_mutex_unlock(&j->conn->wmu);
+        conn_put(j->conn);
+        free(j->buf);
     } else {
-        int cur = -1;
-        if (ioctl(fd, GPUDRV_IOC_GET_MODE, &cur) == -1) {
-            fprintf(stderr, "ioctl GET_MODE failed: %s\n", strerror(errno));
+        pthread_mutex_lock(&drv.cq_mu);
+        while (gpudrv_ring_post_cqe(&drv.ring, j->sqe.user_data, res) != 0) {
+            pthread_mutex_unlock(&drv.cq_mu);
+            sched_yield();      /* the client drains the CQ */
+            pthread_mutex_lock(&drv.cq_mu);
+        }
+        pthread_mutex_unlock(&drv.cq_mu);
+    }
+    job_account(res);
+    free(j);
+}
+
+/* Driver-queue completions are collected and handed back in one call. */
+static void job_finish(struct worker *w, struct job *j, int res)
+{
+    if (j->src != SRC_JOBQ) {
+        job_complete(j, res);
+        return;
+    }
+    gpufw_trace_async_end("daemon", "job", (uintptr_t)j);
+    struct gpudrv_complete_ent *e = &w->jq_done[w->jq_ndone++];
+    e->id = j->jq_id;
+    e->res = res;
+    e->pad = 0;
+    job_account(res);
+    free(j);
+    if (w->jq_ndone == BATCH_MAX_JOBS) jobq_flush(w);
+}
+
+/* ---- execution ---- */
+
+/* One write per input slice into shared device buffers, one NDRange over the
+   whole batch, one read per job straight into its output. */
+static int run_batch_gpu(struct worker *w, struct job *batch)
+{
+    gpufw_ctx *ctx = w->ctx;
+    size_t total = 0;
+    for (struct job *j = batch; j; j = j->next) total += j->sqe.n;
+    size_t bytes = total * sizeof(float);
+    cl_mem a = gpufw_alloc_buffer(ctx, bytes, CL_MEM_READ_ONLY);
+    cl_mem b = gpufw_alloc_buffer(ctx, bytes, CL_MEM_READ_ONLY);
+    cl_mem c = gpufw_alloc_buffer(ctx, bytes, CL_MEM_WRITE_ONLY);
+    int err = (a && b && c) ? 0 : -1;
+
+    size_t off = 0;
+    for (struct job *j = batch; j && !err; j = j->next) {
+        size_t len = j->sqe.n * sizeof(float);
+        err = gpufw_write_buffer_async(ctx, a, off, j->a, len, 0, NULL, NULL);
+        if (!err) err = gpufw_write_buffer_async(ctx, b, off, j->b, len, 0, NULL, NULL);
+        off += len;
+    }
+    int n_arg = (int)total;
+    /* specialized vecadd_vec build for the batch size when the kernel file has one */
+    gpufw_variant v;
+    cl_kernel k = NULL;
+    size_t gws = total;
+    if (gpufw_variant_pick(ctx, total, &v) == 0 && gpufw_variant_kernel(ctx, "vecadd_vec", &v, &k) == 0)
+        gws = gpufw_variant_global_size(&v, total);
+    else if (gpufw_get_kernel(ctx, "vecadd", &k) != 0)
+        err = -1;
+    if (!err) err = gpufw_set_kernel_arg(ctx, k, 0, sizeof(cl_mem), &a);
+    if (!err) err = gpufw_set_kernel_arg(ctx, k, 1, sizeof(cl_mem), &b);
+    if (!err) err = gpufw_set_kernel_arg(ctx, k, 2, sizeof(cl_mem), &c);
+    if (!err) err = gpufw_set_kernel_arg(ctx, k, 3, sizeof(int), &n_arg);
+    if (!err) err = gpufw_launch_kernel_async(ctx, k, gws, 0, 0, NULL, NULL);
+    off = 0;
+    for (struct job *j = batch; j && !err; j = j->next) {
+        size_t len = j->sqe.n * sizeof(float);
+        err = gpufw_read_buffer_async(ctx, c, off, j->out, len, 0, NULL, NULL);
+        off += len;
+    }
+    int ferr = gpufw_finish(ctx);   /* this worker's in-order queue: the last read implies the rest */
+    if (!err) err = ferr;
+    if (a) gpufw_release_buffer(ctx, a);
+    if (b) gpufw_release_buffer(ctx, b);
+    if (c) gpufw_release_buffer(ctx, c);
+    return err;
+}
+
+/* write a, write b, launch, read c: recorded once per kernel choice with the
+   buffers, pointers and n as parameters, then replayed for every single job */
+static gpufw_graph *job_graph(struct worker *w, const gpufw_variant *v)
+{
+    for (unsigned i = 0; i < w->ngraphs; ++i)
+        if (memcmp(&w->graphs[i].v, v, sizeof(*v)) == 0) return w->graphs[i].g;
+    if (w->ngraphs == GRAPH_CACHE) return NULL;
+    gpufw_ctx *ctx = w->ctx;
+    cl_kernel k;
+    if (v->vec_width ? gpufw_variant_kernel(ctx, "vecadd_vec", v, &k) : gpufw_get_kernel(ctx, "vecadd", &k))
+        return NULL;
+    gpufw_graph *g = gpufw_graph_begin(ctx);
+    if (!g) return NULL;
+    gpufw_graph_size bytes = GPUFW_GRAPH_N(sizeof(float));
+    gpufw_graph_write(g, 0, GPUFW_GRAPH_FIXED(0), 0, bytes);
+    gpufw_graph_write(g, 1, GPUFW_GRAPH_FIXED(0), 1, bytes);
+    for (unsigned i = 0; i < 3; ++i) gpufw_graph_arg_mem(g, k, i, i);
+    gpufw_graph_arg_size(g, k, 3, sizeof(int), GPUFW_GRAPH_N(1));
+    gpufw_graph_launch(g, k, v->vec_width ? GPUFW_GRAPH_N_DIV((size_t)v->vec_width * v->per_item) : GPUFW_GRAPH_N(1), 0);
+    gpufw_graph_read(g, 2, GPUFW_GRAPH_FIXED(0), 2, bytes);
+    if (gpufw_graph_end(g) != 0) {
+        gpufw_graph_release(g);
+        return NULL;
+    }
+    w->graphs[w->ngraphs].v = *v;
+    w->graphs[w->ngraphs++].g = g;
+    return g;
+}
+
+static int run_one_gpu(struct worker *w, struct job *j)
+{
+    gpufw_ctx *ctx = w->ctx;
+    size_t n = j->sqe.n;
+    gpufw_variant v;
+    if (gpufw_variant_pick(ctx, n, &v) != 0) memset(&v, 0, sizeof(v));
+    gpufw_graph *g = job_graph(w, &v);
+    if (!g) {
+        j->next = NULL;
+        return run_batch_gpu(w, j);
+    }
+    size_t bytes = n * sizeof(float);
+    gpufw_graph_args args = { .n = n };
+    args.mem[0] = gpufw_alloc_buffer(ctx, bytes, CL_MEM_READ_ONLY);
+    args.mem[1] = gpufw_alloc_buffer(ctx, bytes, CL_MEM_READ_ONLY);
+    args.mem[2] = gpufw_alloc_buffer(ctx, bytes, CL_MEM_WRITE_ONLY);
+    args.src[0] = j->a;
+    args.src[1] = j->b;
+    args.dst[2] = j->out;
+    int err = (args.mem[0] && args.mem[1] && args.mem[2]) ? 0 : -1;
+    if (!err) err = gpufw_graph_replay(ctx, g, &args, NULL);
+    int ferr = gpufw_finish(ctx);
+    if (!err) err = ferr;
+    for (unsigned i = 0; i < 3; ++i)
+        if (args.mem[i]) gpufw_release_buffer(ctx, args.mem[i]);
+    return err;
+}
+
+static int run_one(struct worker *w, struct job *j)
+{
+    switch (j->sqe.op) {
+    case GPUDRV_OP_NOP:
+        return 0;
+    case GPUDRV_OP_VECADD:
+        if (j->mode == GPUDRV_MODE_CPU || w->ctx->backend == GPUFW_BACKEND_NATIVE_CPU)
+            return gpufw_cpu_vecadd(j->a, j->b, j->out, j->sqe.n);
+        if (j->mode == GPUDRV_MODE_HYBRID)
+            return gpufw_hybrid_vecadd(w->ctx, j->a, j->b, j->out, j->sqe.n);
+        return run_one_gpu(w, j);
+    default:
+        return -EINVAL;
+    }
+}
+
+static void *worker_main(void *p)
+{
+    struct worker *w = p;
+    unsigned count;
+    struct job *batch;
+    char name[32];
+    snprintf(name, sizeof(name), "worker %u", w->id);
+    gpufw_trace_thread_name(name);
+    while ((batch = job_pop_batch(&count)) != NULL) {
+        GPUFW_TRACE_SCOPE("daemon", "batch");
+        GPUFW_TRACE_ARG("jobs", count);
+        int err;
+        if (count > 1 && w->ctx->backend == GPUFW_BACKEND_OPENCL) {
+            err = run_batch_gpu(w, batch);
+            if (err) err = -EIO;
+            pthread_mutex_lock(&stats_mu);
+            stats.batches++;
+            stats.batched_jobs += count;
+            pthread_mutex_unlock(&stats_mu);
+            for (struct job *j = batch, *next; j; j = next) {
+                next = j->next;
+                gpufw_trace_async_end("daemon", "run", (uintptr_t)j);
+                job_finish(w, j, err);
+            }
         } else {
-            printf("Kernel reports current mode = %d\n", cur);
+            for (struct job *j = batch, *next; j; j = next) {
+                next = j->next;
+                err = run_one(w, j);
+                gpufw_trace_async_end("daemon", "run", (uintptr_t)j);
+                job_finish(w, j, err == 0 ? 0 : (err == -EINVAL ? -EINVAL : -EIO));
+            }
+        }
+        jobq_flush(w);
+    }
+    for (unsigned i = 0; i < w->ngraphs; ++i) gpufw_graph_release(w->graphs[i].g);
+    return NULL;
+}
+
+/* ---- intake ---- */
+
+static int resolve_mode(__u32 mode)
+{
+    if (mode == GPUDRV_MODE_CPU || mode == GPUDRV_MODE_GPU || mode == GPUDRV_MODE_HYBRID)
+        return (int)mode;
+    return current_mode();
+}
+
+/* Ring and driver-queue jobs point into the shared payload; results are
+   written in place. Returns -EINVAL if the descriptor points outside it. */
+static int job_bind_payload(struct job *j)
+{
+    struct gpudrv_ring *r = &drv.ring;
+    __u64 psize = r->payload_size;     /* cached: the header is client-writable */
+    size_t need = (size_t)j->sqe.n * sizeof(float);
+    j->mode = resolve_mode(j->sqe.mode);
+    if (j->sqe.op == GPUDRV_OP_VECADD &&
+        (j->sqe.in_len < 2 * need || j->sqe.out_len < need || j->sqe.in_off > psize ||
+         j->sqe.in_len > psize - j->sqe.in_off || j->sqe.out_off > psize ||
+         j->sqe.out_len > psize - j->sqe.out_off))
+        return -EINVAL;
+    j->a = (const float *)(r->payload + j->sqe.in_off);
+    j->b = j->a + j->sqe.n;
+    j->out = (float *)(r->payload + j->sqe.out_off);
+    return 0;
+}
+
+static void *ring_main(void *unused)
+{
+    struct gpudrv_ring *r = &drv.ring;
+    gpufw_trace_thread_name("ring");
+    while (!intake_stopped()) {
+        const struct gpudrv_sqe *sqe = gpudrv_ring_peek_sqe(r);
+        if (!sqe) {
+            /* shutdown interrupts the wait with SIGUSR1 */
+            if (gpudrv_ring_wait(r, GPUDRV_RING_SQ) != 0 && errno != EINTR) break;
+            continue;
+        }
+        struct job *j = calloc(1, sizeof(*j));
+        if (!j) break;
+        j->sqe = *sqe;
+        j->src = SRC_RING;
+        gpufw_trace_async_begin("daemon", "job", (uintptr_t)j, "user_data", j->sqe.user_data);
+        gpudrv_ring_sqe_done(r);
+        if (job_bind_payload(j) != 0) job_complete(j, -EINVAL);
+        else job_push(j);
+    }
+    return NULL;
+}
+
+/* Driver job queue: sleep in poll() until jobs are queued, then take them in
+   batches. Rejected descriptors are completed straight away. */
+static void *jobq_main(void *unused)
+{
+    static struct gpudrv_fetch_ent fe[JOBQ_FETCH];
+    struct gpudrv_complete_ent bad[JOBQ_FETCH];
+    struct pollfd pfd = { gpudrv_jobq_poll_fd(&drv.jobq), POLLIN, 0 };
+    gpufw_trace_thread_name("jobq");
+    while (!intake_stopped()) {
+        int n = gpudrv_jobq_fetch(&drv.jobq, fe, JOBQ_FETCH);
+        if (n < 0) {
+            fprintf(stderr, "daemon: FETCH failed: %s\n", strerror(errno));
+            break;
+        }
+        if (n == 0) {
+            poll(&pfd, 1, 100);     /* bounded so shutdown is noticed */
+            continue;
+        }
+        unsigned nbad = 0;
+        for (int i = 0; i < n; ++i) {
+            struct job *j = calloc(1, sizeof(*j));
+            if (!j) {
+                bad[nbad++] = (struct gpudrv_complete_ent){ fe[i].id, -ENOMEM, 0 };
+                continue;
+            }
+            j->sqe = fe[i].sqe;
+            j->src = SRC_JOBQ;
+            j->jq_id = fe[i].id;
+            if (job_bind_payload(j) != 0) {
+                bad[nbad++] = (struct gpudrv_complete_ent){ fe[i].id, -EINVAL, 0 };
+                job_account(-EINVAL);
+                free(j);
+                continue;
+            }
+            gpufw_trace_async_begin("daemon", "job", (uintptr_t)j, "user_data", j->sqe.user_data);
+            job_push(j);
+        }
+        if (nbad) gpudrv_jobq_complete(&drv.jobq, bad, nbad);
+    }
+    return NULL;
+}
+
+/* Socket jobs carry their input inline: sqe, then in_len bytes. */
+static void *conn_main(void *p)
+{
+    struct conn_thread *t = p;
+    struct conn *c = t->c;
+    struct gpudrv_sqe sqe;
+    gpufw_trace_thread_name("conn");
+    while (read_all(c->fd, &sqe, sizeof(sqe)) == 0) {
+        struct job *j = calloc(1, sizeof(*j));
+        if (!j) break;
+        j->sqe = sqe;
+        j->src = SRC_SOCKET;
+        j->mode = resolve_mode(sqe.mode);
+        size_t need = (size_t)sqe.n * sizeof(float);
+        int bad = sqe.in_len > GPUDRV_SOCK_MAX_BYTES || sqe.out_len > GPUDRV_SOCK_MAX_BYTES ||
+                  (sqe.op == GPUDRV_OP_VECADD && (sqe.in_len != 2 * need || sqe.out_len != need));
+        j->buf = bad ? NULL : malloc(sqe.in_len + sqe.out_len + 1);
+        if (bad || !j->buf || read_all(c->fd, j->buf, sqe.in_len) != 0) {
+            free(j->buf);
+            free(j);
+            break;      /* protocol error: drop the connection */
+        }
+        j->a = j->buf;
+        j->b = j->a + sqe.n;
+        j->out = (float *)((char *)j->buf + sqe.in_len);
+        pthread_mutex_lock(&c->wmu);
+        c->refs++;
+        pthread_mutex_unlock(&c->wmu);
+        j->conn = c;
+        gpufw_trace_async_begin("daemon", "job", (uintptr_t)j, "user_data", sqe.user_data);
+        job_push(j);
+    }
+    shutdown(c->fd, SHUT_RD);
+    pthread_mutex_lock(&conns.mu);
+    t->c = NULL;
+    t->done = 1;
+    pthread_mutex_unlock(&conns.mu);
+    conn_put(c);
+    return NULL;
+}
+
+/* Join the reader threads of connections that have closed. */
+static void conn_reap(void)
+{
+    pthread_mutex_lock(&conns.mu);
+    struct conn_thread **pp = &conns.head;
+    while (*pp) {
+        struct conn_thread *t = *pp;
+        if (!t->done) {
+            pp = &t->next;
+            continue;
+        }
+        *pp = t->next;
+        pthread_join(t->thread, NULL);
+        free(t);
+    }
+    pthread_mutex_unlock(&conns.mu);
+}
+
+static void *accept_main(void *p)
+{
+    int lfd = *(int *)p;
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
         }
+        conn_reap();
+        struct conn *c = calloc(1, sizeof(*c));
+        struct conn_thread *t = calloc(1, sizeof(*t));
+        if (!c || !t) {
+            close(fd);
+            free(c);
+            free(t);
+            continue;
+        }
+        c->fd = fd;
+        c->refs = 1;
+        pthread_mutex_init(&c->wmu, NULL);
+        t->c = c;
+        pthread_mutex_lock(&conns.mu);
+        if (pthread_create(&t->thread, NULL, conn_main, t) != 0) {
+            pthread_mutex_unlock(&conns.mu);
+            conn_put(c);
+            free(t);
+            continue;
+        }
+        t->next = conns.head;
+        conns.head = t;
+        pthread_mutex_unlock(&conns.mu);
+    }
+    return NULL;
+}
+
+/* Stop reading from every connection and wait for the readers; jobs they
+   already queued keep their connection until completed. */
+static void conn_stop_all(void)
+{
+    pthread_mutex_lock(&conns.mu);
+    for (struct conn_thread *t = conns.head; t; t = t->next)
+        if (t->c) shutdown(t->c->fd, SHUT_RD);
+    struct conn_thread *t = conns.head;
+    conns.head = NULL;
+    pthread_mutex_unlock(&conns.mu);
+    while (t) {
+        struct conn_thread *next = t->next;
+        pthread_join(t->thread, NULL);
+        free(t);
+        t = next;
+    }
+}
+
+/* The SQ wait only returns for new entries or a signal, and a signal sent
+   just before the thread goes to sleep is lost, so keep poking until it has
+   seen drv.stop. */
+static void ring_stop(pthread_t th)
+{
+    for (;;) {
+        pthread_kill(th, SIGUSR1);
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 10 * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        if (pthread_timedjoin_np(th, NULL, &ts) != ETIMEDOUT) return;
+    }
+}
+
+static void on_wake(int sig)
+{
+    (void)sig;
+}
+
+static int listen_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        fprintf(stderr, "daemon: cannot listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
     }
+    return fd;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [-k kernel.cl] [-w workers] [-s socket] [-n] [-t trace.json]\n", prog);
+    printf("  -k  OpenCL source to build (default %s)\n", DEFAULT_KERNEL);
+    printf("  -w  worker threads sharing one context, each with its own queue (default 2)\n");
+    printf("  -s  local socket for clients without the module (default $GPUDRV_SOCKET or %s)\n", GPUDRV_SOCK_DEFAULT);
+    printf("  -n  do not attach to /dev/gpudrv\n");
+    printf("  -t  write a Chrome/Perfetto trace of jobs, libgpufw calls and device commands on exit\n");
 }
 
 int main(int argc, char **argv)
 {
-    const char *dev = "/dev/gpudrv";
-    int fd = open(dev, O_RDWR);
-    if (fd < 0) {
-        perror("open /dev/gpudrv");
+    unsigned nworkers = 2;
+    const char *sock_path = getenv("GPUDRV_SOCKET");
+    const char *trace_path = NULL;
+    int use_dev = 1;
+    int opt;
+    if (!sock_path || !*sock_path) sock_path = GPUDRV_SOCK_DEFAULT;
+    while ((opt = getopt(argc, argv, "k:w:s:nt:h")) != -1) {
+        switch (opt) {
+        case 'k': kernel_file = optarg; break;
+        case 'w': nworkers = (unsigned)atoi(optarg); break;
+        case 's': sock_path = optarg; break;
+        case 'n': use_dev = 0; break;
+        case 't': trace_path = optarg; break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (nworkers == 0) nworkers = 1;
+    if (trace_path && gpufw_trace_start(trace_path) != 0) return 1;
+    gpufw_trace_thread_name("main");
+
+    /* Handle termination in main via sigwait; every thread inherits the mask. */
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction wake;      /* no SA_RESTART: interrupts the ring thread's wait */
+    memset(&wake, 0, sizeof(wake));
+    wake.sa_handler = on_wake;
+    sigemptyset(&wake.sa_mask);
+    sigaction(SIGUSR1, &wake, NULL);
+
+    if (use_dev) {
+        drv.fd = open("/dev/gpudrv", O_RDWR);
+        if (drv.fd < 0)
+            fprintf(stderr, "daemon: open /dev/gpudrv failed (%s), serving the socket only\n", strerror(errno));
+        else if (gpudrv_ring_init_dev(&drv.ring, drv.fd, 0, 0) == 0)
+            drv.have_ring = 1;
+    }
+    if (drv.have_ring) {
+        int qfd = open("/dev/gpudrv", O_RDWR);
+        if (qfd >= 0) {
+            gpudrv_jobq_init_dev(&drv.jobq, qfd);
+            drv.have_jobq = 1;
+        }
+    }
+
+    /* One warm context for all workers: the program is built (or loaded from the
+       binary cache) once, and the buffer pool, tuning and variant builds are
+       shared. Each worker thread enqueues on its own queue. */
+    static gpufw_ctx ctx;
+    gpufw_init_opts opts = { GPUFW_INIT_CPU_FALLBACK | GPUFW_INIT_THREADS };
+    if (gpufw_init_ex(&ctx, kernel_file, 0, &opts) != 0) {
+        fprintf(stderr, "daemon: init failed\n");
+        return 1;
+    }
+    cl_kernel probe;
+    if (ctx.backend == GPUFW_BACKEND_OPENCL && gpufw_get_kernel(&ctx, "vecadd", &probe) != 0) {
+        fprintf(stderr, "daemon: no vecadd kernel in %s\n", kernel_file);
+        return 1;
+    }
+    struct worker *workers = calloc(nworkers, sizeof(*workers));
+    if (!workers) return 1;
+    for (unsigned i = 0; i < nworkers; ++i) {
+        workers[i].id = i;
+        workers[i].ctx = &ctx;
+    }
+    for (unsigned i = 0; i < nworkers; ++i)
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+
+    pthread_t ring_th, jobq_th, accept_th;
+    if (drv.have_ring) pthread_create(&ring_th, NULL, ring_main, NULL);
+    if (drv.have_jobq) pthread_create(&jobq_th, NULL, jobq_main, NULL);
+    int lfd = listen_socket(sock_path);
+    if (lfd >= 0) pthread_create(&accept_th, NULL, accept_main, &lfd);
+    if (lfd < 0 && !drv.have_ring) {
+        fprintf(stderr, "daemon: no job source available\n");
         return 1;
     }
+    printf("daemon: %u workers (%s), ring %s, job queue %s, socket %s\n", nworkers,
+           ctx.backend == GPUFW_BACKEND_OPENCL ? "opencl" : "native cpu",
+           drv.have_ring ? "attached" : "off", drv.have_jobq ? "attached" : "off",
+           lfd >= 0 ? sock_path : "off");
+    fflush(stdout);
 
-    do_set_mode(fd, GPUDRV_MODE_CPU, "CPU");
-    sleep(1);
-    do_set_mode(fd, GPUDRV_MODE_GPU, "GPU");
-    sleep(1);
-    do_set_mode(fd, GPUDRV_MODE_HYBRID, "HYBRID");
+    int sig;
+    sigwait(&sigs, &sig);
 
-    close(fd);
+    /* Stop intake and join every thread that queues jobs, so nothing is
+       queued behind the workers' backs; then let the workers drain what is
+       queued, and report. */
+    __atomic_store_n(&drv.stop, 1, __ATOMIC_RELEASE);
+    if (lfd >= 0) {
+        shutdown(lfd, SHUT_RDWR);
+        pthread_join(accept_th, NULL);
+        close(lfd);
+        unlink(sock_path);
+        conn_stop_all();
+    }
+    if (drv.have_ring) ring_stop(ring_th);
+    if (drv.have_jobq) pthread_join(jobq_th, NULL);
+    pthread_mutex_lock(&jq.mu);
+    jq.stop = 1;
+    pthread_cond_broadcast(&jq.cv);
+    pthread_mutex_unlock(&jq.mu);
+    for (unsigned i = 0; i < nworkers; ++i) pthread_join(workers[i].thread, NULL);
+
+    printf("daemon: %lu jobs, %lu batched launches covering %lu jobs, %lu errors\n",
+           stats.jobs, stats.batches, stats.batched_jobs, stats.errors);
+    gpufw_cleanup(&ctx);
+    if (trace_path) gpufw_trace_stop();
+    free(workers);
+    gpufw_cpu_shutdown();
+    if (drv.have_jobq) {
+        close(drv.jobq.fd);     /* hands back anything fetched but not run */
+        gpudrv_jobq_exit(&drv.jobq);
+    }
+    if (drv.fd >= 0) {
+        if (drv.have_ring) ioctl(drv.fd, GPUDRV_IOC_RING_WAKE);
+        close(drv.fd);
+    }
     return 0;
-}
\ No newline at end of file
+}
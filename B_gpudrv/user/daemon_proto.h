@@ -0,0 +1,15 @@
+// daemon_proto.h - local-socket job protocol of the gpudrv daemon
+#ifndef GPUDRV_DAEMON_PROTO_H
+#define GPUDRV_DAEMON_PROTO_H
+
+#include "../include/gpudrv_ring.h"
+
+// Without the module, clients reach the daemon over a UNIX stream socket.
+// Each request is a struct gpudrv_sqe (in_off/out_off ignored) followed by
+// in_len bytes of input; each reply is a struct gpudrv_cqe followed, when
+// res == 0, by out_len bytes of output. Requests on one connection may
+// complete out of order; match them by user_data.
+#define GPUDRV_SOCK_DEFAULT    "/tmp/gpudrv.sock"
+#define GPUDRV_SOCK_MAX_BYTES  (256u << 20)
+
+#endif // GPUDRV_DAEMON_PROTO_H
@@ -0,0 +1,412 @@
+// jobq.c - gpudrv vectored job queue, driver-backed or in-process
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/eventfd.h>
+#include "../include/gpudrv_ioctl.h"
+#include "jobq.h"
+
+/* ---- in-process stand-in for the driver's job table ---- */
+
+struct jq_job {
+    __u32 gen;                  /* bumped on free so stale ids miss */
+    __u32 state;                /* GPUDRV_JOB_*; UNKNOWN = free slot */
+    __s32 res;
+    __u32 prio;
+    struct gpudrv_jobq_file *owner, *runner;
+    struct jq_job *prev, *next; /* queue while QUEUED, owner's done list while DONE */
+    struct gpudrv_sqe sqe;
+};
+
+struct jq_list {
+    struct jq_job *first, *last;
+};
+
+struct gpudrv_jobq_file {
+    struct jq_list done;
+    unsigned ndone;
+    int server;
+    __u32 prio;
+    int efd;                    /* registered eventfd, not owned */
+    int pollfd;                 /* readable while this file would poll readable */
+    int armed;
+    struct gpudrv_jobq_file *next;
+};
+
+struct gpudrv_jobq_table {
+    pthread_mutex_t mu;
+    struct jq_job *jobs;        /* GPUDRV_JOB_MAX_INFLIGHT slots */
+    struct jq_job **free_slots;
+    unsigned nfree;
+    struct jq_list queue[GPUDRV_PRIO_LEVELS];
+    struct gpudrv_jobq_file *files;
+};
+
+static void list_append(struct jq_list *l, struct jq_job *j)
+{
+    j->next = NULL;
+    j->prev = l->last;
+    if (l->last) l->last->next = j;
+    else l->first = j;
+    l->last = j;
+}
+
+static void list_prepend(struct jq_list *l, struct jq_job *j)
+{
+    j->prev = NULL;
+    j->next = l->first;
+    if (l->first) l->first->prev = j;
+    else l->last = j;
+    l->first = j;
+}
+
+static void list_remove(struct jq_list *l, struct jq_job *j)
+{
+    if (j->prev) j->prev->next = j->next;
+    else l->first = j->next;
+    if (j->next) j->next->prev = j->prev;
+    else l->last = j->prev;
+    j->prev = j->next = NULL;
+}
+
+static __u64 job_id(const struct gpudrv_jobq_table *t, const struct jq_job *j)
+{
+    return ((__u64)j->gen << 32) | (__u64)(j - t->jobs + 1);
+}
+
+static struct jq_job *job_find(struct gpudrv_jobq_table *t, __u64 id)
+{
+    __u64 slot = (id & 0xffffffffu) - 1;
+    if ((id & 0xffffffffu) == 0 || slot >= GPUDRV_JOB_MAX_INFLIGHT) return NULL;
+    struct jq_job *j = &t->jobs[slot];
+    if (j->state == GPUDRV_JOB_UNKNOWN || j->gen != (__u32)(id >> 32)) return NULL;
+    return j;
+}
+
+static void job_free(struct gpudrv_jobq_table *t, struct jq_job *j)
+{
+    j->state = GPUDRV_JOB_UNKNOWN;
+    j->owner = j->runner = NULL;
+    j->gen++;
+    t->free_slots[t->nfree++] = j;
+}
+
+static int queue_empty(const struct gpudrv_jobq_table *t)
+{
+    for (int p = 0; p < GPUDRV_PRIO_LEVELS; ++p)
+        if (t->queue[p].first) return 0;
+    return 1;
+}
+
+/* Level-triggered readiness on an eventfd: keep the counter non-zero exactly
+   while the file has something to report. Table lock held. */
+static void file_update(struct gpudrv_jobq_table *t, struct gpudrv_jobq_file *f)
+{
+    int ready = f->ndone || (f->server && !queue_empty(t));
+    eventfd_t v;
+    if (ready && !f->armed) {
+        eventfd_write(f->pollfd, 1);
+        f->armed = 1;
+    } else if (!ready && f->armed) {
+        eventfd_read(f->pollfd, &v);
+        f->armed = 0;
+    }
+}
+
+struct gpudrv_jobq_table *gpudrv_jobq_table_create(void)
+{
+    struct gpudrv_jobq_table *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    t->jobs = calloc(GPUDRV_JOB_MAX_INFLIGHT, sizeof(*t->jobs));
+    t->free_slots = malloc(GPUDRV_JOB_MAX_INFLIGHT * sizeof(*t->free_slots));
+    if (!t->jobs || !t->free_slots) {
+        free(t->jobs);
+        free(t->free_slots);
+        free(t);
+        return NULL;
+    }
+    /* hand out low slots first */
+    for (unsigned i = 0; i < GPUDRV_JOB_MAX_INFLIGHT; ++i)
+        t->free_slots[i] = &t->jobs[GPUDRV_JOB_MAX_INFLIGHT - 1 - i];
+    t->nfree = GPUDRV_JOB_MAX_INFLIGHT;
+    pthread_mutex_init(&t->mu, NULL);
+    return t;
+}
+
+void gpudrv_jobq_table_destroy(struct gpudrv_jobq_table *t)
+{
+    if (!t) return;
+    pthread_mutex_destroy(&t->mu);
+    free(t->jobs);
+    free(t->free_slots);
+    free(t);
+}
+
+void gpudrv_jobq_init_dev(struct gpudrv_jobq *q, int fd)
+{
+    memset(q, 0, sizeof(*q));
+    q->fd = fd;
+}
+
+int gpudrv_jobq_init_local(struct gpudrv_jobq *q, struct gpudrv_jobq_table *t)
+{
+    struct gpudrv_jobq_file *f = calloc(1, sizeof(*f));
+    if (!f) return -1;
+    f->efd = -1;
+    f->prio = GPUDRV_PRIO_NORMAL;
+    f->pollfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (f->pollfd < 0) {
+        fprintf(stderr, "gpudrv_jobq: eventfd failed: %s\n", strerror(errno));
+        free(f);
+        return -1;
+    }
+    pthread_mutex_lock(&t->mu);
+    f->next = t->files;
+    t->files = f;
+    pthread_mutex_unlock(&t->mu);
+    q->fd = -1;
+    q->table = t;
+    q->file = f;
+    return 0;
+}
+
+/* Same rules as closing the driver file. */
+static void local_release(struct gpudrv_jobq_table *t, struct gpudrv_jobq_file *f)
+{
+    int requeued = 0;
+    pthread_mutex_lock(&t->mu);
+    for (unsigned i = 0; i < GPUDRV_JOB_MAX_INFLIGHT; ++i) {
+        struct jq_job *j = &t->jobs[i];
+        if (j->state == GPUDRV_JOB_UNKNOWN) continue;
+        if (j->state == GPUDRV_JOB_RUNNING && j->runner == f) {
+            if (j->owner == f) {
+                job_free(t, j);
+            } else {
+                j->state = GPUDRV_JOB_QUEUED;
+                j->runner = NULL;
+                list_prepend(&t->queue[j->prio], j);
+                requeued = 1;
+            }
+        } else if (j->owner == f) {
+            if (j->state == GPUDRV_JOB_RUNNING) {
+                j->owner = NULL;
+            } else {
+                list_remove(j->state == GPUDRV_JOB_QUEUED ? &t->queue[j->prio] : &f->done, j);
+                job_free(t, j);
+            }
+        }
+    }
+    for (struct gpudrv_jobq_file **pp = &t->files; *pp; pp = &(*pp)->next) {
+        if (*pp == f) {
+            *pp = f->next;
+            break;
+        }
+    }
+    for (struct gpudrv_jobq_file *o = t->files; o; o = o->next)
+        if (requeued || o->server) file_update(t, o);
+    pthread_mutex_unlock(&t->mu);
+    close(f->pollfd);
+    free(f);
+}
+
+void gpudrv_jobq_exit(struct gpudrv_jobq *q)
+{
+    if (q->file) local_release(q->table, q->file);
+    memset(q, 0, sizeof(*q));
+    q->fd = -1;
+}
+
+static int check_count(unsigned count)
+{
+    if (count == 0 || count > GPUDRV_VEC_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int gpudrv_jobq_submit(struct gpudrv_jobq *q, const struct gpudrv_sqe *sqes, __u64 *ids, unsigned count)
+{
+    if (check_count(count) != 0) return -1;
+    if (q->fd >= 0) {
+        struct gpudrv_submit_vec v = { (__u64)(uintptr_t)sqes, (__u64)(uintptr_t)ids, count, 0 };
+        if (ioctl(q->fd, GPUDRV_IOC_SUBMIT, &v) == -1) return -1;
+        return (int)v.done;
+    }
+
+    struct gpudrv_jobq_table *t = q->table;
+    unsigned n = 0;
+    pthread_mutex_lock(&t->mu);
+    for (; n < count && t->nfree > 0; ++n) {
+        struct jq_job *j = t->free_slots[--t->nfree];
+        j->state = GPUDRV_JOB_QUEUED;
+        j->res = 0;
+        j->owner = q->file;
+        j->runner = NULL;
+        j->prio = q->file->prio;
+        j->sqe = sqes[n];
+        list_append(&t->queue[j->prio], j);
+        ids[n] = job_id(t, j);
+    }
+    if (n > 0)
+        for (struct gpudrv_jobq_file *o = t->files; o; o = o->next)
+            if (o->server) file_update(t, o);
+    pthread_mutex_unlock(&t->mu);
+    if (n == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return (int)n;
+}
+
+static void status_fill(struct gpudrv_jobq_table *t, struct gpudrv_status_ent *e, const struct jq_job *j)
+{
+    e->id = job_id(t, j);
+    e->user_data = j->sqe.user_data;
+    e->state = j->state;
+    e->res = j->state == GPUDRV_JOB_DONE ? j->res : 0;
+}
+
+static void job_reap(struct gpudrv_jobq_table *t, struct gpudrv_jobq_file *f, struct jq_job *j)
+{
+    list_remove(&f->done, j);
+    f->ndone--;
+    job_free(t, j);
+}
+
+int gpudrv_jobq_status(struct gpudrv_jobq *q, struct gpudrv_status_ent *ents, unsigned count, unsigned flags)
+{
+    if (check_count(count) != 0) return -1;
+    if (q->fd >= 0) {
+        struct gpudrv_status_vec v = { (__u64)(uintptr_t)ents, count, flags, 0, 0 };
+        if (ioctl(q->fd, GPUDRV_IOC_STATUS, &v) == -1) return -1;
+        return (int)v.done;
+    }
+
+    struct gpudrv_jobq_table *t = q->table;
+    struct gpudrv_jobq_file *f = q->file;
+    int reap = (flags & GPUDRV_STATUS_REAP) != 0;
+    unsigned done = 0;
+    pthread_mutex_lock(&t->mu);
+    if (flags & GPUDRV_STATUS_ANY) {
+        struct jq_job *j = f->done.first;
+        while (j && done < count) {
+            struct jq_job *next = j->next;
+            status_fill(t, &ents[done++], j);
+            if (reap) job_reap(t, f, j);
+            j = next;
+        }
+    } else {
+        for (unsigned i = 0; i < count; ++i) {
+            struct jq_job *j = job_find(t, ents[i].id);
+            if (!j || j->owner != f) {
+                ents[i].state = GPUDRV_JOB_UNKNOWN;
+                ents[i].res = 0;
+                continue;
+            }
+            status_fill(t, &ents[i], j);
+            if (j->state != GPUDRV_JOB_DONE) continue;
+            done++;
+            if (reap) job_reap(t, f, j);
+        }
+    }
+    if (reap) file_update(t, f);
+    pthread_mutex_unlock(&t->mu);
+    return (int)done;
+}
+
+int gpudrv_jobq_set_eventfd(struct gpudrv_jobq *q, int efd)
+{
+    if (q->fd >= 0) return ioctl(q->fd, GPUDRV_IOC_SET_EVENTFD, &efd) == -1 ? -1 : 0;
+    pthread_mutex_lock(&q->table->mu);
+    q->file->efd = efd;
+    if (efd >= 0 && q->file->ndone) eventfd_write(efd, 1);
+    pthread_mutex_unlock(&q->table->mu);
+    return 0;
+}
+
+int gpudrv_jobq_set_prio(struct gpudrv_jobq *q, int prio)
+{
+    if (prio < 0 || prio >= GPUDRV_PRIO_LEVELS) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (q->fd >= 0) return ioctl(q->fd, GPUDRV_IOC_SET_PRIO, &prio) == -1 ? -1 : 0;
+    pthread_mutex_lock(&q->table->mu);
+    q->file->prio = (__u32)prio;
+    pthread_mutex_unlock(&q->table->mu);
+    return 0;
+}
+
+int gpudrv_jobq_fetch(struct gpudrv_jobq *q, struct gpudrv_fetch_ent *ents, unsigned count)
+{
+    if (check_count(count) != 0) return -1;
+    if (q->fd >= 0) {
+        struct gpudrv_job_vec v = { (__u64)(uintptr_t)ents, count, 0 };
+        if (ioctl(q->fd, GPUDRV_IOC_FETCH, &v) == -1) return -1;
+        return (int)v.done;
+    }
+
+    struct gpudrv_jobq_table *t = q->table;
+    unsigned n = 0;
+    pthread_mutex_lock(&t->mu);
+    q->file->server = 1;
+    for (int p = GPUDRV_PRIO_LEVELS - 1; p >= 0; --p) {
+        while (n < count && t->queue[p].first) {
+            struct jq_job *j = t->queue[p].first;
+            list_remove(&t->queue[p], j);
+            j->state = GPUDRV_JOB_RUNNING;
+            j->runner = q->file;
+            ents[n].id = job_id(t, j);
+            ents[n].sqe = j->sqe;
+            n++;
+        }
+    }
+    file_update(t, q->file);
+    pthread_mutex_unlock(&t->mu);
+    return (int)n;
+}
+
+int gpudrv_jobq_complete(struct gpudrv_jobq *q, const struct gpudrv_complete_ent *ents, unsigned count)
+{
+    if (check_count(count) != 0) return -1;
+    if (q->fd >= 0) {
+        struct gpudrv_job_vec v = { (__u64)(uintptr_t)ents, count, 0 };
+        if (ioctl(q->fd, GPUDRV_IOC_COMPLETE, &v) == -1) return -1;
+        return (int)v.done;
+    }
+
+    struct gpudrv_jobq_table *t = q->table;
+    unsigned n = 0;
+    pthread_mutex_lock(&t->mu);
+    for (unsigned i = 0; i < count; ++i) {
+        struct jq_job *j = job_find(t, ents[i].id);
+        if (!j || j->state != GPUDRV_JOB_RUNNING || j->runner != q->file) continue;
+        n++;
+        struct gpudrv_jobq_file *owner = j->owner;
+        if (!owner) {
+            job_free(t, j);
+            continue;
+        }
+        j->state = GPUDRV_JOB_DONE;
+        j->res = ents[i].res;
+        j->runner = NULL;
+        list_append(&owner->done, j);
+        owner->ndone++;
+        if (owner->efd >= 0) eventfd_write(owner->efd, 1);
+        file_update(t, owner);
+    }
+    pthread_mutex_unlock(&t->mu);
+    return (int)n;
+}
+
+int gpudrv_jobq_poll_fd(const struct gpudrv_jobq *q)
+{
+    return q->fd >= 0 ? q->fd : q->file->pollfd;
+}
@@ -0,0 +1,41 @@
+// jobq.h - vectored job submit/status with eventfd/poll completion
+#ifndef GPUDRV_USER_JOBQ_H
+#define GPUDRV_USER_JOBQ_H
+
+#include "../include/gpudrv_job.h"
+
+// A handle is one open /dev/gpudrv file, or a handle on an in-process table
+// that follows the same rules (gpudrv_job.h), so clients and the daemon can
+// be exercised without the module. Handles on one table stand for separate
+// open files: jobs belong to the handle that submitted them.
+struct gpudrv_jobq_table;
+struct gpudrv_jobq_file;
+
+struct gpudrv_jobq {
+    int fd;                             // driver fd, or -1 for the in-process table
+    struct gpudrv_jobq_table *table;
+    struct gpudrv_jobq_file *file;
+};
+
+struct gpudrv_jobq_table *gpudrv_jobq_table_create(void);
+void gpudrv_jobq_table_destroy(struct gpudrv_jobq_table *t);   // after every handle is closed
+
+void gpudrv_jobq_init_dev(struct gpudrv_jobq *q, int fd);
+int gpudrv_jobq_init_local(struct gpudrv_jobq *q, struct gpudrv_jobq_table *t);
+void gpudrv_jobq_exit(struct gpudrv_jobq *q);      // does not close a driver fd
+
+// Each call moves up to GPUDRV_VEC_MAX entries and returns how many it
+// handled (queued / reported DONE / fetched / completed), or -1 with errno
+// set; EAGAIN from submit means the driver is full.
+int gpudrv_jobq_submit(struct gpudrv_jobq *q, const struct gpudrv_sqe *sqes, __u64 *ids, unsigned count);
+int gpudrv_jobq_status(struct gpudrv_jobq *q, struct gpudrv_status_ent *ents, unsigned count, unsigned flags);
+int gpudrv_jobq_set_eventfd(struct gpudrv_jobq *q, int efd);
+int gpudrv_jobq_set_prio(struct gpudrv_jobq *q, int prio);      // GPUDRV_PRIO_*, for later submits
+int gpudrv_jobq_fetch(struct gpudrv_jobq *q, struct gpudrv_fetch_ent *ents, unsigned count);
+int gpudrv_jobq_complete(struct gpudrv_jobq *q, const struct gpudrv_complete_ent *ents, unsigned count);
+
+// Descriptor that polls readable under the same conditions as the driver
+// file (the fd itself for the driver).
+int gpudrv_jobq_poll_fd(const struct gpudrv_jobq *q);
+
+#endif // GPUDRV_USER_JOBQ_H
@@ -0,0 +1,205 @@
+// jobq_bench.c - many in-flight jobs: vectored submit + eventfd vs. per-id status polling
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include "../include/gpudrv_ioctl.h"
+#include "jobq.h"
+
+#define FETCH_BATCH 256
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/* ---- server: stands in for the daemon, completes every job it fetches ---- */
+
+struct server {
+    struct gpudrv_jobq q;
+    volatile int stop;
+};
+
+static void *server_main(void *p)
+{
+    struct server *s = p;
+    struct gpudrv_fetch_ent fe[FETCH_BATCH];
+    struct gpudrv_complete_ent ce[FETCH_BATCH];
+    struct pollfd pfd = { gpudrv_jobq_poll_fd(&s->q), POLLIN, 0 };
+    while (!s->stop) {
+        int n = gpudrv_jobq_fetch(&s->q, fe, FETCH_BATCH);
+        if (n < 0) {
+            perror("jobq_bench: fetch");
+            break;
+        }
+        if (n == 0) {
+            poll(&pfd, 1, 50);  /* bounded so stop is noticed */
+            continue;
+        }
+        for (int i = 0; i < n; ++i) {
+            ce[i].id = fe[i].id;
+            ce[i].res = fe[i].sqe.op == GPUDRV_OP_NOP ? 0 : -EINVAL;
+            ce[i].pad = 0;
+        }
+        gpudrv_jobq_complete(&s->q, ce, (unsigned)n);
+    }
+    return NULL;
+}
+
+static void fill_sqe(struct gpudrv_sqe *sqe, unsigned long tag)
+{
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = tag;
+    sqe->op = GPUDRV_OP_NOP;
+    sqe->mode = (__u32)-1;
+}
+
+/* ---- client A: arrays in, eventfd wakeups, reap whatever finished ---- */
+
+static int run_vectored(struct gpudrv_jobq *q, unsigned long jobs, unsigned inflight)
+{
+    static struct gpudrv_sqe sqes[GPUDRV_VEC_MAX];
+    static __u64 ids[GPUDRV_VEC_MAX];
+    static struct gpudrv_status_ent st[GPUDRV_VEC_MAX];
+    int efd = eventfd(0, EFD_CLOEXEC);
+    if (efd < 0 || gpudrv_jobq_set_eventfd(q, efd) != 0) {
+        perror("jobq_bench: eventfd");
+        return -1;
+    }
+    unsigned long submitted = 0, completed = 0, calls = 0, wakeups = 0, bad = 0;
+    double t0 = now_ms();
+    while (completed < jobs) {
+        while (submitted < jobs && submitted - completed < inflight) {
+            unsigned long room = inflight - (submitted - completed);
+            unsigned n = (unsigned)(room < jobs - submitted ? room : jobs - submitted);
+            if (n > GPUDRV_VEC_MAX) n = GPUDRV_VEC_MAX;
+            for (unsigned i = 0; i < n; ++i) fill_sqe(&sqes[i], submitted + i);
+            int got = gpudrv_jobq_submit(q, sqes, ids, n);
+            ++calls;
+            if (got < 0) {
+                if (errno == EAGAIN) break;
+                perror("jobq_bench: submit");
+                return -1;
+            }
+            submitted += (unsigned)got;
+        }
+        int got = gpudrv_jobq_status(q, st, GPUDRV_VEC_MAX, GPUDRV_STATUS_ANY | GPUDRV_STATUS_REAP);
+        ++calls;
+        if (got < 0) {
+            perror("jobq_bench: status");
+            return -1;
+        }
+        for (int i = 0; i < got; ++i)
+            if (st[i].res != 0 || st[i].user_data >= jobs) ++bad;
+        completed += (unsigned)got;
+        if (got == 0) {
+            struct pollfd pfd = { efd, POLLIN, 0 };
+            eventfd_t v;
+            poll(&pfd, 1, -1);
+            eventfd_read(efd, &v);
+            ++wakeups;
+        }
+    }
+    double ms = now_ms() - t0;
+    gpudrv_jobq_set_eventfd(q, -1);
+    close(efd);
+    printf("%-16s jobs=%lu inflight=%u  %.3f ms  %.0f jobs/s  %.3f calls/job  %lu wakeups  errors=%lu\n",
+           "vectored+eventfd", jobs, inflight, ms, jobs / (ms / 1e3), (double)calls / jobs, wakeups, bad);
+    return bad ? -1 : 0;
+}
+
+/* ---- client B: one submit per job, STATUS one id at a time until done ---- */
+
+static int run_scalar(struct gpudrv_jobq *q, unsigned long jobs, unsigned inflight)
+{
+    __u64 *ids = calloc(inflight, sizeof(*ids));
+    if (!ids) return -1;
+    unsigned long submitted = 0, completed = 0, calls = 0, bad = 0;
+    unsigned live = 0, cursor = 0;
+    double t0 = now_ms();
+    while (completed < jobs) {
+        while (submitted < jobs && live < inflight) {
+            struct gpudrv_sqe sqe;
+            fill_sqe(&sqe, submitted);
+            ++calls;
+            if (gpudrv_jobq_submit(q, &sqe, &ids[live], 1) != 1) break;
+            ++live;
+            ++submitted;
+        }
+        struct gpudrv_status_ent st;
+        memset(&st, 0, sizeof(st));
+        st.id = ids[cursor];
+        ++calls;
+        if (gpudrv_jobq_status(q, &st, 1, GPUDRV_STATUS_REAP) == 1) {
+            if (st.res != 0) ++bad;
+            ids[cursor] = ids[--live];
+            ++completed;
+        } else {
+            ++cursor;
+        }
+        if (cursor >= live) cursor = 0;
+    }
+    double ms = now_ms() - t0;
+    free(ids);
+    printf("%-16s jobs=%lu inflight=%u  %.3f ms  %.0f jobs/s  %.3f calls/job  errors=%lu\n",
+           "per-id polling", jobs, inflight, ms, jobs / (ms / 1e3), (double)calls / jobs, bad);
+    return bad ? -1 : 0;
+}
+
+static int open_dev(struct gpudrv_jobq *q)
+{
+    int fd = open("/dev/gpudrv", O_RDWR);
+    if (fd < 0) {
+        perror("open /dev/gpudrv");
+        return -1;
+    }
+    gpudrv_jobq_init_dev(q, fd);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long jobs = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+    unsigned inflight = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : 4096;
+    int use_dev = argc > 3 && strcmp(argv[3], "--dev") == 0;
+    if (jobs == 0 || inflight == 0 || inflight > GPUDRV_JOB_MAX_INFLIGHT) {
+        printf("Usage: %s [jobs] [inflight] [--dev]\n", argv[0]);
+        return 1;
+    }
+
+    struct gpudrv_jobq_table *table = NULL;
+    struct server srv;
+    struct gpudrv_jobq cli;
+    memset(&srv, 0, sizeof(srv));
+    if (use_dev) {
+        if (open_dev(&srv.q) != 0 || open_dev(&cli) != 0) return 1;
+    } else {
+        table = gpudrv_jobq_table_create();
+        if (!table || gpudrv_jobq_init_local(&srv.q, table) != 0 || gpudrv_jobq_init_local(&cli, table) != 0)
+            return 1;
+    }
+
+    pthread_t th;
+    if (pthread_create(&th, NULL, server_main, &srv) != 0) return 1;
+    int rc = run_vectored(&cli, jobs, inflight);
+    if (run_scalar(&cli, jobs, inflight) != 0) rc = -1;
+    srv.stop = 1;
+    pthread_join(th, NULL);
+
+    int fds[2] = { srv.q.fd, cli.fd };
+    gpudrv_jobq_exit(&srv.q);
+    gpudrv_jobq_exit(&cli);
+    for (int i = 0; i < 2; ++i)
+        if (fds[i] >= 0) close(fds[i]);
+    gpudrv_jobq_table_destroy(table);
+    return rc ? 1 : 0;
+}
@@ -0,0 +1,299 @@
+// libgpudrv.c - user-space runners behind the gpudrv modes
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../include/gpudrv_ioctl.h"
+#include "../include/gpudrv_stats.h"
+#include "libgpufw.h"
+#include "libgpudrv.h"
+#include "daemon_proto.h"
+
+#define DEFAULT_KERNEL "kernels/vecadd.cl"
+
+static int drv_fd = -1;
+static int local_mode = GPUDRV_MODE_CPU;
+
+int gpudrv_open(void)
+{
+    drv_fd = open("/dev/gpudrv", O_RDWR);
+    if (drv_fd < 0)
+        fprintf(stderr, "gpudrv: open /dev/gpudrv failed (%s), running without the driver\n", strerror(errno));
+    return 0;
+}
+
+void gpudrv_close(void)
+{
+    if (drv_fd >= 0) close(drv_fd);
+    drv_fd = -1;
+    gpufw_cpu_shutdown();
+}
+
+int gpudrv_set_mode(int mode)
+{
+    if (drv_fd >= 0 && ioctl(drv_fd, GPUDRV_IOC_SET_MODE, &mode) == -1) {
+        fprintf(stderr, "gpudrv: ioctl SET_MODE(%d) failed: %s\n", mode, strerror(errno));
+        return -1;
+    }
+    local_mode = mode;
+    return 0;
+}
+
+int gpudrv_get_mode(void)
+{
+    int cur = local_mode;
+    if (drv_fd >= 0 && ioctl(drv_fd, GPUDRV_IOC_GET_MODE, &cur) == -1) {
+        fprintf(stderr, "gpudrv: ioctl GET_MODE failed: %s\n", strerror(errno));
+        return -1;
+    }
+    return cur;
+}
+
+static void print_hist(FILE *out, const char *name, const char *unit, const __u64 *hist)
+{
+    fprintf(out, "%s:\n", name);
+    for (unsigned b = 0; b < GPUDRV_HIST_BUCKETS; ++b) {
+        if (!hist[b]) continue;
+        unsigned long long lo = b ? 1ull << (b - 1) : 0;
+        if (b == GPUDRV_HIST_BUCKETS - 1)
+            fprintf(out, "  >= %llu %s: %llu\n", lo, unit, (unsigned long long)hist[b]);
+        else
+            fprintf(out, "  [%llu, %llu) %s: %llu\n", lo, 1ull << b, unit, (unsigned long long)hist[b]);
+    }
+}
+
+int gpudrv_print_stats(FILE *out)
+{
+    struct gpudrv_stats st;
+    if (drv_fd < 0) {
+        fprintf(stderr, "gpudrv: stats need /dev/gpudrv\n");
+        return -1;
+    }
+    if (ioctl(drv_fd, GPUDRV_IOC_STATS, &st) == -1) {
+        fprintf(stderr, "gpudrv: ioctl STATS failed: %s\n", strerror(errno));
+        return -1;
+    }
+    fprintf(out, "files %u  ioctls %llu\n", st.files, (unsigned long long)st.ioctls);
+    fprintf(out, "submits %llu  rejects %llu  fetches %llu  completions %llu\n",
+            (unsigned long long)st.submits, (unsigned long long)st.rejects,
+            (unsigned long long)st.fetches, (unsigned long long)st.completions);
+    fprintf(out, "queued low/normal/high %u/%u/%u  running %u  unreaped %u\n",
+            st.queued[GPUDRV_PRIO_LOW], st.queued[GPUDRV_PRIO_NORMAL], st.queued[GPUDRV_PRIO_HIGH],
+            st.running, st.unreaped);
+    print_hist(out, "time in queue", "us", st.queue_us);
+    print_hist(out, "submit to completion", "us", st.total_us);
+    print_hist(out, "queue depth at submit", "jobs", st.depth);
+    return 0;
+}
+
+static const char *kernel_file(void)
+{
+    const char *e = getenv("GPUDRV_KERNEL");
+    return (e && *e) ? e : DEFAULT_KERNEL;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/* Fill inputs, run vecadd once on ctx, check the result and report the time. */
+static int run_vecadd(gpufw_ctx *ctx, size_t n, const char *label, int hybrid)
+{
+    float *a = malloc(n * sizeof(float));
+    float *b = malloc(n * sizeof(float));
+    float *c = malloc(n * sizeof(float));
+    int err = -1;
+    if (!a || !b || !c) {
+        fprintf(stderr, "gpudrv: out of memory for n=%zu\n", n);
+        goto out;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = (float)(i & 1023);
+        b[i] = 2.0f;
+    }
+
+    double t0 = now_ms();
+    err = hybrid ? gpufw_hybrid_vecadd(ctx, a, b, c, n) : gpufw_vecadd(ctx, a, b, c, n);
+    double ms = now_ms() - t0;
+    if (err != 0) {
+        fprintf(stderr, "gpudrv: vecadd (%s) failed (%d)\n", label, err);
+        goto out;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (c[i] != (float)(i & 1023) + 2.0f) {
+            fprintf(stderr, "gpudrv: vecadd (%s) mismatch at %zu: %f\n", label, i, c[i]);
+            err = -1;
+            goto out;
+        }
+    }
+    printf("Kernel time: %.3f ms (%s, n=%zu)\n", ms, label, n);
+out:
+    free(a);
+    free(b);
+    free(c);
+    return err;
+}
+
+int gpudrv_run_cpu(size_t n)
+{
+    gpudrv_set_mode(GPUDRV_MODE_CPU);
+    gpufw_ctx ctx;
+    gpufw_init_opts opts = { GPUFW_INIT_NATIVE_CPU };
+    if (gpufw_init_ex(&ctx, kernel_file(), 0, &opts) != 0) return -1;
+    char label[48];
+    snprintf(label, sizeof(label), "cpu %s x%u", gpufw_cpu_isa_name(gpufw_cpu_detect_isa()), gpufw_cpu_threads());
+    int err = run_vecadd(&ctx, n, label, 0);
+    gpufw_cleanup(&ctx);
+    return err;
+}
+
+int gpudrv_run_gpu(size_t n)
+{
+    gpudrv_set_mode(GPUDRV_MODE_GPU);
+    gpufw_ctx ctx;
+    if (gpufw_init_from_file(&ctx, kernel_file(), 0) != 0) return -1;
+    int err = run_vecadd(&ctx, n, "opencl", 0);
+    gpufw_cleanup(&ctx);
+    return err;
+}
+
+int gpudrv_run_hybrid(size_t n)
+{
+    gpudrv_set_mode(GPUDRV_MODE_HYBRID);
+    gpufw_ctx ctx;
+    gpufw_init_opts opts = { GPUFW_INIT_CPU_FALLBACK };
+    if (gpufw_init_ex(&ctx, kernel_file(), 0, &opts) != 0) return -1;
+    int err = run_vecadd(&ctx, n, "hybrid", 1);
+    if (err == 0) gpufw_hybrid_print(&ctx, stdout);
+    gpufw_cleanup(&ctx);    /* persists the updated split ratio */
+    return err;
+}
+
+static int xfer_all(int fd, void *p, size_t len, int do_write)
+{
+    while (len > 0) {
+        ssize_t r = do_write ? write(fd, p, len) : read(fd, p, len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        p = (char *)p + r;
+        len -= (size_t)r;
+    }
+    return 0;
+}
+
+/* Writer thread pushes every request while the caller drains replies, so
+   the daemon sees the whole burst and can batch it. */
+struct daemon_submit {
+    int fd;
+    size_t n;
+    unsigned jobs;
+    float *in;
+};
+
+static void *daemon_writer(void *p)
+{
+    struct daemon_submit *s = p;
+    size_t in_len = 2 * s->n * sizeof(float);
+    gpufw_trace_thread_name("submit");
+    for (unsigned j = 0; j < s->jobs; ++j) {
+        struct gpudrv_sqe sqe;
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.user_data = j;
+        sqe.op = GPUDRV_OP_VECADD;
+        sqe.in_len = in_len;
+        sqe.out_len = s->n * sizeof(float);
+        sqe.n = (__u32)s->n;
+        sqe.mode = (__u32)-1;
+        gpufw_trace_async_begin("client", "job", j, "n", s->n);
+        if (xfer_all(s->fd, &sqe, sizeof(sqe), 1) != 0 || xfer_all(s->fd, s->in, in_len, 1) != 0)
+            break;
+    }
+    return NULL;
+}
+
+int gpudrv_run_daemon(size_t n, unsigned jobs)
+{
+    GPUFW_TRACE_SCOPE("client", "gpudrv_run_daemon");
+    GPUFW_TRACE_ARG("jobs", jobs);
+    const char *path = getenv("GPUDRV_SOCKET");
+    struct sockaddr_un addr;
+    if (!path || !*path) path = GPUDRV_SOCK_DEFAULT;
+    if (n > UINT32_MAX || 3 * n * sizeof(float) > GPUDRV_SOCK_MAX_BYTES) {
+        fprintf(stderr, "gpudrv: n=%zu too large for a daemon job\n", n);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "gpudrv: cannot reach daemon at %s: %s\n", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    struct daemon_submit s = { fd, n, jobs, malloc(2 * n * sizeof(float)) };
+    float *out = malloc(n * sizeof(float));
+    float *want = malloc(n * sizeof(float));
+    int err = -1;
+    pthread_t th;
+    if (!s.in || !out || !want) goto out;
+    for (size_t i = 0; i < n; ++i) {
+        s.in[i] = (float)(i & 1023);
+        s.in[n + i] = 2.0f;
+        want[i] = s.in[i] + s.in[n + i];
+    }
+
+    /* every element of every reply is checked; vecadd must match exactly */
+    gpufw_validate_opts vopts = { 0, 0.0, 0.0, GPUFW_NAN_MATCH, GPUFW_INF_EXACT, 10 };
+    gpufw_validate_report rep;
+    double t0 = now_ms(), check_ms = 0.0;
+    if (pthread_create(&th, NULL, daemon_writer, &s) != 0) goto out;
+    unsigned done = 0, bad = 0;
+    while (done < jobs) {
+        struct gpudrv_cqe cqe;
+        if (xfer_all(fd, &cqe, sizeof(cqe), 0) != 0) break;
+        gpufw_trace_async_end("client", "job", cqe.user_data);
+        if (cqe.res == 0) {
+            if (xfer_all(fd, out, n * sizeof(float), 0) != 0) break;
+            double t1 = now_ms();
+            if (gpufw_validate_f32(out, want, n, &vopts, &rep) != 0 && bad++ == 0) {
+                fprintf(stderr, "gpudrv: daemon job %llu returned wrong results\n", (unsigned long long)cqe.user_data);
+                gpufw_validate_print(&rep, "daemon vecadd", stderr);
+            }
+            check_ms += now_ms() - t1;
+        } else {
+            ++bad;
+        }
+        ++done;
+    }
+    double ms = now_ms() - t0 - check_ms;     /* the checks are not the daemon's time */
+    shutdown(fd, SHUT_RDWR);
+    pthread_join(th, NULL);
+    if (done < jobs) {
+        fprintf(stderr, "gpudrv: daemon closed the connection after %u of %u jobs\n", done, jobs);
+    } else if (bad) {
+        fprintf(stderr, "gpudrv: %u of %u daemon jobs failed\n", bad, jobs);
+    } else {
+        printf("Kernel time: %.3f ms (daemon, n=%zu, jobs=%u, %.1f us/job)\n", ms, n, jobs, ms * 1e3 / jobs);
+        err = 0;
+    }
+out:
+    close(fd);
+    free(s.in);
+    free(out);
+    free(want);
+    return err;
+}
@@ -0,0 +1,29 @@
+// libgpudrv.h - user-space side of gpudrv: mode switching + workload runners
+#ifndef LIBGPUDRV_H
+#define LIBGPUDRV_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Opens /dev/gpudrv. Without the module loaded the runners still work; the
+// mode is then only tracked in this process.
+int gpudrv_open(void);
+void gpudrv_close(void);
+int gpudrv_set_mode(int mode);
+int gpudrv_get_mode(void);
+
+// Print the driver's telemetry (GPUDRV_IOC_STATS); needs the module.
+int gpudrv_print_stats(FILE *out);
+
+// Run vecadd over n floats in the given mode and print "Kernel time: X ms".
+// The OpenCL paths load $GPUDRV_KERNEL (default kernels/vecadd.cl).
+int gpudrv_run_cpu(size_t n);
+int gpudrv_run_gpu(size_t n);
+int gpudrv_run_hybrid(size_t n);
+
+// Submit jobs vecadd jobs of n floats to a running daemon over its socket
+// ($GPUDRV_SOCKET, default /tmp/gpudrv.sock), all in flight at once, and
+// report the round-trip rate.
+int gpudrv_run_daemon(size_t n, unsigned jobs);
+
+#endif // LIBGPUDRV_H
@@ -0,0 +1,202 @@
+// ring.c - gpudrv submission/completion rings, driver-backed or in-process
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "../include/gpudrv_ioctl.h"
+#include "ring.h"
+
+#define RING_SPIN 2000      /* polls before a consumer goes to sleep */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()          __builtin_ia32_pause()
+#else
+#define cpu_relax()          do { } while (0)
+#endif
+
+#define load_acquire(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static void ring_bind(struct gpudrv_ring *r, void *base, const struct gpudrv_ring_params *p, int fd)
+{
+    r->hdr = base;
+    r->sqes = (struct gpudrv_sqe *)((unsigned char *)base + p->sq_off);
+    r->cqes = (struct gpudrv_cqe *)((unsigned char *)base + p->cq_off);
+    r->payload = (unsigned char *)base + p->payload_off;
+    r->payload_size = p->payload_size;
+    r->entries = p->entries;
+    r->mask = p->entries - 1;
+    r->size = p->total_size;
+    r->fd = fd;
+    r->sq_pending = 0;
+}
+
+int gpudrv_ring_init_dev(struct gpudrv_ring *r, int fd, unsigned entries, size_t payload_size)
+{
+    struct gpudrv_ring_params p;
+    memset(&p, 0, sizeof(p));
+    p.entries = entries;
+    p.payload_size = payload_size;
+    if (ioctl(fd, GPUDRV_IOC_RING_SETUP, &p) == -1) {
+        fprintf(stderr, "gpudrv_ring: ioctl RING_SETUP failed: %s\n", strerror(errno));
+        return -1;
+    }
+    void *base = mmap(NULL, p.total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "gpudrv_ring: mmap of %llu bytes failed: %s\n",
+                (unsigned long long)p.total_size, strerror(errno));
+        return -1;
+    }
+    if (((struct gpudrv_ring_hdr *)base)->magic != GPUDRV_RING_MAGIC) {
+        fprintf(stderr, "gpudrv_ring: bad ring header\n");
+        munmap(base, p.total_size);
+        return -1;
+    }
+    ring_bind(r, base, &p, fd);
+    return 0;
+}
+
+/* Same layout in shared anonymous memory; stays valid across fork(). */
+int gpudrv_ring_init_local(struct gpudrv_ring *r, unsigned entries, size_t payload_size)
+{
+    struct gpudrv_ring_params p;
+    memset(&p, 0, sizeof(p));
+    p.entries = entries;
+    p.payload_size = payload_size;
+    if (gpudrv_ring_layout(&p) != 0) {
+        fprintf(stderr, "gpudrv_ring: invalid size (entries=%u payload=%zu)\n", entries, payload_size);
+        return -1;
+    }
+    void *base = mmap(NULL, p.total_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "gpudrv_ring: mmap failed: %s\n", strerror(errno));
+        return -1;
+    }
+    struct gpudrv_ring_hdr *hdr = base;
+    hdr->magic = GPUDRV_RING_MAGIC;
+    hdr->version = GPUDRV_RING_VERSION;
+    hdr->sq_entries = p.entries;
+    hdr->cq_entries = p.entries;
+    hdr->sq_off = p.sq_off;
+    hdr->cq_off = p.cq_off;
+    hdr->payload_off = p.payload_off;
+    hdr->payload_size = p.payload_size;
+    hdr->total_size = p.total_size;
+    ring_bind(r, base, &p, -1);
+    return 0;
+}
+
+void gpudrv_ring_exit(struct gpudrv_ring *r)
+{
+    if (r->hdr) munmap(r->hdr, r->size);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+static void ring_wake(struct gpudrv_ring *r, struct gpudrv_ring_queue *q)
+{
+    /* pairs with the fence in gpudrv_ring_wait: either the sleeper sees the
+       new tail or we see its NEED_WAKEUP flag */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!(__atomic_load_n(&q->flags, __ATOMIC_RELAXED) & GPUDRV_RING_NEED_WAKEUP))
+        return;
+    if (r->fd >= 0)
+        ioctl(r->fd, GPUDRV_IOC_RING_WAKE);
+    else
+        syscall(SYS_futex, &q->tail, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+struct gpudrv_sqe *gpudrv_ring_get_sqe(struct gpudrv_ring *r)
+{
+    struct gpudrv_ring_queue *q = &r->hdr->sq;
+    __u32 tail = q->tail + r->sq_pending;
+    if (tail - load_acquire(&q->head) >= r->entries)
+        return NULL;
+    r->sq_pending++;
+    struct gpudrv_sqe *sqe = &r->sqes[tail & r->mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void gpudrv_ring_submit(struct gpudrv_ring *r)
+{
+    if (!r->sq_pending) return;
+    struct gpudrv_ring_queue *q = &r->hdr->sq;
+    store_release(&q->tail, q->tail + r->sq_pending);
+    r->sq_pending = 0;
+    ring_wake(r, q);
+}
+
+const struct gpudrv_sqe *gpudrv_ring_peek_sqe(struct gpudrv_ring *r)
+{
+    struct gpudrv_ring_queue *q = &r->hdr->sq;
+    __u32 head = q->head;
+    if (head == load_acquire(&q->tail))
+        return NULL;
+    return &r->sqes[head & r->mask];
+}
+
+void gpudrv_ring_sqe_done(struct gpudrv_ring *r)
+{
+    struct gpudrv_ring_queue *q = &r->hdr->sq;
+    store_release(&q->head, q->head + 1);
+}
+
+int gpudrv_ring_post_cqe(struct gpudrv_ring *r, __u64 user_data, __s32 res)
+{
+    struct gpudrv_ring_queue *q = &r->hdr->cq;
+    __u32 tail = q->tail;
+    if (tail - load_acquire(&q->head) >= r->entries)
+        return -1;
+    struct gpudrv_cqe *cqe = &r->cqes[tail & r->mask];
+    cqe->user_data = user_data;
+    cqe->res = res;
+    cqe->flags = 0;
+    store_release(&q->tail, tail + 1);
+    ring_wake(r, q);
+    return 0;
+}
+
+int gpudrv_ring_reap_cqe(struct gpudrv_ring *r, struct gpudrv_cqe *out)
+{
+    struct gpudrv_ring_queue *q = &r->hdr->cq;
+    __u32 head = q->head;
+    if (head == load_acquire(&q->tail))
+        return 0;
+    *out = r->cqes[head & r->mask];
+    store_release(&q->head, head + 1);
+    return 1;
+}
+
+int gpudrv_ring_wait(struct gpudrv_ring *r, unsigned which)
+{
+    struct gpudrv_ring_queue *q = which == GPUDRV_RING_SQ ? &r->hdr->sq : &r->hdr->cq;
+    for (int i = 0; i < RING_SPIN; ++i) {
+        if (load_acquire(&q->tail) != q->head) return 0;
+        cpu_relax();
+    }
+    for (;;) {
+        __atomic_fetch_or(&q->flags, GPUDRV_RING_NEED_WAKEUP, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        __u32 tail = load_acquire(&q->tail);
+        if (tail != q->head) break;
+        int rc;
+        if (r->fd >= 0)
+            rc = ioctl(r->fd, GPUDRV_IOC_RING_WAIT, &which);
+        else
+            rc = (int)syscall(SYS_futex, &q->tail, FUTEX_WAIT, tail, NULL, NULL, 0);
+        if (rc == -1 && errno != EAGAIN) {      /* EINTR too: let the caller look around */
+            __atomic_fetch_and(&q->flags, ~GPUDRV_RING_NEED_WAKEUP, __ATOMIC_RELAXED);
+            return -1;
+        }
+    }
+    __atomic_fetch_and(&q->flags, ~GPUDRV_RING_NEED_WAKEUP, __ATOMIC_RELAXED);
+    return 0;
+}
@@ -0,0 +1,48 @@
+// ring.h - user-space access to the gpudrv submission/completion rings
+#ifndef GPUDRV_USER_RING_H
+#define GPUDRV_USER_RING_H
+
+#include <stddef.h>
+#include "../include/gpudrv_ring.h"
+
+// A mapped ring: either the driver's (/dev/gpudrv mmap) or an in-process
+// stand-in with the same layout and protocol, so clients and the daemon run
+// unchanged without the module. Each queue has one producer and one consumer.
+// The layout is cached from the setup parameters: the header sits in memory
+// the other side can write, so only head, tail and flags are read from it.
+struct gpudrv_ring {
+    struct gpudrv_ring_hdr *hdr;
+    struct gpudrv_sqe *sqes;
+    struct gpudrv_cqe *cqes;
+    unsigned char *payload;
+    size_t payload_size;
+    unsigned entries;       // SQ and CQ size, a power of two
+    unsigned mask;          // entries - 1
+    size_t size;
+    int fd;                 // driver fd, or -1 for the in-process ring
+    unsigned sq_pending;    // producer side: filled but not yet submitted
+};
+
+// entries and payload_size may be 0 for the defaults.
+int gpudrv_ring_init_dev(struct gpudrv_ring *r, int fd, unsigned entries, size_t payload_size);
+int gpudrv_ring_init_local(struct gpudrv_ring *r, unsigned entries, size_t payload_size);
+void gpudrv_ring_exit(struct gpudrv_ring *r);
+
+// Submission side (client): fill entries from get_sqe, then publish them.
+struct gpudrv_sqe *gpudrv_ring_get_sqe(struct gpudrv_ring *r);     // NULL when the SQ is full
+void gpudrv_ring_submit(struct gpudrv_ring *r);
+
+// Daemon side: peek at the oldest submission, release it once consumed,
+// post its completion (-1 if the CQ is full).
+const struct gpudrv_sqe *gpudrv_ring_peek_sqe(struct gpudrv_ring *r);
+void gpudrv_ring_sqe_done(struct gpudrv_ring *r);
+int gpudrv_ring_post_cqe(struct gpudrv_ring *r, __u64 user_data, __s32 res);
+
+// Client side: take one completion; returns 1, or 0 when the CQ is empty.
+int gpudrv_ring_reap_cqe(struct gpudrv_ring *r, struct gpudrv_cqe *out);
+
+// Block until the queue (GPUDRV_RING_SQ/CQ) has entries; spins briefly first.
+// Returns -1 with errno EINTR if a signal interrupts the wait.
+int gpudrv_ring_wait(struct gpudrv_ring *r, unsigned which);
+
+#endif // GPUDRV_USER_RING_H
@@ -0,0 +1,215 @@
+// ring_bench.c - small-job round trips through the shared ring vs. a copy per job
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "../include/gpudrv_ioctl.h"
+#include "ring.h"
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static void vecadd(const float *a, const float *b, float *c, unsigned n)
+{
+    for (unsigned i = 0; i < n; ++i) c[i] = a[i] + b[i];
+}
+
+/* ---- ring: the consumer thread stands in for the daemon ---- */
+
+struct consumer {
+    struct gpudrv_ring *ring;
+    unsigned long jobs;
+};
+
+static void *ring_consumer(void *p)
+{
+    struct consumer *c = p;
+    struct gpudrv_ring *r = c->ring;
+    for (unsigned long done = 0; done < c->jobs;) {
+        const struct gpudrv_sqe *sqe = gpudrv_ring_peek_sqe(r);
+        if (!sqe) {
+            gpudrv_ring_wait(r, GPUDRV_RING_SQ);
+            continue;
+        }
+        __s32 res = 0;
+        if (sqe->op == GPUDRV_OP_VECADD) {
+            const float *in = (const float *)(r->payload + sqe->in_off);
+            vecadd(in, in + sqe->n, (float *)(r->payload + sqe->out_off), sqe->n);
+        } else if (sqe->op != GPUDRV_OP_NOP) {
+            res = -22;  /* -EINVAL */
+        }
+        __u64 user_data = sqe->user_data;
+        gpudrv_ring_sqe_done(r);
+        while (gpudrv_ring_post_cqe(r, user_data, res) != 0)
+            ;   /* the client never has more than cq_entries in flight */
+        ++done;
+    }
+    return NULL;
+}
+
+static int run_ring(struct gpudrv_ring *r, unsigned long jobs, unsigned n, const char *label)
+{
+    unsigned entries = r->entries;
+    size_t slot = r->payload_size / entries;
+    if ((size_t)n * 3 * sizeof(float) > slot) {
+        n = (unsigned)(slot / (3 * sizeof(float)));
+        printf("%s: n capped to %u to fit %zu-byte payload slots\n", label, n, slot);
+    }
+
+    struct consumer c = { r, jobs };
+    pthread_t th;
+    if (pthread_create(&th, NULL, ring_consumer, &c) != 0) return -1;
+
+    unsigned long submitted = 0, completed = 0, bad = 0;
+    double t0 = now_ms();
+    while (completed < jobs) {
+        /* keep the ring full: one payload slot per in-flight job */
+        while (submitted < jobs && submitted - completed < entries) {
+            struct gpudrv_sqe *sqe = gpudrv_ring_get_sqe(r);
+            if (!sqe) break;
+            size_t base = (submitted % entries) * slot;
+            float *in = (float *)(r->payload + base);
+            for (unsigned i = 0; i < n; ++i) {
+                in[i] = (float)i;
+                in[n + i] = (float)submitted;
+            }
+            sqe->user_data = submitted;
+            sqe->op = GPUDRV_OP_VECADD;
+            sqe->in_off = base;
+            sqe->in_len = 2 * (size_t)n * sizeof(float);
+            sqe->out_off = base + sqe->in_len;
+            sqe->out_len = (size_t)n * sizeof(float);
+            sqe->n = n;
+            sqe->mode = (__u32)-1;
+            ++submitted;
+        }
+        gpudrv_ring_submit(r);
+
+        struct gpudrv_cqe cqe;
+        int got = 0;
+        while (gpudrv_ring_reap_cqe(r, &cqe)) {
+            const float *out = (const float *)(r->payload + (cqe.user_data % entries) * slot + 2 * (size_t)n * sizeof(float));
+            if (cqe.res != 0 || (n > 1 && out[n - 1] != (float)(n - 1) + (float)cqe.user_data)) ++bad;
+            ++completed;
+            ++got;
+        }
+        if (!got && (submitted == jobs || submitted - completed == entries))
+            gpudrv_ring_wait(r, GPUDRV_RING_CQ);
+    }
+    double ms = now_ms() - t0;
+    pthread_join(th, NULL);
+    printf("%-12s jobs=%lu n=%u  %.3f ms  %.0f jobs/s  %.3f us/job  errors=%lu\n",
+           label, jobs, n, ms, jobs / (ms / 1e3), ms * 1e3 / jobs, bad);
+    return bad ? -1 : 0;
+}
+
+/* ---- baseline: one write + one read per job over a socketpair ---- */
+
+struct sock_job {
+    unsigned long id;
+    unsigned n;
+};
+
+static void *sock_consumer(void *p)
+{
+    int fd = *(int *)p;
+    struct sock_job job;
+    float *buf = NULL;
+    size_t cap = 0;
+    while (read(fd, &job, sizeof(job)) == sizeof(job)) {
+        size_t in_bytes = 2 * (size_t)job.n * sizeof(float);
+        if (in_bytes + job.n * sizeof(float) > cap) {
+            cap = in_bytes + job.n * sizeof(float);
+            buf = realloc(buf, cap);
+        }
+        size_t got = 0;
+        while (got < in_bytes) {
+            ssize_t r = read(fd, (char *)buf + got, in_bytes - got);
+            if (r <= 0) goto out;
+            got += (size_t)r;
+        }
+        vecadd(buf, buf + job.n, buf + 2 * job.n, job.n);
+        if (write(fd, buf + 2 * job.n, job.n * sizeof(float)) < 0) break;
+    }
+out:
+    free(buf);
+    return NULL;
+}
+
+static int run_socket(unsigned long jobs, unsigned n)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return -1;
+    pthread_t th;
+    if (pthread_create(&th, NULL, sock_consumer, &sv[1]) != 0) return -1;
+    float *in = malloc(2 * (size_t)n * sizeof(float));
+    float *out = malloc((size_t)n * sizeof(float));
+    unsigned long bad = 0;
+    double t0 = now_ms();
+    for (unsigned long j = 0; j < jobs; ++j) {
+        for (unsigned i = 0; i < n; ++i) {
+            in[i] = (float)i;
+            in[n + i] = (float)j;
+        }
+        struct sock_job job = { j, n };
+        if (write(sv[0], &job, sizeof(job)) != sizeof(job) ||
+            write(sv[0], in, 2 * (size_t)n * sizeof(float)) < 0) { ++bad; break; }
+        size_t got = 0;
+        while (got < n * sizeof(float)) {
+            ssize_t r = read(sv[0], (char *)out + got, n * sizeof(float) - got);
+            if (r <= 0) break;
+            got += (size_t)r;
+        }
+        if (n > 1 && out[n - 1] != (float)(n - 1) + (float)j) ++bad;
+    }
+    double ms = now_ms() - t0;
+    shutdown(sv[0], SHUT_RDWR);
+    pthread_join(th, NULL);
+    close(sv[0]);
+    close(sv[1]);
+    free(in);
+    free(out);
+    printf("%-12s jobs=%lu n=%u  %.3f ms  %.0f jobs/s  %.3f us/job  errors=%lu\n",
+           "socket-copy", jobs, n, ms, jobs / (ms / 1e3), ms * 1e3 / jobs, bad);
+    return bad ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long jobs = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    unsigned n = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : 256;
+    int use_dev = argc > 3 && strcmp(argv[3], "--dev") == 0;
+    if (jobs == 0 || n == 0) {
+        printf("Usage: %s [jobs] [n] [--dev]\n", argv[0]);
+        return 1;
+    }
+
+    struct gpudrv_ring ring;
+    int rc;
+    if (use_dev) {
+        int fd = open("/dev/gpudrv", O_RDWR);
+        if (fd < 0) {
+            perror("open /dev/gpudrv");
+            return 1;
+        }
+        if (gpudrv_ring_init_dev(&ring, fd, 0, 0) != 0) return 1;
+        rc = run_ring(&ring, jobs, n, "ring(dev)");
+        gpudrv_ring_exit(&ring);
+        close(fd);
+    } else {
+        if (gpudrv_ring_init_local(&ring, 0, 0) != 0) return 1;
+        rc = run_ring(&ring, jobs, n, "ring(local)");
+        gpudrv_ring_exit(&ring);
+    }
+    if (run_socket(jobs, n) != 0) rc = -1;
+    return rc ? 1 : 0;
+}
@@ -1,16 +1,192 @@
 #!/usr/bin/perl
 use strict;
 use warnings;
+use Getopt::Long;
 use Text::CSV;
-my $file = shift || "results.csv";
-open my $fh, '<', $file or die "open $file: $!";
-my $csv = Text::CSV->new({binary=>1});
-my @rows;
-while (my $row = $csv->getline($fh)) {
-    push @rows, $row;
-}
-close $fh;
-print "Parsed ", scalar(@rows), " rows\n";
-for my $r (@rows) {
-    print join(", ", @$r), "\n";
-}
\ No newline at end of file
+use JSON::PP;
+use List::Util qw(sum);
+
+# Without --baseline: print the rows of a results file, as before.
+# With --baseline/--candidate: compare two sets of runs per workload, size,
+# device and mode, and exit 1 if anything got significantly slower.
+my (@baseline, @candidate);
+my ($alpha, $threshold, $min_samples, $boot, $ignore_device) = (0.01, 5.0, 5, 2000, 0);
+GetOptions("baseline=s" => \@baseline, "candidate=s" => \@candidate, "alpha=f" => \$alpha,
+           "threshold=f" => \$threshold, "min-samples=i" => \$min_samples, "boot=i" => \$boot,
+           "ignore-device" => \$ignore_device)
+    or die "usage: $0 [results.csv] | --baseline f [--baseline f...] --candidate f [...] "
+         . "[--alpha 0.01] [--threshold 5] [--min-samples 5] [--boot 2000] [--ignore-device]\n";
+
+if (!@baseline && !@candidate) {
+    my $file = shift || "results.csv";
+    my $rows = read_csv($file);
+    print "Parsed ", scalar(@$rows), " rows\n";
+    for my $r (@$rows) {
+        print join(", ", @$r), "\n";
+    }
+    exit 0;
+}
+die "need both --baseline and --candidate\n" unless @baseline && @candidate;
+
+sub read_csv {
+    my ($file) = @_;
+    open my $fh, '<', $file or die "open $file: $!";
+    my $csv = Text::CSV->new({binary=>1});
+    my @rows;
+    while (my $row = $csv->getline($fh)) {
+        push @rows, $row;
+    }
+    close $fh;
+    return \@rows;
+}
+
+# Samples are times in ms, so lower is better everywhere.
+#  - gpufw_bench JSON: every timed iteration of every phase (mode = phase)
+#  - gpufw_bench CSV rows: one sample per run, the phase median
+#  - run_bench.pl client rows: one sample per run for elapsed_ms and kernel_ms
+# Several runs of the same configuration can be passed by repeating the option.
+sub load_samples {
+    my (@files) = @_;
+    my %s;
+    my $add = sub {
+        my ($workload, $n, $device, $mode, @v) = @_;
+        $device = "*" if $ignore_device || !defined $device || $device eq "";
+        push @{$s{join("\t", $workload, $n, $device, $mode)}}, grep { defined && $_ ne "" } @v;
+    };
+    for my $file (@files) {
+        if ($file =~ /\.json$/) {
+            open my $fh, '<', $file or die "open $file: $!";
+            my $d = decode_json(do { local $/; <$fh> });
+            close $fh;
+            my $w = $d->{workload} || "vecadd";
+            my $vals = sub { my ($p) = @_; $p->{samples_ms} ? @{$p->{samples_ms}} : ($p->{median_ms}) };
+            $add->($w, 0, $d->{device}, "init", $vals->($d->{init})) if $d->{init};
+            for my $sz (@{$d->{sizes}}) {
+                for my $ph (sort keys %{$sz->{phases}}) {
+                    $add->($w, $sz->{n}, $d->{device}, $ph, $vals->($sz->{phases}{$ph}));
+                }
+            }
+            next;
+        }
+        # A file may hold client rows and gpufw_bench rows one after the other,
+        # each under its own header, so every header line resets the columns.
+        my (%col, $ncol, $bad);
+        for my $r (@{read_csv($file)}) {
+            if ($r->[0] eq "timestamp") {
+                %col = ();
+                @col{@$r} = (0 .. $#$r);
+                $ncol = @$r;
+                next;
+            }
+            die "$file: no header line before the first row\n" unless $ncol;
+            if (@$r != $ncol) {
+                $bad++;
+                next;
+            }
+            my %f = map { $_ => $r->[$col{$_}] } keys %col;
+            if (defined $f{phase} && $f{phase} ne "") {
+                $add->($f{workload} || "vecadd", $f{n}, $f{device}, $f{phase}, $f{median_ms});
+            } else {
+                $add->("client", $f{n}, "", "elapsed", $f{elapsed_ms});
+                my ($k) = ($f{notes} || "") =~ /kernel_ms=([\d\.]+)/;
+                $add->("client", $f{n}, "", "kernel", $k) if defined $k;
+            }
+        }
+        warn "$file: skipped $bad row(s) whose column count does not match their header\n" if $bad;
+    }
+    return \%s;
+}
+
+sub median {
+    my @v = sort { $a <=> $b } @_;
+    my $m = int(@v / 2);
+    return @v % 2 ? $v[$m] : ($v[$m - 1] + $v[$m]) / 2;
+}
+
+# Standard normal upper tail, via the Abramowitz & Stegun 7.1.26 erfc fit.
+sub norm_sf {
+    my ($z) = @_;
+    my $x = abs($z) / sqrt(2);
+    my $t = 1 / (1 + 0.3275911 * $x);
+    my $erfc = $t * (0.254829592 + $t * (-0.284496736 + $t * (1.421413741 + $t * (-1.453152027 + $t * 1.061405429))))
+             * exp(-$x * $x);
+    return $z >= 0 ? $erfc / 2 : 1 - $erfc / 2;
+}
+
+# Mann-Whitney U, normal approximation with tie and continuity correction.
+# Returns the two-sided p value and Cliff's delta, P(cand > base) - P(cand < base).
+sub mann_whitney {
+    my ($base, $cand) = @_;
+    my ($n1, $n2) = (scalar @$base, scalar @$cand);
+    my @all = sort { $a->[0] <=> $b->[0] } ((map { [$_, 0] } @$base), (map { [$_, 1] } @$cand));
+    my ($rank_cand, $ties, $i) = (0, 0, 0);
+    my $nn = @all;
+    while ($i < $nn) {
+        my $j = $i;
+        $j++ while $j + 1 < $nn && $all[$j + 1][0] == $all[$i][0];
+        my $t = $j - $i + 1;
+        my $r = ($i + $j) / 2 + 1;
+        $rank_cand += $r * scalar(grep { $_->[1] } @all[$i .. $j]);
+        $ties += $t ** 3 - $t;
+        $i = $j + 1;
+    }
+    my $u = $rank_cand - $n2 * ($n2 + 1) / 2;      # pairs where cand > base, ties count half
+    my $delta = 2 * $u / ($n1 * $n2) - 1;
+    my $mu = $n1 * $n2 / 2;
+    my $var = $n1 * $n2 / 12 * (($nn + 1) - $ties / ($nn * ($nn - 1)));
+    return (1.0, $delta) if $var <= 0;
+    my $d = abs($u - $mu) - 0.5;
+    $d = 0 if $d < 0;
+    my $p = 2 * norm_sf($d / sqrt($var));
+    return ($p > 1 ? 1 : $p, $delta);
+}
+
+# Percentile bootstrap interval for median(cand) / median(base).
+sub boot_ratio_ci {
+    my ($base, $cand) = @_;
+    my @r;
+    for (1 .. $boot) {
+        my $mb = median(map { $base->[int rand @$base] } @$base);
+        my $mc = median(map { $cand->[int rand @$cand] } @$cand);
+        push @r, $mb > 0 ? $mc / $mb : 1;
+    }
+    @r = sort { $a <=> $b } @r;
+    return ($r[int($boot * $alpha / 2)], $r[int($boot * (1 - $alpha / 2)) - 1]);
+}
+
+srand(1);       # reproducible intervals for the same inputs
+my $base = load_samples(@baseline);
+my $cand = load_samples(@candidate);
+my %keys = map { $_ => 1 } (keys %$base, keys %$cand);
+my ($regressions, $speedups) = (0, 0);
+
+printf "%-9s %9s %-24s %-8s %11s %11s %8s %8s %7s %-15s %s\n",
+       "workload", "n", "device", "mode", "base_ms", "cand_ms", "change", "p", "delta", "ratio_ci", "verdict";
+for my $k (sort { my @x = split /\t/, $a; my @y = split /\t/, $b;
+                  $x[0] cmp $y[0] || $x[1] <=> $y[1] || $x[2] cmp $y[2] || $x[3] cmp $y[3] } keys %keys) {
+    my ($w, $n, $dev, $mode) = split /\t/, $k;
+    my ($b, $c) = ($base->{$k}, $cand->{$k});
+    if (!$b || !$c || !@$b || !@$c) {
+        printf "%-9s %9s %-24.24s %-8s  only in %s\n", $w, $n, $dev, $mode, $b && @$b ? "baseline" : "candidate";
+        next;
+    }
+    my ($mb, $mc) = (median(@$b), median(@$c));
+    my $change = $mb > 0 ? ($mc / $mb - 1) * 100 : 0;
+    my ($p, $delta, $ci, $verdict) = ("-", "-", "-", "few samples");
+    if (@$b >= $min_samples && @$c >= $min_samples) {
+        ($p, $delta) = mann_whitney($b, $c);
+        my ($lo, $hi) = boot_ratio_ci($b, $c);
+        $ci = sprintf "[%.3f,%.3f]", $lo, $hi;
+        $verdict = "same";
+        if ($p < $alpha && abs($change) >= $threshold) {
+            if ($change > 0 && $lo > 1) { $verdict = "REGRESSION"; $regressions++; }
+            elsif ($change < 0 && $hi < 1) { $verdict = "speedup"; $speedups++; }
+        }
+        $p = sprintf "%.2g", $p;
+        $delta = sprintf "%+.2f", $delta;
+    }
+    printf "%-9s %9s %-24.24s %-8s %11.4f %11.4f %+7.1f%% %8s %7s %-15s %s (%d/%d)\n",
+           $w, $n, $dev, $mode, $mb, $mc, $change, $p, $delta, $ci, $verdict, scalar @$b, scalar @$c;
+}
+printf "%d regression(s), %d speedup(s) at alpha=%g, threshold %g%%\n", $regressions, $speedups, $alpha, $threshold;
+exit($regressions ? 1 : 0);
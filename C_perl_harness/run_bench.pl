@@ -6,10 +6,35 @@ use Time::HiRes qw(gettimeofday tv_interval);
 use Text::CSV;
 
 my $client = "../B_gpudrv/user/gpudrv_client";
-my $out = "results.csv";
-GetOptions("client=s" => \$client, "out=s" => \$out);
+my ($out, $native, $json, @workloads);
+my ($warmup, $reps) = (3, 20);
+GetOptions("client=s" => \$client, "out=s" => \$out, "native=s" => \$native,
+           "json=s" => \$json, "warmup=i" => \$warmup, "reps=i" => \$reps, "workload=s" => \@workloads);
 
 my @sizes = (1024, 65536, 262144, 1048576);
+
+# --native: time in-process with gpufw_bench (warmup, repetitions, per-phase
+# percentiles) instead of once per fork/exec. Its rows have more columns, so
+# they go to native_results.csv by default; gpufw_bench refuses to append to a
+# file with the client header. Each --workload runs at its own default sizes
+# (vecadd's are @sizes).
+$out //= $native ? "native_results.csv" : "results.csv";
+if ($native) {
+    @workloads = ("vecadd") unless @workloads;
+    for my $w (@workloads) {
+        my @cmd = ($native, "-W", $w, "-w", $warmup, "-r", $reps, "-o", $out);
+        if ($json) {
+            my $j = $json;
+            $j =~ s/(\.json)?$/_$w.json/ if @workloads > 1;     # one JSON per workload
+            push @cmd, ("-j", $j);
+        }
+        print "Running: @cmd\n";
+        system(@cmd) == 0 or die "$native failed: $?\n";
+    }
+    print "Results appended to $out\n";
+    exit 0;
+}
+
 my $csv = Text::CSV->new({binary=>1, eol=>"\n"});
 open my $fh, ">>", $out or die "open $out: $!";
 